@@ -0,0 +1,8 @@
+/**
+ * @file boost_zlib.cc
+ * Compile the BOOST zlib filter code for the gzip files once, so
+ * load_crm_matrix.hpp can be included from more than one source.
+ */
+
+#define BOOST_IOSTREAMS_NO_LIB
+#include <yasmic/boost_mod/zlib.cpp>
@@ -25,9 +25,7 @@ glut_2d_canvas::glut_2d_canvas(int w, int h, const char* title)
           virtual_width((float)w), virtual_height((float)h),
           zoom(1.0f),
           mouse_begin_x(0), mouse_begin_y(0),
-          aspect(1.0f),
-          display_finished(true),
-          frame(0)
+          aspect(1.0f)
 {
     set_background_color(0.0f,0.0f,0.0f);
     glutInitWindowSize(w,h);
@@ -42,15 +40,8 @@ void glut_2d_canvas::draw()
 
 void glut_2d_canvas::display()
 {
-    if (display_finished) {
-        frame = 0;
-        glClearColor(background_color[0],background_color[1],background_color[2],0.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);     
-    } else {
-        frame++;
-    }
-
-    display_finished = true;
+    glClearColor(background_color[0],background_color[1],background_color[2],0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);     
 
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -63,10 +54,6 @@ void glut_2d_canvas::display()
     draw();
 
     glutSwapBuffers();
-
-    if (!display_finished) {
-        glutPostRedisplay();
-    }
 }
 
 void glut_2d_canvas::reshape(int w, int h)
@@ -104,9 +104,6 @@ protected:
     }
 
     float background_color[3];
-
-    bool display_finished;
-    int frame;
 };
 
 #endif // VISMATRIX_GLUT_2D_CANVAS_H
@@ -24,8 +24,10 @@
 #define YASMIC_UTIL_LOAD_GZIP
 #include <yasmic/compressed_row_matrix.hpp>
 #include <yasmic/util/load_crm_matrix.hpp>
-#include <yasmic/transpose_matrix.hpp>
-#include <yasmic/nonzero_union.hpp>
+#include <yasmic/util/stream_matrix.hpp>
+#include <yasmic/util/symmetrize_crm.hpp>
+#include <yasmic/util/crm_stats.hpp>
+#include <yasmic/util/load_permutation.hpp>
 #include <yasmic/iterator_utility.hpp>
 
 #include <boost/timer.hpp>
@@ -40,6 +42,7 @@
 
 #include "util/file.hpp"
 #include "util/array.hpp"
+#include "util/parallel.hpp"
 
 matrix_canvas::matrix_canvas(int w, int h)
 : 
@@ -56,12 +59,22 @@ matrix_canvas::matrix_canvas(int w, int h)
             point_alpha(0.5f), 
             normalization_state(no_normalization),
             permutation_state(no_permutation),
+            value_storage(auto_values),
+            compress_columns(false),
+            memory_limit(0),
+            loading(false),
+            texture_timer_set(false),
+            row_extent_key(-1),
+            row_columns_sorted(false),
+            preview_nrows(0), preview_ncols(0), preview_version(0),
+            open_file_window(0),
             colormap_state(rainbow_colormap),
             colormap((float *)spring_color_map, 
                 sizeof(spring_color_map)/sizeof(spring_color_map[0])),
             colormap_invert(false),
             rperm_loaded(false),
-            cperm_loaded(false)
+            cperm_loaded(false),
+            rnorm(0), cnorm(0)
 {
     border_color[0]=1.0f; border_color[1]=1.0f; border_color[2]=1.0f;
 }
@@ -69,7 +82,7 @@ matrix_canvas::matrix_canvas(int w, int h)
 
 void matrix_canvas::post_constructor()
 {
-    init_window();
+    init_window(_m.nrows, _m.ncols);
     init_menu();
     init_display_list();
 
@@ -84,59 +97,47 @@ void matrix_canvas::post_constructor()
 void matrix_canvas::draw()
 {
     using namespace std;
+    if (loading) { draw_preview(); return; }
     if (!matrix_loaded) { return; }
 
-    int m = _m.nrows;
-    int n = _m.ncols;
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    draw_border(_m.nrows, _m.ncols);
 
-    // border
-	glPointSize(1.0);
-    glColor3f(border_color[0], border_color[1], border_color[2]);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(-0.5f, -0.5f);
-    glVertex2f(-0.5f, m-0.5f);
-    glVertex2f(n-0.5f, m-0.5f);
-    glVertex2f(n-0.5f, -0.5f);
-    glEnd();
-
-    glPointSize(zoom / (virtual_width*aspect/(float)width));
+    // the pixels for each row and column of the matrix
+    float ppu = zoom / (virtual_width*aspect/(float)width);
+    glPointSize(ppu);
 
     float x1,y1,x2,y2;
     world_extents(x1,y1,x2,y2);
+    update_row_extents();
 
     int r1=(int)floor(y1),r2=(int)floor(y2);
     int c1=(int)floor(x1),c2=(int)floor(x2);
 
-    if (std::max(x2-x1,y2-y1) < 16384)
+    if (draw_density(x1,y1,x2,y2,ppu))
     {
+        // many nonzeros on each pixel are drawn as one cell
+    }
+    else if (draw_texture_tiles(x1,y1,x2,y2,ppu))
+    {
+        // only the tiles that came into view are rendered
+    }
+    else if (update_point_buffer())
+    {
+        // the buffers draw any number of rows in a few calls
+        points.draw(std::max(r1,0), r2+1, alpha_from_zoom());
+    }
+    else if (draw_raster(x1,y1,x2,y2,ppu))
+    {
+        // one parallel pass over the visible nonzeros
+    }
+    else
+    {
+        // zoomed in, so only a few rows and columns are visible
         cout << "drawing partial matrix (" << r1 << ", " << c1 << ") - ("
             << r2 << ", " << c2 << ")" << endl;
 
         draw_partial_matrix(r1,c1,r2,c2);
     }
-    else if (_m.nrows < 32768) {
-        cout << "drawing full matrix" << endl;
-        // only draw the full matrix if there isn't a very small portion
-	    draw_full_matrix();
-    }
-    else {
-        r1=(std::max)(r1,0);
-        int r2end=(std::min)(r2,_m.nrows);
-
-        r1=r1+16384*frame;
-        r2=(std::min)(r1+16384,r2end);
-        cout << "drawing matrix iteratively " << frame << " (" << r1 << ", " << c1 << ") - ("
-            << r2 << ", " << c2 << ")" << " " << r2end << endl;
-
-        draw_partial_matrix(r1,c1,r2,c2);
-
-        if (r2 != r2end) {
-            display_finished = false;
-        }
-    }
 
     if (data_panel_visible)
     {
@@ -156,39 +157,114 @@ void matrix_canvas::draw()
         //data_panel.update(r, c, yasmic::value(r, c, 
         //    static_cast<const Matrix&>(_m)));
         data_panel.update(r,c,(float)matrix_value(r,c),
-            row_label(r), column_label(c));
+            row_label(r).str(), column_label(c).str());
 
         data_cursor.draw();   
     }
 }
 
-template <bool partial, class NRMap, class NCMap, class PRMap, class PCMap>
-void matrix_canvas::draw_matrix(int r1, int c1, int r2, int c2,
+/**
+ * Draw the border around an m by n matrix.
+ */
+void matrix_canvas::draw_border(int m, int n)
+{
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glPointSize(1.0);
+    glColor3f(border_color[0], border_color[1], border_color[2]);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(-0.5f, -0.5f);
+    glVertex2f(-0.5f, m-0.5f);
+    glVertex2f(n-0.5f, m-0.5f);
+    glVertex2f(n-0.5f, -0.5f);
+    glEnd();
+}
+
+/**
+ * Draw the nonzeros of a matrix that is still loading.  The values 
+ * are not known yet, so every nonzero has the color of the largest 
+ * value.
+ */
+void matrix_canvas::draw_preview()
+{
+    if (preview_nrows <= 0 || preview_ncols <= 0) { return; }
+
+    draw_border(preview_nrows, preview_ncols);
+
+    glPointSize(zoom / (virtual_width*aspect/(float)width));
+
+    float x1,y1,x2,y2;
+    world_extents(x1,y1,x2,y2);
+
+    int colormap_entry = colormap_invert ? 0 : colormap.size-1;
+    glColor4f(colormap.map[colormap_entry*3],
+              colormap.map[colormap_entry*3+1],
+              colormap.map[colormap_entry*3+2],
+              alpha_from_zoom());
+
+    load_progress.draw_points((int)floor(y1), (int)floor(y2));
+}
+
+template <bool partial, class RowPtr, class Columns, class ValMap, 
+          class NRMap, class NCMap, class PRMap, class PCMap>
+void matrix_canvas::draw_matrix(const matrix_type& m, int r1, int c1, int r2, int c2,
     value_type min_val, value_type inv_val_range, float alpha,
-    NRMap nrv, NCMap ncv, PRMap iprm, PCMap pcm)
+    const RowPtr* ai, Columns cols, ValMap vals, NRMap nrv, NCMap ncv, 
+    PRMap iprm, PCMap pcm)
 {
     int colormap_entry;
     value_type v;
 
+    // skip the rows without nonzeros in the columns c1 to c2, and with
+    // the columns in display order, start each row at c1 and stop it
+    // after c2
+    bool sorted = true;
+    const index_type *extent = 0;
+    if (partial) { extent = row_extents_of(m, !util::is_identity(pcm), sorted); }
+    const bool search = partial && sorted && util::is_identity(pcm);
+
     glBegin( GL_POINTS );
 	{
-        for (int pi = std::max(0,r1); pi < std::min(r2, _m.nrows); ++pi)
+        int row_end = m.first_row + m.nrows;
+        for (int pi = std::max(m.first_row,r1); pi < std::min(r2, row_end); ++pi)
         {
             // i is the real row in the matrix for the pith row
-            // of the display
+            // of the display, and li is the row in the arrays of m
             int i = iprm[pi];
+            int li = i - m.first_row;
+
+            RowPtr rbegin, rend;
+            if (m.ar) {
+                // a tile only stores its nonempty rows
+                rbegin = (RowPtr)m.row_pointer(li);
+                rend = (RowPtr)m.row_pointer(li+1);
+            } else {
+                rbegin = ai[li]; rend = ai[li+1];
+            }
+            cols.start_row(li);
+            if (extent && (extent[2*i+1] < c1 || extent[2*i] > c2))
+            {
+                cols.skip(rend - rbegin);
+                continue;
+            }
 
-            for (index_type ri = _m.ai[i]; ri < _m.ai[i+1]; ++ri)
+            RowPtr ri = search ? (RowPtr)cols.seek(rbegin, rend, c1) : rbegin;
+            for (; ri < rend; ++ri)
             {
                 // j is the real column in the matrix for the pjth
                 // column of the display
-                int j = _m.aj[ri];
+                int j = cols.next(ri);
                 int pj = pcm[j];
 
                 // skip all the columns outside
-                if (partial && (pj < c1 || pj > c2)) { continue; }
+                if (partial && (pj < c1 || pj > c2)) 
+                { 
+                    if (search && pj > c2) { cols.skip(rend - ri - 1); break; }
+                    continue; 
+                }
 
-                v = _m.a[ri]*nrv[i]*ncv[j];
+                v = vals[ri]*nrv[i]*ncv[j];
 
                 // scale v to the range [0,1]
                 v = v - min_val;
@@ -212,81 +288,242 @@ void matrix_canvas::draw_matrix(int r1, int c1, int r2, int c2,
 	glEnd();
 }
 
-template <bool partial, class NRMap, class NCMap>
-void matrix_canvas::draw_matrix_dispatch(int r1, int c1, int r2, int c2,
+template <bool partial, class RowPtr, class Columns, class ValMap, 
+          class NRMap, class NCMap>
+void matrix_canvas::draw_matrix_dispatch(const matrix_type& m, 
+    int r1, int c1, int r2, int c2,
     value_type min_val, value_type inv_val_range, float alpha,
-    NRMap nrv, NCMap ncv)
+    const RowPtr* ai, Columns cols, ValMap vals, NRMap nrv, NCMap ncv)
 {
     switch (permutation_state) {
         case no_permutation:
-            draw_matrix<partial>(r1,c1,r2,c2,min_val,inv_val_range,alpha,nrv,ncv,
-                util::identity_array(),util::identity_array());
+            draw_matrix<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,ai,cols,
+                vals,nrv,ncv,util::identity_array(),util::identity_array());
             break;
 
         case row_permutation: 
-            draw_matrix<partial>(r1,c1,r2,c2,min_val,inv_val_range,alpha,nrv,ncv,
-                &irperm[0],util::identity_array());
+            draw_matrix<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,ai,cols,
+                vals,nrv,ncv,&irperm[0],util::identity_array());
             break;
 
         case column_permutation:
-            draw_matrix<partial>(r1,c1,r2,c2,min_val,inv_val_range,alpha,nrv,ncv,
-                util::identity_array(),&cperm[0]);
+            draw_matrix<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,ai,cols,
+                vals,nrv,ncv,util::identity_array(),&cperm[0]);
             break;
 
         case row_column_permutation:
-            draw_matrix<partial>(r1,c1,r2,c2,min_val,inv_val_range,alpha,nrv,ncv,
-                &irperm[0],&cperm[0]);
+            draw_matrix<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,ai,cols,
+                vals,nrv,ncv,&irperm[0],&cperm[0]);
             break;
     }
 }
 
-template <bool partial>
-void matrix_canvas::draw_matrix_dispatch(int r1, int c1, int r2, int c2)
+template <bool partial, class Columns, class ValMap, class NRMap, class NCMap>
+void matrix_canvas::draw_matrix_dispatch(const matrix_type& m, 
+    int r1, int c1, int r2, int c2,
+    value_type min_val, value_type inv_val_range, float alpha,
+    Columns cols, ValMap vals, NRMap nrv, NCMap ncv)
 {
-    value_type max_val = matrix_stats.max_val;
-    value_type min_val = matrix_stats.min_val;
+    if (m.ai_wide) {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            m.ai_wide,cols,vals,nrv,ncv);
+    } else {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            m.ai,cols,vals,nrv,ncv);
+    }
+}
 
-    if (max_val - min_val <= 0) 
-    {
-        // this sets min_val to something reasonable, and 
-        // shows the high end of the colormap if the values
-        // are all equal
-        min_val = max_val - 1.0;
+template <bool partial, class ValMap, class NRMap, class NCMap>
+void matrix_canvas::draw_matrix_dispatch(const matrix_type& m, 
+    int r1, int c1, int r2, int c2,
+    value_type min_val, value_type inv_val_range, float alpha,
+    ValMap vals, NRMap nrv, NCMap ncv)
+{
+    if (m.aj_packed) {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            matrix_type::packed_columns(m),vals,nrv,ncv);
+    } else {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            matrix_type::raw_columns(m),vals,nrv,ncv);
     }
-    value_type inv_val_range = 1.0/(max_val - min_val);
+}
+
+template <bool partial, class NRMap, class NCMap>
+void matrix_canvas::draw_matrix_dispatch(const matrix_type& m, 
+    int r1, int c1, int r2, int c2,
+    value_type min_val, value_type inv_val_range, float alpha,
+    NRMap nrv, NCMap ncv)
+{
+    if (m.a) {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            m.a,nrv,ncv);
+    } else if (m.a_float) {
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            m.a_float,nrv,ncv);
+    } else {
+        // a pattern matrix, every value is 1
+        draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            util::constant_array<value_type>(1),nrv,ncv);
+    }
+}
+
+template <bool partial>
+void matrix_canvas::draw_matrix_dispatch(const matrix_type& m, 
+    int r1, int c1, int r2, int c2)
+{
+    value_type min_val, inv_val_range;
+    color_range(min_val, inv_val_range);
 
     float alpha = alpha_from_zoom();
 
     switch (normalization_state) {
         case no_normalization:
-            draw_matrix_dispatch<partial>(r1,c1,r2,c2,min_val,inv_val_range,alpha,
+            draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
                 util::constant_array<value_type>(1),util::constant_array<value_type>(1));
             break;
 
         case row_normalization:
-            draw_matrix_dispatch<partial>(r1,c1,r2,c2,0.0,1.0,alpha,
-                &rnorm[0],util::constant_array<value_type>(1));
+            draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+                rnorm,util::constant_array<value_type>(1));
             break;
 
         case column_normalization:
-            draw_matrix_dispatch<partial>(r1,c1,r2,c2,0.0,1.0,alpha,
-                util::constant_array<value_type>(1),&cnorm[0]);
+            draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+                util::constant_array<value_type>(1),cnorm);
             break;
 
         case row_column_normalization:
-            draw_matrix_dispatch<partial>(r1,c1,r2,c2,0.0,1.0,alpha,&rnorm[0],&cnorm[0]);
+            draw_matrix_dispatch<partial>(m,r1,c1,r2,c2,min_val,inv_val_range,alpha,
+                rnorm,cnorm);
             break;
     }
 }
 
-void matrix_canvas::draw_full_matrix()
+void matrix_canvas::draw_partial_matrix(int r1, int c1, int r2, int c2)
 {
-    draw_matrix_dispatch<false>(0,0,_m.nrows,_m.ncols);
+    if (tiles.is_open()) {
+        draw_tiled_matrix(r1,c1,r2,c2);
+        return;
+    }
+    draw_matrix_dispatch<true>(_m,r1,c1,r2,c2);
 }
 
-void matrix_canvas::draw_partial_matrix(int r1, int c1, int r2, int c2)
+/**
+ * Make the row extents match the column permutation, and check that
+ * the columns of every row are sorted.
+ *
+ * @return false if the matrix is in tiles, which have no extents
+ */
+bool matrix_canvas::update_row_extents()
 {
-    draw_matrix_dispatch<true>(r1,c1,r2,c2);
+    using namespace std;
+
+    if (tiles.is_open() || !matrix_loaded) { return (false); }
+
+    int key = permutation_state & column_permutation;
+    if (key == row_extent_key) { return (true); }
+
+    // the texture tiles read the extents on their render thread
+    texture_tiles.set_state(-1);
+
+    double t0 = util::wall_time();
+    row_extent.resize(2*(std::size_t)_m.nrows);
+    if (_m.aj_packed) {
+        fill_row_extents(matrix_type::packed_columns(_m));
+    } else {
+        fill_row_extents(matrix_type::raw_columns(_m));
+    }
+    row_extent_key = key;
+
+    cout << "found row extents in " << util::wall_time() - t0 << endl;
+    return (true);
+}
+
+template <class Columns>
+void matrix_canvas::fill_row_extents(Columns cols)
+{
+    bool cperm_set = (permutation_state & column_permutation) != 0;
+    long unsorted = 0;
+
+    #pragma omp parallel reduction(+:unsorted)
+    {
+        Columns c(cols);
+
+        #pragma omp for schedule(static)
+        for (index_type i = 0; i < _m.nrows; ++i)
+        {
+            // an empty row has an empty extent
+            index_type lo = std::numeric_limits<index_type>::max(), hi = -1;
+            index_type last = 0;
+
+            nz_index_type rend = _m.row_end(i);
+            c.start_row(i);
+            for (nz_index_type ri = _m.row_begin(i); ri < rend; ++ri)
+            {
+                index_type j = c.next(ri);
+                if (j < last) { ++unsorted; }
+                last = j;
+
+                index_type pj = cperm_set ? cperm[j] : j;
+                lo = std::min(lo, pj);
+                hi = std::max(hi, pj);
+            }
+            row_extent[2*(std::size_t)i] = lo;
+            row_extent[2*(std::size_t)i+1] = hi;
+        }
+    }
+
+    row_columns_sorted = (unsorted == 0);
+}
+
+/**
+ * The row extents of m for a column permutation, if it is _m and they
+ * match.  The columns of a tile are always sorted.
+ *
+ * @param sorted are the columns of every row of m sorted?
+ * @return the extents, indexed by the row of the matrix, or NULL
+ */
+const matrix_canvas::index_type* matrix_canvas::row_extents_of(
+    const matrix_type& m, bool column_permuted, bool& sorted)
+{
+    sorted = true;
+    if (&m != &_m || row_extent_key < 0) { return (0); }
+
+    sorted = row_columns_sorted;
+    if (row_extent_key != (column_permuted ? column_permutation : 0)) { return (0); }
+    return (&row_extent[0]);
+}
+
+/**
+ * Draw the rows r1 to r2 and columns c1 to c2 from the tiles.  Each
+ * tile is mapped while we draw it, and then the tiles around the 
+ * region are prefetched for the next frame.  The tiles do not 
+ * support permutations.
+ */
+void matrix_canvas::draw_tiled_matrix(int r1, int c1, int r2, int c2)
+{
+    int ts = tiles.tile_size();
+
+    // the rows r1 to r2-1 and the columns c1 to c2 are drawn
+    int rbegin = std::max(r1, 0), rend = std::min(r2, _m.nrows);
+    int cbegin = std::max(c1, 0), cend = std::min(c2, _m.ncols-1);
+    if (rbegin >= rend || cbegin > cend) { return; }
+
+    int tr1 = rbegin/ts, tr2 = (rend-1)/ts;
+    int tc1 = cbegin/ts, tc2 = cend/ts;
+
+    tiles.begin_frame();
+    for (int tr = tr1; tr <= tr2; ++tr)
+    {
+        for (int tc = tc1; tc <= tc2; ++tc)
+        {
+            const matrix_type *t = tiles.acquire(tr, tc);
+            if (!t) { continue; }
+            draw_matrix_dispatch<true>(*t,r1,c1,r2,c2);
+            tiles.release(tr, tc);
+        }
+    }
+    tiles.prefetch(tr1, tc1, tr2, tc2);
 }
 
 /**
@@ -427,8 +664,6 @@ void matrix_canvas::reshape(int w, int h)
 
 void matrix_canvas::motion(int x, int y)
 {
-    display_finished = true;
-
     // rescale the mouse click 
     int move_x = x-mouse_begin_x;
     int move_y = y-mouse_begin_y;
@@ -467,7 +702,7 @@ void matrix_canvas::key(unsigned char key, int x, int y)
     switch (key) {
         case 'o':
         case 'O':
-            write_svg();
+            if (matrix_loaded) { write_svg(); }
             break;
     }
 }
@@ -505,13 +740,17 @@ void matrix_canvas::special_key(int key, int x, int y)
  * This function initializes the window and assures it is
  * sized correctly, etc.
  */
-void matrix_canvas::init_window()
+void matrix_canvas::init_window(index_type nrows, index_type ncols)
 {
     // make sure we are the current window
     glutSetWindow(get_glut_window_id());
 
-    set_center(_m.ncols/2, _m.nrows/2);
-    set_natural_size(_m.ncols, _m.nrows);
+    // without a matrix, keep the size of the window
+    if (nrows > 0 && ncols > 0)
+    {
+        set_center(ncols/2, nrows/2);
+        set_natural_size(ncols, nrows);
+    }
     
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -555,41 +794,152 @@ matrix_canvas::value_type matrix_canvas::matrix_value(
         return (value_type)0;
     }
 
-    index_type ri,riend;
-    ri = _m.ai[r];
-    riend = _m.ai[r+1];
-
-    while (ri < riend) 
+    const matrix_type *m = &_m;
+    int ts = tiles.tile_size();
+    if (tiles.is_open())
     {
-        if (c == _m.aj[ri]) { return _m.a[ri]; }
-        ++ri;
+        m = tiles.acquire(r/ts, c/ts);
+        if (!m) { return ((value_type)0); }
     }
-    return ((value_type)0);
+
+    value_type v = m->find(r, c);
+
+    if (tiles.is_open()) { tiles.release(r/ts, c/ts); }
+    return (v);
 }
 
-const std::string& matrix_canvas::row_label(index_type r)
+/**
+ * Load the matrix file into _m with 64-bit row pointers and then
+ * symmetrize, pack, and sort it.  The values are loaded into vals, 
+ * which lets the canvas keep them in double or single precision.
+ *
+ * @param vals the value array for the matrix
+ * @param symmetrize if true, symmetrize the matrix
+ * @param unit_values set to true if every value in the file is 1
+ * @return false if the matrix could not be loaded
+ */
+template <class Value>
+bool matrix_canvas::load_packed_matrix(std::vector<Value>& vals,
+    bool symmetrize, bool& unit_values)
 {
-    if (r >= 0 && r < rlabel.size()) {
-        return rlabel[r];
-    } else {
-        return empty_label;
+    using namespace std;
+
+    boost::timer t0;
+
+    _m.ai_data.clear();
+
+    // the loaders report the nonzeros to load_progress as they read them
+    load_progress.set_stage("reading");
+    yasmic::crm_load_monitor<index_type>() = &load_progress;
+    std::vector<boost::int64_t> ids;
+	bool rval = load_crm_matrix(matrix_filename, _m.ai_wide_data, _m.aj_data, vals, 
+        _m.nrows, _m.ncols, _m.nnz, false, &ids);
+    yasmic::crm_load_monitor<index_type>() = 0;
+	if (!rval)
+	{
+        return false;
+	}
+
+    // an edge list labels its rows and columns with the node ids
+    if (!ids.empty())
+    {
+        rlabel.assign(ids);
+        clabel.assign(ids);
     }
+
+	std::cerr << "read matrix in " << t0.elapsed() <<  std::endl;
+
+    // check the values before symmetrizing and packing, which add
+    // together repeated entries
+    unit_values = true;
+    for (typename vector<Value>::const_iterator vi = vals.begin(); 
+         vi != vals.end(); ++vi)
+    {
+        if (*vi != (Value)1) { unit_values = false; break; }
+    }
+
+	using namespace yasmic;
+
+	// for operations that need value information, use this type
+	typedef compressed_row_matrix<
+		vector<nz_index_type>::iterator, vector<index_type>::iterator,
+        typename vector<Value>::iterator  >
+        crs_matrix;  
+
+    if (symmetrize)
+	{
+		t0.restart();
+        load_progress.set_stage("symmetrizing");
+
+		symmetrize_crm_storage(_m.ai_wide_data, _m.aj_data, vals, 
+            _m.nrows, _m.ncols);
+		_m.nnz = _m.ai_wide_data.back();
+
+		std::cerr << "symmetrized matrix in " << t0.elapsed() <<  std::endl;
+	}
+
+	{
+		nz_index_type nzstart = _m.nnz;
+
+		t0.restart();
+        load_progress.set_stage("packing");
+
+		crs_matrix mlarge(_m.ai_wide_data.begin(), _m.ai_wide_data.end(), 
+                    _m.aj_data.begin(), _m.aj_data.end(), 
+					vals.begin(), vals.end(), _m.nrows, _m.ncols, _m.nnz);
+
+        // a file written with sorted rows and no duplicates needs
+        // neither pass
+        if (is_sorted_storage(mlarge))
+        {
+            std::cerr << "matrix is already sorted" << std::endl;
+        }
+        else
+        {
+            pack_storage(mlarge, std::plus<Value>());
+            sort_storage(mlarge);
+        }
+
+		_m.nnz = _m.ai_wide_data.back();
+
+		std::cerr << "packed matrix in " << t0.elapsed() <<  std::endl;
+		std::cerr << "removed " << nzstart - _m.nnz << " nzs" << std::endl;
+	}
+
+    return (true);
 }
 
-const std::string& matrix_canvas::column_label(index_type c)
+namespace {
+
+/**
+ * Compute the stats of m with the row pointers ai and whichever
+ * values m stores.
+ */
+template <class Matrix, class RowPtr, class Index, class Value>
+void compute_matrix_stats(const Matrix& m, const RowPtr* ai,
+    crm_stats<Index,Value>& s, Value* rnorm, Value* cnorm)
 {
-    if (c >= 0 && c < clabel.size()) {
-        return clabel[c];
+    if (m.a) {
+        compute_crm_stats(m.nrows, m.ncols, ai, m.aj, m.a, s, rnorm, cnorm);
+    } else if (m.a_float) {
+        compute_crm_stats(m.nrows, m.ncols, ai, m.aj, m.a_float, s, rnorm, cnorm);
     } else {
-        return empty_label;
+        compute_crm_stats(m.nrows, m.ncols, ai, m.aj, 
+            util::constant_array<Value>(1), s, rnorm, cnorm);
     }
 }
 
+} // anonymous namespace
+
+/**
+ * Load the matrix into _m, or open its tiles if there is a memory 
+ * limit.  This function does not touch the window, so it can run on
+ * the loading thread, and the caller has to show the matrix.
+ */
 bool matrix_canvas::load_matrix(const std::string& filename,
-    bool symmetrize)
+    bool symmetrize, bool use_cache)
 {
     using namespace std;
-    matrix_loaded = false;
 
     matrix_filename = filename;
 
@@ -607,115 +957,305 @@ bool matrix_canvas::load_matrix(const std::string& filename,
         return false; 
     }
 
-	rval = load_crm_matrix(matrix_filename, _m.ai, _m.aj, _m.a, 
-        _m.nrows, _m.ncols, _m.nnz);
+    if (memory_limit > 0)
+    {
+        return (load_tiled_matrix(symmetrize, use_cache));
+    }
+
+    // the cache does not keep the node ids of an edge list
+    if (yasmic::is_edge_list_file(matrix_filename)) { use_cache = false; }
+
+    load_progress.set_stage("reading cache");
+    if (use_cache && load_matrix_cache(symmetrize))
+    {
+        std::cerr << "read matrix cache " << cache_filename() 
+                  << " in " << t0.elapsed() << std::endl;
+
+        if (compress_columns) { pack_matrix_columns(); }
+        return (true);
+    }
+
+    // load and pack with 64-bit row pointers, they are narrowed 
+    // afterwards if the number of nonzeros fits in an index_type
+    _m.drop_values();
+
+    bool unit_values = false;
+    if (value_storage == float_values || value_storage == no_values) {
+        rval = load_packed_matrix(_m.a_float_data, symmetrize, unit_values);
+    } else {
+        rval = load_packed_matrix(_m.a_data, symmetrize, unit_values);
+    }
 	if (!rval)
 	{
         std::cerr << "error loading matrix: cannot proceed!\n" << std::endl;
 		return false;
 	}
 
-	std::cerr << "read matrix in " << t0.elapsed() <<  std::endl;
+    if (value_storage == no_values 
+        || (value_storage == auto_values && unit_values))
+    {
+        // store only the pattern of the matrix
+        _m.drop_values();
+    }
 
-	using namespace yasmic;
+    {
+		std::cerr << "matrix: " << matrix_filename << std::endl;
+		std::cerr << "nrows: " << _m.nrows << std::endl;
+		std::cerr << "ncols: " << _m.ncols << std::endl;
+		std::cerr << "nnz: " << _m.nnz << std::endl;
+		std::cerr << "values: " << (_m.a_data.size() ? "double" : 
+            _m.a_float_data.size() ? "float" : "none (pattern)") << std::endl;
+	}
 
-	// for operations that need value information, use this type
-	typedef compressed_row_matrix<
-		vector<index_type>::iterator, vector<index_type>::iterator,
-        vector<value_type>::iterator  >
-        crs_matrix;  
+    _m.narrow_row_pointers();
+    _m.use_data();
 
-    if (symmetrize)
-	{
-		t0.restart();
+    //
+    // compute matrix stats
+    //
 
-		_m.nnz = (int)(2*_m.aj.size());
+    load_progress.set_stage("computing statistics");
 
-		vector<int> rows_temp(_m.ai);
-		vector<int> cols_temp(_m.aj);
-		vector<value_type> vals_temp(_m.a);
+    rnorm_data.resize(_m.nrows);
+    cnorm_data.resize(_m.ncols);
 
-		std::fill(_m.ai.begin(), _m.ai.end(), 0);
-		_m.aj.resize(_m.nnz);
-		_m.a.resize(_m.nnz);
+    value_type *rn = rnorm_data.empty() ? 0 : &rnorm_data[0];
+    value_type *cn = cnorm_data.empty() ? 0 : &cnorm_data[0];
 
-		typedef transpose_matrix<crs_matrix> t_matrix;
-		typedef nonzero_union<crs_matrix, t_matrix> nzu_matrix;
+    crm_stats<index_type, value_type> s;
+    if (_m.ai_wide) {
+        compute_matrix_stats(_m, _m.ai_wide, s, rn, cn);
+    } else {
+        compute_matrix_stats(_m, _m.ai, s, rn, cn);
+    }
+    matrix_stats.min_val = s.min_val;
+    matrix_stats.max_val = s.max_val;
+    matrix_stats.min_degree = s.min_degree;
+    matrix_stats.max_degree = s.max_degree;
 
-		crs_matrix m(rows_temp.begin(), rows_temp.end(), cols_temp.begin(), cols_temp.end(), 
-					vals_temp.begin(), vals_temp.end(), 
-                    _m.nrows, _m.ncols, _m.nnz/2);
+    rnorm = rn;
+    cnorm = cn;
 
-		t_matrix mt(m);
-		nzu_matrix nzu(m, mt);
+    if (use_cache)
+    {
+        t0.restart();
+        load_progress.set_stage("writing cache");
+        if (write_matrix_cache(symmetrize))
+        {
+            std::cerr << "wrote matrix cache " << cache_filename() 
+                      << " in " << t0.elapsed() << std::endl;
+        }
+    }
 
-		_m.nrows = nrows(nzu);
-		_m.ncols = ncols(nzu);
+    if (compress_columns) { pack_matrix_columns(); }
+    return (true);
+}
 
-		// load the matrix
-		load_matrix_to_crm(nzu, _m.ai.begin(), _m.aj.begin(), _m.a.begin());
+/**
+ * Compress the column indices of _m, after everything else that 
+ * reads them while loading.
+ */
+void matrix_canvas::pack_matrix_columns()
+{
+    boost::timer t0;
 
-		std::cerr << "symmetrized matrix in " << t0.elapsed() <<  std::endl;
-	}
+    load_progress.set_stage("packing columns");
+    if (!_m.pack_columns())
+    {
+        std::cerr << "the columns of the matrix are not sorted, "
+                  << "not compressing them" << std::endl;
+        return;
+    }
 
-	{
-		index_type nzstart = _m.nnz;
+    std::cerr << "packed columns into " << _m.aj_packed_data.size() 
+              << " bytes (" << (double)_m.aj_packed_data.size()/(double)std::max(_m.nnz,(nz_index_type)1)
+              << " per nonzero) in " << t0.elapsed() << std::endl;
+}
 
-		t0.restart();
+namespace {
+
+/** Give the nonzeros to the first or second pass of a tile writer. */
+struct tile_writer_sink
+{
+    typedef matrix_tile_writer::index_type index_type;
 
-		crs_matrix mlarge(_m.ai.begin(), _m.ai.end(), _m.aj.begin(), _m.aj.end(), 
-					_m.a.begin(), _m.a.end(), _m.nrows, _m.ncols, _m.nnz);
+    tile_writer_sink(matrix_tile_writer& w, bool counting,
+        yasmic::load_monitor<index_type>* monitor)
+    : w(w), counting(counting), mb(monitor, counting) {}
 
-        pack_storage(mlarge, std::plus<value_type>());
-		sort_storage(mlarge);
+    template <class Index, class Value>
+    void operator() (Index r, Index c, Value v)
+    {
+        mb((index_type)r, (index_type)c);
+        if (counting) { w.count((index_type)r, (index_type)c, (double)v); }
+        else { w.add((index_type)r, (index_type)c, (double)v); }
+    }
 
-		_m.nnz = _m.ai.back();
+    matrix_tile_writer& w;
+    bool counting;
+    yasmic::load_monitor_buffer<index_type> mb;
+};
 
-		std::cerr << "packed matrix in " << t0.elapsed() <<  std::endl;
-		std::cerr << "removed " << nzstart - _m.nnz << " nzs" << std::endl;
-	}
+/**
+ * Read every chunk of a ChunkSource into one pass of a tile writer.
+ * The writer is not thread safe, so the chunks are read in order.
+ */
+template <class ChunkSource>
+bool write_tile_pass(ChunkSource& src, matrix_tile_writer& w, bool counting,
+    yasmic::load_monitor<matrix_tile_writer::index_type>* monitor)
+{
+    tile_writer_sink s(w, counting, monitor);
+    for (int i = 0; i < src.nchunks(); ++i) 
+    {
+        if (!src.parse_chunk(i, s)) 
+        {
+            std::cerr << "error: invalid matrix data, cannot parse chunk " 
+                      << i << std::endl;
+            return (false);
+        }
+    }
+    return (true);
+}
 
+/**
+ * Write a .vmtiles file from the nonzeros that stream_matrix_file
+ * reads, parsing the chunks once for each pass of the writer.
+ */
+struct tile_file_visitor
+{
+    typedef matrix_tile_writer::index_type index_type;
+
+    /**
+     * @param value_size the bytes for each value, or -1 to store a
+     * pattern if every value is 1 and doubles otherwise
+     * @param memory_limit the memory for sorting the nonzeros into tiles
+     * @param monitor watches both passes over the nonzeros, or 0
+     */
+    tile_file_visitor(const std::string& filename, bool symmetrize,
+        const matrix_tile_source& src, int value_size,
+        boost::uint64_t memory_limit,
+        yasmic::load_monitor<index_type>* monitor)
+    : filename(filename), symmetrize(symmetrize), src(src), 
+      value_size(value_size), memory_limit(memory_limit), monitor(monitor) {}
+
+    template <class ChunkSource>
+    bool operator() (ChunkSource& s, index_type nr, index_type nc,
+        boost::int64_t nnz, bool)
     {
-		std::cerr << "matrix: " << matrix_filename << std::endl;
-		std::cerr << "nrows: " << _m.nrows << std::endl;
-		std::cerr << "ncols: " << _m.ncols << std::endl;
-		std::cerr << "nnz: " << _m.nnz << std::endl;
-	}
+        matrix_tile_writer w(filename, nr, nc, symmetrize);
+        w.set_memory_limit(memory_limit);
 
-    matrix_loaded = true;
-    init_window();
-    data_cursor.set_matrix_size(_m.nrows, _m.ncols);
+        if (monitor) { monitor->begin(nr, nc, nnz, 2); }
 
-    //
-    // compute matrix stats
-    //
+        if (!write_tile_pass(s, w, true, monitor) || !w.start_add() 
+            || !write_tile_pass(s, w, false, monitor)) 
+        {
+            return (false);
+        }
+
+        int size = value_size;
+        if (size < 0) { size = w.unit_values() ? 0 : sizeof(double); }
+        return (w.finish(src, size));
+    }
+
+    std::string filename;
+    bool symmetrize;
+    const matrix_tile_source& src;
+    int value_size;
+    boost::uint64_t memory_limit;
+    yasmic::load_monitor<index_type>* monitor;
+};
+
+}
+
+/**
+ * Build the .vmtiles file for the matrix.
+ *
+ * The nonzeros are read twice from the disk, so the matrix never has 
+ * to fit in memory.  Edge lists, which number their nodes in memory, 
+ * and compressed Matrix Market files, which are inflated into memory,
+ * cannot be written as tiles.
+ */
+bool matrix_canvas::write_matrix_tiles(bool symmetrize)
+{
+    using namespace std;
+
+    matrix_tile_source src;
+    if (!matrix_source_info(matrix_filename, src.source_size, src.source_mtime)) {
+        return (false);
+    }
+    src.symmetrize = symmetrize;
+    src.value_storage = value_storage;
 
-    matrix_stats.max_degree = 0;
-    matrix_stats.min_degree = std::numeric_limits<index_type>::max();
-    matrix_stats.max_val = std::numeric_limits<value_type>::min();
-    matrix_stats.min_val = std::numeric_limits<value_type>::max();
+    int value_size = -1;
+    if (value_storage == no_values) { value_size = 0; }
+    else if (value_storage == float_values) { value_size = sizeof(float); }
+    else if (value_storage == double_values) { value_size = sizeof(value_type); }
 
-    rnorm.resize(_m.nrows);
-    cnorm.resize(_m.ncols);
+    load_progress.set_stage("writing tiles");
 
-    for (index_type r = 0; r < _m.nrows; ++r)
+    tile_file_visitor visit(tiles_filename(), symmetrize, src, value_size, 
+        memory_limit, &load_progress);
+    bool streamed;
+    bool rval = stream_matrix_file<index_type, nz_index_type, value_type>(
+        matrix_filename, visit, streamed);
+    if (streamed) { return (rval); }
+
+    if (yasmic::is_edge_list_file(matrix_filename))
+    {
+        cerr << "error: an edge list numbers its nodes in memory and cannot "
+             << "be written as tiles within a memory limit, convert "
+             << matrix_filename << " to bsmat first" << endl;
+    }
+    else
     {
-        index_type deg = _m.ai[r+1] - _m.ai[r];
-        matrix_stats.max_degree = std::max(matrix_stats.max_degree, deg);
-        matrix_stats.min_degree = std::min(matrix_stats.min_degree, deg);
+        cerr << "error: a compressed Matrix Market file is inflated into "
+             << "memory, decompress " << matrix_filename 
+             << " to build the tiles" << endl;
+    }
+    return (false);
+}
 
-        for (index_type ri = _m.ai[r]; ri < _m.ai[r+1]; ++ri) 
-        {
-            value_type val = _m.a[ri];
-            matrix_stats.max_val = std::max(matrix_stats.max_val, val);
-            matrix_stats.min_val = std::min(matrix_stats.min_val, val);
+/**
+ * Load the matrix as tiles from the .vmtiles file, building the file 
+ * first if it does not exist or is out of date.
+ */
+bool matrix_canvas::load_tiled_matrix(bool symmetrize, bool use_cache)
+{
+    using namespace std;
 
-            rnorm[r] += val*val;
-            cnorm[_m.aj[ri]] += val*val;
+    boost::timer t0;
+
+    load_progress.set_stage("reading tiles");
+    if (use_cache && load_matrix_tiles(symmetrize))
+    {
+        cerr << "read matrix tiles " << tiles_filename() 
+             << " in " << t0.elapsed() << endl;
+    }
+    else
+    {
+        if (!write_matrix_tiles(symmetrize) || !load_matrix_tiles(symmetrize))
+        {
+            cerr << "error loading matrix: cannot proceed!\n" << endl;
+            return (false);
         }
+        cerr << "wrote matrix tiles " << tiles_filename() 
+             << " in " << t0.elapsed() << endl;
     }
-    for (index_type r=0; r<_m.nrows; ++r) { rnorm[r]=1.0/sqrt(rnorm[r]); }
-    for (index_type r=0; r<_m.ncols; ++r) { cnorm[r]=1.0/sqrt(cnorm[r]); }
+
+    tiles.set_memory_limit(memory_limit);
+
+    {
+		std::cerr << "matrix: " << matrix_filename << std::endl;
+		std::cerr << "nrows: " << _m.nrows << std::endl;
+		std::cerr << "ncols: " << _m.ncols << std::endl;
+		std::cerr << "nnz: " << _m.nnz << std::endl;
+		std::cerr << "values: " << (tiles.value_size() == sizeof(value_type) ? "double" : 
+            tiles.value_size() ? "float" : "none (pattern)") << std::endl;
+        std::cerr << "tiles: " << tiles.tile_rows() << " x " << tiles.tile_cols()
+                  << " of " << tiles.tile_size() << " rows and columns, using at most "
+                  << memory_limit/(1024.0*1024.0) << " MB" << std::endl;
+	}
 
     return (true);
 }
@@ -725,6 +1265,11 @@ bool matrix_canvas::load_permutations(const std::string& rperm_filename,
 {
     using namespace std;
 
+    if (tiles.is_open() && (!rperm_filename.empty() || !cperm_filename.empty())) {
+        cerr << "permutations are not supported with a memory limit" << endl;
+        return (false);
+    }
+
     if (!rperm_filename.empty() && !util::file_exists(rperm_filename)) {
         cerr << rperm_filename << " does not exist." << endl;
         return (false);
@@ -735,41 +1280,10 @@ bool matrix_canvas::load_permutations(const std::string& rperm_filename,
         return (false);
     }
 
-    // use all the boost iostreams stuff loaded from the load_crm_matrix.hpp
-    // header file
-    typedef boost::iostreams::filtering_stream<
-                boost::iostreams::input_seekable> 
-        filtered_ifstream;
-
     if (!rperm_filename.empty())
     {
         YASMIC_VERBOSE( cerr << "reading " << rperm_filename << endl; )
-        filtered_ifstream ios_fifs;
-        ifstream ifs(rperm_filename.c_str());
-
-        if (util::gzip_header(ifs))
-        {
-            ifs.seekg(0, ios::beg);
-            ios_fifs.push(boost::iostreams::gzip_decompressor());
-            YASMIC_VERBOSE(  cerr << "detected gzip" << endl; )
-        }
-
-        ios_fifs.push(ifs);
-
-        string line;
-
-        irperm.resize(_m.nrows);
-
-        index_type r;
-        for (r=0; r<_m.nrows && !ios_fifs.eof(); ++r) {
-            index_type p;
-            ifs >> p;
-            irperm[r]=p;
-        }
-
-        if (r!=_m.nrows) {
-            cerr << rperm_filename << " only contains " << r << " entries, " 
-                 << " not " << _m.nrows << std::endl;
+        if (!yasmic::load_permutation(rperm_filename, _m.nrows, irperm)) {
             return (false);
         }
 
@@ -779,35 +1293,13 @@ bool matrix_canvas::load_permutations(const std::string& rperm_filename,
     if (!cperm_filename.empty())
     {
         YASMIC_VERBOSE( cerr << "reading " << cperm_filename << endl; )
-        filtered_ifstream ios_fifs;
-        ifstream ifs(cperm_filename.c_str());
-
-        if (util::gzip_header(ifs))
-        {
-            ifs.seekg(0, ios::beg);
-            ios_fifs.push(boost::iostreams::gzip_decompressor());
-            YASMIC_VERBOSE(  cerr << "detected gzip" << endl; )
+        if (!yasmic::load_permutation(cperm_filename, _m.ncols, icperm)) {
+            return (false);
         }
 
-        ios_fifs.push(ifs);
-
-        string line;
-
         cperm.resize(_m.ncols);
-        icperm.resize(_m.ncols);
-
-        index_type c;
-        for (c=0; c<_m.ncols && !ios_fifs.eof(); ++c) {
-            index_type p;
-            ifs >> p;
-            icperm[c]=p;
-            cperm[p]=c;
-        }
-
-        if (c!=_m.ncols) {
-            cerr << cperm_filename << " only contains " << c << " entries, " 
-                 << " not " << _m.ncols << std::endl;
-            return (false);
+        if (_m.ncols > 0) {
+            yasmic::invert_permutation(&icperm[0], _m.ncols, &cperm[0]);
         }
 
         cperm_loaded = true;
@@ -831,59 +1323,276 @@ bool matrix_canvas::load_labels(const std::string& rlabel_filename,
         return (false);
     }
 
-    // use all the boost iostreams stuff loaded from the load_crm_matrix.hpp
-    // header file
-    typedef boost::iostreams::filtering_stream<
-                boost::iostreams::input_seekable> 
-        filtered_ifstream;
-
     if (!rlabel_filename.empty())
     {
         YASMIC_VERBOSE( cerr << "reading " << rlabel_filename << endl; )
-        filtered_ifstream ios_fifs;
-        ifstream ifs(rlabel_filename.c_str());
+        if (!rlabel.load(rlabel_filename)) {
+            return (false);
+        }
+        YASMIC_VERBOSE( cerr << "read " << rlabel.size() << " labels" << endl; )
+    }
 
-        if (util::gzip_header(ifs))
-        {
-            ifs.seekg(0, ios::beg);
-            ios_fifs.push(boost::iostreams::gzip_decompressor());
-            YASMIC_VERBOSE(  cerr << "detected gzip" << endl; )
+    if (!clabel_filename.empty())
+    {
+        YASMIC_VERBOSE( cerr << "reading " << clabel_filename << endl; )
+        if (!clabel.load(clabel_filename)) {
+            return (false);
         }
+        YASMIC_VERBOSE( cerr << "read " << clabel.size() << " labels" << endl; )
+    }
 
-        ios_fifs.push(ifs);
+    return (true);
+}
 
-        string line;
+/*
+ * =================
+ * background loading
+ * =================
+ */
 
-        while (!ios_fifs.eof()) {
-            getline(ios_fifs, line);
-            rlabel.push_back(line);
-        }
+void matrix_canvas::load_matrix_async(const load_request& r)
+{
+    if (loading)
+    {
+        std::cerr << "vismatrix : " << load_options.matrix_filename 
+                  << " is still loading" << std::endl;
+        return;
     }
 
-    if (!clabel_filename.empty())
+    clear_matrix();
+
+    load_options = r;
+    load_progress.reset(memory_limit == 0);
+    preview_nrows = 0;
+    preview_ncols = 0;
+    preview_version = 0;
+    loading = true;
+
+    data_panel.set_progress("loading " + r.matrix_filename, "", 0.0f);
+
+    if (!load_thread.start(load_thread_main, this))
+    {
+        // load on this thread and show the matrix at the first timer
+        run_load();
+    }
+
+    glutTimerFunc(load_timer_ms, glut_load_timer, get_glut_window_id());
+    glutPostRedisplay();
+}
+
+void matrix_canvas::load_thread_main(void *arg)
+{
+    ((matrix_canvas*)arg)->run_load();
+}
+
+/**
+ * Load everything in load_options.  This runs on the loading thread 
+ * and must not touch the window.
+ */
+void matrix_canvas::run_load()
+{
+    const load_request& r = load_options;
+
+    bool ok = true;
+    std::string error;
+    if (!load_matrix(r.matrix_filename, r.symmetrize, r.use_cache)) 
+    {
+        ok = false;
+        error = "error loading matrix";
+    }
+    else if (!load_permutations(r.rperm_filename, r.cperm_filename)) 
+    {
+        ok = false;
+        error = "error loading permutations";
+    }
+    else if (!load_labels(r.rlabel_filename, r.clabel_filename))
+    {
+        ok = false;
+        error = "error loading labels";
+    }
+
+    load_progress.finish(ok, error);
+}
+
+void matrix_canvas::glut_load_timer(int id)
+{
+    glut_window<glut_2d_canvas>* w = 
+        (glut_window<glut_2d_canvas>*)get_window_data(id);
+    if (w) 
+    {
+        static_cast<matrix_canvas*>(static_cast<glut_2d_canvas*>(w))->check_load();
+    }
+}
+
+/**
+ * Update the window with the progress of the load.  This is called 
+ * from a GLUT timer on the display thread until the load finishes.
+ */
+void matrix_canvas::check_load()
+{
+    if (!loading) { return; }
+
+    matrix_load_progress::status s = load_progress.get_status();
+    if (s.finished)
     {
-        YASMIC_VERBOSE(  cerr << "reading " << clabel_filename << endl; )
-        filtered_ifstream ios_fifs;
-        ifstream ifs(clabel_filename.c_str());
+        finish_load(s);
+        return;
+    }
+
+    if (s.nrows != preview_nrows || s.ncols != preview_ncols)
+    {
+        // the loader found the size of the matrix
+        preview_nrows = s.nrows;
+        preview_ncols = s.ncols;
+        init_window(preview_nrows, preview_ncols);
+        reshape(width, height);
+    }
 
-        if (util::gzip_header(ifs))
+    data_panel.set_progress("loading " + load_options.matrix_filename, 
+        s.stage, s.fraction);
+
+    if (s.version != preview_version)
+    {
+        preview_version = s.version;
+        glutSetWindow(get_glut_window_id());
+        glutPostRedisplay();
+    }
+
+    glutTimerFunc(load_timer_ms, glut_load_timer, get_glut_window_id());
+}
+
+/**
+ * Show the matrix from a finished load, or report the error.
+ */
+void matrix_canvas::finish_load(const matrix_load_progress::status& s)
+{
+    using namespace std;
+
+    load_thread.join();
+    loading = false;
+    data_panel.clear_progress();
+
+    if (!s.ok)
+    {
+        if (load_options.exit_on_error)
         {
-            ifs.seekg(0, ios::beg);
-            ios_fifs.push(boost::iostreams::gzip_decompressor());
-            YASMIC_VERBOSE(  cerr << "detected gzip" << endl; )
+            cerr << "vismatrix : " << s.error << ", terminating..." << endl;
+            exit(-1);
         }
+        cerr << "vismatrix : " << s.error << endl;
+        clear_matrix();
+    }
+    else
+    {
+        matrix_loaded = true;
+        init_window(_m.nrows, _m.ncols);
+        reshape(width, height);
+        data_cursor.set_matrix_size(_m.nrows, _m.ncols);
+    }
+
+    glutSetWindow(get_glut_window_id());
+    glutPostRedisplay();
+}
+
+/**
+ * Forget the current matrix along with its permutations and labels.
+ */
+void matrix_canvas::clear_matrix()
+{
+    matrix_loaded = false;
 
-        ios_fifs.push(ifs);
+    tiles.close();
+    points.clear();
+    density.clear();
+    raster.clear();
+    texture_tiles.clear();
+    std::vector<index_type>().swap(row_extent);
+    row_extent_key = -1;
+    row_columns_sorted = false;
+    _m.clear();
+
+    std::vector<value_type>().swap(rnorm_data);
+    std::vector<value_type>().swap(cnorm_data);
+    rnorm = 0;
+    cnorm = 0;
+
+    std::vector<index_type>().swap(irperm);
+    std::vector<index_type>().swap(cperm);
+    std::vector<index_type>().swap(icperm);
+    rperm_loaded = false;
+    cperm_loaded = false;
+    permutation_state = no_permutation;
+
+    rlabel.clear();
+    clabel.clear();
+}
 
-        string line;
+/*
+ * =================
+ * open file dialog
+ * =================
+ */
 
-        while (!ios_fifs.eof()) {
-            getline(ios_fifs, line);
-            clabel.push_back(line);
-        }
+/**
+ * Show a GLUI window to pick a file.  The controls keep the id of 
+ * the canvas window so the callbacks can find the canvas.
+ */
+void matrix_canvas::open_file_dialog()
+{
+    if (open_file_window) { return; }
+
+    open_file_window = GLUI_Master.create_glui("Open File");
+    GLUI_FileBrowser *fb = new GLUI_FileBrowser(open_file_window, "", 
+        GLUI_PANEL_NONE, get_glut_window_id(), glui_open_file);
+    fb->set_w(300);
+    fb->set_h(300);
+    new GLUI_Button(open_file_window, "Cancel", get_glut_window_id(), 
+        glui_cancel_open_file);
+    open_file_window->set_main_gfx_window(get_glut_window_id());
+}
+
+void matrix_canvas::glui_open_file(GLUI_Control *c)
+{
+    GLUI_FileBrowser *fb = dynamic_cast<GLUI_FileBrowser*>(c);
+    glut_window<glut_2d_canvas>* w = 
+        (glut_window<glut_2d_canvas>*)get_window_data(c->get_id());
+    if (fb && w) 
+    {
+        static_cast<matrix_canvas*>(static_cast<glut_2d_canvas*>(w))
+            ->open_file(fb->get_file());
     }
+}
 
-    return (true);
+void matrix_canvas::glui_cancel_open_file(GLUI_Control *c)
+{
+    glut_window<glut_2d_canvas>* w = 
+        (glut_window<glut_2d_canvas>*)get_window_data(c->get_id());
+    if (w) 
+    {
+        static_cast<matrix_canvas*>(static_cast<glut_2d_canvas*>(w))
+            ->open_file("");
+    }
+}
+
+/**
+ * Close the open file dialog and load filename, if it is not empty, 
+ * with the options of the last load.
+ */
+void matrix_canvas::open_file(const std::string& filename)
+{
+    if (open_file_window) 
+    {
+        open_file_window->close();
+        open_file_window = 0;
+    }
+
+    if (filename.empty()) { return; }
+
+    load_request r;
+    r.matrix_filename = filename;
+    r.symmetrize = load_options.symmetrize;
+    r.use_cache = load_options.use_cache;
+    load_matrix_async(r);
 }
 
 /*
@@ -913,6 +1622,7 @@ void matrix_canvas::set_colormap(colormap_state_type c)
 {
     // at the moment, we don't have any support for a user colormap
     if (c == user_colormap) { c = rainbow_colormap; }
+    colormap_state = c;
     switch (c)
     {
     case rainbow_colormap:
@@ -969,7 +1679,7 @@ void matrix_canvas::init_menu()
     // create the main menu
     glutCreateMenu(glut_menu);
 
-    //glutAddMenuEntry("Open File...", menu_file_id);
+    glutAddMenuEntry("Open File...", menu_file_id);
     glutAddMenuEntry("Toggle Cursor", menu_toggle_cursor_id);
     glutAddSubMenu("Aspect Ratio", submenu_aspect_ratio);
     glutAddSubMenu("Colormap", submenu_colormap);
@@ -1000,6 +1710,7 @@ void matrix_canvas::menu(int value)
     switch (value)
     {
     case menu_file_id:
+        open_file_dialog();
         break;
 
     case menu_toggle_cursor_id:
@@ -1081,7 +1792,6 @@ void matrix_canvas::menu(int value)
     }
 
     if (update_screen) {
-        display_finished = true; 
         glutPostRedisplay();
     }
 }
@@ -2,50 +2,120 @@
 #define MATRIX_CANVAS_HPP
 
 #include <string>
+#include <algorithm>
 #include <limits>
 #include <cmath>
 #include <vector>
+#include <cstdio>
 
 #include "xplat_gl.h"
 
+#include <boost/cstdint.hpp>
+
+#include "sparse_matrix.hpp"
+#include "matrix_tiles.hpp"
+#include "matrix_point_buffer.hpp"
+#include "matrix_density_pyramid.hpp"
+#include "matrix_raster_image.hpp"
+#include "matrix_texture_tiles.hpp"
+#include "matrix_load_progress.hpp"
+#include "matrix_labels.hpp"
+
 #include "glut_2d_canvas.h"
 #include "matrix_data_panel.hpp"
 #include "matrix_data_cursor.hpp"
 
-/**
- * A lightweight wrapper class to implement a sparse matrix as
- * a small set of variables.
- */
-template <class index_type, class value_type>
-struct sparse_matrix 
-{
-    std::vector<index_type> ai;
-    std::vector<index_type> aj;
-    std::vector<value_type> a;
-    index_type nrows;
-    index_type ncols;
-    index_type nnz;
-};
-
-
 /**
  * The matrix_canvas assumes that the matrix
- * can be stored in memory.  It loads a matrix_data_cursor and a 
+ * can be stored in memory, unless it has a memory limit, in which
+ * case it draws the matrix from the tiles of a .vmtiles file (see 
+ * matrix_tiles.hpp).  It loads a matrix_data_cursor and a 
  * matrix_data_panel to handle other details of the implementation.
+ *
+ * With load_matrix_async, the matrix loads on a background thread
+ * while the window is open.  Until it is done, the canvas draws the 
+ * nonzeros read so far (see matrix_load_progress.hpp) and the data 
+ * panel shows a progress bar.
  */
 class matrix_canvas
     : public glut_2d_canvas
 {
 protected:
     typedef int index_type;
+    typedef boost::int64_t nz_index_type;
     typedef double value_type;
     typedef glut_2d_canvas super;
 
-    // large_scale_nz controls when we build the matrix _m_fast to draw
-    // quickly and then ``fill in'' later
+    // a matrix with more than large_scale_nz nonzeros is drawn from the
+    // density pyramid and the texture tiles when it is zoomed out
     const static int large_scale_nz = 524288;
 
-    sparse_matrix<index_type, value_type> _m;
+    typedef sparse_matrix<index_type, nz_index_type, value_type> matrix_type;
+
+    // with tiles, _m only holds the size of the matrix
+    matrix_type _m;
+    matrix_tiles tiles;
+    boost::uint64_t memory_limit;
+
+    // the nonzeros of _m as points in vertex buffer objects
+    matrix_point_buffer points;
+
+    // the nonzeros of _m summed over cells for zoomed out views, and
+    // the visible cells of the last frame
+    matrix_density_pyramid density;
+    std::vector<GLfloat> density_xy;
+    std::vector<GLubyte> density_rgba;
+
+    // the first and last display column of each row of _m, for the
+    // column permutation in row_extent_key, and whether the columns of
+    // every row are sorted
+    std::vector<index_type> row_extent;
+    int row_extent_key;
+    bool row_columns_sorted;
+
+    // the visible nonzeros rasterized on the CPU
+    matrix_raster_image raster;
+
+    // how nonzeros are binned on pixels and colored, see set_pixel_style
+    struct pixel_style_type
+    {
+        bool rperm, cperm, rnorm, cnorm, invert;
+        value_type min_val, inv_val_range;
+        std::vector<GLubyte> colormap;
+        GLubyte alpha[256];
+
+        /** Color a pixel from its value and the nonzeros on it. */
+        void color(value_type v, boost::uint32_t count, GLubyte *rgba) const
+        {
+            // scale the value to the range [0,1]
+            int ncolors = (int)colormap.size()/3;
+            v = (v - min_val)*inv_val_range;
+            int e = (int)(v*(ncolors-1));
+            e = std::max(0, std::min(e, ncolors-1));
+            if (invert) { e = ncolors-1-e; }
+
+            rgba[0] = colormap[3*e];
+            rgba[1] = colormap[3*e+1];
+            rgba[2] = colormap[3*e+2];
+            rgba[3] = alpha[std::min<boost::uint32_t>(count, 255)];
+        }
+    };
+
+    // the display rows and columns on the pixels of a matrix_pixel_bins:
+    // pixel (px,py) holds the rows from y0 + py/sy to y0 + (py+1)/sy and
+    // the columns from x0 + px/sx to x0 + (px+1)/sx, and only the rows
+    // r0 to r1-1 and columns c0 to c1-1 are binned
+    struct pixel_window_type
+    {
+        double x0, y0, sx, sy;
+        boost::int64_t r0, r1, c0, c1;
+    };
+
+    // how the texture tiles are rendered, only changed while the render
+    // thread is idle, and its scratch bins
+    pixel_style_type texture_style;
+    matrix_pixel_bins texture_bins;
+    bool texture_timer_set;
 
     std::vector<index_type> irperm;
     std::vector<index_type> cperm;
@@ -53,10 +123,12 @@ protected:
     bool rperm_loaded;
     bool cperm_loaded;
 
-    std::vector<std::string> rlabel;
-    std::vector<std::string> clabel;
-    std::vector<value_type> rnorm;
-    std::vector<value_type> cnorm;
+    matrix_labels rlabel;
+    matrix_labels clabel;
+    std::vector<value_type> rnorm_data;
+    std::vector<value_type> cnorm_data;
+    const value_type *rnorm;
+    const value_type *cnorm;
 
     struct {
         value_type min_val;
@@ -68,6 +140,34 @@ protected:
     std::string matrix_filename;
     bool matrix_loaded;
 
+public:
+    /** The files and options for load_matrix_async. */
+    struct load_request
+    {
+        std::string matrix_filename;
+        bool symmetrize;
+        bool use_cache;
+        std::string rperm_filename, cperm_filename;
+        std::string rlabel_filename, clabel_filename;
+        bool exit_on_error;
+
+        load_request() 
+        : symmetrize(false), use_cache(true), exit_on_error(false) {}
+    };
+
+protected:
+    // the background load, everything but load_progress is only used
+    // by the display thread
+    load_request load_options;
+    matrix_load_progress load_progress;
+    util::thread load_thread;
+    bool loading;
+    index_type preview_nrows;
+    index_type preview_ncols;
+    unsigned int preview_version;
+
+    GLUI *open_file_window;
+
     GLuint matrix_display_list;
 
 public:
@@ -105,6 +205,13 @@ public:
         row_column_normalization=3
     };
 
+    enum value_storage_type {
+        auto_values=0,
+        no_values=1,
+        float_values=2,
+        double_values=3
+    };
+
     enum colormap_state_type {
         first_colormap=1,
         user_colormap=1,
@@ -125,8 +232,28 @@ public:
 
     void home();
     
-    void set_permutation(permutation_state_type p) { permutation_state = p; }
+    /** Set a permutation, if the permutation vectors it uses are loaded. */
+    void set_permutation(permutation_state_type p) 
+    { 
+        if (!matrix_loaded) { return; }
+        if ((p & row_permutation) && !rperm_loaded) { return; }
+        if ((p & column_permutation) && !cperm_loaded) { return; }
+        permutation_state = p; 
+    }
     void set_normalization(normalization_state_type n) { normalization_state = n; }
+    void set_value_storage(value_storage_type v) { value_storage = v; }
+
+    /** 
+     * Store the column indices of the matrix as varint gaps, which 
+     * takes less memory and draws a little slower.
+     */
+    void set_compress_columns(bool c) { compress_columns = c; }
+
+    /** 
+     * Keep at most bytes of the matrix in memory by drawing it from
+     * tiles; 0 loads the entire matrix. 
+     */
+    void set_memory_limit(boost::uint64_t bytes) { memory_limit = bytes; }
        
     colormap_state_type get_colormap();
     void set_colormap(colormap_state_type c);
@@ -136,8 +263,18 @@ public:
     { border_color[0]=r; border_color[1]=g; border_color[2]=b; }
 
     // data loading
+    
+    /**
+     * Load the matrix, permutations, and labels on a background thread
+     * and show the matrix when they are done.  This replaces the current
+     * matrix.  If r.exit_on_error is set, the program exits if the 
+     * load fails.
+     */
+    void load_matrix_async(const load_request& r);
+    bool is_loading() { return (loading); }
+
     bool load_matrix(const std::string& filename,
-        bool symmetrize = false);
+        bool symmetrize = false, bool use_cache = true);
     bool load_permutations(const std::string& rperm_filename,
         const std::string& cperm_filename);
     bool load_labels(const std::string& rlabel_filename,
@@ -145,23 +282,111 @@ public:
 
 protected:
     // matrix drawing
-    void draw_full_matrix();
     void draw_partial_matrix(int r1, int c1, int r2, int c2);
 
-    template <bool partial, class NRMap, class NCMap, class PRMap, class PCMap>
-    void draw_matrix(int r1, int c1, int r2, int c2,
+    void draw_tiled_matrix(int r1, int c1, int r2, int c2);
+    void draw_border(int m, int n);
+
+    template <bool partial, class RowPtr, class Columns, class ValMap, 
+              class NRMap, class NCMap, class PRMap, class PCMap>
+    void draw_matrix(const matrix_type& m, int r1, int c1, int r2, int c2,
+        value_type min, value_type inv_val_range, float alpha,
+        const RowPtr* ai, Columns cols, ValMap vals, NRMap nrv, NCMap ncv, 
+        PRMap iprm, PCMap pcm);
+
+    template <bool partial, class RowPtr, class Columns, class ValMap, 
+              class NRMap, class NCMap>
+    void draw_matrix_dispatch(const matrix_type& m, int r1, int c1, int r2, int c2,
         value_type min, value_type inv_val_range, float alpha,
-        NRMap nrv, NCMap ncv, PRMap iprm, PCMap pcm);
+        const RowPtr* ai, Columns cols, ValMap vals, NRMap nrv, NCMap ncv);
+
+    template <bool partial, class Columns, class ValMap, class NRMap, class NCMap>
+    void draw_matrix_dispatch(const matrix_type& m, int r1, int c1, int r2, int c2,
+        value_type min, value_type inv_val_range, float alpha,
+        Columns cols, ValMap vals, NRMap nrv, NCMap ncv);
+
+    template <bool partial, class ValMap, class NRMap, class NCMap>
+    void draw_matrix_dispatch(const matrix_type& m, int r1, int c1, int r2, int c2,
+        value_type min, value_type inv_val_range, float alpha,
+        ValMap vals, NRMap nrv, NCMap ncv);
 
     template <bool partial, class NRMap, class NCMap>
-    void draw_matrix_dispatch(int r1, int c1, int r2, int c2,
+    void draw_matrix_dispatch(const matrix_type& m, int r1, int c1, int r2, int c2,
         value_type min, value_type inv_val_range, float alpha,
         NRMap nrv, NCMap ncv);
 
     template <bool partial>
-    void draw_matrix_dispatch(int r1, int c1, int r2, int c2);
+    void draw_matrix_dispatch(const matrix_type& m, int r1, int c1, int r2, int c2);
+
+    void color_range(value_type& min_val, value_type& inv_val_range);
+
+    bool update_row_extents();
+    template <class Columns>
+    void fill_row_extents(Columns cols);
+    const index_type* row_extents_of(const matrix_type& m, bool column_permuted,
+        bool& sorted);
+
+    // vertex buffer objects, see matrix_canvas_points.cc
+    bool update_point_buffer();
+    template <class Columns>
+    void fill_point_positions(Columns cols, GLfloat *xy);
+    template <class Columns>
+    void fill_point_colors(Columns cols, GLubyte *rgb);
+
+    // density pyramid, see matrix_canvas_density.cc
+    bool update_density_pyramid();
+    template <class Columns>
+    void fill_density(Columns cols);
+    bool draw_density(float x1, float y1, float x2, float y2, float ppu);
+
+    // CPU rasterizer and the binning of nonzeros on pixels that the
+    // texture tiles share, see matrix_canvas_raster.cc
+    bool draw_raster(float x1, float y1, float x2, float y2, float ppu);
+    void set_pixel_style(pixel_style_type& s, float alpha);
+    void bin_pixels(const pixel_style_type& s, const pixel_window_type& w,
+        matrix_pixel_bins& bins);
+    void bin_matrix_pixels(const matrix_type& m, const pixel_style_type& s,
+        const pixel_window_type& w, matrix_pixel_bins& bins);
+    template <class Columns>
+    void bin_matrix_pixels(const matrix_type& m, Columns cols,
+        const pixel_style_type& s, const pixel_window_type& w,
+        matrix_pixel_bins& bins);
+    static long color_pixels(const pixel_style_type& s,
+        const matrix_pixel_bins& bins, GLubyte *rgba);
+
+    // texture tile cache, see matrix_canvas_texture_tiles.cc
+    bool draw_texture_tiles(float x1, float y1, float x2, float y2, float ppu);
+    void update_texture_style(float alpha);
+    static bool render_texture_tile(void *arg, int level, int tr, int tc,
+        GLubyte *rgba);
+    bool render_texture_tile(int level, int tr, int tc, GLubyte *rgba);
+    static void glut_texture_timer(int id);
 
     void write_svg();
+    void write_svg_matrix(FILE *svgfile, const matrix_type& m, 
+        int r1, int c1, int r2, int c2,
+        value_type min_val, value_type inv_val_range, float alpha, float onepx);
+    template <class Columns>
+    void write_svg_matrix(FILE *svgfile, const matrix_type& m, Columns cols,
+        int r1, int c1, int r2, int c2,
+        value_type min_val, value_type inv_val_range, float alpha, float onepx);
+
+    // binary matrix cache
+    std::string cache_filename();
+    bool load_matrix_cache(bool symmetrize);
+    bool write_matrix_cache(bool symmetrize);
+
+    // out-of-core tiles
+    std::string tiles_filename();
+    bool load_matrix_tiles(bool symmetrize);
+    bool write_matrix_tiles(bool symmetrize);
+    bool load_tiled_matrix(bool symmetrize, bool use_cache);
+
+    void pack_matrix_columns();
+
+    template <class Value>
+    bool load_packed_matrix(std::vector<Value>& vals, bool symmetrize, 
+        bool& unit_values);
 
     float alpha_from_zoom();
 
@@ -173,6 +398,8 @@ protected:
 
     permutation_state_type permutation_state;
     normalization_state_type normalization_state;
+    value_storage_type value_storage;
+    bool compress_columns;
     colormap_state_type colormap_state;
     bool colormap_invert;
 
@@ -185,16 +412,29 @@ protected:
 
     float border_color[3];
 
+    // background loading
+    static void load_thread_main(void *arg);
+    static void glut_load_timer(int id);
+    void run_load();
+    void check_load();
+    void finish_load(const matrix_load_progress::status& s);
+    void clear_matrix();
+    void draw_preview();
+
+    // the open file dialog
+    void open_file_dialog();
+    static void glui_open_file(GLUI_Control *c);
+    static void glui_cancel_open_file(GLUI_Control *c);
+    void open_file(const std::string& filename);
+
     // internal functions
-    void init_window();
+    void init_window(index_type nrows, index_type ncols);
     void init_display_list();   
     void init_menu();
 
     value_type matrix_value(index_type r, index_type c);
-    const std::string& row_label(index_type r);
-    const std::string& column_label(index_type r);
-
-    const std::string empty_label;
+    util::string_ref row_label(index_type r) { return (rlabel[r]); }
+    util::string_ref column_label(index_type c) { return (clabel[c]); }
 
     const static int menu_file_id = 1;
     const static int menu_exit_id = 2;
@@ -215,6 +455,9 @@ protected:
     const static int menu_colors_black_bkg = 2002;
     
 
+    const static int load_timer_ms = 200;
+    const static int texture_timer_ms = 50;
+
     const static int panel_offset = 5;
     const static int panel_height = 50;
     
@@ -225,6 +468,10 @@ protected:
     // put everything I want constructed last here
     matrix_data_panel data_panel;
     matrix_data_cursor data_cursor;
+
+    // tiles of the display rendered on a background thread, last so
+    // the thread stops before anything it reads is destroyed
+    matrix_texture_tiles texture_tiles;
 };
 
 #endif // MATRIX_CANVAS_HPP
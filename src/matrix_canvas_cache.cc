@@ -0,0 +1,361 @@
+/**
+ * @file matrix_canvas_cache.cc
+ * Functions to save the packed and sorted matrix as a binary cache
+ * file and to memory map it on later runs, and to open the tiles of
+ * a matrix from a .vmtiles file.
+ */
+
+/*
+ * The cache file is the name of the matrix with ".vmcache" appended.
+ * It holds a matrix_cache_header followed by the arrays
+ *
+ *   ai     (nrows+1) index_type or nz_index_type (see offset_size)
+ *   aj     nnz index_type
+ *   a      nnz values of value_size bytes (none for a pattern)
+ *   rnorm  nrows value_type
+ *   cnorm  ncols value_type
+ *
+ * each of which starts at an offset aligned to cache_alignment bytes,
+ * so the canvas can use them directly from the mapped file.  The
+ * cache is only used if the size and modification time of the matrix
+ * file, the symmetrize flag, and the requested value storage match the
+ * values stored in the header.
+ */
+
+#include "matrix_canvas.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+
+#include <boost/cstdint.hpp>
+
+namespace {
+
+const char cache_magic[8] = { 'V','M','C','A','C','H','E','\0' };
+const boost::uint32_t cache_version = 3;
+const boost::uint32_t cache_byte_order = 0x01020304;
+const boost::uint64_t cache_alignment = 64;
+
+struct matrix_cache_header
+{
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t byte_order;
+    boost::uint32_t index_size;
+    boost::uint32_t value_size;
+    boost::uint32_t symmetrize;
+    boost::uint32_t offset_size;
+    boost::uint32_t value_storage;
+    boost::uint32_t reserved;
+
+    boost::uint64_t source_size;
+    boost::int64_t source_mtime;
+
+    boost::int64_t nrows;
+    boost::int64_t ncols;
+    boost::int64_t nnz;
+
+    double min_val;
+    double max_val;
+    boost::int64_t min_degree;
+    boost::int64_t max_degree;
+
+    boost::uint64_t ai_offset;
+    boost::uint64_t aj_offset;
+    boost::uint64_t a_offset;
+    boost::uint64_t rnorm_offset;
+    boost::uint64_t cnorm_offset;
+    boost::uint64_t file_size;
+};
+
+boost::uint64_t cache_align(boost::uint64_t off)
+{
+    return ((off + cache_alignment - 1)/cache_alignment*cache_alignment);
+}
+
+/**
+ * Fill in the offsets of the arrays for a matrix.  The row pointers
+ * take h.offset_size bytes each and the values h.value_size bytes.
+ */
+template <class index_type, class value_type>
+void cache_layout(matrix_cache_header& h)
+{
+    boost::uint64_t off = cache_align(sizeof(matrix_cache_header));
+    h.ai_offset = off;
+    off = cache_align(off + (boost::uint64_t)h.offset_size*(h.nrows+1));
+    h.aj_offset = off;
+    off = cache_align(off + sizeof(index_type)*h.nnz);
+    h.a_offset = off;
+    off = cache_align(off + (boost::uint64_t)h.value_size*h.nnz);
+    h.rnorm_offset = off;
+    off = cache_align(off + sizeof(value_type)*h.nrows);
+    h.cnorm_offset = off;
+    off = off + sizeof(value_type)*h.ncols;
+    h.file_size = off;
+}
+
+/**
+ * Write an array at offset, after zero padding from the current 
+ * position pos.  On return, pos is the position after the array.
+ */
+bool write_cache_array(FILE *f, boost::uint64_t& pos, boost::uint64_t offset,
+    const void *data, size_t size)
+{
+    static const char zeros[cache_alignment] = { 0 };
+    if (pos > offset || offset - pos > cache_alignment) { return (false); }
+    size_t pad = (size_t)(offset - pos);
+    if (pad > 0 && fwrite(zeros, 1, pad, f) != pad) { return (false); }
+    if (size > 0 && fwrite(data, 1, size, f) != size) { return (false); }
+    pos = offset + size;
+    return (true);
+}
+
+}
+
+std::string matrix_canvas::cache_filename()
+{
+    return (matrix_filename + ".vmcache");
+}
+
+/**
+ * Load the matrix from the cache file if it exists and is up to date.
+ *
+ * On success, the arrays of _m, rnorm, and cnorm point into the
+ * mapped file, and matrix_stats is filled in.
+ *
+ * @param symmetrize the value of the symmetrize flag for this matrix
+ * @return true if the matrix was loaded from the cache
+ */
+bool matrix_canvas::load_matrix_cache(bool symmetrize)
+{
+    boost::uint64_t source_size;
+    boost::int64_t source_mtime;
+    if (!matrix_source_info(matrix_filename, source_size, source_mtime)) {
+        return (false);
+    }
+
+    util::mapped_file& f = _m.cache_file;
+    if (!f.open(cache_filename())) {
+        return (false);
+    }
+
+    matrix_cache_header h;
+    if (f.size() < sizeof(h)) { f.close(); return (false); }
+    memcpy(&h, f.data(), sizeof(h));
+
+    matrix_cache_header expect = h;
+    cache_layout<index_type, value_type>(expect);
+
+    if (memcmp(h.magic, cache_magic, sizeof(cache_magic)) != 0
+        || h.version != cache_version
+        || h.byte_order != cache_byte_order
+        || h.index_size != sizeof(index_type)
+        || (h.value_size != 0 && h.value_size != sizeof(float)
+            && h.value_size != sizeof(value_type))
+        || (h.offset_size != sizeof(index_type)
+            && h.offset_size != sizeof(nz_index_type))
+        || h.nrows < 0 || h.ncols < 0 || h.nnz < 0
+        || h.ai_offset != expect.ai_offset
+        || h.aj_offset != expect.aj_offset
+        || h.a_offset != expect.a_offset
+        || h.rnorm_offset != expect.rnorm_offset
+        || h.cnorm_offset != expect.cnorm_offset
+        || h.file_size != expect.file_size
+        || (boost::uint64_t)f.size() < h.file_size)
+    {
+        YASMIC_VERBOSE( std::cerr << "ignoring invalid matrix cache "
+            << cache_filename() << std::endl; )
+        f.close();
+        return (false);
+    }
+
+    if (h.source_size != source_size || h.source_mtime != source_mtime
+        || h.symmetrize != (boost::uint32_t)symmetrize
+        || h.value_storage != (boost::uint32_t)value_storage)
+    {
+        YASMIC_VERBOSE( std::cerr << "ignoring out of date matrix cache "
+            << cache_filename() << std::endl; )
+        f.close();
+        return (false);
+    }
+
+    _m.ai_data.clear();
+    _m.ai_wide_data.clear();
+    _m.aj_data.clear();
+    _m.drop_packed_columns();
+    _m.drop_values();
+    rnorm_data.clear();
+    cnorm_data.clear();
+
+    _m.nrows = (index_type)h.nrows;
+    _m.ncols = (index_type)h.ncols;
+    _m.nnz = (nz_index_type)h.nnz;
+    _m.ai = 0;
+    _m.ai_wide = 0;
+    if (h.offset_size == sizeof(index_type)) {
+        _m.ai = (const index_type*)(f.data() + h.ai_offset);
+    } else {
+        _m.ai_wide = (const nz_index_type*)(f.data() + h.ai_offset);
+    }
+    _m.aj = (const index_type*)(f.data() + h.aj_offset);
+    _m.a = 0;
+    _m.a_float = 0;
+    if (h.value_size == sizeof(value_type)) {
+        _m.a = (const value_type*)(f.data() + h.a_offset);
+    } else if (h.value_size == sizeof(float)) {
+        _m.a_float = (const float*)(f.data() + h.a_offset);
+    }
+    rnorm = (const value_type*)(f.data() + h.rnorm_offset);
+    cnorm = (const value_type*)(f.data() + h.cnorm_offset);
+
+    matrix_stats.min_val = (value_type)h.min_val;
+    matrix_stats.max_val = (value_type)h.max_val;
+    matrix_stats.min_degree = (index_type)h.min_degree;
+    matrix_stats.max_degree = (index_type)h.max_degree;
+
+    return (true);
+}
+
+/**
+ * Write the current matrix to the cache file.
+ *
+ * The file is written to a temporary name and then renamed, so
+ * another vismatrix never maps a partially written cache.
+ *
+ * @param symmetrize the value of the symmetrize flag for this matrix
+ * @return true if the cache was written
+ */
+bool matrix_canvas::write_matrix_cache(bool symmetrize)
+{
+    matrix_cache_header h;
+    memset(&h, 0, sizeof(h));
+
+    if (!matrix_source_info(matrix_filename, h.source_size, h.source_mtime)) {
+        return (false);
+    }
+
+    memcpy(h.magic, cache_magic, sizeof(cache_magic));
+    h.version = cache_version;
+    h.byte_order = cache_byte_order;
+    h.index_size = sizeof(index_type);
+    h.value_size = _m.a ? sizeof(value_type) : (_m.a_float ? sizeof(float) : 0);
+    h.symmetrize = symmetrize;
+    h.offset_size = _m.ai_wide ? sizeof(nz_index_type) : sizeof(index_type);
+    h.value_storage = value_storage;
+
+    h.nrows = _m.nrows;
+    h.ncols = _m.ncols;
+    h.nnz = _m.nnz;
+
+    h.min_val = matrix_stats.min_val;
+    h.max_val = matrix_stats.max_val;
+    h.min_degree = matrix_stats.min_degree;
+    h.max_degree = matrix_stats.max_degree;
+
+    cache_layout<index_type, value_type>(h);
+
+    std::string tempname = cache_filename() + ".tmp";
+    FILE *f = fopen(tempname.c_str(), "wb");
+    if (!f) {
+        YASMIC_VERBOSE( std::cerr << "cannot write matrix cache "
+            << tempname << std::endl; )
+        return (false);
+    }
+
+    boost::uint64_t pos = sizeof(h);
+    bool rval = fwrite(&h, sizeof(h), 1, f) == 1
+        && write_cache_array(f, pos, h.ai_offset, 
+                _m.ai_wide ? (const void*)_m.ai_wide : (const void*)_m.ai,
+                (size_t)h.offset_size*(_m.nrows+1))
+        && write_cache_array(f, pos, h.aj_offset, _m.aj,
+                (size_t)(sizeof(index_type)*_m.nnz))
+        && write_cache_array(f, pos, h.a_offset, 
+                _m.a ? (const void*)_m.a : (const void*)_m.a_float,
+                (size_t)h.value_size*_m.nnz)
+        && write_cache_array(f, pos, h.rnorm_offset, rnorm,
+                sizeof(value_type)*_m.nrows)
+        && write_cache_array(f, pos, h.cnorm_offset, cnorm,
+                sizeof(value_type)*_m.ncols);
+
+    rval = (fclose(f) == 0) && rval;
+
+    if (rval) {
+#ifdef _WIN32
+        // rename does not replace an existing file on windows
+        remove(cache_filename().c_str());
+#endif
+        rval = (rename(tempname.c_str(), cache_filename().c_str()) == 0);
+    }
+
+    if (!rval) {
+        std::cerr << "warning: cannot write matrix cache "
+                  << cache_filename() << std::endl;
+        remove(tempname.c_str());
+    }
+
+    return (rval);
+}
+
+std::string matrix_canvas::tiles_filename()
+{
+    return (matrix_filename + ".vmtiles");
+}
+
+/**
+ * Open the tiles of the matrix if the .vmtiles file exists and is 
+ * up to date, with the same checks as for the cache.
+ *
+ * On success, _m only holds the size of the matrix, rnorm and cnorm
+ * point into the tiles file, and matrix_stats is filled in.
+ *
+ * @param symmetrize the value of the symmetrize flag for this matrix
+ * @return true if the tiles were opened
+ */
+bool matrix_canvas::load_matrix_tiles(bool symmetrize)
+{
+    boost::uint64_t source_size;
+    boost::int64_t source_mtime;
+    if (!matrix_source_info(matrix_filename, source_size, source_mtime)) {
+        return (false);
+    }
+
+    if (!tiles.open(tiles_filename())) {
+        return (false);
+    }
+
+    const matrix_tile_source& src = tiles.source();
+    if (src.source_size != source_size || src.source_mtime != source_mtime
+        || src.symmetrize != (boost::uint32_t)symmetrize
+        || src.value_storage != (boost::uint32_t)value_storage)
+    {
+        YASMIC_VERBOSE( std::cerr << "ignoring out of date matrix tiles "
+            << tiles_filename() << std::endl; )
+        tiles.close();
+        return (false);
+    }
+
+    _m.cache_file.close();
+    _m.ai_data.clear();
+    _m.ai_wide_data.clear();
+    _m.aj_data.clear();
+    _m.drop_packed_columns();
+    _m.drop_values();
+    _m.use_data();
+    rnorm_data.clear();
+    cnorm_data.clear();
+
+    _m.nrows = tiles.nrows();
+    _m.ncols = tiles.ncols();
+    _m.nnz = tiles.nnz();
+    rnorm = tiles.rnorm();
+    cnorm = tiles.cnorm();
+
+    matrix_stats.min_val = tiles.min_val();
+    matrix_stats.max_val = tiles.max_val();
+    matrix_stats.min_degree = tiles.min_degree();
+    matrix_stats.max_degree = tiles.max_degree();
+
+    return (true);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file matrix_canvas_density.cc
+ * Draw a zoomed out view of the matrix from a density pyramid, so a
+ * frame costs about one cell per pixel instead of one point per
+ * nonzero.
+ */
+
+#include "matrix_canvas.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#include <util/parallel.hpp>
+
+/**
+ * Make the density pyramid match the current permutation and
+ * normalization.
+ *
+ * @return false if the matrix is drawn without a pyramid, because it
+ * is in tiles or small enough to draw every point
+ */
+bool matrix_canvas::update_density_pyramid()
+{
+    using namespace std;
+
+    if (tiles.is_open() || _m.nnz <= large_scale_nz) { return (false); }
+
+    int key = permutation_state + 4*normalization_state;
+    if (density.has_key(key)) { return (true); }
+
+    double t0 = util::wall_time();
+
+    density.start(_m.nrows, _m.ncols);
+    if (_m.aj_packed) {
+        fill_density(matrix_type::packed_columns(_m));
+    } else {
+        fill_density(matrix_type::raw_columns(_m));
+    }
+    density.finish(key);
+
+    cout << "built density pyramid with " << density.levels() << " levels in "
+         << util::wall_time() - t0 << endl;
+
+    return (true);
+}
+
+/**
+ * Add every nonzero to the cell of the first level of the pyramid at
+ * its place on the display.  Each thread fills whole rows of cells.
+ */
+template <class Columns>
+void matrix_canvas::fill_density(Columns cols)
+{
+    int s = density.shift(0);
+    index_type nbands = density.rows(0);
+    bool rperm = (permutation_state & row_permutation) != 0;
+    bool cperm_set = (permutation_state & column_permutation) != 0;
+    bool rnorm_set = (normalization_state & row_normalization) != 0;
+    bool cnorm_set = (normalization_state & column_normalization) != 0;
+
+    #pragma omp parallel
+    {
+        Columns c(cols);
+
+        #pragma omp for schedule(dynamic,1)
+        for (index_type b = 0; b < nbands; ++b)
+        {
+            density_cell *cells = density.row(0, b);
+            index_type pbegin = b << s;
+            index_type pend = (index_type)std::min<boost::int64_t>(_m.nrows,
+                                ((boost::int64_t)b + 1) << s);
+
+            for (index_type pi = pbegin; pi < pend; ++pi)
+            {
+                index_type i = rperm ? irperm[pi] : pi;
+
+                nz_index_type rend = _m.row_end(i);
+                c.start_row(i);
+                for (nz_index_type ri = _m.row_begin(i); ri < rend; ++ri)
+                {
+                    index_type j = c.next(ri);
+                    index_type pj = cperm_set ? cperm[j] : j;
+
+                    value_type v = _m.value(ri);
+                    if (rnorm_set) { v *= rnorm[i]; }
+                    if (cnorm_set) { v *= cnorm[j]; }
+
+                    cells[pj >> s].add((float)v);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Draw the part of the display from x1,y1 to x2,y2 with the level of
+ * the density pyramid whose cells are about a pixel.  Each cell is a
+ * square with the color of the mean of its values and the alpha of
+ * its nonzeros drawn on top of each other.
+ *
+ * @param ppu the pixels for each row and column of the matrix
+ * @return false if the view is drawn with the points
+ */
+bool matrix_canvas::draw_density(float x1, float y1, float x2, float y2,
+    float ppu)
+{
+    // only draw cells of at least 2 by 2 rows and columns
+    if (ppu <= 0.0f || ppu > 0.5f) { return (false); }
+    if (!update_density_pyramid()) { return (false); }
+
+    // the largest cells that are at most a pixel, or the first level
+    // if its cells are at most two pixels
+    int s = (int)std::floor(std::log(1.0/ppu)/std::log(2.0));
+    int l = std::max(0, std::min(s - density.shift(0), density.levels()-1));
+    s = density.shift(l);
+    if ((float)((boost::int64_t)1 << s)*ppu > 2.0f) { return (false); }
+
+    // the visible cells, row pi of the display is drawn from pi-0.5
+    // to pi+0.5
+    index_type nr = density.rows(l), nc = density.cols(l);
+    index_type r1 = std::max(0, (index_type)std::floor(y1+0.5f) >> s);
+    index_type r2 = std::min(nr-1, (index_type)std::floor(y2+0.5f) >> s);
+    index_type c1 = std::max(0, (index_type)std::floor(x1+0.5f) >> s);
+    index_type c2 = std::min(nc-1, (index_type)std::floor(x2+0.5f) >> s);
+    if (r1 > r2 || c1 > c2) { return (true); }
+
+    pixel_style_type style;
+    set_pixel_style(style, alpha_from_zoom());
+
+    // count the cells with nonzeros in each row, then fill them
+    index_type nrows = r2 - r1 + 1;
+    std::vector<boost::int64_t> start(nrows+1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (index_type r = r1; r <= r2; ++r)
+    {
+        const density_cell *cells = density.row(l, r);
+        boost::int64_t n = 0;
+        for (index_type c = c1; c <= c2; ++c) { n += (cells[c].count > 0); }
+        start[r-r1+1] = n;
+    }
+    for (index_type r = 0; r < nrows; ++r) { start[r+1] += start[r]; }
+
+    std::size_t ncells = (std::size_t)start[nrows];
+    density_xy.resize(2*ncells + 2);
+    density_rgba.resize(4*ncells + 4);
+
+    float size = (float)((boost::int64_t)1 << s);
+    float half = 0.5f*size - 0.5f;
+
+    #pragma omp parallel for schedule(static)
+    for (index_type r = r1; r <= r2; ++r)
+    {
+        const density_cell *cells = density.row(l, r);
+        GLfloat *xy = &density_xy[2*start[r-r1]];
+        GLubyte *rgba = &density_rgba[4*start[r-r1]];
+        for (index_type c = c1; c <= c2; ++c)
+        {
+            const density_cell& d = cells[c];
+            if (d.count == 0) { continue; }
+
+            *xy++ = (GLfloat)((boost::int64_t)c << s) + half;
+            *xy++ = (GLfloat)((boost::int64_t)r << s) + half;
+
+            // the color of the mean
+            style.color((value_type)d.sum/d.count, d.count, rgba);
+            rgba += 4;
+        }
+    }
+
+    // square points exactly cover the cells
+    glDisable(GL_POINT_SMOOTH);
+    glPointSize(std::max(1.0f, size*ppu));
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, &density_xy[0]);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, &density_rgba[0]);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)ncells);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+#if !defined (__APPLE__)
+    glEnable(GL_POINT_SMOOTH);
+#endif
+
+    return (true);
+}
@@ -0,0 +1,201 @@
+/**
+ * @file matrix_canvas_points.cc
+ * Fill the vertex buffer objects the canvas draws the matrix from.
+ */
+
+#include "matrix_canvas.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <util/parallel.hpp>
+
+/**
+ * The range of the values for the colormap.  With a normalization,
+ * the values are in [0,1].
+ */
+void matrix_canvas::color_range(value_type& min_val, value_type& inv_val_range)
+{
+    if (normalization_state != no_normalization)
+    {
+        min_val = 0.0;
+        inv_val_range = 1.0;
+        return;
+    }
+
+    value_type max_val = matrix_stats.max_val;
+    min_val = matrix_stats.min_val;
+
+    if (max_val - min_val <= 0)
+    {
+        // this sets min_val to something reasonable, and
+        // shows the high end of the colormap if the values
+        // are all equal
+        min_val = max_val - 1.0;
+    }
+    inv_val_range = 1.0/(max_val - min_val);
+}
+
+/**
+ * Make the points in the buffers match the current permutation,
+ * normalization, and colormap, and rebuild only what changed.
+ *
+ * @return false if the matrix cannot be drawn from the buffers,
+ * because it is in tiles, it is too large, or OpenGL does not have
+ * vertex buffer objects
+ */
+bool matrix_canvas::update_point_buffer()
+{
+    using namespace std;
+
+    if (tiles.is_open() || _m.nnz > matrix_point_buffer::max_points
+        || !points.usable())
+    {
+        return (false);
+    }
+
+    int positions_key = permutation_state;
+    int colors_key = normalization_state + 4*(colormap_state + 8*colormap_invert);
+
+    if (!points.has_positions(positions_key))
+    {
+        double t0 = util::wall_time();
+
+        // the first point of each row of the display
+        vector<nz_index_type> row_start(_m.nrows+1);
+        row_start[0] = 0;
+        bool rperm = (permutation_state & row_permutation) != 0;
+
+        #pragma omp parallel for schedule(static)
+        for (index_type pi = 0; pi < _m.nrows; ++pi)
+        {
+            index_type i = rperm ? irperm[pi] : pi;
+            row_start[pi+1] = _m.row_end(i) - _m.row_begin(i);
+        }
+        util::parallel_partial_sum(row_start.begin()+1, _m.nrows);
+
+        GLfloat *xy = points.map_positions(row_start);
+        if (!xy) { return (false); }
+        if (_m.aj_packed) {
+            fill_point_positions(matrix_type::packed_columns(_m), xy);
+        } else {
+            fill_point_positions(matrix_type::raw_columns(_m), xy);
+        }
+        if (!points.unmap_positions(positions_key)) { return (false); }
+
+        cout << "built " << points.size() << " point positions in "
+             << util::wall_time() - t0 << endl;
+    }
+
+    if (!points.has_colors(colors_key))
+    {
+        double t0 = util::wall_time();
+
+        GLubyte *rgb = points.map_colors();
+        if (!rgb) { return (false); }
+        if (_m.aj_packed) {
+            fill_point_colors(matrix_type::packed_columns(_m), rgb);
+        } else {
+            fill_point_colors(matrix_type::raw_columns(_m), rgb);
+        }
+        if (!points.unmap_colors(colors_key)) { return (false); }
+
+        cout << "built " << points.size() << " point colors in "
+             << util::wall_time() - t0 << endl;
+    }
+
+    return (true);
+}
+
+/**
+ * Write the position (pj,pi) of every nonzero, in the order of the
+ * rows of the display.
+ */
+template <class Columns>
+void matrix_canvas::fill_point_positions(Columns cols, GLfloat *xy)
+{
+    const nz_index_type *row_start = &points.row_start()[0];
+    bool rperm = (permutation_state & row_permutation) != 0;
+    bool cperm_set = (permutation_state & column_permutation) != 0;
+
+    #pragma omp parallel
+    {
+        // the packed columns remember where they are
+        Columns c(cols);
+
+        #pragma omp for schedule(dynamic,256)
+        for (index_type pi = 0; pi < _m.nrows; ++pi)
+        {
+            // i is the real row in the matrix for the pith row
+            // of the display
+            index_type i = rperm ? irperm[pi] : pi;
+
+            GLfloat *p = xy + 2*row_start[pi];
+            nz_index_type rend = _m.row_end(i);
+            c.start_row(i);
+            for (nz_index_type ri = _m.row_begin(i); ri < rend; ++ri)
+            {
+                index_type j = c.next(ri);
+                *p++ = (GLfloat)(cperm_set ? cperm[j] : j);
+                *p++ = (GLfloat)pi;
+            }
+        }
+    }
+}
+
+/**
+ * Write the color of every nonzero, in the order of the rows of the
+ * display.
+ */
+template <class Columns>
+void matrix_canvas::fill_point_colors(Columns cols, GLubyte *rgb)
+{
+    const nz_index_type *row_start = &points.row_start()[0];
+    bool rperm = (permutation_state & row_permutation) != 0;
+    bool rnorm_set = (normalization_state & row_normalization) != 0;
+    bool cnorm_set = (normalization_state & column_normalization) != 0;
+
+    value_type min_val, inv_val_range;
+    color_range(min_val, inv_val_range);
+
+    // the colormap as bytes
+    int ncolors = colormap.size;
+    std::vector<GLubyte> map(3*ncolors);
+    for (int k = 0; k < 3*ncolors; ++k) {
+        map[k] = (GLubyte)(colormap.map[k]*255.0f + 0.5f);
+    }
+
+    #pragma omp parallel
+    {
+        Columns c(cols);
+
+        #pragma omp for schedule(dynamic,256)
+        for (index_type pi = 0; pi < _m.nrows; ++pi)
+        {
+            index_type i = rperm ? irperm[pi] : pi;
+
+            GLubyte *p = rgb + 3*row_start[pi];
+            nz_index_type rend = _m.row_end(i);
+            c.start_row(i);
+            for (nz_index_type ri = _m.row_begin(i); ri < rend; ++ri)
+            {
+                index_type j = c.next(ri);
+
+                value_type v = _m.value(ri);
+                if (rnorm_set) { v *= rnorm[i]; }
+                if (cnorm_set) { v *= cnorm[j]; }
+
+                // scale v to the range [0,1]
+                v = (v - min_val)*inv_val_range;
+
+                int colormap_entry = (int)(v*(ncolors-1));
+                colormap_entry = std::max(0, std::min(colormap_entry, ncolors-1));
+                if (colormap_invert) { colormap_entry = ncolors-1-colormap_entry; }
+
+                *p++ = map[3*colormap_entry];
+                *p++ = map[3*colormap_entry+1];
+                *p++ = map[3*colormap_entry+2];
+            }
+        }
+    }
+}
@@ -0,0 +1,250 @@
+/**
+ * @file matrix_canvas_raster.cc
+ * Rasterize the visible nonzeros of the matrix on the CPU with many
+ * threads and draw them as one texture.  The binning of the nonzeros
+ * on pixels and their colors are shared with the texture tiles.
+ */
+
+#include "matrix_canvas.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#include <util/parallel.hpp>
+
+/**
+ * Draw the part of the display from x1,y1 to x2,y2 from an image with
+ * a pixel for each pixel of the window.  Each pixel has the color of
+ * the largest value on it and the alpha of its nonzeros drawn on top
+ * of each other.  The image is only drawn again when the view or the
+ * way the matrix is displayed changes.
+ *
+ * @param ppu the pixels for each row and column of the matrix
+ * @return false if the view is drawn with the points, because a
+ * nonzero is larger than a pixel
+ */
+bool matrix_canvas::draw_raster(float x1, float y1, float x2, float y2,
+    float ppu)
+{
+    using namespace std;
+
+    if (ppu > 1.0f || width <= 0 || height <= 0 || x2 <= x1 || y2 <= y1) {
+        return (false);
+    }
+
+    matrix_raster_image::key_type k;
+    k.x1 = x1; k.y1 = y1; k.x2 = x2; k.y2 = y2;
+    k.width = width; k.height = height;
+    k.state = permutation_state + 4*(normalization_state
+                + 4*(colormap_state + 8*colormap_invert));
+    k.alpha = alpha_from_zoom();
+
+    if (!raster.has_key(k))
+    {
+        double t0 = util::wall_time();
+
+        raster.reset(width, height);
+
+        pixel_style_type s;
+        set_pixel_style(s, k.alpha);
+
+        pixel_window_type w;
+        w.x0 = x1; w.y0 = y1;
+        w.sx = width/((double)x2 - x1); w.sy = height/((double)y2 - y1);
+        w.r0 = std::max((boost::int64_t)std::floor(y1), (boost::int64_t)0);
+        w.r1 = std::min((boost::int64_t)std::ceil(y2) + 1, (boost::int64_t)_m.nrows);
+        w.c0 = std::max((boost::int64_t)std::floor(x1), (boost::int64_t)0);
+        w.c1 = std::min((boost::int64_t)std::ceil(x2) + 1, (boost::int64_t)_m.ncols);
+
+        if (tiles.is_open()) { tiles.begin_frame(); }
+        bin_pixels(s, w, raster.bins());
+        color_pixels(s, raster.bins(), raster.rgba());
+        raster.upload(k);
+
+        cout << "rasterized matrix in " << util::wall_time() - t0 << endl;
+    }
+
+    raster.draw(x1, y1, x2, y2);
+    return (true);
+}
+
+/**
+ * Take the permutation, normalization, and colormap of the display
+ * for binning and coloring pixels, with alpha for each nonzero.
+ */
+void matrix_canvas::set_pixel_style(pixel_style_type& s, float alpha)
+{
+    s.rperm = (permutation_state & row_permutation) != 0;
+    s.cperm = (permutation_state & column_permutation) != 0;
+    s.rnorm = (normalization_state & row_normalization) != 0;
+    s.cnorm = (normalization_state & column_normalization) != 0;
+    s.invert = colormap_invert;
+    color_range(s.min_val, s.inv_val_range);
+
+    // the colormap as bytes
+    s.colormap.resize(3*colormap.size);
+    for (int k = 0; k < 3*colormap.size; ++k) {
+        s.colormap[k] = (GLubyte)(colormap.map[k]*255.0f + 0.5f);
+    }
+
+    // the alpha of n points with alpha a on top of each other
+    for (int n = 0; n < 256; ++n) {
+        s.alpha[n] = (GLubyte)(255.0*(1.0 - std::pow(1.0 - alpha, (double)n)) + 0.5);
+    }
+}
+
+/**
+ * Add the nonzeros in the window to the bins.  With tiles, the matrix
+ * tiles under the window are binned one at a time, each with many
+ * threads.  This runs on the render thread of the texture tiles too,
+ * so it must not touch the window.
+ */
+void matrix_canvas::bin_pixels(const pixel_style_type& s,
+    const pixel_window_type& w, matrix_pixel_bins& bins)
+{
+    if (!tiles.is_open())
+    {
+        bin_matrix_pixels(_m, s, w, bins);
+        return;
+    }
+
+    boost::int64_t r0 = std::max(w.r0, (boost::int64_t)0);
+    boost::int64_t r1 = std::min(w.r1, (boost::int64_t)_m.nrows);
+    boost::int64_t c0 = std::max(w.c0, (boost::int64_t)0);
+    boost::int64_t c1 = std::min(w.c1, (boost::int64_t)_m.ncols);
+    if (r0 >= r1 || c0 >= c1) { return; }
+
+    int ts = tiles.tile_size();
+    for (int tr = (int)(r0/ts); tr <= (int)((r1-1)/ts); ++tr)
+    {
+        for (int tc = (int)(c0/ts); tc <= (int)((c1-1)/ts); ++tc)
+        {
+            const matrix_type *t = tiles.acquire(tr, tc);
+            if (!t) { continue; }
+            bin_matrix_pixels(*t, s, w, bins);
+            tiles.release(tr, tc);
+        }
+    }
+}
+
+void matrix_canvas::bin_matrix_pixels(const matrix_type& m,
+    const pixel_style_type& s, const pixel_window_type& w,
+    matrix_pixel_bins& bins)
+{
+    if (m.aj_packed) {
+        bin_matrix_pixels(m, matrix_type::packed_columns(m), s, w, bins);
+    } else {
+        bin_matrix_pixels(m, matrix_type::raw_columns(m), s, w, bins);
+    }
+}
+
+/**
+ * Add the nonzeros of m to the pixels they fall on.  Each thread takes
+ * whole rows of pixels, and with them all the rows of the display on
+ * those pixels, so no two threads write the same pixel.
+ */
+template <class Columns>
+void matrix_canvas::bin_matrix_pixels(const matrix_type& m, Columns cols,
+    const pixel_style_type& s, const pixel_window_type& w,
+    matrix_pixel_bins& bins)
+{
+    int bw = bins.width(), bh = bins.height();
+
+    boost::int64_t first = std::max<boost::int64_t>(w.r0, m.first_row);
+    boost::int64_t last = std::min<boost::int64_t>(w.r1, m.first_row + m.nrows);
+    if (first >= last) { return; }
+
+    // the row extents and the search in sorted rows skip the columns
+    // outside c0 to c1
+    bool sorted = true;
+    const index_type *extent = row_extents_of(m, s.cperm, sorted);
+    bool search = sorted && !s.cperm;
+
+    #pragma omp parallel
+    {
+        Columns c(cols);
+
+        #pragma omp for schedule(dynamic,1)
+        for (int py = 0; py < bh; ++py)
+        {
+            // the display rows in [y0 + py/sy, y0 + (py+1)/sy)
+            boost::int64_t pb = (boost::int64_t)std::ceil(w.y0 + py/w.sy);
+            boost::int64_t pe = (boost::int64_t)std::ceil(w.y0 + (py+1)/w.sy);
+            pb = std::max(pb, first);
+            pe = std::min(pe, last);
+
+            boost::uint32_t *count = bins.count_row(py);
+            float *max = bins.max_row(py);
+
+            for (index_type pi = (index_type)pb; pi < (index_type)pe; ++pi)
+            {
+                index_type i = s.rperm ? irperm[pi] : pi;
+
+                nz_index_type rbegin = m.row_begin(i), rend = m.row_end(i);
+                c.start_row(i - m.first_row);
+                if (extent && (extent[2*i+1] < w.c0 || extent[2*i] >= w.c1))
+                {
+                    c.skip(rend - rbegin);
+                    continue;
+                }
+
+                nz_index_type ri = search ? c.seek(rbegin, rend, (index_type)w.c0) : rbegin;
+                for (; ri < rend; ++ri)
+                {
+                    index_type j = c.next(ri);
+                    index_type pj = s.cperm ? cperm[j] : j;
+
+                    int px = (int)std::floor(((double)pj - w.x0)*w.sx);
+                    if (pj < w.c0 || pj >= w.c1 || px < 0 || px >= bw)
+                    {
+                        if (search && (pj >= w.c1 || px >= bw)) {
+                            c.skip(rend - ri - 1);
+                            break;
+                        }
+                        continue;
+                    }
+
+                    value_type v = m.value(ri);
+                    if (s.rnorm) { v *= rnorm[i]; }
+                    if (s.cnorm) { v *= cnorm[j]; }
+
+                    ++count[px];
+                    if ((float)v > max[px]) { max[px] = (float)v; }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Color the pixels in rgba from the counts and largest values in the
+ * bins.
+ *
+ * @return the number of pixels with nonzeros
+ */
+long matrix_canvas::color_pixels(const pixel_style_type& s,
+    const matrix_pixel_bins& bins, GLubyte *rgba)
+{
+    int w = bins.width(), h = bins.height();
+    long nonempty = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:nonempty)
+    for (int y = 0; y < h; ++y)
+    {
+        const boost::uint32_t *count = bins.count_row(y);
+        const float *max = bins.max_row(y);
+        GLubyte *p = rgba + 4*(std::size_t)y*w;
+        for (int x = 0; x < w; ++x, p += 4)
+        {
+            if (count[x] == 0) {
+                p[0] = p[1] = p[2] = p[3] = 0;
+                continue;
+            }
+            ++nonempty;
+            s.color(max[x], count[x], p);
+        }
+    }
+
+    return (nonempty);
+}
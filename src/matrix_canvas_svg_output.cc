@@ -103,11 +103,6 @@ void matrix_canvas::write_svg()
 
 
     {
-        value_type v;
-        int colormap_entry;
-
-        float pts=(zoom / (virtual_width*aspect/(float)width));
-
         float x1,y1,x2,y2;
         world_extents(x1,y1,x2,y2);
 
@@ -134,70 +129,121 @@ void matrix_canvas::write_svg()
             inv_val_range = 1.0f;
         }
 
-        for (int pi = std::max(0,r1); pi < std::min(r2, _m.nrows); ++pi)
+        if (tiles.is_open())
         {
-            if (pi-std::max(0,r1)>0 && (pi-std::max(0,r1)) % 10000 == 0 &&
-                std::min(r2, _m.nrows) - std::max(0,r1) >= 20000) {
-                std::cout << "  writing row " << (pi-std::max(0,r1)) 
-                          << " of " << std::min(r2, _m.nrows) - std::max(0,r1)
-                          << std::endl;
-            }
-            // i is the real row in the matrix for the pith row
-            // of the display
-            int i=pi;
-            if (permutation_state == row_permutation || 
-                permutation_state == row_column_permutation) {
-                i=irperm[i];
+            // write one tile at a time
+            int ts = tiles.tile_size();
+            int rend = std::min(r2, _m.nrows), cend = std::min(c2, _m.ncols-1);
+            for (int tr = std::max(r1,0)/ts; rend > 0 && tr <= (rend-1)/ts; ++tr) {
+                for (int tc = std::max(c1,0)/ts; cend >= 0 && tc <= cend/ts; ++tc) {
+                    const matrix_type *t = tiles.acquire(tr, tc);
+                    if (!t) { continue; }
+                    write_svg_matrix(svgfile, *t, r1, c1, r2, c2, 
+                        min_val, inv_val_range, alpha, onepx);
+                    tiles.release(tr, tc);
+                }
             }
+        }
+        else
+        {
+            write_svg_matrix(svgfile, _m, r1, c1, r2, c2, 
+                min_val, inv_val_range, alpha, onepx);
+        }
+    }
 
-            for (index_type ri = _m.ai[i]; ri < _m.ai[i+1]; ++ri)
-            {
-                // j is the real column in the matrix for the pjth
-                // column of the display
-                int j = _m.aj[ri];
-                int pj = j;
-                if (permutation_state == column_permutation ||
-                    permutation_state == row_column_permutation) {
-                    pj = cperm[pj];
-                }
+    fprintf(svgfile,"</g>\n");
+    fprintf(svgfile,"</g>\n");
+    fprintf(svgfile,"</g>\n");
+    fprintf(svgfile, "</svg>\n");
 
-                // skip all the columns outside
-                if (pj < c1 || pj > c2) { continue; }
+    fclose(svgfile);
+}
 
-                v = _m.a[ri];
-                if (normalization_state == row_normalization ||
-                    normalization_state == row_column_normalization) {
-                    v*=rnorm[i];
-                }
-                if (normalization_state == column_normalization ||
-                    normalization_state == row_column_normalization) {
-                    v*=cnorm[j];
-                }
+/**
+ * Write the nonzeros of m in rows r1 to r2-1 and columns c1 to c2 as
+ * circles.  m is either the matrix or one of its tiles.
+ */
+void matrix_canvas::write_svg_matrix(FILE *svgfile, const matrix_type& m, 
+    int r1, int c1, int r2, int c2,
+    value_type min_val, value_type inv_val_range, float alpha, float onepx)
+{
+    if (m.aj_packed) {
+        write_svg_matrix(svgfile, m, matrix_type::packed_columns(m), 
+            r1, c1, r2, c2, min_val, inv_val_range, alpha, onepx);
+    } else {
+        write_svg_matrix(svgfile, m, matrix_type::raw_columns(m), 
+            r1, c1, r2, c2, min_val, inv_val_range, alpha, onepx);
+    }
+}
 
-                // scale v to the range [0,1]
-                v = v - min_val;
-                v = v*inv_val_range;
+template <class Columns>
+void matrix_canvas::write_svg_matrix(FILE *svgfile, const matrix_type& m, 
+    Columns cols, int r1, int c1, int r2, int c2,
+    value_type min_val, value_type inv_val_range, float alpha, float onepx)
+{
+    value_type v;
+    int colormap_entry;
+    int r,g,b;
 
-                if (!colormap_invert) { 
-                    colormap_entry = (int)(v*(colormap.size-1)); 
-                } else { 
-                    colormap_entry = (int)(v*(colormap.size-1)); 
-                    colormap_entry=colormap.size-1-colormap_entry;
-                }
+    int first_row = m.first_row, end_row = m.first_row + m.nrows;
 
-                color2rgb(&colormap.map[colormap_entry*3],r,g,b);
+    for (int pi = std::max(first_row,r1); pi < std::min(r2, end_row); ++pi)
+    {
+        if (pi-std::max(first_row,r1)>0 && (pi-std::max(first_row,r1)) % 10000 == 0 &&
+            std::min(r2, end_row) - std::max(first_row,r1) >= 20000) {
+            std::cout << "  writing row " << (pi-std::max(first_row,r1)) 
+                      << " of " << std::min(r2, end_row) - std::max(first_row,r1)
+                      << std::endl;
+        }
+        // i is the real row in the matrix for the pith row
+        // of the display
+        int i=pi;
+        if (permutation_state == row_permutation || 
+            permutation_state == row_column_permutation) {
+            i=irperm[i];
+        }
 
-                fprintf(svgfile, "<circle cx=\"%g\" cy=\"%g\" r=\"%g\" fill=\"rgb(%i,%i,%i)\" opacity=\"%g\"/>\n",
-                    (float)pi,(float)pj, (std::max)(0.5f,onepx/2.0f), r,g,b, alpha);
+        nz_index_type rend = m.row_end(i);
+        cols.start_row(i - first_row);
+        for (nz_index_type ri = m.row_begin(i); ri < rend; ++ri)
+        {
+            // j is the real column in the matrix for the pjth
+            // column of the display
+            int j = cols.next(ri);
+            int pj = j;
+            if (permutation_state == column_permutation ||
+                permutation_state == row_column_permutation) {
+                pj = cperm[pj];
             }
-        }
 
-    }
+            // skip all the columns outside
+            if (pj < c1 || pj > c2) { continue; }
 
-    fprintf(svgfile,"</g>\n");
-    fprintf(svgfile,"</g>\n");
-    fprintf(svgfile,"</g>\n");
-    fprintf(svgfile, "</svg>\n");
+            v = m.value(ri);
+            if (normalization_state == row_normalization ||
+                normalization_state == row_column_normalization) {
+                v*=rnorm[i];
+            }
+            if (normalization_state == column_normalization ||
+                normalization_state == row_column_normalization) {
+                v*=cnorm[j];
+            }
 
-    fclose(svgfile);
+            // scale v to the range [0,1]
+            v = v - min_val;
+            v = v*inv_val_range;
+
+            if (!colormap_invert) { 
+                colormap_entry = (int)(v*(colormap.size-1)); 
+            } else { 
+                colormap_entry = (int)(v*(colormap.size-1)); 
+                colormap_entry=colormap.size-1-colormap_entry;
+            }
+
+            color2rgb(&colormap.map[colormap_entry*3],r,g,b);
+
+            fprintf(svgfile, "<circle cx=\"%g\" cy=\"%g\" r=\"%g\" fill=\"rgb(%i,%i,%i)\" opacity=\"%g\"/>\n",
+                (float)pi,(float)pj, (std::max)(0.5f,onepx/2.0f), r,g,b, alpha);
+        }
+    }
 }
@@ -0,0 +1,172 @@
+/**
+ * @file matrix_canvas_texture_tiles.cc
+ * Draw the matrix from texture tiles rendered on a background thread,
+ * so panning only renders the tiles that come into view.
+ */
+
+#include "matrix_canvas.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#include <util/parallel.hpp>
+
+/**
+ * Draw the part of the display from x1,y1 to x2,y2 from the level of
+ * texture tiles whose pixels are at least a pixel of the window.  A
+ * tile that is not rendered yet is drawn from a coarser tile, if there
+ * is one, and requested along with the tiles around the view.  The
+ * window is drawn again when the requested tiles are done.
+ *
+ * @param ppu the pixels for each row and column of the matrix
+ * @return false if the view is drawn with the points
+ */
+bool matrix_canvas::draw_texture_tiles(float x1, float y1, float x2, float y2,
+    float ppu)
+{
+    if (ppu <= 0.0f || ppu > 1.0f) { return (false); }
+    if (!tiles.is_open() && _m.nnz <= large_scale_nz) { return (false); }
+    if (!texture_tiles.start(&matrix_canvas::render_texture_tile, this)) {
+        return (false);
+    }
+
+    int level = std::max(0,
+        (int)std::ceil(std::log(1.0/ppu)/std::log(2.0) - 1e-4));
+
+    update_texture_style(alpha_from_zoom());
+    texture_tiles.begin_frame();
+    texture_tiles.upload();
+
+    // row pi of the display is drawn from pi-0.5 to pi+0.5
+    boost::int64_t span = (boost::int64_t)matrix_texture_tiles::tile_pixels << level;
+    int ntr = (int)((_m.nrows + span - 1)/span);
+    int ntc = (int)((_m.ncols + span - 1)/span);
+    int tr1 = std::max(0, (int)std::floor((y1 + 0.5)/span));
+    int tr2 = std::min(ntr-1, (int)std::floor((y2 + 0.5)/span));
+    int tc1 = std::max(0, (int)std::floor((x1 + 0.5)/span));
+    int tc2 = std::min(ntc-1, (int)std::floor((x2 + 0.5)/span));
+    if (tr1 > tr2 || tc1 > tc2) { return (true); }
+
+    std::vector<std::pair<int,int> > want;
+    bool missing = false;
+
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    for (int tr = tr1; tr <= tr2; ++tr)
+    {
+        for (int tc = tc1; tc <= tc2; ++tc)
+        {
+            GLuint texture = 0;
+            float u1 = 0.0f, v1 = 0.0f, f = 1.0f;
+            if (!texture_tiles.find(level, tr, tc, texture))
+            {
+                want.push_back(std::make_pair(tr, tc));
+                missing = true;
+
+                // the part of a coarser tile over this one, if any
+                texture = 0;
+                for (int d = 1; d <= 4; ++d)
+                {
+                    if (!texture_tiles.find(level+d, tr >> d, tc >> d, texture)) {
+                        continue;
+                    }
+                    f = 1.0f/(float)(1 << d);
+                    u1 = (float)(tc & ((1 << d) - 1))*f;
+                    v1 = (float)(tr & ((1 << d) - 1))*f;
+                    break;
+                }
+            }
+            if (!texture) { continue; }
+
+            // row 0 of a tile is at its top
+            float wx = (float)(tc*span) - 0.5f, wy = (float)(tr*span) - 0.5f;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glBegin(GL_QUADS);
+            glTexCoord2f(u1, v1); glVertex2f(wx, wy);
+            glTexCoord2f(u1+f, v1); glVertex2f(wx + span, wy);
+            glTexCoord2f(u1+f, v1+f); glVertex2f(wx + span, wy + span);
+            glTexCoord2f(u1, v1+f); glVertex2f(wx, wy + span);
+            glEnd();
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+
+    // then the tiles around the view, for panning
+    for (int tr = std::max(tr1-1, 0); tr <= std::min(tr2+1, ntr-1); ++tr) {
+        for (int tc = std::max(tc1-1, 0); tc <= std::min(tc2+1, ntc-1); ++tc) {
+            if (tr >= tr1 && tr <= tr2 && tc >= tc1 && tc <= tc2) { continue; }
+            want.push_back(std::make_pair(tr, tc));
+        }
+    }
+    texture_tiles.request(level, want);
+
+    if (missing && !texture_timer_set)
+    {
+        texture_timer_set = true;
+        glutTimerFunc(texture_timer_ms, glut_texture_timer, get_glut_window_id());
+    }
+
+    return (true);
+}
+
+/**
+ * Make the texture tiles match the current permutation, normalization,
+ * colormap, and alpha.  The alpha is rounded so that zooming within a
+ * level keeps most of the tiles.
+ */
+void matrix_canvas::update_texture_style(float alpha)
+{
+    int a = (int)(alpha*32.0f + 0.5f);
+    int state = permutation_state + 4*(normalization_state
+                + 4*(colormap_state + 8*(colormap_invert + 2*a)));
+    if (texture_tiles.state() == state) { return; }
+
+    // the render thread is idle until the next request
+    texture_tiles.set_state(state);
+    set_pixel_style(texture_style, (float)(a/32.0));
+}
+
+bool matrix_canvas::render_texture_tile(void *arg, int level, int tr, int tc,
+    GLubyte *rgba)
+{
+    return (((matrix_canvas*)arg)->render_texture_tile(level, tr, tc, rgba));
+}
+
+/**
+ * Render tile (tr,tc) of a level into rgba.  This runs on the render
+ * thread of the texture tiles and must not touch the window.
+ *
+ * @return false if the tile has no nonzeros
+ */
+bool matrix_canvas::render_texture_tile(int level, int tr, int tc,
+    GLubyte *rgba)
+{
+    const int n = matrix_texture_tiles::tile_pixels;
+
+    // pixel (px,py) holds 2^level rows and columns
+    boost::int64_t span = (boost::int64_t)n << level;
+    pixel_window_type w;
+    w.r0 = tr*span; w.r1 = std::min<boost::int64_t>(w.r0 + span, _m.nrows);
+    w.c0 = tc*span; w.c1 = std::min<boost::int64_t>(w.c0 + span, _m.ncols);
+    w.x0 = (double)w.c0; w.y0 = (double)w.r0;
+    w.sx = w.sy = 1.0/(double)((boost::int64_t)1 << level);
+
+    texture_bins.reset(n, n);
+    bin_pixels(texture_style, w, texture_bins);
+    return (color_pixels(texture_style, texture_bins, rgba) > 0);
+}
+
+void matrix_canvas::glut_texture_timer(int id)
+{
+    glut_window<glut_2d_canvas>* w =
+        (glut_window<glut_2d_canvas>*)get_window_data(id);
+    if (w)
+    {
+        static_cast<matrix_canvas*>(static_cast<glut_2d_canvas*>(w))
+            ->texture_timer_set = false;
+        glutSetWindow(id);
+        glutPostRedisplay();
+    }
+}
@@ -0,0 +1,140 @@
+/**
+ * @file matrix_convert.cc
+ * Convert a matrix file to another format with the yasmic loaders and
+ * writers.
+ */
+
+#define YASMIC_UTIL_LOAD_GZIP
+#include <yasmic/compressed_row_matrix.hpp>
+#include <yasmic/util/load_crm_matrix.hpp>
+#include <yasmic/util/stream_matrix.hpp>
+#include <yasmic/util/symmetrize_crm.hpp>
+#include <yasmic/util/write_crm_matrix.hpp>
+
+#include "matrix_convert.hpp"
+
+#include <iostream>
+#include <vector>
+#include <functional>
+
+#include <boost/cstdint.hpp>
+
+#include <util/parallel.hpp>
+
+namespace {
+
+/** Write the nonzeros that stream_matrix_file reads to a file. */
+struct coord_file_visitor
+{
+    coord_file_visitor(const std::string& filename, yasmic::crm_output_format fmt)
+    : filename(filename), fmt(fmt) {}
+
+    template <class ChunkSource, class Index, class NzIndex>
+    bool operator() (ChunkSource& src, Index nr, Index nc, NzIndex nnz,
+        bool nnz_exact)
+    {
+        return (write_coord_matrix(filename, fmt, src, nr, nc, nnz, nnz_exact));
+    }
+
+    std::string filename;
+    yasmic::crm_output_format fmt;
+};
+
+}
+
+bool convert_matrix(const std::string& input_filename,
+    const std::string& output_filename, bool symmetrize)
+{
+    using namespace std;
+    using namespace yasmic;
+
+    typedef int index_type;
+    typedef boost::int64_t nz_index_type;
+    typedef double value_type;
+
+    crm_output_format fmt;
+    if (!crm_output_format_from_filename(output_filename, fmt))
+    {
+        cerr << "error: cannot write " << output_filename
+             << ", the extension must be smat, mtx, cmat, bsmat, bssmat, "
+             << "petsc, or bcsr" << endl;
+        return (false);
+    }
+
+    // the coordinate formats take the nonzeros as they are read
+    if (!symmetrize && impl::is_coordinate_format(fmt))
+    {
+        double t0 = util::wall_time();
+        coord_file_visitor visit(output_filename, fmt);
+        bool streamed;
+        bool rval = stream_matrix_file<index_type, nz_index_type, value_type>(
+            input_filename, visit, streamed);
+        if (streamed)
+        {
+            if (rval)
+            {
+                cerr << "streamed " << output_filename << " in " 
+                     << util::wall_time() - t0 << " with " 
+                     << util::max_threads() << " threads" << endl;
+            }
+            return (rval);
+        }
+    }
+
+    vector<nz_index_type> rows;
+    vector<index_type> cols;
+    vector<value_type> vals;
+    index_type nr, nc;
+    nz_index_type nnz;
+
+    double t0 = util::wall_time();
+    if (!load_crm_matrix(input_filename, rows, cols, vals, nr, nc, nnz))
+    {
+        return (false);
+    }
+    cerr << "read matrix in " << util::wall_time() - t0 << endl;
+
+    if (symmetrize)
+    {
+        t0 = util::wall_time();
+        symmetrize_crm_storage(rows, cols, vals, nr, nc);
+        nnz = rows.back();
+        cerr << "symmetrized matrix in " << util::wall_time() - t0 << endl;
+    }
+
+    // the rows of the other formats need sorted, unique columns, which
+    // sums repeated entries, as does A+A' with symmetrize
+    if (symmetrize || !impl::is_coordinate_format(fmt))
+    {
+        t0 = util::wall_time();
+
+        typedef compressed_row_matrix<
+            vector<nz_index_type>::iterator, vector<index_type>::iterator,
+            vector<value_type>::iterator >
+            crs_matrix;
+
+        crs_matrix m(rows.begin(), rows.end(), cols.begin(), cols.end(),
+            vals.begin(), vals.end(), nr, nc, nnz);
+
+        if (!is_sorted_storage(m))
+        {
+            pack_storage(m, std::plus<value_type>());
+            sort_storage(m);
+            nnz = rows.back();
+        }
+
+        cerr << "packed matrix in " << util::wall_time() - t0 << endl;
+    }
+
+    t0 = util::wall_time();
+    if (!write_crm_matrix(output_filename, fmt, nr, nc, nnz, &rows[0],
+            cols.empty() ? (const index_type*)0 : &cols[0],
+            vals.empty() ? (const value_type*)0 : &vals[0]))
+    {
+        return (false);
+    }
+    cerr << "wrote " << output_filename << " in " << util::wall_time() - t0
+         << " with " << util::max_threads() << " threads" << endl;
+
+    return (true);
+}
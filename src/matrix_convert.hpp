@@ -0,0 +1,31 @@
+#ifndef MATRIX_CONVERT_HPP
+#define MATRIX_CONVERT_HPP
+
+/**
+ * @file matrix_convert.hpp
+ * Convert a matrix file to another format without a display.
+ */
+
+#include <string>
+
+/**
+ * Load a matrix with the loaders the canvas uses and write it in the
+ * format given by the extension of the output file, see
+ * write_crm_matrix.hpp.  Nothing uses OpenGL or GLUT.
+ *
+ * The coordinate formats, smat, mtx, bsmat, and bssmat, are written
+ * from the nonzeros as they are read from the disk, in the order of
+ * the input file, without a copy of the matrix in memory, and keep
+ * repeated entries.  The other formats need the rows together, so the
+ * matrix is loaded, and then packed and sorted, which adds repeated
+ * entries together.  With symmetrize, the matrix is loaded and A+A'
+ * is packed and sorted for every format.  An input that cannot be
+ * streamed, see stream_matrix.hpp, is loaded for every format, but
+ * only packed for the formats that need it.
+ *
+ * @return false if the matrix could not be read or written
+ */
+bool convert_matrix(const std::string& input_filename,
+    const std::string& output_filename, bool symmetrize);
+
+#endif // MATRIX_CONVERT_HPP
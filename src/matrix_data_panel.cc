@@ -11,9 +11,11 @@
 
 #include "matrix_data_panel.hpp"
 
+#include <algorithm>
+
 matrix_data_panel::matrix_data_panel(int parent_id, 
         int w, int h, int x, int y)
-        : parent_glut_id(parent_id)
+        : parent_glut_id(parent_id), progress(-1.0f)
 {
     set_background_color(0.25f,0.25f,0.25f);
     set_border_color(0.0f,1.0f,0.0f);
@@ -32,6 +34,13 @@ void matrix_data_panel::display()
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);       
 
+    if (progress >= 0.0f)
+    {
+        display_progress();
+        glutSwapBuffers();
+        return;
+    }
+
     //char str[300];
     //snprintf(str, 300, "row [%d]:    ", matrix->rperm[vy]);
     //string rs = str + matrix->rlabels[matrix->rperm[vy]];
@@ -75,6 +84,41 @@ void matrix_data_panel::display()
     glutSwapBuffers();
 }
 
+/**
+ * Draw the progress title, the stage with the percent done, and the 
+ * progress bar on the three lines of the panel.
+ */
+void matrix_data_panel::display_progress()
+{
+    std::ostringstream stage_oss;
+    stage_oss << progress_stage << " " << (int)(100.0f*progress) << "%";
+
+    glColor3f(text_color[0],text_color[1],text_color[2]);
+    draw_text(5,15,progress_title.c_str(), GL_U_TEXT_SCREEN_COORDS);
+    draw_text(5,30,stage_oss.str().c_str(), GL_U_TEXT_SCREEN_COORDS);
+
+    double x1, y1, x2, y2;
+    screen_to_world(5, 35, &x1, &y1);
+    screen_to_world(width-5, 46, &x2, &y2);
+    double xp = x1 + (x2-x1)*std::min(progress, 1.0f);
+
+    glColor3f(border_color[0],border_color[1],border_color[2]);
+    glBegin(GL_QUADS);
+    glVertex2d(x1, y1);
+    glVertex2d(xp, y1);
+    glVertex2d(xp, y2);
+    glVertex2d(x1, y2);
+    glEnd();
+
+    glColor3f(text_color[0],text_color[1],text_color[2]);
+    glBegin(GL_LINE_LOOP);
+    glVertex2d(x1, y1);
+    glVertex2d(x2, y1);
+    glVertex2d(x2, y2);
+    glVertex2d(x1, y2);
+    glEnd();
+}
+
 void matrix_data_panel::reshape(int w, int h)
 {
     glViewport (0, 0, w, h);
@@ -54,6 +54,26 @@ public:
         glutSetWindow(old_glut_win);
     }
 
+    /**
+     * Show a progress bar with a title and the current stage instead
+     * of the data, e.g. while a matrix loads.
+     * @param fraction the length of the bar between 0 and 1
+     */
+    void set_progress(const std::string& in_title, 
+        const std::string& in_stage, float fraction)
+    {
+        progress_title = in_title; progress_stage = in_stage;
+        progress = fraction;
+
+        int old_glut_win = glutGetWindow();
+        glutSetWindow(super::get_glut_window_id());
+        glutPostRedisplay();
+        glutSetWindow(old_glut_win);
+    }
+
+    /** Remove the progress bar and show the data again. */
+    void clear_progress() { set_progress("", "", -1.0f); }
+
     void set_background_color(float r, float g, float b)
     { background_color[0]=r; background_color[1]=g; background_color[2]=b; }
 
@@ -64,6 +84,8 @@ public:
     { text_color[0]=r; text_color[1]=g; text_color[2]=b; }
 
 private:
+    void display_progress();
+
     int parent_glut_id;
     int width, height;
 
@@ -71,6 +93,11 @@ private:
     float val;
 
     std::string rlabel, clabel;
+
+    // a negative progress hides the progress bar
+    float progress;
+    std::string progress_title, progress_stage;
+
     float background_color[3];
     float border_color[3];
     float text_color[3];
@@ -0,0 +1,79 @@
+/**
+ * @file matrix_density_pyramid.cc
+ * Build the levels of a density pyramid with many threads.
+ */
+
+#include "matrix_density_pyramid.hpp"
+
+#include <algorithm>
+
+namespace {
+
+inline matrix_density_pyramid::index_type cells_for(
+    matrix_density_pyramid::index_type n, int shift)
+{
+    return (((n - 1) >> shift) + 1);
+}
+
+}
+
+void matrix_density_pyramid::clear()
+{
+    std::vector<level>().swap(_levels);
+    _key = -1;
+}
+
+void matrix_density_pyramid::start(index_type nrows, index_type ncols)
+{
+    clear();
+
+    nrows = std::max(nrows, 1);
+    ncols = std::max(ncols, 1);
+
+    // cells of at least 2 by 2, or the pyramid saves nothing
+    _shift = 1;
+    while ((double)cells_for(nrows, _shift)*cells_for(ncols, _shift) > max_cells) {
+        ++_shift;
+    }
+
+    _levels.resize(1);
+    level& l = _levels[0];
+    l.rows = cells_for(nrows, _shift);
+    l.cols = cells_for(ncols, _shift);
+    l.cells.resize((std::size_t)l.rows*l.cols);
+
+    density_cell *c = &l.cells[0];
+    std::ptrdiff_t n = (std::ptrdiff_t)l.cells.size();
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t k = 0; k < n; ++k) { c[k].clear(); }
+}
+
+void matrix_density_pyramid::finish(int key)
+{
+    while (_levels.back().rows > 1 || _levels.back().cols > 1)
+    {
+        _levels.push_back(level());
+        const level& f = _levels[_levels.size()-2];
+        level& l = _levels.back();
+        l.rows = cells_for(f.rows, 1);
+        l.cols = cells_for(f.cols, 1);
+        l.cells.resize((std::size_t)l.rows*l.cols);
+
+        // each cell adds the 2 by 2 cells under it
+        #pragma omp parallel for schedule(static)
+        for (index_type r = 0; r < l.rows; ++r)
+        {
+            density_cell *out = &l.cells[(std::size_t)r*l.cols];
+            for (index_type c = 0; c < l.cols; ++c) { out[c].clear(); }
+
+            for (index_type fr = 2*r; fr < std::min(2*r+2, f.rows); ++fr)
+            {
+                const density_cell *in = &f.cells[(std::size_t)fr*f.cols];
+                for (index_type fc = 0; fc < f.cols; ++fc) {
+                    out[fc/2].add(in[fc]);
+                }
+            }
+        }
+    }
+    _key = key;
+}
@@ -0,0 +1,109 @@
+#ifndef MATRIX_DENSITY_PYRAMID_HPP
+#define MATRIX_DENSITY_PYRAMID_HPP
+
+/**
+ * @file matrix_density_pyramid.hpp
+ * A multi-resolution summary of the nonzeros of a matrix for views
+ * where many nonzeros fall on each pixel.
+ */
+
+#include <vector>
+#include <limits>
+
+#include <boost/cstdint.hpp>
+
+/**
+ * The nonzeros in one cell of the pyramid.  An empty cell has count 0,
+ * and min and max are only meaningful when count > 0.
+ */
+struct density_cell
+{
+    boost::uint32_t count;
+    float sum;
+    float min;
+    float max;
+
+    void clear()
+    {
+        count = 0; sum = 0.0f;
+        min = std::numeric_limits<float>::max();
+        max = -std::numeric_limits<float>::max();
+    }
+
+    void add(float v)
+    {
+        if (count < std::numeric_limits<boost::uint32_t>::max()) { ++count; }
+        sum += v;
+        if (v < min) { min = v; }
+        if (v > max) { max = v; }
+    }
+
+    void add(const density_cell& c)
+    {
+        boost::uint32_t n = count + c.count;
+        count = n < count ? std::numeric_limits<boost::uint32_t>::max() : n;
+        sum += c.sum;
+        if (c.min < min) { min = c.min; }
+        if (c.max > max) { max = c.max; }
+    }
+};
+
+/**
+ * The matrix_density_pyramid class is a mip-pyramid of dense grids of
+ * density_cells over the display of a matrix.  A cell of level l
+ * covers a square of 2^shift(l) rows and columns, and each level has
+ * cells twice as large as the one before, up to a single cell.  The
+ * first level has the smallest cells for which the grid has at most
+ * max_cells cells.
+ *
+ * The owner fills the first level between start and finish, with
+ * each row of cells written by only one thread, and finish builds the
+ * other levels in parallel.  The key says what the cells were built
+ * from, e.g. the permutation and normalization of the display.
+ */
+class matrix_density_pyramid
+{
+public:
+    typedef int index_type;
+
+    // the most cells in the first level, 16 bytes each
+    const static int max_cells = 1<<22;
+
+    matrix_density_pyramid() : _shift(1), _key(-1) {}
+
+    bool has_key(int key) const { return (_key == key && !_levels.empty()); }
+
+    void clear();
+
+    /**
+     * Allocate the first level for an nrows by ncols display, with
+     * every cell empty, and forget the other levels.
+     */
+    void start(index_type nrows, index_type ncols);
+
+    /** Build the other levels from the first one. */
+    void finish(int key);
+
+    int levels() const { return ((int)_levels.size()); }
+    int shift(int level) const { return (_shift + level); }
+    index_type rows(int level) const { return (_levels[level].rows); }
+    index_type cols(int level) const { return (_levels[level].cols); }
+
+    density_cell* row(int level, index_type r)
+    { return (&_levels[level].cells[(std::size_t)r*_levels[level].cols]); }
+    const density_cell* row(int level, index_type r) const
+    { return (&_levels[level].cells[(std::size_t)r*_levels[level].cols]); }
+
+private:
+    struct level
+    {
+        index_type rows, cols;
+        std::vector<density_cell> cells;
+    };
+
+    std::vector<level> _levels;
+    int _shift;
+    int _key;
+};
+
+#endif // MATRIX_DENSITY_PYRAMID_HPP
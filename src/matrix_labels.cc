@@ -0,0 +1,115 @@
+/**
+ * @file matrix_labels.cc
+ * Index the lines of a label file with many threads.
+ */
+
+#define YASMIC_UTIL_LOAD_GZIP
+#include "matrix_labels.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#include <util/parallel.hpp>
+
+bool matrix_labels::load(const std::string& filename)
+{
+    clear();
+
+    if (!_input.open(filename))
+    {
+        return (false);
+    }
+
+    const char* begin = _input.begin();
+    std::size_t bytes = _input.size();
+
+    int nchunks = (int)std::min<std::size_t>(util::max_threads(),
+                    bytes/(1<<20) + 1);
+    std::vector<boost::uint64_t> nlines(nchunks+1, 0);
+
+    // count the lines that end in each chunk
+    #pragma omp parallel for schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        const char* p = begin + util::block_begin(bytes, nchunks, i);
+        const char* end = begin + util::block_begin(bytes, nchunks, i+1);
+        boost::uint64_t n = 0;
+        while (p != end && (p = (const char*)std::memchr(p, '\n', end - p)))
+        {
+            ++n; ++p;
+        }
+        nlines[i+1] = n;
+    }
+
+    for (int i = 0; i < nchunks; ++i) { nlines[i+1] += nlines[i]; }
+
+    // the last line may not end with a newline
+    boost::uint64_t n = nlines[nchunks];
+    if (bytes > 0 && begin[bytes-1] != '\n') { ++n; }
+
+    _offsets.resize(n+1);
+    _offsets[0] = 0;
+    _offsets[n] = bytes;
+
+    // each chunk writes the start of the line after each of its newlines
+    #pragma omp parallel for schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        const char* p = begin + util::block_begin(bytes, nchunks, i);
+        const char* end = begin + util::block_begin(bytes, nchunks, i+1);
+        boost::uint64_t* o = &_offsets[0] + nlines[i] + 1;
+        while (p != end && (p = (const char*)std::memchr(p, '\n', end - p)))
+        {
+            ++p;
+            *o++ = (boost::uint64_t)(p - begin);
+        }
+    }
+
+    return (true);
+}
+
+void matrix_labels::assign(const std::vector<boost::int64_t>& ids)
+{
+    clear();
+
+    index_type n = (index_type)ids.size();
+    _offsets.resize(n+1);
+    _offsets[0] = 0;
+
+    // the length of each label with its newline, then the offsets
+    #pragma omp parallel for schedule(static)
+    for (index_type i = 0; i < n; ++i)
+    {
+        boost::int64_t v = ids[i];
+        boost::uint64_t len = v < 0 ? 2 : 1;
+        while (v <= -10 || v >= 10) { v /= 10; ++len; }
+        _offsets[i+1] = len + 1;
+    }
+
+    util::parallel_partial_sum(_offsets.begin()+1, n);
+
+    std::vector<char> data((std::size_t)_offsets[n]);
+
+    #pragma omp parallel for schedule(static)
+    for (index_type i = 0; i < n; ++i)
+    {
+        // write the digits backwards from the newline
+        char* p = &data[0] + _offsets[i+1] - 1;
+        *p = '\n';
+        boost::int64_t v = ids[i];
+        do {
+            int d = (int)(v % 10);
+            *--p = (char)('0' + (d < 0 ? -d : d));
+            v /= 10;
+        } while (v != 0);
+        if (ids[i] < 0) { *--p = '-'; }
+    }
+
+    _input.assign(data);
+}
+
+void matrix_labels::clear()
+{
+    _input.close();
+    std::vector<boost::uint64_t>().swap(_offsets);
+}
@@ -0,0 +1,75 @@
+#ifndef MATRIX_LABELS_HPP
+#define MATRIX_LABELS_HPP
+
+/**
+ * @file matrix_labels.hpp
+ * The labels of the rows or columns of a matrix.
+ */
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <yasmic/util/input_bytes.hpp>
+
+#include "util/string_ref.hpp"
+
+/**
+ * The matrix_labels class holds a label file with one label per line.
+ * The labels stay where the file is, memory mapped, or for a gzip file,
+ * in the single buffer it was inflated into.  An index with the offset
+ * of every line is built with many threads, so a label is a
+ * string_ref into the file and no label is ever copied.
+ */
+class matrix_labels
+{
+public:
+    typedef int index_type;
+
+    matrix_labels() {}
+
+    /**
+     * Read a label file and forget the current labels.
+     * @return false if the file cannot be read
+     */
+    bool load(const std::string& filename);
+
+    /**
+     * Use the decimal numbers in ids as the labels and forget the
+     * current labels.
+     */
+    void assign(const std::vector<boost::int64_t>& ids);
+
+    void clear();
+
+    /** @return the number of labels */
+    index_type size() const
+    { return (_offsets.empty() ? 0 : (index_type)(_offsets.size() - 1)); }
+
+    /**
+     * @return label i without the end of the line, or an empty label
+     * if there is no label i
+     */
+    util::string_ref operator[] (index_type i) const
+    {
+        if (i < 0 || i >= size()) { return (util::string_ref()); }
+
+        const char* b = _input.begin() + _offsets[i];
+        const char* e = _input.begin() + _offsets[i+1];
+        if (e != b && e[-1] == '\n') { --e; }
+        if (e != b && e[-1] == '\r') { --e; }
+        return (util::string_ref(b, (std::size_t)(e - b)));
+    }
+
+private:
+    matrix_labels(const matrix_labels&);
+    matrix_labels& operator= (const matrix_labels&);
+
+    yasmic::input_bytes _input;
+
+    // label i is [_offsets[i], _offsets[i+1]) in _input
+    std::vector<boost::uint64_t> _offsets;
+};
+
+#endif // MATRIX_LABELS_HPP
@@ -0,0 +1,151 @@
+/**
+ * @file matrix_load_progress.cc
+ * Track and draw a matrix while it loads on a background thread.
+ */
+
+#include "xplat_gl.h"
+
+#include "matrix_load_progress.hpp"
+
+#include <algorithm>
+#include <limits>
+
+matrix_load_progress::matrix_load_progress()
+{
+    reset(true);
+}
+
+void matrix_load_progress::reset(bool keep_points)
+{
+    util::scoped_lock l(_lock);
+
+    _keep_points = keep_points;
+    _nrows = 0;
+    _ncols = 0;
+    _nnz = 0;
+    _passes = 1;
+    _stride = 1;
+    _read = 0;
+    _stage.clear();
+    std::deque<batch>().swap(_batches);
+    _version = 0;
+    _finished = false;
+    _ok = false;
+    _error.clear();
+}
+
+void matrix_load_progress::begin(index_type nr, index_type nc,
+    boost::uint64_t nnz, int passes)
+{
+    util::scoped_lock l(_lock);
+
+    _nrows = nr;
+    _ncols = nc;
+    _nnz = nnz;
+    _passes = std::max(passes, 1);
+    _stride = (std::size_t)(nnz/max_points) + 1;
+    _read = 0;
+    std::deque<batch>().swap(_batches);
+    ++_version;
+}
+
+void matrix_load_progress::nonzeros(const index_type* r, const index_type* c,
+    std::size_t n)
+{
+    batch b;
+    b.first_row = std::numeric_limits<index_type>::max();
+    b.last_row = -1;
+
+    // build the batch before taking the lock, so the other loading
+    // threads only wait for the push_back
+    index_type nr, nc;
+    std::size_t stride;
+    bool keep_points;
+    {
+        util::scoped_lock l(_lock);
+        nr = _nrows; nc = _ncols;
+        stride = _stride;
+        keep_points = _keep_points;
+    }
+
+    if (keep_points)
+    {
+        b.ij.reserve(2*(n/stride + 1));
+        for (std::size_t k = 0; k < n; k += stride)
+        {
+            if (r[k] < 0 || r[k] >= nr || c[k] < 0 || c[k] >= nc) { continue; }
+            b.ij.push_back(r[k]);
+            b.ij.push_back(c[k]);
+            b.first_row = std::min(b.first_row, r[k]);
+            b.last_row = std::max(b.last_row, r[k]);
+        }
+    }
+
+    util::scoped_lock l(_lock);
+    _read += n;
+    if (!b.ij.empty())
+    {
+        _batches.push_back(batch());
+        _batches.back().first_row = b.first_row;
+        _batches.back().last_row = b.last_row;
+        _batches.back().ij.swap(b.ij);
+        ++_version;
+    }
+}
+
+void matrix_load_progress::advance(std::size_t n)
+{
+    util::scoped_lock l(_lock);
+    _read += n;
+}
+
+void matrix_load_progress::set_stage(const std::string& stage)
+{
+    util::scoped_lock l(_lock);
+    _stage = stage;
+}
+
+void matrix_load_progress::finish(bool ok, const std::string& error)
+{
+    util::scoped_lock l(_lock);
+    _finished = true;
+    _ok = ok;
+    _error = error;
+}
+
+matrix_load_progress::status matrix_load_progress::get_status()
+{
+    util::scoped_lock l(_lock);
+
+    status s;
+    s.nrows = _nrows;
+    s.ncols = _ncols;
+    s.fraction = 0.0f;
+    if (_nnz > 0) {
+        s.fraction = (float)std::min((double)_read/((double)_nnz*_passes), 1.0);
+    }
+    s.stage = _stage;
+    s.version = _version;
+    s.finished = _finished;
+    s.ok = _ok;
+    s.error = _error;
+    return (s);
+}
+
+void matrix_load_progress::draw_points(int r1, int r2)
+{
+    util::scoped_lock l(_lock);
+
+    glBegin(GL_POINTS);
+    for (std::deque<batch>::const_iterator bi = _batches.begin();
+         bi != _batches.end(); ++bi)
+    {
+        if (bi->last_row < r1 || bi->first_row > r2) { continue; }
+
+        const index_type *ij = &bi->ij[0], *ijend = ij + bi->ij.size();
+        for (; ij != ijend; ij += 2) {
+            glVertex2f((GLfloat)ij[1], (GLfloat)ij[0]);
+        }
+    }
+    glEnd();
+}
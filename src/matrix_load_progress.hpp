@@ -0,0 +1,116 @@
+#ifndef MATRIX_LOAD_PROGRESS_HPP
+#define MATRIX_LOAD_PROGRESS_HPP
+
+/**
+ * @file matrix_load_progress.hpp
+ * Share a matrix that is loading on a background thread with the
+ * display.
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+#include <yasmic/util/load_monitor.hpp>
+
+#include "util/thread.hpp"
+
+/**
+ * The matrix_load_progress class is the load_monitor for a matrix
+ * that loads on a background thread.  It tracks the fraction of the
+ * file that has been read and keeps the nonzeros from the first pass
+ * over the file in batches, along with the rows in each batch, so the
+ * canvas can draw the part of the matrix read so far.  For a file
+ * sorted by rows, each batch is a block of rows.
+ *
+ * At most about max_points nonzeros are kept; for a larger matrix,
+ * only every kth nonzero of each batch is kept.
+ *
+ * The loading threads call the load_monitor functions, set_stage, and
+ * finish.  The display thread calls get_status and draw_points.
+ */
+class matrix_load_progress
+    : public yasmic::load_monitor<int>
+{
+public:
+    typedef int index_type;
+
+    const static std::size_t max_points = 1<<22;
+
+    /** A copy of the state of the load for the display thread. */
+    struct status
+    {
+        index_type nrows;
+        index_type ncols;
+        float fraction;
+        std::string stage;
+        unsigned int version;   // changes when nonzeros are added
+        bool finished;
+        bool ok;
+        std::string error;
+    };
+
+    matrix_load_progress();
+
+    /**
+     * Start a new load and forget the last one.
+     * @param keep_points false to only track the progress
+     */
+    void reset(bool keep_points);
+
+    // the load_monitor interface
+    void begin(index_type nr, index_type nc, boost::uint64_t nnz, int passes);
+    void nonzeros(const index_type* r, const index_type* c, std::size_t n);
+    void advance(std::size_t n);
+
+    /** Name the current step of the load, e.g. "packing". */
+    void set_stage(const std::string& stage);
+
+    /**
+     * The load is done.
+     * @param error a description of the error if ok is false
+     */
+    void finish(bool ok, const std::string& error);
+
+    status get_status();
+
+    /**
+     * Draw the nonzeros in the rows r1 to r2 as points with the
+     * current color.
+     */
+    void draw_points(int r1, int r2);
+
+private:
+    matrix_load_progress(const matrix_load_progress&);
+    matrix_load_progress& operator= (const matrix_load_progress&);
+
+    struct batch
+    {
+        index_type first_row;
+        index_type last_row;
+        std::vector<index_type> ij;     // the row and column of each point
+    };
+
+    util::mutex _lock;
+
+    bool _keep_points;
+    index_type _nrows;
+    index_type _ncols;
+    boost::uint64_t _nnz;
+    int _passes;
+    std::size_t _stride;
+    boost::uint64_t _read;
+
+    std::string _stage;
+    std::deque<batch> _batches;
+    unsigned int _version;
+
+    bool _finished;
+    bool _ok;
+    std::string _error;
+};
+
+#endif // MATRIX_LOAD_PROGRESS_HPP
@@ -0,0 +1,157 @@
+/**
+ * @file matrix_point_buffer.cc
+ * Draw the nonzeros of a matrix from vertex buffer objects.
+ */
+
+#include "matrix_point_buffer.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+namespace {
+
+// the most points in one glDrawArrays call
+const int max_draw_points = 1<<24;
+
+const int no_key = -1;
+
+}
+
+matrix_point_buffer::matrix_point_buffer()
+: _positions(0), _colors(0), _positions_key(no_key), _colors_key(no_key),
+  _failed(false)
+{
+}
+
+bool matrix_point_buffer::supported()
+{
+    const char *v = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (!v || std::sscanf(v, "%d.%d", &major, &minor) != 2) { return (false); }
+    return (major > 1 || (major == 1 && minor >= 5));
+}
+
+bool matrix_point_buffer::usable()
+{
+    return (!_failed && supported());
+}
+
+void matrix_point_buffer::clear()
+{
+    if (_positions) { glDeleteBuffers(1, &_positions); }
+    if (_colors) { glDeleteBuffers(1, &_colors); }
+    _positions = _colors = 0;
+    _positions_key = _colors_key = no_key;
+    _failed = false;
+    std::vector<nz_index_type>().swap(_row_start);
+    std::vector<char>().swap(_staging);
+}
+
+/**
+ * Allocate a buffer with bytes and map it for writing, or use the
+ * staging array if it cannot be mapped.
+ * @return 0 if the buffer cannot be allocated
+ */
+void* matrix_point_buffer::map(GLuint& buffer, std::size_t bytes)
+{
+    while (glGetError() != GL_NO_ERROR) {}
+
+    if (!buffer) { glGenBuffers(1, &buffer); }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)bytes, 0, GL_STATIC_DRAW);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _failed = true;
+        return (0);
+    }
+
+    void *p = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    if (!p)
+    {
+        _staging.resize(std::max<std::size_t>(bytes, 1));
+        p = &_staging[0];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return (p);
+}
+
+bool matrix_point_buffer::unmap(GLuint buffer, std::size_t bytes)
+{
+    bool ok = true;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (!_staging.empty())
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)bytes, &_staging[0]);
+        std::vector<char>().swap(_staging);
+    }
+    else
+    {
+        // the contents are lost if the display changed while mapped
+        ok = (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return (ok);
+}
+
+GLfloat* matrix_point_buffer::map_positions(std::vector<nz_index_type>& row_start)
+{
+    _positions_key = _colors_key = no_key;
+    _row_start.swap(row_start);
+    std::size_t n = (std::size_t)size();
+    GLfloat *p = (GLfloat*)map(_positions, n*2*sizeof(GLfloat));
+    if (!p) { std::vector<nz_index_type>().swap(_row_start); }
+    return (p);
+}
+
+bool matrix_point_buffer::unmap_positions(int key)
+{
+    if (!unmap(_positions, (std::size_t)size()*2*sizeof(GLfloat))) { return (false); }
+    _positions_key = key;
+    return (true);
+}
+
+GLubyte* matrix_point_buffer::map_colors()
+{
+    _colors_key = no_key;
+    return ((GLubyte*)map(_colors, (std::size_t)size()*3));
+}
+
+bool matrix_point_buffer::unmap_colors(int key)
+{
+    if (!unmap(_colors, (std::size_t)size()*3)) { return (false); }
+    _colors_key = key;
+    return (true);
+}
+
+void matrix_point_buffer::draw(index_type r1, index_type r2, float alpha)
+{
+    index_type nrows = (index_type)_row_start.size() - 1;
+    r1 = std::max(r1, 0);
+    r2 = std::min(r2, nrows);
+    if (r1 >= r2) { return; }
+
+    glBlendColor(0.0f, 0.0f, 0.0f, alpha);
+    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, _positions);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, _colors);
+    glColorPointer(3, GL_UNSIGNED_BYTE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    nz_index_type end = _row_start[r2];
+    for (nz_index_type k = _row_start[r1]; k < end; k += max_draw_points)
+    {
+        glDrawArrays(GL_POINTS, (GLint)k,
+            (GLsizei)std::min<nz_index_type>(max_draw_points, end - k));
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
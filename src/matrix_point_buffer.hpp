@@ -0,0 +1,106 @@
+#ifndef MATRIX_POINT_BUFFER_HPP
+#define MATRIX_POINT_BUFFER_HPP
+
+/**
+ * @file matrix_point_buffer.hpp
+ * The nonzeros of a matrix as points in OpenGL vertex buffer objects.
+ */
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "xplat_gl.h"
+
+/**
+ * The matrix_point_buffer class keeps one point for each nonzero of
+ * the matrix in two vertex buffer objects: the position of the point
+ * on the display, and its color.  The points are ordered by the row
+ * of the display, and row_start has the first point of each row, so
+ * any range of rows is drawn with a few glDrawArrays calls.
+ *
+ * The positions and the colors are filled separately, each with a
+ * key for what they were built from, so the canvas only rebuilds the
+ * positions when the permutation changes and the colors when the
+ * normalization or the colormap changes.  The buffers are mapped
+ * while they are filled, so the points are never copied on the host,
+ * and they can be filled by many threads.  The alpha of the points
+ * changes with the zoom, so it is not in the colors; it is the
+ * constant blend color instead.
+ *
+ * All the functions but fill need the OpenGL context of the canvas.
+ */
+class matrix_point_buffer
+{
+public:
+    typedef int index_type;
+    typedef boost::int64_t nz_index_type;
+
+    // the most points kept in the buffers, 12 bytes each
+    const static int max_points = 1<<26;
+
+    matrix_point_buffer();
+
+    /** @return true if OpenGL has vertex buffer objects */
+    static bool supported();
+
+    /**
+     * @return false if the buffers cannot be used, because OpenGL does
+     * not have them or a buffer could not be allocated
+     */
+    bool usable();
+
+    /** Free the buffers and forget the points. */
+    void clear();
+
+    bool has_positions(int key) const
+    { return (_positions_key == key && !_row_start.empty()); }
+    bool has_colors(int key) const
+    { return (_colors_key == key && has_positions(_positions_key)); }
+
+    /**
+     * Allocate the positions of the points, two floats for each, and
+     * map them.  This forgets the colors.
+     *
+     * @param row_start the first point of each row of the display,
+     * and the number of points at the end; swapped into the buffer
+     * @return the positions to fill, or 0 if there is no memory
+     */
+    GLfloat* map_positions(std::vector<nz_index_type>& row_start);
+    bool unmap_positions(int key);
+
+    /**
+     * Allocate the colors of the points, three bytes for each, and
+     * map them.
+     * @return the colors to fill, or 0 if there is no memory
+     */
+    GLubyte* map_colors();
+    bool unmap_colors(int key);
+
+    const std::vector<nz_index_type>& row_start() const { return (_row_start); }
+    nz_index_type size() const
+    { return (_row_start.empty() ? 0 : _row_start.back()); }
+
+    /** Draw the points in the rows r1 to r2-1 of the display. */
+    void draw(index_type r1, index_type r2, float alpha);
+
+private:
+    matrix_point_buffer(const matrix_point_buffer&);
+    matrix_point_buffer& operator= (const matrix_point_buffer&);
+
+    void* map(GLuint& buffer, std::size_t bytes);
+    bool unmap(GLuint buffer, std::size_t bytes);
+
+    GLuint _positions;
+    GLuint _colors;
+    int _positions_key;
+    int _colors_key;
+    bool _failed;
+
+    std::vector<nz_index_type> _row_start;
+
+    // the points when a buffer cannot be mapped
+    std::vector<char> _staging;
+};
+
+#endif // MATRIX_POINT_BUFFER_HPP
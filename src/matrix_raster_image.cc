@@ -0,0 +1,106 @@
+/**
+ * @file matrix_raster_image.cc
+ * Keep a CPU rasterized image of a matrix in a texture.
+ */
+
+#include "matrix_raster_image.hpp"
+
+#include <algorithm>
+
+void matrix_pixel_bins::reset(int width, int height)
+{
+    _width = std::max(width, 0);
+    _height = std::max(height, 0);
+
+    std::size_t n = (std::size_t)_width*_height;
+    _count.resize(n);
+    _max.resize(n);
+
+    std::ptrdiff_t rows = _height;
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t y = 0; y < rows; ++y)
+    {
+        std::fill(count_row((int)y), count_row((int)y) + _width, 0);
+        std::fill(max_row((int)y), max_row((int)y) + _width,
+            -std::numeric_limits<float>::max());
+    }
+}
+
+void matrix_pixel_bins::clear()
+{
+    _width = _height = 0;
+    std::vector<boost::uint32_t>().swap(_count);
+    std::vector<float>().swap(_max);
+}
+
+void matrix_raster_image::clear()
+{
+    if (_texture) { glDeleteTextures(1, &_texture); }
+    _texture = 0;
+    _texture_width = _texture_height = 0;
+    _bins.clear();
+    std::vector<GLubyte>().swap(_rgba);
+    _valid = false;
+}
+
+void matrix_raster_image::reset(int width, int height)
+{
+    _valid = false;
+    _bins.reset(width, height);
+    _rgba.resize(4*(std::size_t)_bins.width()*_bins.height());
+}
+
+bool matrix_raster_image::upload(const key_type& k)
+{
+    int w = width(), h = height();
+    if (w <= 0 || h <= 0) { return (false); }
+
+    // a power of two texture that holds the image, for any OpenGL
+    int tw = 1, th = 1;
+    while (tw < w) { tw *= 2; }
+    while (th < h) { th *= 2; }
+
+    if (!_texture) { glGenTextures(1, &_texture); }
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    if (tw != _texture_width || th != _texture_height)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tw, th, 0, GL_RGBA,
+            GL_UNSIGNED_BYTE, 0);
+        _texture_width = tw;
+        _texture_height = th;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA,
+        GL_UNSIGNED_BYTE, &_rgba[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _key = k;
+    _valid = true;
+    return (true);
+}
+
+void matrix_raster_image::draw(float x1, float y1, float x2, float y2)
+{
+    if (!_valid) { return; }
+
+    // row 0 of the image is at y1
+    float u = (float)width()/_texture_width;
+    float v = (float)height()/_texture_height;
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(x1, y1);
+    glTexCoord2f(u, 0.0f); glVertex2f(x2, y1);
+    glTexCoord2f(u, v); glVertex2f(x2, y2);
+    glTexCoord2f(0.0f, v); glVertex2f(x1, y2);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+}
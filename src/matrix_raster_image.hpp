@@ -0,0 +1,113 @@
+#ifndef MATRIX_RASTER_IMAGE_HPP
+#define MATRIX_RASTER_IMAGE_HPP
+
+/**
+ * @file matrix_raster_image.hpp
+ * An image of the nonzeros of a matrix rasterized on the CPU.
+ */
+
+#include <vector>
+#include <limits>
+
+#include <boost/cstdint.hpp>
+
+#include "xplat_gl.h"
+
+/**
+ * The number of nonzeros on each pixel of an image and the largest of
+ * their values, as rows of pixels that can each be filled by its own
+ * thread.
+ */
+class matrix_pixel_bins
+{
+public:
+    matrix_pixel_bins() : _width(0), _height(0) {}
+
+    /** Size the bins and clear every pixel. */
+    void reset(int width, int height);
+
+    /** Free the bins. */
+    void clear();
+
+    int width() const { return (_width); }
+    int height() const { return (_height); }
+
+    boost::uint32_t* count_row(int y) { return (&_count[(std::size_t)y*_width]); }
+    float* max_row(int y) { return (&_max[(std::size_t)y*_width]); }
+    const boost::uint32_t* count_row(int y) const { return (&_count[(std::size_t)y*_width]); }
+    const float* max_row(int y) const { return (&_max[(std::size_t)y*_width]); }
+
+private:
+    int _width, _height;
+    std::vector<boost::uint32_t> _count;
+    std::vector<float> _max;
+};
+
+/**
+ * The matrix_raster_image class holds one accumulation image with a
+ * pixel for each pixel of the window.  The owner bins the nonzeros
+ * into bins(), then colors the pixels in rgba(), and the image is 
+ * uploaded as a single texture and drawn as one quad over the view.
+ *
+ * The key says what the image was drawn from, so a redraw of the same
+ * view, e.g. when only the data cursor moved, just draws the texture.
+ *
+ * upload, draw, and clear need the OpenGL context of the canvas.
+ */
+class matrix_raster_image
+{
+public:
+    /** What the image was drawn from. */
+    struct key_type
+    {
+        float x1, y1, x2, y2;
+        int width, height;
+        int state;
+        float alpha;
+
+        bool operator== (const key_type& k) const
+        {
+            return (x1 == k.x1 && y1 == k.y1 && x2 == k.x2 && y2 == k.y2
+                && width == k.width && height == k.height && state == k.state
+                && alpha == k.alpha);
+        }
+    };
+
+    matrix_raster_image() : _texture(0), _texture_width(0), 
+        _texture_height(0), _valid(false) {}
+
+    bool has_key(const key_type& k) const { return (_valid && _key == k); }
+
+    /** Free the texture and the image. */
+    void clear();
+
+    /** Size the image and clear every pixel. */
+    void reset(int width, int height);
+
+    int width() const { return (_bins.width()); }
+    int height() const { return (_bins.height()); }
+
+    matrix_pixel_bins& bins() { return (_bins); }
+    GLubyte* rgba() { return (_rgba.empty() ? 0 : &_rgba[0]); }
+
+    /** Upload the rgba pixels to the texture. */
+    bool upload(const key_type& k);
+
+    /** Draw the image over the world rectangle x1,y1 to x2,y2. */
+    void draw(float x1, float y1, float x2, float y2);
+
+private:
+    matrix_raster_image(const matrix_raster_image&);
+    matrix_raster_image& operator= (const matrix_raster_image&);
+
+    matrix_pixel_bins _bins;
+    std::vector<GLubyte> _rgba;
+
+    GLuint _texture;
+    int _texture_width, _texture_height;
+
+    key_type _key;
+    bool _valid;
+};
+
+#endif // MATRIX_RASTER_IMAGE_HPP
@@ -0,0 +1,284 @@
+/**
+ * @file matrix_texture_tiles.cc
+ * Render tiles of the display on a background thread and keep them as
+ * textures.
+ */
+
+#include "matrix_texture_tiles.hpp"
+
+#include <algorithm>
+
+matrix_texture_tiles::matrix_texture_tiles()
+: _render(0), _render_arg(0), _memory_limit((boost::uint64_t)256 << 20),
+  _resident(0), _frame(0), _state(-1), _rendering(false), _stop(false)
+{
+}
+
+matrix_texture_tiles::~matrix_texture_tiles()
+{
+    // the window, and with it the textures, is already gone
+    if (_thread.running())
+    {
+        {
+            util::scoped_lock l(_lock);
+            _stop = true;
+            _wake.notify_all();
+        }
+        _thread.join();
+    }
+    _dead_textures.clear();
+    for (std::map<tile_id, tile_entry*>::iterator it = _tiles.begin();
+         it != _tiles.end(); ++it)
+    {
+        delete it->second->pixels;
+        delete it->second;
+    }
+    for (std::size_t i = 0; i < _free_pixels.size(); ++i) { delete _free_pixels[i]; }
+}
+
+bool matrix_texture_tiles::start(render_function render, void *arg)
+{
+    if (_thread.running()) { return (true); }
+
+    _render = render;
+    _render_arg = arg;
+    _stop = false;
+    return (_thread.start(&matrix_texture_tiles::render_thread, this));
+}
+
+void matrix_texture_tiles::clear()
+{
+    if (_thread.running())
+    {
+        {
+            util::scoped_lock l(_lock);
+            _stop = true;
+            _wake.notify_all();
+        }
+        _thread.join();
+    }
+
+    util::scoped_lock l(_lock);
+    free_tiles();
+    for (std::size_t i = 0; i < _free_pixels.size(); ++i) { delete _free_pixels[i]; }
+    _free_pixels.clear();
+    if (!_dead_textures.empty()) {
+        glDeleteTextures((GLsizei)_dead_textures.size(), &_dead_textures[0]);
+        _dead_textures.clear();
+    }
+    _queue.clear();
+    _state = -1;
+    _stop = false;
+}
+
+void matrix_texture_tiles::set_memory_limit(boost::uint64_t bytes)
+{
+    util::scoped_lock l(_lock);
+    _memory_limit = bytes;
+}
+
+int matrix_texture_tiles::state()
+{
+    util::scoped_lock l(_lock);
+    return (_state);
+}
+
+void matrix_texture_tiles::set_state(int state)
+{
+    util::scoped_lock l(_lock);
+    if (state == _state) { return; }
+
+    _state = state;
+    _queue.clear();
+    while (_rendering) { _idle.wait(_lock); }
+    free_tiles();
+}
+
+void matrix_texture_tiles::begin_frame()
+{
+    util::scoped_lock l(_lock);
+    ++_frame;
+}
+
+void matrix_texture_tiles::upload()
+{
+    util::scoped_lock l(_lock);
+
+    if (!_dead_textures.empty()) {
+        glDeleteTextures((GLsizei)_dead_textures.size(), &_dead_textures[0]);
+        _dead_textures.clear();
+    }
+
+    for (std::size_t i = 0; i < _ready.size(); ++i)
+    {
+        std::map<tile_id, tile_entry*>::iterator it = _tiles.find(_ready[i]);
+        if (it == _tiles.end() || !it->second->pixels) { continue; }
+        tile_entry *t = it->second;
+
+        glGenTextures(1, &t->texture);
+        glBindTexture(GL_TEXTURE_2D, t->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile_pixels, tile_pixels, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, &(*t->pixels)[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // keep one buffer for the next tile
+        if (_free_pixels.empty()) { _free_pixels.push_back(t->pixels); }
+        else { delete t->pixels; }
+        t->pixels = 0;
+    }
+    _ready.clear();
+}
+
+bool matrix_texture_tiles::find(int level, int tr, int tc, GLuint& texture)
+{
+    util::scoped_lock l(_lock);
+    std::map<tile_id, tile_entry*>::iterator it =
+        _tiles.find(make_id(level, tr, tc));
+    if (it == _tiles.end() || it->second->pixels) { return (false); }
+
+    tile_entry *t = it->second;
+    t->frame = _frame;
+    _lru.splice(_lru.begin(), _lru, t->lru);
+    texture = t->texture;
+    return (true);
+}
+
+void matrix_texture_tiles::request(int level,
+    const std::vector<std::pair<int,int> >& tiles)
+{
+    util::scoped_lock l(_lock);
+    _queue.clear();
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+        tile_id id = make_id(level, tiles[i].first, tiles[i].second);
+        if (_tiles.find(id) == _tiles.end()) { _queue.push_back(id); }
+    }
+    if (!_queue.empty()) { _wake.notify_one(); }
+}
+
+bool matrix_texture_tiles::pending()
+{
+    util::scoped_lock l(_lock);
+    return (!_queue.empty() || _rendering || !_ready.empty());
+}
+
+boost::uint64_t matrix_texture_tiles::resident_bytes()
+{
+    util::scoped_lock l(_lock);
+    return (_resident);
+}
+
+void matrix_texture_tiles::evict(tile_id id)
+{
+    std::map<tile_id, tile_entry*>::iterator it = _tiles.find(id);
+    tile_entry *t = it->second;
+    if (t->texture) { _dead_textures.push_back(t->texture); }
+    delete t->pixels;
+    _lru.erase(t->lru);
+    _resident -= t->bytes;
+    _tiles.erase(it);
+    delete t;
+}
+
+void matrix_texture_tiles::free_tiles()
+{
+    while (!_lru.empty()) { evict(_lru.back()); }
+    _ready.clear();
+}
+
+/**
+ * Free the least recently used tiles from earlier frames until there
+ * is room for bytes more within the memory limit.
+ *
+ * @return false if there is not enough room
+ */
+bool matrix_texture_tiles::make_room(boost::uint64_t bytes)
+{
+    if (bytes > _memory_limit) { return (false); }
+
+    std::list<tile_id>::iterator it = _lru.end();
+    while (_resident + bytes > _memory_limit && it != _lru.begin())
+    {
+        --it;
+        if (_tiles[*it]->frame == _frame) { continue; }
+        tile_id id = *it;
+        ++it;
+        evict(id);
+    }
+    return (_resident + bytes <= _memory_limit);
+}
+
+void matrix_texture_tiles::render_thread(void *arg)
+{
+    ((matrix_texture_tiles*)arg)->render_loop();
+}
+
+/**
+ * Render the tiles in the queue until the thread is stopped.  A tile
+ * rendered for an old state is dropped, and once the tiles of this
+ * frame fill the memory, the rest of the queue is dropped as well.
+ */
+void matrix_texture_tiles::render_loop()
+{
+    const std::size_t tile_bytes = 4*(std::size_t)tile_pixels*tile_pixels;
+
+    _lock.lock();
+    for (;;)
+    {
+        while (!_stop && _queue.empty()) { _wake.wait(_lock); }
+        if (_stop) { break; }
+
+        tile_id id = _queue.front();
+        _queue.pop_front();
+        if (_tiles.find(id) != _tiles.end()) { continue; }
+
+        std::vector<GLubyte> *pixels;
+        if (_free_pixels.empty()) {
+            pixels = new std::vector<GLubyte>(tile_bytes);
+        } else {
+            pixels = _free_pixels.back();
+            _free_pixels.pop_back();
+        }
+        int state = _state;
+        _rendering = true;
+
+        _lock.unlock();
+        int level = (int)(id >> 48);
+        int tr = (int)((id >> 24) & 0xffffff), tc = (int)(id & 0xffffff);
+        bool nonempty = _render(_render_arg, level, tr, tc, &(*pixels)[0]);
+        _lock.lock();
+
+        _rendering = false;
+        _idle.notify_all();
+
+        boost::uint64_t bytes = nonempty ? tile_bytes : 0;
+        if (state != _state || !make_room(bytes))
+        {
+            if (state == _state) { _queue.clear(); }
+            _free_pixels.push_back(pixels);
+            continue;
+        }
+
+        tile_entry *t = new tile_entry;
+        t->texture = 0;
+        t->pixels = 0;
+        t->bytes = bytes;
+        t->frame = _frame;
+        if (nonempty) {
+            t->pixels = pixels;
+            _ready.push_back(id);
+        } else {
+            _free_pixels.push_back(pixels);
+        }
+        _tiles[id] = t;
+        _lru.push_front(id);
+        t->lru = _lru.begin();
+        _resident += t->bytes;
+    }
+    _lock.unlock();
+}
@@ -0,0 +1,138 @@
+#ifndef MATRIX_TEXTURE_TILES_HPP
+#define MATRIX_TEXTURE_TILES_HPP
+
+/**
+ * @file matrix_texture_tiles.hpp
+ * A cache of pre-rendered texture tiles of the display, so panning
+ * only renders the tiles that come into view.
+ */
+
+#include <vector>
+#include <list>
+#include <map>
+#include <deque>
+
+#include <boost/cstdint.hpp>
+
+#include "xplat_gl.h"
+#include "util/thread.hpp"
+
+/**
+ * The matrix_texture_tiles class keeps rendered tiles of the display
+ * as textures.  Level l divides the display into squares of
+ * tile_pixels << l rows and columns, and each pixel of a tile at
+ * level l covers 2^l rows and columns.
+ *
+ * Requested tiles are rendered on a background thread by the render
+ * function given to start, which fills the rgba pixels of a tile and
+ * returns false if it has no nonzeros.  Each call to upload turns the
+ * finished tiles into textures, so all of the OpenGL calls are on the
+ * display thread.  The tiles in memory, as pixels or as textures, use
+ * at most the memory limit, and the least recently used tiles that are
+ * not part of the current frame are freed to make room.
+ *
+ * The state says how the tiles were rendered, e.g. the permutation and
+ * the colormap.  Changing it throws out every tile.
+ */
+class matrix_texture_tiles
+{
+public:
+    // the pixels on each side of a tile
+    const static int tile_pixels = 1024;
+
+    typedef bool (*render_function)(void *arg, int level, int tr, int tc,
+        GLubyte *rgba);
+
+    matrix_texture_tiles();
+    ~matrix_texture_tiles();
+
+    /**
+     * Start the thread that renders tiles with render(arg, ...).
+     * @return false if the thread could not be started
+     */
+    bool start(render_function render, void *arg);
+    bool is_running() const { return (_thread.running()); }
+
+    /** Stop the render thread and free every tile. */
+    void clear();
+
+    void set_memory_limit(boost::uint64_t bytes);
+
+    int state();
+
+    /**
+     * Throw out every tile and request unless they have this state.
+     * This waits for the tile being rendered, so the render function
+     * can change what it draws from once it returns.
+     */
+    void set_state(int state);
+
+    void begin_frame();
+
+    /** Make textures of the finished tiles. */
+    void upload();
+
+    /**
+     * Find tile (tr,tc) of a level and keep it for this frame.
+     * @param texture the texture of the tile, or 0 if it is empty
+     * @return false if the tile is not rendered yet
+     */
+    bool find(int level, int tr, int tc, GLuint& texture);
+
+    /** Replace the queue of tiles to render, in order. */
+    void request(int level, const std::vector<std::pair<int,int> >& tiles);
+
+    /** Are tiles still waiting to be rendered or uploaded? */
+    bool pending();
+
+    /** The bytes of all the tiles in memory. */
+    boost::uint64_t resident_bytes();
+
+private:
+    matrix_texture_tiles(const matrix_texture_tiles&);
+    matrix_texture_tiles& operator= (const matrix_texture_tiles&);
+
+    typedef boost::uint64_t tile_id;
+    static tile_id make_id(int level, int tr, int tc)
+    { return (((tile_id)level << 48) | ((tile_id)tr << 24) | (tile_id)tc); }
+
+    struct tile_entry
+    {
+        GLuint texture;
+        std::vector<GLubyte> *pixels;
+        boost::uint64_t bytes;
+        unsigned int frame;
+        std::list<tile_id>::iterator lru;
+    };
+
+    bool make_room(boost::uint64_t bytes);
+    void evict(tile_id id);
+    void free_tiles();
+
+    static void render_thread(void *arg);
+    void render_loop();
+
+    render_function _render;
+    void *_render_arg;
+    boost::uint64_t _memory_limit;
+
+    // everything below is protected by _lock
+    util::mutex _lock;
+    util::condition _wake;
+    util::condition _idle;
+    std::map<tile_id, tile_entry*> _tiles;
+    std::list<tile_id> _lru;
+    std::deque<tile_id> _queue;
+    std::vector<tile_id> _ready;
+    std::vector<GLuint> _dead_textures;
+    std::vector<std::vector<GLubyte>*> _free_pixels;
+    boost::uint64_t _resident;
+    unsigned int _frame;
+    int _state;
+    bool _rendering;
+    bool _stop;
+
+    util::thread _thread;
+};
+
+#endif // MATRIX_TEXTURE_TILES_HPP
@@ -0,0 +1,1109 @@
+/**
+ * @file matrix_tiles.cc
+ * Write, map, and prefetch the tiles of a .vmtiles file.
+ */
+
+/*
+ * The .vmtiles file holds a tile_file_header followed by
+ *
+ *   the tiles, each one at an offset aligned to tile_alignment bytes
+ *   rnorm      nrows value_type
+ *   cnorm      ncols value_type
+ *   directory  tile_rows*tile_cols tile_dir_entry, row major
+ *
+ * Tile (tr,tc) covers the rows tr*tile_size to (tr+1)*tile_size-1 and
+ * the same range of columns with tc.  A tile only stores its rows
+ * with nonzeros, so a tile with nnz nonzeros in rows of its rows is
+ *
+ *   aj     nnz index_type, the columns of the whole matrix
+ *   a      nnz values of value_size bytes (none for a pattern)
+ *   ar     rows index_type, the stored rows from the first row of the
+ *          tile, in order
+ *   ai     rows+1 index_type or nz_index_type (see offset_size), the
+ *          start of each stored row
+ *
+ * with each array aligned to tile_alignment bytes from the start of
+ * the tile.  The size of a tile is then bounded by its nonzeros and
+ * not by tile_size, however scattered they are.  Empty tiles are not
+ * stored and have nnz = 0 in the directory, so finding the tiles in a
+ * region of the matrix never touches the tiles themselves.
+ */
+
+#include "matrix_tiles.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+
+#include <yasmic/verbose_util.hpp>
+
+namespace {
+
+const char tile_magic[8] = { 'V','M','T','I','L','E','S','\0' };
+const boost::uint32_t tile_version = 2;
+const boost::uint32_t tile_byte_order = 0x01020304;
+const boost::uint64_t tile_alignment = 64;
+
+// tiles are at least this large, and grow until there are at most
+// max_tiles_per_side tiles in each direction
+const int min_tile_size = 4096;
+const int max_tiles_per_side = 1024;
+
+// each mapped tile is a mapping of its own, which takes whole pages,
+// and the number of mappings of a process is limited (65530 by default
+// on linux), so a limit on the memory alone could map too many tiles
+const boost::uint64_t tile_page_size = 4096;
+const std::size_t max_mapped_tiles = 16384;
+
+// the memory for the buffers of the staged nonzeros, and the staged
+// nonzeros read at once to pick out part of a band
+const std::size_t staging_buffer_entries = 1<<21;
+const std::size_t read_buffer_entries = 1<<16;
+
+struct tile_file_header
+{
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t byte_order;
+    boost::uint32_t index_size;
+    boost::uint32_t value_size;
+    boost::uint32_t symmetrize;
+    boost::uint32_t value_storage;
+    boost::uint32_t tile_size;
+    boost::uint32_t reserved;
+
+    boost::uint64_t source_size;
+    boost::int64_t source_mtime;
+
+    boost::int64_t nrows;
+    boost::int64_t ncols;
+    boost::int64_t nnz;
+    boost::int64_t tile_rows;
+    boost::int64_t tile_cols;
+
+    double min_val;
+    double max_val;
+    boost::int64_t min_degree;
+    boost::int64_t max_degree;
+
+    boost::uint64_t rnorm_offset;
+    boost::uint64_t cnorm_offset;
+    boost::uint64_t directory_offset;
+    boost::uint64_t file_size;
+};
+
+struct tile_dir_entry
+{
+    boost::uint64_t offset;
+    boost::int64_t nnz;
+    boost::uint32_t offset_size;
+    boost::uint32_t rows;
+};
+
+boost::uint64_t tile_align(boost::uint64_t off)
+{
+    return ((off + tile_alignment - 1)/tile_alignment*tile_alignment);
+}
+
+/**
+ * Compute the offsets of the arrays in a tile, relative to the start
+ * of the tile, and the size of the tile.
+ */
+void tile_layout(boost::uint64_t nnz, boost::uint64_t rows,
+    boost::uint64_t offset_size, boost::uint64_t value_size,
+    boost::uint64_t& a_offset, boost::uint64_t& ar_offset,
+    boost::uint64_t& ai_offset, boost::uint64_t& bytes)
+{
+    a_offset = tile_align(sizeof(int)*nnz);
+    ar_offset = tile_align(a_offset + value_size*nnz);
+    ai_offset = tile_align(ar_offset + sizeof(int)*rows);
+    bytes = ai_offset + offset_size*(rows+1);
+}
+
+int tile_size_for(boost::int64_t n)
+{
+    boost::int64_t t = min_tile_size;
+    while ((n + t - 1)/t > max_tiles_per_side) { t *= 2; }
+    return ((int)t);
+}
+
+bool seek_file(FILE *f, boost::uint64_t off)
+{
+#ifdef _WIN32
+    return (_fseeki64(f, (__int64)off, SEEK_SET) == 0);
+#else
+    return (fseeko(f, (off_t)off, SEEK_SET) == 0);
+#endif
+}
+
+/**
+ * Write an array at offset, after zero padding from the current
+ * position pos.  On return, pos is the position after the array.
+ */
+bool write_tile_array(FILE *f, boost::uint64_t& pos, boost::uint64_t offset,
+    const void *data, size_t size)
+{
+    static const char zeros[tile_alignment] = { 0 };
+    if (pos > offset || offset - pos > tile_alignment) { return (false); }
+    size_t pad = (size_t)(offset - pos);
+    if (pad > 0 && fwrite(zeros, 1, pad, f) != pad) { return (false); }
+    if (size > 0 && fwrite(data, 1, size, f) != size) { return (false); }
+    pos = offset + size;
+    return (true);
+}
+
+/**
+ * Order the nonzeros of a band by tile, and then by row and column.
+ */
+template <class Entry>
+struct tile_order
+{
+    tile_order(int t) : tile_size(t) {}
+    bool operator() (const Entry& a, const Entry& b) const
+    {
+        int ta = a.c/tile_size, tb = b.c/tile_size;
+        if (ta != tb) { return (ta < tb); }
+        if (a.r != b.r) { return (a.r < b.r); }
+        return (a.c < b.c);
+    }
+    int tile_size;
+};
+
+}
+
+bool matrix_source_info(const std::string& filename,
+    boost::uint64_t& size, boost::int64_t& mtime)
+{
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_stat64(filename.c_str(), &st) != 0) { return (false); }
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) { return (false); }
+#endif
+    size = (boost::uint64_t)st.st_size;
+    mtime = (boost::int64_t)st.st_mtime;
+    return (true);
+}
+
+/*
+ * =================
+ * matrix_tile_writer
+ * =================
+ */
+
+matrix_tile_writer::matrix_tile_writer(const std::string& filename,
+    index_type nrows, index_type ncols, bool symmetrize)
+: _filename(filename), _src_nrows(nrows), _src_ncols(ncols),
+  _nrows(nrows), _ncols(ncols), _symmetrize(symmetrize), _memory_limit(0),
+  _bad(false), _bad_r(0), _bad_c(0), _unit_values(true), _error(false),
+  _buffer_size(0), _staging(0), _value_size(0), _nnz(0),
+  _out_offset(0), _out_nnz(0), _out_pieces(false), _values(0), _values_bytes(0)
+{
+    if (symmetrize) {
+        _nrows = std::max(nrows, ncols);
+        _ncols = _nrows;
+    }
+    _tile_size = tile_size_for(std::max(_nrows, _ncols));
+    _tile_rows = (int)((_nrows + (nz_index_type)_tile_size - 1)/_tile_size);
+    _tile_cols = (int)((_ncols + (nz_index_type)_tile_size - 1)/_tile_size);
+    _band_nnz.assign(_tile_rows, 0);
+    _tile_nnz.assign((std::size_t)_tile_rows*_tile_cols, 0);
+}
+
+matrix_tile_writer::~matrix_tile_writer()
+{
+    if (_staging) {
+        fclose(_staging);
+        remove((_filename + ".tmp.coo").c_str());
+    }
+    if (_values) {
+        fclose(_values);
+        remove((_filename + ".tmp.val").c_str());
+    }
+}
+
+bool matrix_tile_writer::start_add()
+{
+    using namespace std;
+
+    if (_bad) {
+        cerr << "error: invalid matrix data, nrows or ncols exceeded ("
+             << _bad_r << "," << _bad_c << ")" << endl;
+        return (false);
+    }
+
+    _band_start.assign(_tile_rows, 0);
+    for (int b = 1; b < _tile_rows; ++b) {
+        _band_start[b] = _band_start[b-1] + _band_nnz[b-1];
+    }
+    _band_staged.assign(_tile_rows, 0);
+    _band_buffer.resize(_tile_rows);
+    _buffer_size = std::max((std::size_t)256,
+                            staging_buffer_entries/std::max(_tile_rows,1));
+
+    std::string staging = _filename + ".tmp.coo";
+    _staging = fopen(staging.c_str(), "w+b");
+    if (!_staging) {
+        cerr << "error: cannot write " << staging << endl;
+        return (false);
+    }
+    return (true);
+}
+
+void matrix_tile_writer::stage(index_type r, index_type c, value_type v)
+{
+    int b = r/_tile_size;
+    std::vector<entry>& buf = _band_buffer[b];
+    if (buf.capacity() < _buffer_size) { buf.reserve(_buffer_size); }
+    entry e = { r, c, v };
+    buf.push_back(e);
+    if (buf.size() >= _buffer_size) { flush(b); }
+}
+
+bool matrix_tile_writer::flush(int b)
+{
+    std::vector<entry>& buf = _band_buffer[b];
+    if (buf.empty()) { return (!_error); }
+
+    // the second pass must not give more nonzeros than the first
+    if (_band_staged[b] + (nz_index_type)buf.size() > _band_nnz[b]
+        || !seek_file(_staging,
+                sizeof(entry)*(boost::uint64_t)(_band_start[b] + _band_staged[b]))
+        || fwrite(&buf[0], sizeof(entry), buf.size(), _staging) != buf.size())
+    {
+        _error = true;
+    }
+    _band_staged[b] += buf.size();
+    buf.clear();
+    return (!_error);
+}
+
+/**
+ * Read the staged nonzeros of band b from k on into buf, at most
+ * buf.size() of them.  On return, buf has the nonzeros read.
+ */
+bool matrix_tile_writer::read_staged(int b, nz_index_type k,
+    std::vector<entry>& buf)
+{
+    std::size_t n = (std::size_t)std::min<nz_index_type>(
+                        (nz_index_type)buf.size(), _band_nnz[b] - k);
+    buf.resize(n);
+    return (n == 0
+        || (seek_file(_staging, sizeof(entry)*(boost::uint64_t)(_band_start[b] + k))
+            && fread(&buf[0], sizeof(entry), n, _staging) == n));
+}
+
+/** Is e in the tile columns tc1 to tc2-1 and the rows r1 to r2-1? */
+bool matrix_tile_writer::in_range(const entry& e, int tc1, int tc2,
+    index_type r1, index_type r2) const
+{
+    int tc = e.c/_tile_size;
+    return (tc >= tc1 && tc < tc2 && e.r >= r1 && e.r < r2);
+}
+
+/**
+ * Read the n staged nonzeros of band b in the tile columns tc1 to
+ * tc2-1 and the rows r1 to r2-1 into e, sort them by tile, row, and
+ * column, and add together repeated entries, in single precision for
+ * float values as in a matrix loaded into memory.
+ */
+bool matrix_tile_writer::read_band(int b, int tc1, int tc2,
+    index_type r1, index_type r2, nz_index_type n, std::vector<entry>& e)
+{
+    if (n == _band_nnz[b])
+    {
+        // all of the band, which is read at once and then only checked
+        e.resize((std::size_t)n);
+        if (!read_staged(b, 0, e)) { return (false); }
+        std::size_t m = 0;
+        for (std::size_t k = 0; k < e.size(); ++k) {
+            if (in_range(e[k], tc1, tc2, r1, r2)) { e[m++] = e[k]; }
+        }
+        e.resize(m);
+    }
+    else
+    {
+        e.clear();
+        e.reserve((std::size_t)n);
+        std::vector<entry> buf;
+        for (nz_index_type k = 0; k < _band_nnz[b]; k += buf.size())
+        {
+            buf.resize(read_buffer_entries);
+            if (!read_staged(b, k, buf)) { return (false); }
+            for (std::size_t i = 0; i < buf.size(); ++i) {
+                if (in_range(buf[i], tc1, tc2, r1, r2)) { e.push_back(buf[i]); }
+            }
+        }
+    }
+
+    std::sort(e.begin(), e.end(), tile_order<entry>(_tile_size));
+
+    bool single = (_value_size == sizeof(float));
+    std::size_t m = 0;
+    for (std::size_t k = 0; k < e.size(); ++k) {
+        if (single) { e[k].v = (value_type)(float)e[k].v; }
+        if (m > 0 && e[m-1].r == e[k].r && e[m-1].c == e[k].c) {
+            e[m-1].v += e[k].v;
+            if (single) { e[m-1].v = (value_type)(float)e[m-1].v; }
+        } else {
+            e[m++] = e[k];
+        }
+    }
+    e.resize(m);
+    return (true);
+}
+
+/**
+ * Start a tile at the next aligned offset of f.
+ *
+ * @param pieces the rows of the tile are added in more than one piece,
+ * so its values go to the values file until end_tile
+ */
+bool matrix_tile_writer::begin_tile(boost::uint64_t pos, bool pieces)
+{
+    _out_offset = tile_align(pos);
+    _out_nnz = 0;
+    _out_pieces = pieces;
+    _out_ar.clear();
+    _out_ai.assign(1, 0);
+    _out_a.clear();
+    _out_a_float.clear();
+    _values_bytes = 0;
+
+    if (!pieces) { return (true); }
+    std::string values = _filename + ".tmp.val";
+    if (!_values && !(_values = fopen(values.c_str(), "w+b"))) {
+        std::cerr << "error: cannot write " << values << std::endl;
+        return (false);
+    }
+    return (seek_file(_values, 0));
+}
+
+/**
+ * Add the n nonzeros e, which are sorted by row and column, to the
+ * tile after the rows added so far.  Their columns are written to f
+ * right away.  This also accumulates the statistics of the matrix.
+ */
+bool matrix_tile_writer::add_tile_rows(const entry *e, std::size_t n,
+    FILE *f, boost::uint64_t& pos)
+{
+    if (n == 0) { return (true); }
+
+    index_type row0 = e[0].r/_tile_size*_tile_size;
+    _out_aj.resize(n);
+    for (std::size_t k = 0; k < n; ++k)
+    {
+        index_type li = e[k].r - row0;
+        if (_out_ar.empty() || _out_ar.back() != li) {
+            _out_ar.push_back(li);
+            _out_ai.push_back(_out_ai.back());
+        }
+        ++_out_ai.back();
+        _out_aj[k] = e[k].c;
+
+        value_type v = e[k].v;
+        if (_value_size == 0) {
+            v = 1;
+        } else if (_value_size == sizeof(float)) {
+            _out_a_float.push_back((float)v);
+            v = (value_type)(float)v;
+        } else {
+            _out_a.push_back(v);
+        }
+
+        _max_val = std::max(_max_val, v);
+        _min_val = std::min(_min_val, v);
+        _rnorm[e[k].r] += v*v;
+        _cnorm[e[k].c] += v*v;
+        ++_degree[li];
+    }
+
+    boost::uint64_t offset = _out_nnz == 0 ? _out_offset : pos;
+    _out_nnz += n;
+    if (!write_tile_array(f, pos, offset, &_out_aj[0], sizeof(index_type)*n)) {
+        return (false);
+    }
+
+    if (_out_pieces)
+    {
+        std::size_t bytes = (std::size_t)_value_size*n;
+        const void *a = _out_a.empty() ? (const void*)(_out_a_float.empty() ? 0 : &_out_a_float[0])
+                                       : (const void*)&_out_a[0];
+        if (bytes > 0 && fwrite(a, 1, bytes, _values) != bytes) { return (false); }
+        _values_bytes += bytes;
+        _out_a.clear();
+        _out_a_float.clear();
+    }
+    return (true);
+}
+
+/**
+ * Write the values and the rows of the tile after its columns, and
+ * add it to the directory as tile (b,tc).
+ */
+bool matrix_tile_writer::end_tile(int b, int tc, FILE *f, boost::uint64_t& pos)
+{
+    tile_dir_entry d;
+    memset(&d, 0, sizeof(d));
+    d.offset = _out_offset;
+    d.nnz = _out_nnz;
+    d.rows = (boost::uint32_t)_out_ar.size();
+    d.offset_size = _out_nnz <= (nz_index_type)std::numeric_limits<index_type>::max()
+                    ? sizeof(index_type) : sizeof(nz_index_type);
+
+    boost::uint64_t a_offset, ar_offset, ai_offset, bytes;
+    tile_layout(d.nnz, d.rows, d.offset_size, _value_size,
+        a_offset, ar_offset, ai_offset, bytes);
+
+    if (!write_tile_array(f, pos, d.offset + a_offset, 0, 0)) { return (false); }
+    if (_out_pieces)
+    {
+        // copy the values back from the values file
+        std::vector<char> buf(read_buffer_entries*sizeof(entry));
+        if (!seek_file(_values, 0)) { return (false); }
+        for (boost::uint64_t left = _values_bytes; left > 0; )
+        {
+            std::size_t m = (std::size_t)std::min<boost::uint64_t>(left, buf.size());
+            if (fread(&buf[0], 1, m, _values) != m
+                || !write_tile_array(f, pos, pos, &buf[0], m))
+            {
+                return (false);
+            }
+            left -= m;
+        }
+    }
+    else
+    {
+        const void *a = _out_a.empty() ? (const void*)(_out_a_float.empty() ? 0 : &_out_a_float[0])
+                                       : (const void*)&_out_a[0];
+        if (!write_tile_array(f, pos, pos, a, (size_t)_value_size*_out_nnz)) {
+            return (false);
+        }
+    }
+
+    const void *ai_ptr = &_out_ai[0];
+    std::vector<index_type> ai_narrow;
+    if (d.offset_size == sizeof(index_type)) {
+        ai_narrow.assign(_out_ai.begin(), _out_ai.end());
+        ai_ptr = &ai_narrow[0];
+    }
+    if (!write_tile_array(f, pos, d.offset + ar_offset, &_out_ar[0],
+            sizeof(index_type)*_out_ar.size())
+        || !write_tile_array(f, pos, d.offset + ai_offset, ai_ptr,
+            (size_t)d.offset_size*_out_ai.size()))
+    {
+        return (false);
+    }
+
+    memcpy(&_directory[((std::size_t)b*_tile_cols + tc)*sizeof(d)], &d, sizeof(d));
+    _nnz += _out_nnz;
+    return (true);
+}
+
+/**
+ * Write tile (b,tc), whose staged nonzeros do not fit in the memory
+ * limit, from pieces of its rows that do.  A single row with more
+ * staged nonzeros than fit is still read at once.
+ */
+bool matrix_tile_writer::write_large_tile(int b, int tc, nz_index_type fit,
+    FILE *f, boost::uint64_t& pos)
+{
+    index_type row0 = b*_tile_size;
+    index_type rows = std::min(_tile_size, _nrows - row0);
+
+    std::vector<nz_index_type> count(rows, 0);
+    std::vector<entry> buf;
+    for (nz_index_type k = 0; k < _band_nnz[b]; k += buf.size())
+    {
+        buf.resize(read_buffer_entries);
+        if (!read_staged(b, k, buf)) { return (false); }
+        for (std::size_t i = 0; i < buf.size(); ++i) {
+            if (buf[i].c/_tile_size == tc) { ++count[buf[i].r - row0]; }
+        }
+    }
+    std::vector<entry>().swap(buf);
+
+    if (!begin_tile(pos, true)) { return (false); }
+    std::vector<entry> e;
+    for (index_type r1 = 0; r1 < rows; )
+    {
+        index_type r2 = r1 + 1;
+        nz_index_type n = count[r1];
+        while (r2 < rows && n + count[r2] <= fit) { n += count[r2++]; }
+        if (n > 0
+            && (!read_band(b, tc, tc+1, row0 + r1, row0 + r2, n, e)
+                || !add_tile_rows(e.empty() ? 0 : &e[0], e.size(), f, pos)))
+        {
+            return (false);
+        }
+        r1 = r2;
+    }
+    return (end_tile(b, tc, f, pos));
+}
+
+/**
+ * Sort the nonzeros of band b into tiles and write them at the end of
+ * f.  The tile columns of the band are read and sorted in ranges whose
+ * staged nonzeros fit in the memory limit together, and a tile that
+ * does not fit alone is written with write_large_tile.
+ */
+bool matrix_tile_writer::write_band(int b, FILE *f, boost::uint64_t& pos)
+{
+    index_type row0 = b*_tile_size;
+    index_type rows = std::min(_tile_size, _nrows - row0);
+    _degree.assign(rows, 0);
+
+    nz_index_type fit = std::max<nz_index_type>(_band_nnz[b], 1);
+    if (_memory_limit > 0) {
+        fit = std::max<nz_index_type>((nz_index_type)(_memory_limit/sizeof(entry)), 1);
+    }
+
+    const nz_index_type *count = &_tile_nnz[(std::size_t)b*_tile_cols];
+    std::vector<entry> e;
+    for (int tc1 = 0; tc1 < _tile_cols; )
+    {
+        int tc2 = tc1 + 1;
+        nz_index_type n = count[tc1];
+        while (tc2 < _tile_cols && n + count[tc2] <= fit) { n += count[tc2++]; }
+
+        if (n > fit)
+        {
+            if (!write_large_tile(b, tc1, fit, f, pos)) { return (false); }
+        }
+        else if (n > 0)
+        {
+            if (!read_band(b, tc1, tc2, row0, row0 + rows, n, e)) { return (false); }
+            for (std::size_t k0 = 0; k0 < e.size(); )
+            {
+                int tc = e[k0].c/_tile_size;
+                std::size_t k1 = k0;
+                while (k1 < e.size() && e[k1].c/_tile_size == tc) { ++k1; }
+                if (!begin_tile(pos, false)
+                    || !add_tile_rows(&e[k0], k1 - k0, f, pos)
+                    || !end_tile(b, tc, f, pos))
+                {
+                    return (false);
+                }
+                k0 = k1;
+            }
+        }
+        tc1 = tc2;
+    }
+
+    for (index_type i = 0; i < rows; ++i) {
+        _max_degree = std::max(_max_degree, _degree[i]);
+        _min_degree = std::min(_min_degree, _degree[i]);
+    }
+
+    return (true);
+}
+
+bool matrix_tile_writer::finish(const matrix_tile_source& src, int value_size)
+{
+    using namespace std;
+
+    if (!_staging) { return (false); }
+    for (int b = 0; b < _tile_rows; ++b) { flush(b); }
+    for (int b = 0; b < _tile_rows && !_error; ++b) {
+        if (_band_staged[b] != _band_nnz[b]) { _error = true; }
+    }
+    if (_error) {
+        cerr << "error: cannot stage the nonzeros in "
+             << _filename << ".tmp.coo" << endl;
+        return (false);
+    }
+    std::vector< std::vector<entry> >().swap(_band_buffer);
+
+    _value_size = value_size;
+    _rnorm.assign(_nrows, 0);
+    _cnorm.assign(_ncols, 0);
+    _directory.assign((std::size_t)_tile_rows*_tile_cols*sizeof(tile_dir_entry), 0);
+    _nnz = 0;
+    _max_degree = 0;
+    _min_degree = std::numeric_limits<index_type>::max();
+    _max_val = std::numeric_limits<value_type>::min();
+    _min_val = std::numeric_limits<value_type>::max();
+
+    std::string tempname = _filename + ".tmp";
+    FILE *f = fopen(tempname.c_str(), "wb");
+    if (!f) {
+        cerr << "error: cannot write " << tempname << endl;
+        return (false);
+    }
+
+    tile_file_header h;
+    memset(&h, 0, sizeof(h));
+
+    boost::uint64_t pos = sizeof(h);
+    bool rval = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (int b = 0; b < _tile_rows && rval; ++b) {
+        rval = write_band(b, f, pos);
+    }
+
+    for (index_type r=0; r<_nrows; ++r) { _rnorm[r]=1.0/sqrt(_rnorm[r]); }
+    for (index_type r=0; r<_ncols; ++r) { _cnorm[r]=1.0/sqrt(_cnorm[r]); }
+
+    memcpy(h.magic, tile_magic, sizeof(tile_magic));
+    h.version = tile_version;
+    h.byte_order = tile_byte_order;
+    h.index_size = sizeof(index_type);
+    h.value_size = _value_size;
+    h.symmetrize = src.symmetrize;
+    h.value_storage = src.value_storage;
+    h.tile_size = _tile_size;
+    h.source_size = src.source_size;
+    h.source_mtime = src.source_mtime;
+    h.nrows = _nrows;
+    h.ncols = _ncols;
+    h.nnz = _nnz;
+    h.tile_rows = _tile_rows;
+    h.tile_cols = _tile_cols;
+    h.min_val = _min_val;
+    h.max_val = _max_val;
+    h.min_degree = _min_degree;
+    h.max_degree = _max_degree;
+    h.rnorm_offset = tile_align(pos);
+    h.cnorm_offset = tile_align(h.rnorm_offset + sizeof(value_type)*_nrows);
+    h.directory_offset = tile_align(h.cnorm_offset + sizeof(value_type)*_ncols);
+    h.file_size = h.directory_offset + _directory.size();
+
+    rval = rval
+        && write_tile_array(f, pos, h.rnorm_offset,
+                _rnorm.empty() ? 0 : &_rnorm[0], sizeof(value_type)*_nrows)
+        && write_tile_array(f, pos, h.cnorm_offset,
+                _cnorm.empty() ? 0 : &_cnorm[0], sizeof(value_type)*_ncols)
+        && write_tile_array(f, pos, h.directory_offset,
+                _directory.empty() ? 0 : &_directory[0], _directory.size())
+        && seek_file(f, 0)
+        && fwrite(&h, sizeof(h), 1, f) == 1;
+
+    rval = (fclose(f) == 0) && rval;
+
+    fclose(_staging);
+    _staging = 0;
+    remove((_filename + ".tmp.coo").c_str());
+    if (_values) {
+        fclose(_values);
+        _values = 0;
+        remove((_filename + ".tmp.val").c_str());
+    }
+
+    if (rval) {
+#ifdef _WIN32
+        // rename does not replace an existing file on windows
+        remove(_filename.c_str());
+#endif
+        rval = (rename(tempname.c_str(), _filename.c_str()) == 0);
+    }
+
+    if (!rval) {
+        cerr << "error: cannot write " << _filename << endl;
+        remove(tempname.c_str());
+    }
+
+    return (rval);
+}
+
+/*
+ * =================
+ * matrix_tiles
+ * =================
+ */
+
+matrix_tiles::matrix_tiles()
+: _open(false), _nrows(0), _ncols(0), _nnz(0), _value_size(0),
+  _tile_size(0), _tile_rows(0), _tile_cols(0),
+  _min_val(0), _max_val(0), _min_degree(0), _max_degree(0),
+  _file_size(0), _rnorm(0), _cnorm(0), _directory(0), _memory_limit(0),
+  _resident(0), _mapped(0), _frame(0), _stop(false)
+{
+    memset(&_source, 0, sizeof(_source));
+}
+
+matrix_tiles::~matrix_tiles()
+{
+    close();
+}
+
+bool matrix_tiles::open(const std::string& filename)
+{
+    close();
+
+    tile_file_header h;
+    boost::uint64_t size;
+    boost::int64_t mtime;
+    if (!matrix_source_info(filename, size, mtime)) { return (false); }
+
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) { return (false); }
+    bool read = fread(&h, sizeof(h), 1, f) == 1;
+    fclose(f);
+    if (!read) { return (false); }
+
+    if (memcmp(h.magic, tile_magic, sizeof(tile_magic)) != 0
+        || h.version != tile_version
+        || h.byte_order != tile_byte_order
+        || h.index_size != sizeof(index_type)
+        || (h.value_size != 0 && h.value_size != sizeof(float)
+            && h.value_size != sizeof(value_type))
+        || h.tile_size == 0 || h.tile_size > (boost::uint32_t)std::numeric_limits<index_type>::max()
+        || h.nrows < 0 || h.ncols < 0 || h.nnz < 0
+        || h.nrows > std::numeric_limits<index_type>::max()
+        || h.ncols > std::numeric_limits<index_type>::max()
+        || h.tile_rows != (h.nrows + h.tile_size - 1)/h.tile_size
+        || h.tile_cols != (h.ncols + h.tile_size - 1)/h.tile_size
+        || h.rnorm_offset != tile_align(h.rnorm_offset)
+        || h.cnorm_offset != tile_align(h.rnorm_offset + sizeof(value_type)*h.nrows)
+        || h.directory_offset != tile_align(h.cnorm_offset + sizeof(value_type)*h.ncols)
+        || h.file_size != h.directory_offset
+                          + sizeof(tile_dir_entry)*h.tile_rows*h.tile_cols
+        || size < h.file_size)
+    {
+        YASMIC_VERBOSE( std::cerr << "ignoring invalid matrix tiles "
+            << filename << std::endl; )
+        return (false);
+    }
+
+    if (!_index.open(filename, h.rnorm_offset,
+            (std::size_t)(h.file_size - h.rnorm_offset)))
+    {
+        return (false);
+    }
+
+    _filename = filename;
+    _file_size = h.file_size;
+    _source.source_size = h.source_size;
+    _source.source_mtime = h.source_mtime;
+    _source.symmetrize = h.symmetrize;
+    _source.value_storage = h.value_storage;
+
+    _nrows = (index_type)h.nrows;
+    _ncols = (index_type)h.ncols;
+    _nnz = (nz_index_type)h.nnz;
+    _value_size = (int)h.value_size;
+    _tile_size = (index_type)h.tile_size;
+    _tile_rows = (int)h.tile_rows;
+    _tile_cols = (int)h.tile_cols;
+
+    _min_val = (value_type)h.min_val;
+    _max_val = (value_type)h.max_val;
+    _min_degree = (index_type)h.min_degree;
+    _max_degree = (index_type)h.max_degree;
+
+    _rnorm = (const value_type*)_index.data();
+    _cnorm = (const value_type*)(_index.data() + (h.cnorm_offset - h.rnorm_offset));
+    _directory = _index.data() + (h.directory_offset - h.rnorm_offset);
+
+    _tiles.assign((std::size_t)_tile_rows*_tile_cols, (tile_entry*)0);
+    _lru.clear();
+    _queue.clear();
+    _resident = 0;
+    _mapped = 0;
+    _frame = 0;
+    _stop = false;
+    _open = true;
+
+    if (!_thread.start(&matrix_tiles::prefetch_thread, this)) {
+        YASMIC_VERBOSE( std::cerr << "cannot start the tile prefetch thread"
+            << std::endl; )
+    }
+
+    return (true);
+}
+
+void matrix_tiles::close()
+{
+    if (_thread.running())
+    {
+        {
+            util::scoped_lock l(_lock);
+            _stop = true;
+            _wake.notify_all();
+        }
+        _thread.join();
+    }
+
+    for (std::size_t i = 0; i < _tiles.size(); ++i) { delete _tiles[i]; }
+    _tiles.clear();
+    _lru.clear();
+    _queue.clear();
+    _resident = 0;
+    _mapped = 0;
+    _index.close();
+    _file_size = 0;
+    _rnorm = 0;
+    _cnorm = 0;
+    _directory = 0;
+    _open = false;
+}
+
+void matrix_tiles::set_memory_limit(boost::uint64_t bytes)
+{
+    util::scoped_lock l(_lock);
+    _memory_limit = bytes;
+    make_room(0, true);
+}
+
+matrix_tiles::nz_index_type matrix_tiles::tile_nnz(int tr, int tc) const
+{
+    if (!_open || tr < 0 || tr >= _tile_rows || tc < 0 || tc >= _tile_cols) {
+        return (0);
+    }
+    tile_dir_entry d;
+    memcpy(&d, _directory + ((std::size_t)tr*_tile_cols + tc)*sizeof(d), sizeof(d));
+    return ((nz_index_type)d.nnz);
+}
+
+/**
+ * Map tile id into memory.  This does not touch any of the shared
+ * state, so it is called without the lock.
+ *
+ * @param touch read a byte from every page of the tile, so the tile
+ * is in memory when the function returns
+ * @return the new tile, or NULL if it is empty or cannot be mapped
+ */
+matrix_tiles::tile_entry* matrix_tiles::map_tile(int id, bool touch)
+{
+    tile_dir_entry d;
+    memcpy(&d, _directory + (std::size_t)id*sizeof(d), sizeof(d));
+    if (d.nnz <= 0) { return (0); }
+
+    int tr = id/_tile_cols;
+    index_type row0 = tr*_tile_size;
+    index_type rows = std::min(_tile_size, _nrows - row0);
+
+    boost::uint64_t a_offset, ar_offset, ai_offset, bytes;
+    tile_layout(d.nnz, d.rows, d.offset_size, _value_size,
+        a_offset, ar_offset, ai_offset, bytes);
+
+    if ((d.offset_size != sizeof(index_type) && d.offset_size != sizeof(nz_index_type))
+        || d.rows == 0 || d.rows > (boost::uint32_t)rows
+        || d.offset != tile_align(d.offset)
+        || d.offset + bytes > _file_size)
+    {
+        std::cerr << "error: invalid tile " << id << " in " << _filename << std::endl;
+        return (0);
+    }
+
+    tile_entry *t = new tile_entry;
+    tile_type& m = t->m;
+    if (!m.cache_file.open(_filename, d.offset, (std::size_t)bytes)) {
+        std::cerr << "error: cannot map tile " << id << " of " << _filename << std::endl;
+        delete t;
+        return (0);
+    }
+
+    const char *p = m.cache_file.data();
+    m.ar = (const index_type*)(p + ar_offset);
+    if (d.offset_size == sizeof(index_type)) {
+        m.ai = (const index_type*)(p + ai_offset);
+    } else {
+        m.ai_wide = (const nz_index_type*)(p + ai_offset);
+    }
+    m.aj = (const index_type*)p;
+    if (_value_size == sizeof(value_type)) {
+        m.a = (const value_type*)(p + a_offset);
+    } else if (_value_size == sizeof(float)) {
+        m.a_float = (const float*)(p + a_offset);
+    }
+    m.nrows = rows;
+    m.ncols = _ncols;
+    m.nnz = (nz_index_type)d.nnz;
+    m.first_row = row0;
+    m.nrows_stored = (index_type)d.rows;
+
+    if (touch) {
+        m.cache_file.advise_willneed();
+        volatile char sum = 0;
+        for (std::size_t i = 0; i < m.cache_file.size(); i += 4096) { sum += p[i]; }
+    }
+
+    t->bytes = (bytes + tile_page_size - 1)/tile_page_size*tile_page_size;
+    t->pins = 0;
+    t->frame = 0;
+    return (t);
+}
+
+void matrix_tiles::insert_tile(int id, tile_entry *t)
+{
+    _tiles[id] = t;
+    _lru.push_front(id);
+    t->lru = _lru.begin();
+    _resident += t->bytes;
+    ++_mapped;
+}
+
+void matrix_tiles::evict(int id)
+{
+    tile_entry *t = _tiles[id];
+    _lru.erase(t->lru);
+    _resident -= t->bytes;
+    --_mapped;
+    _tiles[id] = 0;
+    delete t;
+}
+
+/**
+ * Is there room for a tile of bytes more, or none if bytes is 0,
+ * within the memory limit and the number of mapped tiles?
+ */
+bool matrix_tiles::has_room(boost::uint64_t bytes) const
+{
+    return ((_memory_limit == 0 || _resident + bytes <= _memory_limit)
+        && _mapped + (bytes > 0 ? 1 : 0) <= max_mapped_tiles);
+}
+
+/**
+ * Unmap the least recently used tiles until there is room for bytes
+ * more within the memory limit.  Acquired tiles are never unmapped.
+ *
+ * @param any_frame if false, only unmap tiles from earlier frames
+ * @return false if there is not enough room
+ */
+bool matrix_tiles::make_room(boost::uint64_t bytes, bool any_frame)
+{
+    if (_memory_limit > 0 && bytes > _memory_limit) { return (false); }
+
+    std::list<int>::iterator it = _lru.end();
+    while (!has_room(bytes) && it != _lru.begin())
+    {
+        --it;
+        tile_entry *t = _tiles[*it];
+        if (t->pins > 0 || (!any_frame && t->frame == _frame)) { continue; }
+        int id = *it;
+        ++it;
+        evict(id);
+    }
+    return (has_room(bytes));
+}
+
+const matrix_tiles::tile_type* matrix_tiles::acquire(int tr, int tc)
+{
+    if (tile_nnz(tr, tc) <= 0) { return (0); }
+    int id = tr*_tile_cols + tc;
+
+    _lock.lock();
+    tile_entry *t = _tiles[id];
+    if (!t)
+    {
+        // map the tile without holding up the prefetch thread
+        _lock.unlock();
+        tile_entry *nt = map_tile(id, false);
+        if (!nt) { return (0); }
+        _lock.lock();
+
+        t = _tiles[id];
+        if (t) {
+            // the prefetch thread was faster
+            delete nt;
+        } else {
+            t = nt;
+            make_room(t->bytes, true);
+            insert_tile(id, t);
+        }
+    }
+    ++t->pins;
+    t->frame = _frame;
+    _lru.splice(_lru.begin(), _lru, t->lru);
+    _lock.unlock();
+
+    return (&t->m);
+}
+
+void matrix_tiles::release(int tr, int tc)
+{
+    if (tr < 0 || tr >= _tile_rows || tc < 0 || tc >= _tile_cols) { return; }
+    util::scoped_lock l(_lock);
+    tile_entry *t = _tiles[tr*_tile_cols + tc];
+    if (t && t->pins > 0) { --t->pins; }
+
+    // a tile larger than the limit is only mapped while it is used
+    make_room(0, true);
+}
+
+void matrix_tiles::begin_frame()
+{
+    util::scoped_lock l(_lock);
+    ++_frame;
+}
+
+void matrix_tiles::prefetch(int tr1, int tc1, int tr2, int tc2)
+{
+    util::scoped_lock l(_lock);
+    _queue.clear();
+
+    // the rows of tiles below and above the block come first, so an 
+    // iterative draw from top to bottom finds its next row in memory
+    int rows[2] = { tr2+1, tr1-1 };
+    for (int k = 0; k < 2; ++k) {
+        if (rows[k] < 0 || rows[k] >= _tile_rows) { continue; }
+        for (int tc = std::max(tc1-1, 0); tc <= std::min(tc2+1, _tile_cols-1); ++tc) {
+            _queue.push_back(rows[k]*_tile_cols + tc);
+        }
+    }
+    int cols[2] = { tc1-1, tc2+1 };
+    for (int k = 0; k < 2; ++k) {
+        if (cols[k] < 0 || cols[k] >= _tile_cols) { continue; }
+        for (int tr = std::max(tr1, 0); tr <= std::min(tr2, _tile_rows-1); ++tr) {
+            _queue.push_back(tr*_tile_cols + cols[k]);
+        }
+    }
+
+    if (!_queue.empty()) { _wake.notify_one(); }
+}
+
+boost::uint64_t matrix_tiles::resident_bytes()
+{
+    util::scoped_lock l(_lock);
+    return (_resident);
+}
+
+void matrix_tiles::prefetch_thread(void *arg)
+{
+    ((matrix_tiles*)arg)->prefetch_loop();
+}
+
+/**
+ * Map the tiles in the prefetch queue until the thread is stopped.
+ * A tile is only kept if it fits within the memory limit after
+ * unmapping tiles from earlier frames; otherwise the rest of the
+ * queue is dropped as well.
+ */
+void matrix_tiles::prefetch_loop()
+{
+    _lock.lock();
+    for (;;)
+    {
+        while (!_stop && _queue.empty()) { _wake.wait(_lock); }
+        if (_stop) { break; }
+
+        int id = _queue.front();
+        _queue.pop_front();
+        if (_tiles[id]) { continue; }
+
+        _lock.unlock();
+        tile_entry *t = map_tile(id, true);
+        _lock.lock();
+
+        if (!t) { continue; }
+        if (_tiles[id]) {
+            delete t;
+        } else if (!make_room(t->bytes, false)) {
+            // skip a tile larger than the limit, but stop once the 
+            // tiles of this frame fill the memory
+            if (_memory_limit == 0 || t->bytes <= _memory_limit) { _queue.clear(); }
+            delete t;
+        } else {
+            t->frame = _frame;
+            insert_tile(id, t);
+        }
+    }
+    _lock.unlock();
+}
@@ -0,0 +1,332 @@
+#ifndef MATRIX_TILES_HPP
+#define MATRIX_TILES_HPP
+
+/**
+ * @file matrix_tiles.hpp
+ * An on-disk tiled copy of a matrix for matrices that do not fit in
+ * memory.
+ *
+ * The matrix is cut into square tiles of tile_size rows and columns
+ * and each tile is stored as its own compressed sparse row matrix of
+ * just its nonempty rows in a .vmtiles file, with a small directory
+ * of the tiles at the end of the file.  The matrix_tile_writer builds the file from a stream of
+ * nonzeros that is read twice, and the matrix_tiles class memory maps
+ * the tiles one at a time, keeps the recently used ones mapped within
+ * a memory limit, and prefetches tiles on a background thread.
+ *
+ * See matrix_tiles.cc for the layout of the file.
+ */
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <cstdio>
+
+#include <boost/cstdint.hpp>
+
+#include "sparse_matrix.hpp"
+#include "util/mapped_file.hpp"
+#include "util/thread.hpp"
+
+/**
+ * Get the size and modification time of a file.
+ * @return false if the file does not exist
+ */
+bool matrix_source_info(const std::string& filename,
+    boost::uint64_t& size, boost::int64_t& mtime);
+
+/**
+ * The properties of the matrix file a .vmtiles file was built from.
+ * A .vmtiles file is only used when these match the current file and
+ * options.
+ */
+struct matrix_tile_source
+{
+    boost::uint64_t source_size;
+    boost::int64_t source_mtime;
+    boost::uint32_t symmetrize;
+    boost::uint32_t value_storage;
+};
+
+/**
+ * Write a .vmtiles file.
+ *
+ * The nonzeros are given twice: first to count, then to add, both
+ * times in the same order.  Between the two passes, start_add decides
+ * on the layout.  The added nonzeros are staged on the disk in bands
+ * of tile_size rows, and finish sorts one band at a time into tiles.
+ * A band with more staged nonzeros than fit in the memory limit is
+ * sorted in ranges of tiles, and a tile that does not fit alone in
+ * ranges of its rows.
+ *
+ * Repeated entries are added together.  With symmetrize, every entry
+ * (i,j) is also added as (j,i), which gives the same matrix as the
+ * symmetrize option for a matrix in memory.
+ */
+class matrix_tile_writer
+{
+public:
+    typedef int index_type;
+    typedef boost::int64_t nz_index_type;
+    typedef double value_type;
+
+    matrix_tile_writer(const std::string& filename,
+        index_type nrows, index_type ncols, bool symmetrize);
+    ~matrix_tile_writer();
+
+    /**
+     * Set the memory for sorting the staged nonzeros, or 0 to sort a
+     * whole band at once.
+     */
+    void set_memory_limit(boost::uint64_t bytes) { _memory_limit = bytes; }
+
+    /** The first pass over the nonzeros. */
+    void count(index_type r, index_type c, value_type v)
+    {
+        if (r < 0 || r >= _src_nrows || c < 0 || c >= _src_ncols) {
+            if (!_bad) { _bad = true; _bad_r = r; _bad_c = c; }
+            return;
+        }
+        if (v != (value_type)1) { _unit_values = false; }
+        int tr = r/_tile_size, tc = c/_tile_size;
+        ++_band_nnz[tr];
+        ++_tile_nnz[(std::size_t)tr*_tile_cols + tc];
+        if (_symmetrize) {
+            ++_band_nnz[tc];
+            ++_tile_nnz[(std::size_t)tc*_tile_cols + tr];
+        }
+    }
+
+    /**
+     * Allocate the staging file for the second pass.
+     * @return false if the counts are invalid or the file cannot be
+     * written.
+     */
+    bool start_add();
+
+    /** The second pass over the nonzeros. */
+    void add(index_type r, index_type c, value_type v)
+    {
+        if (r < 0 || r >= _src_nrows || c < 0 || c >= _src_ncols) { return; }
+        stage(r, c, v);
+        if (_symmetrize) { stage(c, r, v); }
+    }
+
+    /**
+     * Sort the staged nonzeros into tiles and write the file.
+     *
+     * @param src the source information for the header
+     * @param value_size the bytes for each value: 0 for a pattern,
+     * sizeof(float), or sizeof(value_type)
+     * @return false if the file could not be written
+     */
+    bool finish(const matrix_tile_source& src, int value_size);
+
+    /** @return true if every value counted so far is 1. */
+    bool unit_values() const { return (_unit_values); }
+
+    index_type nrows() const { return (_nrows); }
+    index_type ncols() const { return (_ncols); }
+
+private:
+    struct entry { index_type r, c; value_type v; };
+
+    void stage(index_type r, index_type c, value_type v);
+    bool flush(int band);
+    bool in_range(const entry& e, int tc1, int tc2, index_type r1,
+        index_type r2) const;
+    bool read_staged(int band, nz_index_type k, std::vector<entry>& buf);
+    bool read_band(int band, int tc1, int tc2, index_type r1, index_type r2,
+        nz_index_type n, std::vector<entry>& e);
+    bool begin_tile(boost::uint64_t pos, bool pieces);
+    bool add_tile_rows(const entry *e, std::size_t n, std::FILE *f,
+        boost::uint64_t& pos);
+    bool end_tile(int band, int tc, std::FILE *f, boost::uint64_t& pos);
+    bool write_large_tile(int band, int tc, nz_index_type fit, std::FILE *f,
+        boost::uint64_t& pos);
+    bool write_band(int band, std::FILE *f, boost::uint64_t& pos);
+
+    std::string _filename;
+    index_type _src_nrows;
+    index_type _src_ncols;
+    index_type _nrows;
+    index_type _ncols;
+    bool _symmetrize;
+    boost::uint64_t _memory_limit;
+    index_type _tile_size;
+    int _tile_rows;
+    int _tile_cols;
+
+    bool _bad;
+    index_type _bad_r, _bad_c;
+    bool _unit_values;
+    bool _error;
+
+    std::vector<nz_index_type> _band_nnz;
+    std::vector<nz_index_type> _tile_nnz;
+    std::vector<nz_index_type> _band_start;
+    std::vector<nz_index_type> _band_staged;
+    std::vector< std::vector<entry> > _band_buffer;
+    std::size_t _buffer_size;
+    std::FILE *_staging;
+
+    // filled in by finish
+    int _value_size;
+    std::vector<value_type> _rnorm;
+    std::vector<value_type> _cnorm;
+    std::vector<char> _directory;
+    nz_index_type _nnz;
+    value_type _min_val, _max_val;
+    index_type _min_degree, _max_degree;
+    std::vector<index_type> _degree;
+
+    // the tile being written, and the file for the values of a tile
+    // that is written in pieces
+    boost::uint64_t _out_offset;
+    nz_index_type _out_nnz;
+    bool _out_pieces;
+    std::vector<index_type> _out_ar;
+    std::vector<nz_index_type> _out_ai;
+    std::vector<index_type> _out_aj;
+    std::vector<value_type> _out_a;
+    std::vector<float> _out_a_float;
+    std::FILE *_values;
+    boost::uint64_t _values_bytes;
+};
+
+/**
+ * A tiled matrix on disk.
+ *
+ * Use acquire to get a tile and release when done with it.  A tile
+ * is mapped on the first acquire and stays mapped until the tiles
+ * mapped together use more than the memory limit, or are too many
+ * mappings, in which case the least recently used tiles that are not
+ * acquired are unmapped.
+ *
+ * Each call to begin_frame starts a new frame of the display.  The
+ * prefetch thread only unmaps tiles from earlier frames to make room,
+ * so it never throws out a tile that is on the screen.
+ */
+class matrix_tiles
+{
+public:
+    typedef int index_type;
+    typedef boost::int64_t nz_index_type;
+    typedef double value_type;
+    typedef sparse_matrix<index_type, nz_index_type, value_type> tile_type;
+
+    matrix_tiles();
+    ~matrix_tiles();
+
+    /**
+     * Open a .vmtiles file and start the prefetch thread.
+     * @return false if the file is not a valid .vmtiles file
+     */
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return (_open); }
+
+    /** The source the file was built from. */
+    const matrix_tile_source& source() const { return (_source); }
+
+    void set_memory_limit(boost::uint64_t bytes);
+
+    index_type nrows() const { return (_nrows); }
+    index_type ncols() const { return (_ncols); }
+    nz_index_type nnz() const { return (_nnz); }
+    int value_size() const { return (_value_size); }
+
+    index_type tile_size() const { return (_tile_size); }
+    int tile_rows() const { return (_tile_rows); }
+    int tile_cols() const { return (_tile_cols); }
+
+    /** The number of nonzeros in tile (tr,tc). */
+    nz_index_type tile_nnz(int tr, int tc) const;
+
+    const value_type* rnorm() const { return (_rnorm); }
+    const value_type* cnorm() const { return (_cnorm); }
+    value_type min_val() const { return (_min_val); }
+    value_type max_val() const { return (_max_val); }
+    index_type min_degree() const { return (_min_degree); }
+    index_type max_degree() const { return (_max_degree); }
+
+    /**
+     * Get tile (tr,tc), mapping it if it is not in memory.
+     * @return the tile, or NULL if it is empty or cannot be mapped
+     */
+    const tile_type* acquire(int tr, int tc);
+    void release(int tr, int tc);
+
+    void begin_frame();
+
+    /**
+     * Replace the prefetch queue with the tiles around the block of
+     * tiles tr1 to tr2 and tc1 to tc2.
+     */
+    void prefetch(int tr1, int tc1, int tr2, int tc2);
+
+    /** The bytes of all the tiles in memory. */
+    boost::uint64_t resident_bytes();
+
+private:
+    matrix_tiles(const matrix_tiles&);
+    matrix_tiles& operator= (const matrix_tiles&);
+
+    struct tile_entry
+    {
+        tile_type m;
+        boost::uint64_t bytes;
+        int pins;
+        unsigned int frame;
+        std::list<int>::iterator lru;
+    };
+
+    tile_entry* map_tile(int id, bool touch);
+    void insert_tile(int id, tile_entry *t);
+    bool has_room(boost::uint64_t bytes) const;
+    bool make_room(boost::uint64_t bytes, bool any_frame);
+    void evict(int id);
+
+    static void prefetch_thread(void *arg);
+    void prefetch_loop();
+
+    bool _open;
+    std::string _filename;
+    matrix_tile_source _source;
+
+    index_type _nrows;
+    index_type _ncols;
+    nz_index_type _nnz;
+    int _value_size;
+    index_type _tile_size;
+    int _tile_rows;
+    int _tile_cols;
+
+    value_type _min_val, _max_val;
+    index_type _min_degree, _max_degree;
+
+    // the row and column norms and the directory are mapped together
+    boost::uint64_t _file_size;
+    util::mapped_file _index;
+    const value_type *_rnorm;
+    const value_type *_cnorm;
+    const char *_directory;
+
+    boost::uint64_t _memory_limit;
+
+    // everything below is protected by _lock
+    util::mutex _lock;
+    util::condition _wake;
+    std::vector<tile_entry*> _tiles;
+    std::list<int> _lru;
+    boost::uint64_t _resident;
+    std::size_t _mapped;
+    unsigned int _frame;
+    std::deque<int> _queue;
+    bool _stop;
+
+    util::thread _thread;
+};
+
+#endif // MATRIX_TILES_HPP
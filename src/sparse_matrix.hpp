@@ -0,0 +1,314 @@
+#ifndef SPARSE_MATRIX_HPP
+#define SPARSE_MATRIX_HPP
+
+/**
+ * @file sparse_matrix.hpp
+ * The compressed sparse row arrays the matrix_canvas draws from.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "util/mapped_file.hpp"
+#include "util/varint.hpp"
+
+/**
+ * A lightweight wrapper class to implement a sparse matrix as
+ * a small set of variables.
+ *
+ * The canvas reads the matrix through the ai, aj, and a pointers.
+ * They either point into the ai_data, aj_data, and a_data vectors 
+ * for a matrix we parsed ourselves, or into a memory mapped 
+ * .vmcache file (see matrix_canvas_cache.cc) or tile of a .vmtiles 
+ * file (see matrix_tiles.hpp).
+ *
+ * A tile only holds the rows first_row to first_row+nrows-1, so 
+ * row_begin and row_end take the row of the whole matrix and ai[0]
+ * is the start of row first_row.  For anything but a tile, first_row
+ * is 0.
+ *
+ * A tile also only stores its rows with nonzeros: ar has the 
+ * nrows_stored rows of the arrays that are stored, in order, and ai
+ * has the row pointers of just those rows.  A row that is not in ar 
+ * is empty.  ar is null for anything but a tile.
+ *
+ * The row pointers are stored as index_type when the number of 
+ * nonzeros fits, and as the wider nz_index_type otherwise.  Exactly 
+ * one of ai and ai_wide is set for a loaded matrix.
+ *
+ * The values are stored in a (value_type), in a_float (single 
+ * precision), or not at all.  If both a and a_float are null, the 
+ * matrix is a pattern and every nonzero has the value 1.
+ *
+ * The column indices are in aj, or, after pack_columns, in aj_packed.
+ * There, each row is the first column and then the gaps between the
+ * sorted columns, all as varints (see util/varint.hpp).  A matrix with
+ * some locality needs one or two bytes for most nonzeros instead of
+ * four.  aj_block has the byte offset of every packed_block_rows-th 
+ * row, so reading any row only skips the varints of a few rows.  Use
+ * raw_columns or packed_columns to read the columns of either storage.
+ */
+template <class index_type, class nz_index_type, class value_type>
+struct sparse_matrix 
+{
+    std::vector<index_type> ai_data;
+    std::vector<nz_index_type> ai_wide_data;
+    std::vector<index_type> aj_data;
+    std::vector<value_type> a_data;
+    std::vector<float> a_float_data;
+    std::vector<unsigned char> aj_packed_data;
+    std::vector<boost::uint64_t> aj_block_data;
+
+    const index_type *ar;
+    const index_type *ai;
+    const nz_index_type *ai_wide;
+    const index_type *aj;
+    const unsigned char *aj_packed;
+    const boost::uint64_t *aj_block;
+    const value_type *a;
+    const float *a_float;
+
+    index_type nrows;
+    index_type ncols;
+    nz_index_type nnz;
+    index_type first_row;
+    index_type nrows_stored;
+
+    util::mapped_file cache_file;
+
+    enum { packed_block_rows = 64 };
+
+    sparse_matrix() 
+    : ar(0), ai(0), ai_wide(0), aj(0), aj_packed(0), aj_block(0), a(0), 
+      a_float(0), nrows(0), ncols(0), nnz(0), first_row(0), nrows_stored(0) {}
+
+    nz_index_type row_begin(index_type i) const
+    { return (row_pointer(i - first_row)); }
+
+    nz_index_type row_end(index_type i) const
+    { return (row_pointer(i - first_row + 1)); }
+
+    /**
+     * The start of row i of the arrays.  With only the nonempty rows
+     * stored, this is the start of the first stored row from i on, so
+     * a row that is not stored starts and ends at the same nonzero.
+     */
+    nz_index_type row_pointer(index_type i) const
+    {
+        if (ar) { i = (index_type)(std::lower_bound(ar, ar + nrows_stored, i) - ar); }
+        return (ai_wide ? ai_wide[i] : (nz_index_type)ai[i]); 
+    }
+
+    /** The value of the kth nonzero, for any of the value storages. */
+    value_type value(nz_index_type k) const
+    { return (a ? a[k] : (a_float ? (value_type)a_float[k] : (value_type)1)); }
+
+    /** 
+     * The start of the packed columns of row i of the arrays, which is
+     * row i+first_row of the matrix.
+     */
+    const unsigned char* packed_row(index_type i) const
+    {
+        index_type b = i/packed_block_rows;
+        const unsigned char *p = aj_packed + aj_block[b];
+        util::skip_varints(p, (std::size_t)(row_begin(first_row + i)
+            - row_begin(first_row + b*packed_block_rows)));
+        return (p);
+    }
+
+    /**
+     * Move the column indices from aj to aj_packed.  The columns in
+     * each row have to be sorted and distinct, otherwise the matrix is
+     * not changed.
+     * @return false if the columns are not sorted
+     */
+    bool pack_columns()
+    {
+        if (!aj || aj_packed) { return (aj_packed != 0); }
+
+        // size the arrays first, so we never hold two copies of the
+        // packed columns
+        std::size_t bytes = 0;
+        for (index_type i = 0; i < nrows; ++i)
+        {
+            nz_index_type kbegin = row_begin(first_row + i), kend = row_end(first_row + i);
+            index_type last = 0;
+            for (nz_index_type k = kbegin; k < kend; ++k) {
+                if (aj[k] < last || (k > kbegin && aj[k] == last)) { return (false); }
+                bytes += util::varint_size((boost::uint32_t)(aj[k] - last));
+                last = aj[k];
+            }
+        }
+
+        std::vector<unsigned char>(bytes).swap(aj_packed_data);
+        std::vector<boost::uint64_t>(nrows/packed_block_rows + 1).swap(aj_block_data);
+
+        unsigned char *p = aj_packed_data.empty() ? 0 : &aj_packed_data[0];
+        unsigned char *start = p;
+        for (index_type i = 0; i < nrows; ++i)
+        {
+            if (i % packed_block_rows == 0) {
+                aj_block_data[i/packed_block_rows] = (boost::uint64_t)(p - start);
+            }
+            nz_index_type kbegin = row_begin(first_row + i), kend = row_end(first_row + i);
+            index_type last = 0;
+            for (nz_index_type k = kbegin; k < kend; ++k) {
+                p = util::write_varint(p, (boost::uint32_t)(aj[k] - last));
+                last = aj[k];
+            }
+        }
+
+        std::vector<index_type>().swap(aj_data);
+        aj = 0;
+        // keep a valid pointer for a matrix without nonzeros
+        if (aj_packed_data.empty()) { aj_packed_data.push_back(0); }
+        aj_packed = &aj_packed_data[0];
+        aj_block = &aj_block_data[0];
+        return (true);
+    }
+
+    /** Free the packed columns. */
+    void drop_packed_columns()
+    {
+        std::vector<unsigned char>().swap(aj_packed_data);
+        std::vector<boost::uint64_t>().swap(aj_block_data);
+        aj_packed = 0;
+        aj_block = 0;
+    }
+
+    /** 
+     * Read the columns of a matrix stored in aj.  Call start_row(i)
+     * with a row i of the arrays, and then next(k) for each nonzero k 
+     * of that row.  In a row with sorted columns, seek finds the first
+     * nonzero in a range of columns, and skip passes over the rest of
+     * the row.
+     */
+    class raw_columns
+    {
+    public:
+        explicit raw_columns(const sparse_matrix& m) : _aj(m.aj) {}
+        void start_row(index_type) {}
+        index_type next(nz_index_type k) { return (_aj[k]); }
+        void skip(nz_index_type) {}
+
+        /**
+         * The first nonzero from kbegin to kend with a column of at
+         * least c, in a row with sorted columns.  This gallops from
+         * kbegin, so a column near the start of a long row is cheap.
+         */
+        nz_index_type seek(nz_index_type kbegin, nz_index_type kend, index_type c)
+        {
+            nz_index_type k = kbegin, step = 1;
+            while (k + step < kend && _aj[k + step] < c) { k += step; step *= 2; }
+            return (std::lower_bound(_aj + k, _aj + std::min(k + step, kend), c) - _aj);
+        }
+    private:
+        const index_type *_aj;
+    };
+
+    /**
+     * Read the columns of a matrix stored in aj_packed, with the same
+     * interface as raw_columns.  Every row has to be read or skipped
+     * to the end, and reading the rows in order never seeks.
+     */
+    class packed_columns
+    {
+    public:
+        explicit packed_columns(const sparse_matrix& m) 
+        : _m(m), _p(0), _next_row(-1), _col(0) {}
+
+        void start_row(index_type i)
+        {
+            if (i != _next_row) { _p = _m.packed_row(i); }
+            _next_row = i+1;
+            _col = 0;
+        }
+
+        index_type next(nz_index_type) 
+        { 
+            _col += (index_type)util::read_varint(_p);
+            return (_col);
+        }
+
+        /** Skip the next n columns of the row without decoding them. */
+        void skip(nz_index_type n) { util::skip_varints(_p, (std::size_t)n); }
+
+        /** The gaps can only be read in order, so this is kbegin. */
+        nz_index_type seek(nz_index_type kbegin, nz_index_type, index_type)
+        { return (kbegin); }
+
+    private:
+        const sparse_matrix& _m;
+        const unsigned char *_p;
+        index_type _next_row;
+        index_type _col;
+    };
+
+    /** @return the value of the nonzero (i,j) of the matrix, or 0 */
+    value_type find(index_type i, index_type j) const
+    {
+        if (aj_packed) { return (find(packed_columns(*this), i, j)); }
+        return (find(raw_columns(*this), i, j));
+    }
+
+    template <class Columns>
+    value_type find(Columns cols, index_type i, index_type j) const
+    {
+        cols.start_row(i - first_row);
+        for (nz_index_type k = row_begin(i), kend = row_end(i); k < kend; ++k) {
+            if (cols.next(k) == j) { return (value(k)); }
+        }
+        return ((value_type)0);
+    }
+
+    /** Free the values and store the matrix as a pattern. */
+    void drop_values()
+    {
+        std::vector<value_type>().swap(a_data);
+        std::vector<float>().swap(a_float_data);
+    }
+
+    /** 
+     * Store the row pointers in ai_data if the number of nonzeros 
+     * fits in an index_type.
+     */
+    void narrow_row_pointers()
+    {
+        if (nnz <= (nz_index_type)std::numeric_limits<index_type>::max())
+        {
+            ai_data.assign(ai_wide_data.begin(), ai_wide_data.end());
+            std::vector<nz_index_type>().swap(ai_wide_data);
+        }
+    }
+
+    /** Free everything and go back to an empty matrix. */
+    void clear()
+    {
+        std::vector<index_type>().swap(ai_data);
+        std::vector<nz_index_type>().swap(ai_wide_data);
+        std::vector<index_type>().swap(aj_data);
+        drop_values();
+        drop_packed_columns();
+        use_data();
+        nrows = 0; ncols = 0; nnz = 0; first_row = 0; nrows_stored = 0;
+    }
+
+    /** Point the arrays at the data vectors. */
+    void use_data()
+    {
+        cache_file.close();
+        ar = 0;
+        ai = ai_data.empty() ? 0 : &ai_data[0];
+        ai_wide = ai_wide_data.empty() ? 0 : &ai_wide_data[0];
+        aj = aj_data.empty() ? 0 : &aj_data[0];
+        aj_packed = aj_packed_data.empty() ? 0 : &aj_packed_data[0];
+        aj_block = aj_block_data.empty() ? 0 : &aj_block_data[0];
+        a = a_data.empty() ? 0 : &a_data[0];
+        a_float = a_float_data.empty() ? 0 : &a_float_data[0];
+    }
+};
+
+#endif // SPARSE_MATRIX_HPP
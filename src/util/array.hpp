@@ -15,6 +15,11 @@ namespace util {
         template <typename I>
         T operator[](I) { return (_t); }
     };
+
+    // is a map the identity_array, decided at compile time
+    template <typename Map>
+    inline bool is_identity(const Map&) { return (false); }
+    inline bool is_identity(const identity_array&) { return (true); }
 } // namespace util
 
 #endif // CPP_UTIL_ARRAY_HPP
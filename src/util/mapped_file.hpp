@@ -0,0 +1,272 @@
+#ifndef CPP_UTIL_MAPPED_FILE_HPP_
+#define CPP_UTIL_MAPPED_FILE_HPP_
+
+/**
+ * @file mapped_file.hpp
+ * A small read-only memory mapped file.  All of the functions are
+ * inline, so this file can be included from any number of sources.
+ */
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN
+#   endif
+#	include <windows.h>
+#else
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace util
+{
+    /**
+     * The mapped_file class maps an entire file, or a range of bytes
+     * in a file, into memory for reading.  The mapping is released
+     * when the object is destroyed.
+     *
+     * Empty files are handled as an open file with size() == 0 and
+     * data() == NULL.
+     */
+    class mapped_file
+    {
+    public:
+        mapped_file()
+        : _data(0), _size(0), _is_open(false), _base(0), _base_size(0)
+#ifdef _WIN32
+          , _file(INVALID_HANDLE_VALUE), _map(0)
+#endif
+        {}
+
+        explicit mapped_file(const std::string& filename)
+        : _data(0), _size(0), _is_open(false), _base(0), _base_size(0)
+#ifdef _WIN32
+          , _file(INVALID_HANDLE_VALUE), _map(0)
+#endif
+        { open(filename); }
+
+        ~mapped_file() { close(); }
+
+        /**
+         * Map a file into memory.
+         *
+         * @param filename the name of the file
+         * @return true if the file was mapped, false otherwise
+         */
+        bool open(const std::string& filename);
+
+        /**
+         * Map size bytes of a file starting at offset.  The offset 
+         * does not have to be aligned, the mapping starts at the 
+         * page before it and data() points at the offset.
+         *
+         * @param filename the name of the file
+         * @param offset the first byte to map
+         * @param size the number of bytes to map
+         * @return true if the range was mapped, false otherwise
+         */
+        bool open(const std::string& filename, 
+            unsigned long long offset, std::size_t size);
+
+        /**
+         * Release the mapping.
+         */
+        void close();
+
+        bool is_open() const { return (_is_open); }
+
+        const char* data() const { return (_data); }
+        const char* begin() const { return (_data); }
+        const char* end() const { return (_data + _size); }
+        std::size_t size() const { return (_size); }
+
+        /**
+         * Tell the operating system we are going to read the
+         * mapping from start to finish.
+         */
+        void advise_sequential()
+        {
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+            if (_base && _base_size) {
+                madvise(_base, _base_size, MADV_SEQUENTIAL);
+            }
+#endif
+        }
+
+        /**
+         * Tell the operating system we are going to read the mapping 
+         * soon, so it can start reading it from the disk.
+         */
+        void advise_willneed()
+        {
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+            if (_base && _base_size) {
+                madvise(_base, _base_size, MADV_WILLNEED);
+            }
+#endif
+        }
+
+    private:
+        // disable copy construction
+        mapped_file(const mapped_file&);
+        mapped_file& operator= (const mapped_file&);
+
+        const char* _data;
+        std::size_t _size;
+        bool _is_open;
+
+        // the start and length of the mapping, which differ from
+        // _data and _size when a range of the file is mapped
+        void* _base;
+        std::size_t _base_size;
+
+#ifdef _WIN32
+        HANDLE _file;
+        HANDLE _map;
+#endif
+    };
+
+    inline bool mapped_file::open(const std::string& filename)
+    {
+        close();
+
+#ifdef _WIN32
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (_file == INVALID_HANDLE_VALUE) { return (false); }
+
+        LARGE_INTEGER li;
+        if (!GetFileSizeEx(_file, &li)) { close(); return (false); }
+        _size = (std::size_t)li.QuadPart;
+
+        if (_size > 0)
+        {
+            _map = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (_map == 0) { close(); return (false); }
+            _base = MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0);
+            if (_base == 0) { close(); return (false); }
+            _data = (const char*)_base;
+            _base_size = _size;
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) { return (false); }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return (false);
+        }
+        _size = (std::size_t)st.st_size;
+
+        if (_size > 0)
+        {
+            void *p = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                _size = 0;
+                return (false);
+            }
+            _base = p;
+            _base_size = _size;
+            _data = (const char*)p;
+        }
+
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+#endif
+        _is_open = true;
+        return (true);
+    }
+
+    inline bool mapped_file::open(const std::string& filename,
+        unsigned long long offset, std::size_t size)
+    {
+        close();
+
+#ifdef _WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        unsigned long long start = offset - offset%si.dwAllocationGranularity;
+
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE) { return (false); }
+
+        LARGE_INTEGER li;
+        if (!GetFileSizeEx(_file, &li) 
+            || offset + size > (unsigned long long)li.QuadPart) 
+        { 
+            close(); 
+            return (false); 
+        }
+
+        if (size > 0)
+        {
+            _map = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (_map == 0) { close(); return (false); }
+            _base_size = (std::size_t)(offset - start) + size;
+            _base = MapViewOfFile(_map, FILE_MAP_READ, 
+                (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), _base_size);
+            if (_base == 0) { close(); return (false); }
+        }
+#else
+        unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+        unsigned long long start = offset - offset%page;
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) { return (false); }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+            || offset + size > (unsigned long long)st.st_size) 
+        {
+            ::close(fd);
+            return (false);
+        }
+
+        if (size > 0)
+        {
+            std::size_t len = (std::size_t)(offset - start) + size;
+            void *p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, (off_t)start);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                return (false);
+            }
+            _base = p;
+            _base_size = len;
+        }
+
+        ::close(fd);
+#endif
+        if (_base) { _data = (const char*)_base + (std::size_t)(offset - start); }
+        _size = size;
+        _is_open = true;
+        return (true);
+    }
+
+    inline void mapped_file::close()
+    {
+#ifdef _WIN32
+        if (_base) { UnmapViewOfFile((LPCVOID)_base); }
+        if (_map) { CloseHandle(_map); }
+        if (_file != INVALID_HANDLE_VALUE) { CloseHandle(_file); }
+        _map = 0;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if (_base) { munmap(_base, _base_size); }
+#endif
+        _base = 0;
+        _base_size = 0;
+        _data = 0;
+        _size = 0;
+        _is_open = false;
+    }
+}
+
+#endif /* CPP_UTIL_MAPPED_FILE_HPP_ */
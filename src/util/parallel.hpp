@@ -0,0 +1,129 @@
+#ifndef CPP_UTIL_PARALLEL_HPP_
+#define CPP_UTIL_PARALLEL_HPP_
+
+/**
+ * @file parallel.hpp
+ * Small wrappers around the OpenMP runtime so that code using them
+ * still compiles (and runs on one thread) without OpenMP.
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <vector>
+#include <iterator>
+#include <cstddef>
+
+namespace util
+{
+    /**
+     * @return the number of threads a parallel region will use
+     */
+    inline int max_threads()
+    {
+#ifdef _OPENMP
+        return (omp_get_max_threads());
+#else
+        return (1);
+#endif
+    }
+
+    /**
+     * @return the id of the calling thread inside a parallel region
+     */
+    inline int thread_num()
+    {
+#ifdef _OPENMP
+        return (omp_get_thread_num());
+#else
+        return (0);
+#endif
+    }
+
+    /**
+     * @return the number of threads in the current parallel region
+     */
+    inline int num_threads()
+    {
+#ifdef _OPENMP
+        return (omp_get_num_threads());
+#else
+        return (1);
+#endif
+    }
+
+    /**
+     * @return a wall clock time in seconds
+     */
+    inline double wall_time()
+    {
+#ifdef _OPENMP
+        return (omp_get_wtime());
+#elif defined(_WIN32)
+        return ((double)GetTickCount()/1000.0);
+#else
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return ((double)tv.tv_sec + (double)tv.tv_usec/1.0e6);
+#endif
+    }
+
+    /**
+     * Split the range [0,n) into nparts contiguous pieces of nearly equal
+     * size.  Part p is [block_begin(n,nparts,p), block_begin(n,nparts,p+1)).
+     */
+    template <class Index>
+    inline Index block_begin(Index n, int nparts, int p)
+    {
+        return ((Index)(((double)n*(double)p)/(double)nparts));
+    }
+
+    /**
+     * Compute an inclusive prefix sum of a[0], ..., a[n-1] in place with
+     * all the available threads.
+     *
+     * Each thread sums its own block, the block totals are scanned, and
+     * then each thread adds its offset back into its block.
+     */
+    template <class Index, class RAI>
+    void parallel_partial_sum(RAI a, Index n)
+    {
+        int nthreads = max_threads();
+        if (nthreads <= 1 || n < (Index)(1<<16)) {
+            for (Index i = 1; i < n; ++i) { a[i] += a[i-1]; }
+            return;
+        }
+
+        typedef typename std::iterator_traits<RAI>::value_type value_type;
+        std::vector<value_type> block_sums(nthreads+1, 0);
+
+        #pragma omp parallel num_threads(nthreads)
+        {
+            int nt = num_threads();
+            int t = thread_num();
+            Index b = block_begin(n, nt, t);
+            Index e = block_begin(n, nt, t+1);
+
+            for (Index i = b+1; i < e; ++i) { a[i] += a[i-1]; }
+            if (e > b) { block_sums[t+1] = a[e-1]; }
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                for (int i = 1; i <= nt; ++i) { block_sums[i] += block_sums[i-1]; }
+            }
+
+            value_type offset = block_sums[t];
+            if (offset != 0) {
+                for (Index i = b; i < e; ++i) { a[i] += offset; }
+            }
+        }
+    }
+}
+
+#endif /* CPP_UTIL_PARALLEL_HPP_ */
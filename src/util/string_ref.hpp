@@ -0,0 +1,60 @@
+#ifndef CPP_UTIL_STRING_REF_HPP_
+#define CPP_UTIL_STRING_REF_HPP_
+
+/**
+ * @file string_ref.hpp
+ * A read only view of characters that somebody else owns, e.g. a line
+ * of a memory mapped file.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <ostream>
+
+namespace util
+{
+    class string_ref
+    {
+    public:
+        string_ref() : _data(0), _size(0) {}
+        string_ref(const char* data, std::size_t size)
+            : _data(data), _size(size) {}
+        string_ref(const char* s) : _data(s), _size(std::strlen(s)) {}
+        string_ref(const std::string& s) : _data(s.data()), _size(s.size()) {}
+
+        const char* data() const { return (_data); }
+        std::size_t size() const { return (_size); }
+        bool empty() const { return (_size == 0); }
+
+        const char* begin() const { return (_data); }
+        const char* end() const { return (_data + _size); }
+
+        char operator[] (std::size_t i) const { return (_data[i]); }
+
+        /** @return a copy of the characters */
+        std::string str() const { return (std::string(_data, _size)); }
+
+    private:
+        const char* _data;
+        std::size_t _size;
+    };
+
+    inline bool operator== (const string_ref& a, const string_ref& b)
+    {
+        return (a.size() == b.size()
+                && std::memcmp(a.data(), b.data(), a.size()) == 0);
+    }
+
+    inline bool operator!= (const string_ref& a, const string_ref& b)
+    {
+        return (!(a == b));
+    }
+
+    inline std::ostream& operator<< (std::ostream& os, const string_ref& s)
+    {
+        return (os.write(s.data(), (std::streamsize)s.size()));
+    }
+}
+
+#endif /* CPP_UTIL_STRING_REF_HPP_ */
@@ -0,0 +1,187 @@
+#ifndef CPP_UTIL_THREAD_HPP_
+#define CPP_UTIL_THREAD_HPP_
+
+/**
+ * @file thread.hpp
+ * A minimal thread, mutex, and condition variable on top of pthreads
+ * or the Win32 API.  All of the functions are inline, so this file can
+ * be included from any number of sources.
+ *
+ * These classes are for the few long lived helper threads in the
+ * program (e.g. a decompression thread).  Data parallel loops use
+ * OpenMP through util/parallel.hpp instead.
+ */
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN
+#   endif
+#	include <windows.h>
+#	include <process.h>
+#else
+#	include <pthread.h>
+#endif
+
+namespace util
+{
+    class condition;
+
+    /**
+     * A mutex.  Use scoped_lock to lock and unlock it.
+     */
+    class mutex
+    {
+    public:
+#ifdef _WIN32
+        mutex() { InitializeCriticalSection(&_m); }
+        ~mutex() { DeleteCriticalSection(&_m); }
+        void lock() { EnterCriticalSection(&_m); }
+        void unlock() { LeaveCriticalSection(&_m); }
+#else
+        mutex() { pthread_mutex_init(&_m, 0); }
+        ~mutex() { pthread_mutex_destroy(&_m); }
+        void lock() { pthread_mutex_lock(&_m); }
+        void unlock() { pthread_mutex_unlock(&_m); }
+#endif
+
+    private:
+        friend class condition;
+
+        // disable copy construction
+        mutex(const mutex&);
+        mutex& operator= (const mutex&);
+
+#ifdef _WIN32
+        CRITICAL_SECTION _m;
+#else
+        pthread_mutex_t _m;
+#endif
+    };
+
+    /**
+     * Lock a mutex for the lifetime of the object.
+     */
+    class scoped_lock
+    {
+    public:
+        explicit scoped_lock(mutex& m) : _m(m) { _m.lock(); }
+        ~scoped_lock() { _m.unlock(); }
+
+    private:
+        scoped_lock(const scoped_lock&);
+        scoped_lock& operator= (const scoped_lock&);
+
+        mutex& _m;
+    };
+
+    /**
+     * A condition variable.  As usual, wait must be called with the
+     * mutex locked and should be called in a loop that checks the
+     * predicate.
+     */
+    class condition
+    {
+    public:
+#ifdef _WIN32
+        condition() { InitializeConditionVariable(&_c); }
+        ~condition() {}
+        void wait(mutex& m) { SleepConditionVariableCS(&_c, &m._m, INFINITE); }
+        void notify_one() { WakeConditionVariable(&_c); }
+        void notify_all() { WakeAllConditionVariable(&_c); }
+#else
+        condition() { pthread_cond_init(&_c, 0); }
+        ~condition() { pthread_cond_destroy(&_c); }
+        void wait(mutex& m) { pthread_cond_wait(&_c, &m._m); }
+        void notify_one() { pthread_cond_signal(&_c); }
+        void notify_all() { pthread_cond_broadcast(&_c); }
+#endif
+
+    private:
+        condition(const condition&);
+        condition& operator= (const condition&);
+
+#ifdef _WIN32
+        CONDITION_VARIABLE _c;
+#else
+        pthread_cond_t _c;
+#endif
+    };
+
+    /**
+     * A thread that runs a function taking a single void* argument.
+     * A running thread must be joined before the object is destroyed.
+     */
+    class thread
+    {
+    public:
+        typedef void (*function_type)(void*);
+
+        thread() : _fn(0), _arg(0), _running(false) {}
+        ~thread() { join(); }
+
+        /**
+         * Start a thread to run fn(arg).
+         * @return false if the thread could not be started
+         */
+        bool start(function_type fn, void *arg)
+        {
+            if (_running) { return (false); }
+            _fn = fn;
+            _arg = arg;
+#ifdef _WIN32
+            _h = (HANDLE)_beginthreadex(0, 0, &thread::run, this, 0, 0);
+            _running = (_h != 0);
+#else
+            _running = (pthread_create(&_t, 0, &thread::run, this) == 0);
+#endif
+            return (_running);
+        }
+
+        /**
+         * Wait for the thread to finish.
+         */
+        void join()
+        {
+            if (!_running) { return; }
+#ifdef _WIN32
+            WaitForSingleObject(_h, INFINITE);
+            CloseHandle(_h);
+#else
+            pthread_join(_t, 0);
+#endif
+            _running = false;
+        }
+
+        bool running() const { return (_running); }
+
+    private:
+        thread(const thread&);
+        thread& operator= (const thread&);
+
+#ifdef _WIN32
+        static unsigned __stdcall run(void *t)
+        {
+            thread *self = (thread*)t;
+            self->_fn(self->_arg);
+            return (0);
+        }
+
+        HANDLE _h;
+#else
+        static void* run(void *t)
+        {
+            thread *self = (thread*)t;
+            self->_fn(self->_arg);
+            return (0);
+        }
+
+        pthread_t _t;
+#endif
+
+        function_type _fn;
+        void *_arg;
+        bool _running;
+    };
+}
+
+#endif /* CPP_UTIL_THREAD_HPP_ */
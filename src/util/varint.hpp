@@ -0,0 +1,65 @@
+#ifndef CPP_UTIL_VARINT_HPP_
+#define CPP_UTIL_VARINT_HPP_
+
+/**
+ * @file varint.hpp
+ * Byte aligned variable length integers.  Each byte holds seven bits
+ * of the value, lowest first, and the high bit is set on every byte
+ * but the last, so values below 128 take one byte.
+ */
+
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+namespace util
+{
+    /** @return the number of bytes to store v */
+    inline std::size_t varint_size(boost::uint32_t v)
+    {
+        std::size_t n = 1;
+        while (v >= 0x80) { v >>= 7; ++n; }
+        return (n);
+    }
+
+    /**
+     * Write v at p.
+     * @return the byte after v
+     */
+    inline unsigned char* write_varint(unsigned char* p, boost::uint32_t v)
+    {
+        while (v >= 0x80) {
+            *p++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (unsigned char)v;
+        return (p);
+    }
+
+    /** Read the value at p and move p past it. */
+    inline boost::uint32_t read_varint(const unsigned char*& p)
+    {
+        boost::uint32_t v = *p++;
+        if (v < 0x80) { return (v); }
+
+        v &= 0x7f;
+        int shift = 7;
+        unsigned char b;
+        do {
+            b = *p++;
+            v |= (boost::uint32_t)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        return (v);
+    }
+
+    /** Move p past the next n values. */
+    inline void skip_varints(const unsigned char*& p, std::size_t n)
+    {
+        while (n > 0) {
+            if (!(*p++ & 0x80)) { --n; }
+        }
+    }
+} // namespace util
+
+#endif // CPP_UTIL_VARINT_HPP_
@@ -24,6 +24,7 @@
 #include "matrix_data_panel.hpp"
 #include "matrix_canvas.hpp"
 #include "matrix_data_panel.hpp"
+#include "matrix_convert.hpp"
 
 #include <tclap/CmdLine.h>
 
@@ -33,14 +34,15 @@
 #include <functional>
 #include <iterator>
 #include <fstream>
+#include <cstdlib>
 
 #include <boost/timer.hpp>
+#include <boost/cstdint.hpp>
 
 /*
  * TODO:
  *
  * -Implement storing the matrix as a quad-tree "too" (for now...)
- * -Implement a two-level drawing scheme: level 1 and 2 are large 1024x1024 textures...
  * -Implement colors
  * -Implement SVG output
  * -Implement menu's for different viewing information (view->white background; view->black background)
@@ -152,6 +154,35 @@ const static int glui_normalization_id = 102;
 
 const static int glui_permutation_id = 104;
 
+/**
+ * Parse a size like 512, 512M, 64k, or 4G.  A size without a suffix
+ * is in megabytes.
+ *
+ * @return the size in bytes, or 0 if the string is not a size
+ */
+boost::uint64_t parse_memory_size(const std::string& s)
+{
+    char *end = 0;
+    double size = strtod(s.c_str(), &end);
+    if (end == s.c_str() || size <= 0) { return (0); }
+
+    double unit = 1024.0*1024.0;
+    if (*end != '\0')
+    {
+        switch (*end) {
+            case 'k': case 'K': unit = 1024.0; break;
+            case 'm': case 'M': unit = 1024.0*1024.0; break;
+            case 'g': case 'G': unit = 1024.0*1024.0*1024.0; break;
+            default: return (0);
+        }
+        ++end;
+        if (*end == 'b' || *end == 'B') { ++end; }
+        if (*end != '\0') { return (0); }
+    }
+
+    return ((boost::uint64_t)(size*unit));
+}
+
 void glui_callback(int id)
 {
     bool redisplay = false;
@@ -227,9 +258,12 @@ int main(int argc, char **argv)
     string clabel_filename;
 
 	bool symmetrize;
+    bool nocache=false;
+    string values="auto";
+    bool compress=false;
+    boost::uint64_t memory_limit=0;
     bool nocontrols=true;
-
-    bool rval = false;
+    string convert_filename;
 
 	try
 	{
@@ -250,6 +284,35 @@ int main(int argc, char **argv)
 			false /* default option */);
 		cmd.add(symmetrize_arg);
 
+        SwitchArg nocache_arg(
+			"", /* short tag */ "nocache", /* long tag */
+			"do not read or write the .vmcache file for the matrix", /* description */ 
+			false /* default option */);
+		cmd.add(nocache_arg);
+
+        ValueArg<std::string> values_arg(
+            "", /* short tag */ "values", /* long tag */
+            "store the values as none (only the pattern), float, or double; "
+            "by default, a matrix where every value is 1 is stored as a pattern", /* description */
+            false, /* not required */ "auto", /* default option */
+            "none|float|double" /* type descrption*/);
+        cmd.add(values_arg);
+
+        SwitchArg compress_arg(
+            "", /* short tag */ "compress", /* long tag */
+            "store the column indices as compressed gaps, which takes less "
+            "memory and draws a little slower", /* description */
+            false /* default option */);
+        cmd.add(compress_arg);
+
+        ValueArg<std::string> memory_limit_arg(
+            "", /* short tag */ "memory-limit", /* long tag */
+            "keep at most SIZE of the matrix in memory by drawing it from a "
+            ".vmtiles file of tiles; SIZE is in MB, or use a K, M, or G suffix", /* description */
+            false, /* not required */ "", /* default option */
+            "SIZE" /* type descrption*/);
+        cmd.add(memory_limit_arg);
+
         SwitchArg nocontrols_arg(
 			"", /* short tag */ "nocontrols", /* long tag */
 			"do not display the control panel at the bottom", /* description */ 
@@ -298,6 +361,17 @@ int main(int argc, char **argv)
             "LABELFILE" /* type descrption*/);
         cmd.add(rclabel_arg);
 
+        ValueArg<std::string> convert_arg(
+            "", /* short tag */ "convert", /* long tag */
+            "write the matrix to OUTFILE and exit without a display; the "
+            "extension of OUTFILE picks the format: smat, mtx, cmat, bsmat, "
+            "bssmat, petsc, or bcsr; smat, mtx, bsmat, and bssmat keep "
+            "repeated entries unless --symmetrize is given, the others add "
+            "them together", /* description */
+            false, /* not required */ "", /* default option */
+            "OUTFILE" /* type descrption*/);
+        cmd.add(convert_arg);
+
 		cmd.parse(argc, argv);
 
         yasmic::yasmic_verbose = verbose_arg.getValue();
@@ -305,6 +379,28 @@ int main(int argc, char **argv)
 
 		symmetrize = symmetrize_arg.getValue();
 
+        nocache = nocache_arg.getValue();
+
+        compress = compress_arg.getValue();
+
+        values = values_arg.getValue();
+        if (values != "auto" && values != "none" && values != "float" 
+            && values != "double") 
+        {
+            cerr << "error: --values must be none, float, or double" << endl;
+            return (-1);
+        }
+
+        if (memory_limit_arg.isSet())
+        {
+            memory_limit = parse_memory_size(memory_limit_arg.getValue());
+            if (memory_limit == 0)
+            {
+                cerr << "error: --memory-limit must be a size like 512, 512M, or 4G" << endl;
+                return (-1);
+            }
+        }
+
         nocontrols = nocontrols_arg.getValue();
 
         rperm_filename = rperm_arg.getValue();
@@ -320,6 +416,8 @@ int main(int argc, char **argv)
             rlabel_filename = rclabel_arg.getValue();
             clabel_filename = rclabel_arg.getValue();
         }
+
+        convert_filename = convert_arg.getValue();
 	}
 	catch (TCLAP::ArgException &e)
 	{
@@ -327,6 +425,12 @@ int main(int argc, char **argv)
 		return (-1);
 	}
     
+    // a conversion never opens a window
+    if (!convert_filename.empty())
+    {
+        return (convert_matrix(matrix_filename, convert_filename, symmetrize) ? 0 : -1);
+    }
+
     yasmic::yasmic_verbose = 1;
     //nocontrols = true;
 
@@ -339,30 +443,12 @@ int main(int argc, char **argv)
     // create the window
     matrix_canvas wind(800,600);
 
-    // begin the data loading process
-    rval = wind.load_matrix(matrix_filename, symmetrize);
-    if (!rval) 
-    {
-        cerr << "vismatrix : error loading matrix, terminating..." << endl;
-        return (-1);
-    }
+    if (values == "none") { wind.set_value_storage(matrix_canvas::no_values); }
+    else if (values == "float") { wind.set_value_storage(matrix_canvas::float_values); }
+    else if (values == "double") { wind.set_value_storage(matrix_canvas::double_values); }
 
-    
-    rval = wind.load_permutations(rperm_filename, cperm_filename);
-    if (!rval)
-    {
-        cerr << "vismatrix : error loading permutations, terminating..." << endl;
-        return (-1);
-    }
-
-
-    
-    rval = wind.load_labels(rlabel_filename, clabel_filename);
-    if (!rval)
-    {
-        cerr << "vismatrix : error loading labels, terminating..." << endl;
-        return (-1);
-    }
+    wind.set_compress_columns(compress);
+    wind.set_memory_limit(memory_limit);
 
     // this is a work around for a bug with visual c++ where the GLUT
     // calls will crash if we compile in release mode with optimizations
@@ -422,6 +508,19 @@ int main(int argc, char **argv)
     // hacky fix around a GLUI bug
     glui_reshape_func(600,400);
 
+    // begin the data loading process, the window shows the matrix
+    // as it loads
+    matrix_canvas::load_request load;
+    load.matrix_filename = matrix_filename;
+    load.symmetrize = symmetrize;
+    load.use_cache = !nocache;
+    load.rperm_filename = rperm_filename;
+    load.cperm_filename = cperm_filename;
+    load.rlabel_filename = rlabel_filename;
+    load.clabel_filename = clabel_filename;
+    load.exit_on_error = true;
+    wind.load_matrix_async(load);
+
     glutMainLoop();
 
     return (0);
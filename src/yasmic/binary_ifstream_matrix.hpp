@@ -11,6 +11,7 @@
 
 
 #include <fstream>
+#include <cstring>
 #include <boost/tuple/tuple.hpp>
 #include <iterator>
 #include <boost/iterator/iterator_facade.hpp>
@@ -50,11 +51,15 @@ namespace yasmic
             {  
 				if (_str != 0)
 				{
-            		_str->read((char *)&_r, sizeof(i_index_type));
-					_str->read((char *)&_c, sizeof(i_index_type));
-					_str->read((char *)&_v, sizeof(i_value_type));
+					// read the whole record at once
+					char rec[2*sizeof(i_index_type) + sizeof(i_value_type)];
+            		_str->read(rec, sizeof(rec));
 
-					if (_str->eof()) { _str = 0; }
+					if (_str->eof()) { _str = 0; return; }
+
+					std::memcpy(&_r, rec, sizeof(i_index_type));
+					std::memcpy(&_c, rec + sizeof(i_index_type), sizeof(i_index_type));
+					std::memcpy(&_v, rec + 2*sizeof(i_index_type), sizeof(i_value_type));
 				}
             }
             
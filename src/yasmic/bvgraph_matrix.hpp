@@ -25,14 +25,16 @@
  * Interprete a Boldi-Vigna Graph as a matrix.
  */
  
+#include <cassert>
 #include <iostream>
 #include <istream>
 #include <string>
 #include <algorithm>
 #include <map>
 #include <vector>
-#include <util/file.hpp>
+#include <util/file.h>
 #include <boost/lexical_cast.hpp>
+#include <boost/cstdint.hpp>
 #include <iterator>
 
 namespace yasmic 
@@ -50,7 +52,7 @@ namespace yasmic
         int n;
         
         // number of arcs
-        int m;
+        boost::int64_t m;
         
         // the base filename of the graph
         std::string basename;
@@ -67,6 +69,8 @@ namespace yasmic
         
         static const int DEFAULT_ZETA_K = 3;
         int _zeta_k;
+
+        bool _valid;
       
         void load_internal()
         {
@@ -74,23 +78,21 @@ namespace yasmic
             std::string propfilename = basename + ".properties";
             std::string graphfilename = basename + ".graph";
             std::ifstream propif(propfilename.c_str());
-            std::cout << propfilename << " " << util::file_exists(propfilename.c_str()) << std::endl;
-            std::cout << propfilename << " " << !propif << std::endl;
-            std::cout << graphfilename << " " << util::file_exists(graphfilename.c_str()) << std::endl; 
             if (!propif || !util::file_exists(graphfilename.c_str())) {
-                assert( ("file does not exist", 0) );
+                std::cerr << "error: cannot open " << propfilename 
+                          << " and " << graphfilename << std::endl;
                 return;
             }
             
-            std::map<std::string, int> options;
+            std::map<std::string, boost::int64_t> options;
             
-            // initialize the options we want
+            // initialize the options we want, with the defaults
             options["nodes"];
             options["arcs"];
-            options["windowsize"];
-            options["minintervallength"];
-            options["maxrefcount"];
-            options["zetak"];
+            options["windowsize"] = _window_size;
+            options["minintervallength"] = _min_interval_length;
+            options["maxrefcount"] = _max_ref_count;
+            options["zetak"] = _zeta_k;
             
             typedef std::string::size_type position;
             std::string property_line;
@@ -100,28 +102,46 @@ namespace yasmic
                 position eq = property_line.find('=');
                 if (eq == std::string::npos) { continue; }
                 std::string key = property_line.substr(0,eq);
-                // TODO throw error on non-trivial compressionflags
+                std::string value = property_line.substr(eq+1);
+                // strip a trailing carriage return
+                if (!value.empty() && value[value.size()-1] == '\r') { 
+                    value.erase(value.size()-1); 
+                }
+                if (key == "compressionflags" && !value.empty())
+                {
+                    // the decoder only handles the default codes
+                    std::cerr << "error: unsupported compressionflags " 
+                              << value << std::endl;
+                    return;
+                }
                 if (options.find(key) != options.end())
                 {
                     // we want to save this key
-                    std::string value = property_line.substr(eq+1);
-                    options[key] = boost::lexical_cast<int>(value);
+                    try {
+                        options[key] = boost::lexical_cast<boost::int64_t>(value);
+                    } catch (boost::bad_lexical_cast&) {
+                        std::cerr << "error: invalid property " 
+                                  << property_line << std::endl;
+                        return;
+                    }
                 }
             }
             
-            n = options["nodes"];
+            n = (int)options["nodes"];
             m = options["arcs"];
-            _window_size = options["windowsize"];
-            _min_interval_length = options["minintervallength"];
-            _max_ref_count = options["maxrefcount"];
-            _zeta_k = options["zetak"];
-            
-            // note that if compressionflags is specified, boost::lexical_cast 
-            // will through an exception because it is an invalid type.
-            if (n == 0 || m == 0 || _min_interval_length <= 1) {
-                assert( ("property errors", 0) );
-                // TODO throw an error
+            _window_size = (int)options["windowsize"];
+            _min_interval_length = (int)options["minintervallength"];
+            _max_ref_count = (int)options["maxrefcount"];
+            _zeta_k = (int)options["zetak"];
+            
+            if (n <= 0 || m < 0 || _window_size < 0 || _zeta_k <= 0 
+                || (_min_interval_length != 0 && _min_interval_length <= 1)) {
+                std::cerr << "error: invalid properties in " 
+                          << propfilename << std::endl;
+                return;
             }
+
+            _valid = true;
         }
         
         // disable copy construction
@@ -135,14 +155,22 @@ namespace yasmic
           _max_ref_count(DEFAULT_MAX_REF_COUNT),
           _window_size(DEFAULT_WINDOW_SIZE),
           _min_interval_length(DEFAULT_MIN_INTERVAL_LENGTH),
-          _zeta_k(DEFAULT_ZETA_K)
+          _zeta_k(DEFAULT_ZETA_K),
+          _valid(false)
         {
             load_internal(); 
         }
+
+        /**
+         * @return false if the properties could not be read
+         */
+        bool valid() const { return (_valid); }
+
         int num_nodes() const  { return (n); }
-        int num_arcs() const { return (m); }
+        boost::int64_t num_arcs() const { return (m); }
         
         std::string graph_filename() const { return (basename + ".graph"); }
+        std::string offsets_filename() const { return (basename + ".offsets"); }
         int max_ref_count() const  { return (_max_ref_count); }
         int window_size() const { return (_window_size); }
         int min_interval_length() const { return (_min_interval_length); }
@@ -201,7 +229,7 @@ namespace yasmic
         public:
             bit_istream(std::istream& is, const int buffer_size)
             : f(is), bufsize(buffer_size), fill(0), pos(0), avail(0), buffer(NULL), position(0),
-              read_bits(0), current(0)
+              read_bits(0), current(0), past_end(false)
             {
                 assert ( bufsize > 0 );
                 buffer = new unsigned char[bufsize];
@@ -220,6 +248,28 @@ namespace yasmic
                 fill = 0;
             }
             
+            /**
+             * Move to a bit offset from the start of the underlying 
+             * stream.
+             */
+            void seek_bit(boost::int64_t bit) {
+                f.clear();
+                f.seekg((std::streamoff)(bit >> 3), std::ios_base::beg);
+                position = (long)(bit >> 3);
+                avail = 0;
+                pos = 0;
+                fill = 0;
+                past_end = false;
+                read_bits = (long)bit;
+                const int skip = (int)(bit & 7);
+                if (skip != 0) { current = read(); fill = 8 - skip; }
+            }
+
+            /**
+             * @return true if we tried to read past the end of the stream
+             */
+            bool eof() const { return (past_end); }
+            
             /**
              * Close the bitstream
              */
@@ -313,6 +363,8 @@ namespace yasmic
             int avail;
             // current position of the first byte in the byte buffer
             long position;
+            // true after a read past the end of the stream
+            bool past_end;
             
             /**
              * Read the next byte from the underlying stream.
@@ -328,7 +380,11 @@ namespace yasmic
                     f.read((char*)buffer, bufsize);
                     avail = f.gcount(); 
                     if (avail <= 0) {
-                        // throw an exception
+                        // return ones, so a unary code stops here, and 
+                        // remember the error
+                        avail = 0;
+                        past_end = true;
+                        return 0xFF;
                     }
                     else {
                         position += pos;
@@ -417,6 +473,11 @@ namespace yasmic
             std::vector<int> buffer1;
             std::vector<int> buffer2;
             std::vector<int> arcs;
+
+            // the successors of the nodes before first_node are unknown
+            int first_node;
+            // true if the current row could not be decoded
+            bool _bad_row;
             
             int read_offset() { return (bis.read_gamma()); }    
             int read_outdegree() { return (bis.read_gamma()); }
@@ -430,7 +491,7 @@ namespace yasmic
             void load_successors()
             {
                 const int x = curr;
-                int ref, ref_index;
+                int ref = 0, ref_index;
                 int i, extra_count, block_count = 0;
                 std::vector<int> block, left, len;
                 
@@ -445,6 +506,12 @@ namespace yasmic
                 if ( window_size > 0 ) {
                     ref = read_reference();
                 }
+
+                if (d < 0 || ref > window_size || (ref > 0 && x - ref < first_node)) {
+                    // the reference is outside of the window, or the data is invalid
+                    bad_row();
+                    return;
+                }
                 
                 ref_index = (x - ref + cyclic_buffer_size) % cyclic_buffer_size;
                 
@@ -471,6 +538,7 @@ namespace yasmic
                         copied += (outd[ref_index] - total);
                     }
                     extra_count = d - copied;
+                    if (total > outd[ref_index] || extra_count < 0) { bad_row(); return; }
                 }
                 else {
                     extra_count = d;
@@ -498,6 +566,7 @@ namespace yasmic
                             prev += len[i];
                             extra_count -= len[i];
                         }
+                        if (extra_count < 0) { bad_row(); return; }
                     }
                 }
                 
@@ -629,6 +698,12 @@ namespace yasmic
                 assert (buf1_index == d);
                 // std::cout << "end arcs" << std::endl;
             }
+
+            void bad_row()
+            {
+                _bad_row = true;
+                outd[curr%cyclic_buffer_size] = curr_outd = 0;
+            }
             
         public:
             // constructor
@@ -646,7 +721,9 @@ namespace yasmic
               cyclic_buffer_size(window_size+1),
               outd(cyclic_buffer_size),
               curr(-1),
-              window(cyclic_buffer_size)                
+              window(cyclic_buffer_size),
+              first_node(0),
+              _bad_row(false)
             {}
                     
             
@@ -661,8 +738,41 @@ namespace yasmic
                 _row_arcs_end = false;
                 _rows_end = false;
                 curr = -1;
+                first_node = 0;
             }
             
+            /**
+             * Start decoding at a node.  The bit offset of the node is 
+             * in the .offsets file.  A node can copy successors from the
+             * window_size nodes before it, so the rows decoded after a
+             * seek are only correct once the reference chains stay
+             * after the starting node, i.e. window_size*max_ref_count
+             * nodes later.
+             *
+             * Seeking does not clear the window of previous rows, so
+             * the nodes after a seek can still copy from them.  Use
+             * set_first_node to mark where the decoded rows start.
+             *
+             * @param node the node, the next call to next_row decodes it
+             * @param bit the bit offset of the node in the .graph file
+             */
+            void seek(int node, boost::int64_t bit)
+            {
+                graph_stream.clear();
+                bis.seek_bit(bit);
+
+                _row_arcs_end = false;
+                _rows_end = false;
+                curr = node - 1;
+            }
+
+            // the rows before node are unknown, a row that copies
+            // from one of them is reported as a row_error
+            void set_first_node(int node) { first_node = node; }
+
+            // true if the current row is invalid or the stream ended
+            bool row_error() const { return (_bad_row || bis.eof()); }
+            
             // step to the next row of the matrix
             void next_row()
             {
@@ -671,6 +781,7 @@ namespace yasmic
                 if (curr > n-1) { _rows_end = true; return; }
                 
                 int curr_index = curr % cyclic_buffer_size;
+                _bad_row = false;
                 load_successors();
                 curr_arc = -1;
                 _row_arcs_end = false;
@@ -704,8 +815,169 @@ namespace yasmic
             // returns true when there are no more arcs for the current row
             bool row_arcs_end() { return (_row_arcs_end); }
         }; // class bvgraph_iterator
+
+        /**
+         * A ChunkSource (see yasmic/util/load_crm_parallel.hpp) that 
+         * decodes a range of nodes of a bvgraph in each chunk.
+         *
+         * The ranges are picked from the bit offsets in the .offsets file
+         * so each chunk decodes about the same number of bits.  A node
+         * copies successors from a reference at most window_size nodes
+         * before it, with chains of at most max_ref_count references, so
+         * a chunk starting at node s first decodes the window_size*
+         * max_ref_count nodes before s, each one at its own offset.
+         *
+         * Without an .offsets file, or with unbounded reference chains,
+         * there is a single chunk.
+         */
+        class bvgraph_chunk_source
+        {
+        public:
+            bvgraph_chunk_source(const bvgraph_matrix& g, int nchunks)
+            : _g(g)
+            {
+                int n = g.num_nodes();
+
+                boost::int64_t span = (boost::int64_t)g.window_size()*g.max_ref_count();
+                if (nchunks > 1 && g.max_ref_count() >= 0 
+                    && util::file_exists(g.offsets_filename()))
+                {
+                    if (!read_offsets(nchunks, (int)std::min(span, (boost::int64_t)n)))
+                    {
+                        std::cerr << "warning: cannot read " << g.offsets_filename()
+                                  << ", decoding on one thread" << std::endl;
+                        nchunks = 1;
+                    }
+                }
+                else
+                {
+                    nchunks = 1;
+                }
+
+                if (nchunks == 1)
+                {
+                    _first.assign(1, 0);
+                    _first.push_back(n);
+                    _warm.assign(1, 0);
+                    _offsets.assign(1, std::vector<boost::int64_t>(1, 0));
+                    _bits.assign(1, 0);
+                    _bits.push_back(8*(boost::int64_t)util::filesize(g.graph_filename()));
+                }
+            }
+
+            int nchunks() const { return ((int)_first.size() - 1); }
+
+            std::size_t chunk_bytes(int i) const
+            { return ((std::size_t)((_bits[i+1] - _bits[i])/8)); }
+
+            template <class Sink>
+            bool parse_chunk(int i, Sink& s)
+            {
+                int first = _first[i];
+                int last = _first[i+1];
+                if (first >= last) { return (true); }
+
+                bvgraph_sequential_iterator it(_g);
+
+                // decode the nodes before the chunk that it may copy from
+                int w = _warm[i];
+                it.set_first_node(w);
+                for (int x = w; x < first; ++x)
+                {
+                    it.seek(x, _offsets[i][x-w]);
+                    it.next_row();
+                }
+
+                it.seek(first, _offsets[i][first-w]);
+                for (int x = first; x < last; ++x)
+                {
+                    it.next_row();
+                    if (it.row_error()) { return (false); }
+                    while (!it.row_arcs_end())
+                    {
+                        it.next_row_arc();
+                        s(x, it.cur_row_arc_target(), 1);
+                    }
+                }
+
+                return (true);
+            }
+
+        private:
+            /**
+             * Read the gamma coded offsets and split the nodes into
+             * chunks.  Only the offsets of the nodes each chunk decodes 
+             * first are saved.
+             *
+             * @param span the number of nodes to decode before a chunk
+             */
+            bool read_offsets(int nchunks, int span)
+            {
+                int n = _g.num_nodes();
+                boost::int64_t total = 8*(boost::int64_t)util::filesize(_g.graph_filename());
+
+                std::ifstream ofs(_g.offsets_filename().c_str(), std::ios::binary);
+                bit_istream obs(ofs, 64*1024);
+
+                // the offsets of the last span+1 nodes
+                std::vector<boost::int64_t> ring(span+1);
+
+                _first.assign(1, 0);
+                _warm.assign(1, 0);
+                _offsets.assign(1, std::vector<boost::int64_t>(1, 0));
+                _bits.assign(1, 0);
+
+                // there are n+1 offsets, the first is always 0
+                boost::int64_t off = 0;
+                for (int x = 0; x <= n; ++x)
+                {
+                    off += obs.read_gamma();
+                    if (obs.eof()) { return (false); }
+                    ring[x % (span+1)] = off;
+
+                    // node x starts the next chunk when it passes the 
+                    // next equal share of the bits
+                    int k = (int)_first.size();
+                    if (x < n && k < nchunks && off >= total/nchunks*k)
+                    {
+                        int w = std::max(0, x - span);
+                        _first.push_back(x);
+                        _warm.push_back(w);
+                        _offsets.push_back(std::vector<boost::int64_t>());
+                        for (int y = w; y <= x; ++y) {
+                            _offsets.back().push_back(ring[y % (span+1)]);
+                        }
+                        _bits.push_back(off);
+                    }
+                }
+
+                _first.push_back(n);
+                _bits.push_back(off);
+
+                return (true);
+            }
+
+            const bvgraph_matrix& _g;
+
+            // chunk i decodes nodes [_first[i], _first[i+1])
+            std::vector<int> _first;
+            // and starts with the nodes from _warm[i]
+            std::vector<int> _warm;
+            // the bit offsets of nodes _warm[i] to _first[i]
+            std::vector< std::vector<boost::int64_t> > _offsets;
+            // the bit offsets of the _first nodes
+            std::vector<boost::int64_t> _bits;
+        }; // class bvgraph_chunk_source
     } // namespace impl  
     
               
 }// namespace yasmic
 
+#ifdef BOOST_MSVC
+#if _MSC_VER >= 1400
+    // restore the warning for ifstream::read
+    #pragma warning( pop )
+#endif // _MSC_VER >= 1400
+#endif // BOOST_MSVC
+
+#endif // YASMIC_BVGRAPH_MATRIX
@@ -18,8 +18,12 @@
 #include <vector> 
 
 #include <functional>
+#include <algorithm>
 #include <yasmic/tuple_utility.hpp>
 #include <limits>
+#include <cstddef>
+
+#include <util/parallel.hpp>
 
 #include <yasmic/generic_matrix_operations.hpp>
 
@@ -105,7 +109,11 @@ namespace yasmic
             dereference() const 
             { 
             	//return boost::make_tuple(_row, *_ci, *_vi);
-				return make_simple_nonzero(_row, *_ci, *_vi, _id);
+				// the columns may be stored in a narrower type than
+				// the row pointers
+				return make_simple_nonzero(_row, 
+					(typename std::iterator_traits<RowIter>::value_type)*_ci, 
+					*_vi, _id);
             }
 
 
@@ -168,7 +176,9 @@ namespace yasmic
 				IndexType>
             dereference() const 
 			{
-				return (make_simple_nonzero(_r, *_ci, *_vi, _nzi));
+				return (make_simple_nonzero(
+					(typename std::iterator_traits<ColIter>::value_type)_r, 
+					*_ci, *_vi, _nzi));
 			}
 		};
 
@@ -320,76 +330,166 @@ namespace yasmic
 
 
 
+	namespace impl
+	{
+		/**
+		 * Split the rows of a crm matrix into nparts ranges with about
+		 * the same number of nonzeros.  Range p is the rows 
+		 * [crm_balanced_row(p), crm_balanced_row(p+1)).
+		 */
+		template <class RowIter, class Index>
+		Index crm_balanced_row(RowIter rows, Index nr, int nparts, int p)
+		{
+			if (p <= 0) { return (0); }
+			if (p >= nparts) { return (nr); }
+			typedef typename std::iterator_traits<RowIter>::value_type nz_type;
+			nz_type target = rows[0] + 
+				(nz_type)(((double)(rows[nr] - rows[0])*p)/nparts);
+			return ((Index)(std::lower_bound(rows, rows + nr, target) - rows));
+		}
+
+		/**
+		 * The number of threads to pack a matrix.  Each thread needs a
+		 * work array with one entry for each column, so we never use 
+		 * more work arrays than it takes to match the nonzeros.
+		 */
+		template <class Index, class NzIndex>
+		int crm_pack_threads(Index nc, NzIndex nnz)
+		{
+			int nthreads = util::max_threads();
+			if (nc > 0 && (double)nnz/(double)nc < (double)nthreads) {
+				nthreads = (int)((double)nnz/(double)nc);
+			}
+			return (std::max(nthreads, 1));
+		}
+	}
+
+	/**
+	 * Remove the duplicate entries in each row, combining their values
+	 * with b.  This doesn't actually free any memory, but reduces the
+	 * non-zero count to the appropriate level for the matrix.
+	 *
+	 * The rows are split into ranges with about the same number of 
+	 * nonzeros, and each range is packed in place on its own thread 
+	 * with its own work array.  Then the packed ranges are moved next
+	 * to each other.
+	 */
 	template <class RowIter, class ColIter, class ValIter, class BFunc >
 	void pack_storage(compressed_row_matrix<RowIter, ColIter, ValIter>& m, BFunc b = BFunc())
 	{
-		// remove any duplicate entries.  This doesn't actually free any 
-		// memory, but reduces the non-zero count to the appropriate level
-		// for the matrix.
-
 		typedef compressed_row_matrix<RowIter, ColIter, ValIter> Matrix;
 		typedef smatrix_traits<Matrix> traits;
+		typedef typename traits::index_type index_type;
+		typedef typename traits::nz_index_type nz_type;
 
-		std::vector<typename traits::index_type> wa(ncols(m));
+		RowIter rows = m._rstart;
+		ColIter ci = m._cstart;
+		ValIter vi = m._vstart;
+		index_type nr = (index_type)(m._rend - m._rstart) - 1;
+		if (nr < 1) { return; }
 
-		typename traits::nz_index_type cur_elem = 0;
-		
-		typename traits::index_type unused = std::numeric_limits<typename traits::index_type>::max();
+		int nparts = impl::crm_pack_threads(ncols(m), rows[nr] - rows[0]);
 
-		std::fill(wa.begin(), wa.end(), unused);
+		// the ranges and where they start, saved before any thread 
+		// changes the row pointers
+		std::vector<index_type> bounds(nparts+1);
+		std::vector<nz_type> start(nparts+1), len(nparts);
+		for (int p = 0; p <= nparts; ++p)
+		{
+			bounds[p] = impl::crm_balanced_row(rows, nr, nparts, p);
+			start[p] = rows[bounds[p]];
+		}
 
-		RowIter ri, riend;
-		ri = m._rstart;
-		riend = m._rend-1;
+		index_type unused = std::numeric_limits<index_type>::max();
 
-		ColIter ci = m._cstart;
-		ValIter vi = m._vstart;
-
-		for(; ri != riend; ++ri)
+		#pragma omp parallel for num_threads(nparts) schedule(static,1)
+		for (int p = 0; p < nparts; ++p)
 		{
-			typename traits::nz_index_type pos_start = *ri;
-			typename traits::nz_index_type pos_end = *(ri+1);
+			std::vector<index_type> wa(ncols(m), unused);
 
-			*ri = cur_elem;
+			nz_type cur_elem = start[p];
+			nz_type pos_start = start[p];
 
-			// 
-			// look at the elements in order
-			//
-	        
-			for (typename traits::nz_index_type k=pos_start; k<pos_end; k++)
+			for (index_type r = bounds[p]; r < bounds[p+1]; ++r)
 			{
-				// the column
-				typename traits::index_type c = ci[k]; 
-	            
-				if (wa[c] == unused)
+				nz_type pos_end = (r+1 == bounds[p+1]) ? start[p+1] : rows[r+1];
+
+				rows[r] = cur_elem;
+
+				if (pos_end - pos_start == 1)
+				{
+					// a row with one entry has no duplicates
+					ci[cur_elem] = ci[pos_start];
+					vi[cur_elem] = vi[pos_start];
+					++cur_elem;
+					pos_start = pos_end;
+					continue;
+				}
+
+				// 
+				// look at the elements in order
+				//
+				for (nz_type k=pos_start; k<pos_end; k++)
 				{
-					// this is a new element
-					ci[cur_elem] = c;
-					vi[cur_elem] = vi[k];
-	                
-					wa[c] = cur_elem;
-	                
-					// now we've used this element...
-					cur_elem++;
+					// the column
+					index_type c = ci[k]; 
+		            
+					if (wa[c] == unused)
+					{
+						// this is a new element
+						ci[cur_elem] = c;
+						vi[cur_elem] = vi[k];
+		                
+						wa[c] = cur_elem;
+		                
+						// now we've used this element...
+						cur_elem++;
+					}
+					else
+					{
+						// this is a duplicate element
+						vi[wa[c]] = b(vi[wa[c]], vi[k]);
+					}
 				}
-				else
+		        
+				// reset just the entries we used (which are stored in the ci
+				// array)
+				for (nz_type k=rows[r]; k < cur_elem; k++)
 				{
-					// this is a duplicate element
-					//vi[wa[c]] += vi[k];
-					vi[wa[c]] = b(vi[wa[c]], vi[k]);
+					wa[ci[k]] = unused;
 				}
+
+				pos_start = pos_end;
 			}
-	        
-			// reset just the entries we used (which are stored in the ci
-			// array)
-			for (typename traits::nz_index_type k=*ri; k < cur_elem; k++)
+
+			len[p] = cur_elem - start[p];
+		}
+
+		// move each packed range down to the end of the one before; the
+		// ranges only move towards the front, so this is done in order
+		std::vector<nz_type> shift(nparts);
+		nz_type dest = start[0];
+		for (int p = 0; p < nparts; ++p)
+		{
+			shift[p] = start[p] - dest;
+			if (shift[p] > 0)
 			{
-				wa[ci[k]] = unused;
+				std::copy(ci + start[p], ci + (start[p] + len[p]), ci + dest);
+				std::copy(vi + start[p], vi + (start[p] + len[p]), vi + dest);
 			}
+			dest += len[p];
+		}
 
+		#pragma omp parallel for num_threads(nparts) schedule(static,1)
+		for (int p = 0; p < nparts; ++p)
+		{
+			if (shift[p] == 0) { continue; }
+			for (index_type r = bounds[p]; r < bounds[p+1]; ++r) {
+				rows[r] -= shift[p];
+			}
 		}
 
-		*ri = cur_elem;
+		rows[nr] = dest;
 	}
 
     /* ========================================================
@@ -521,9 +621,105 @@ namespace yasmic
 	}
 
 
+	namespace impl
+	{
+		/** The rows up to this length are sorted with an insertion sort. */
+		const int crm_insertion_sort_max = 16;
+		/** The rows longer than this are sorted with a radix sort. */
+		const int crm_radix_sort_min = 32;
+
+		/**
+		 * One pass of a radix sort.  Move the n entries of (sc,sv) to
+		 * (dc,dv), stably ordered by the byte of c-base at shift.
+		 */
+		template <class SrcCol, class SrcVal, class DstCol, class DstVal, class Index>
+		void crm_radix_pass(SrcCol sc, SrcVal sv, std::ptrdiff_t n, 
+			DstCol dc, DstVal dv, Index base, int shift)
+		{
+			std::ptrdiff_t count[257] = {0};
+			for (std::ptrdiff_t k = 0; k < n; ++k) {
+				++count[(((unsigned long long)(sc[k] - base)) >> shift & 0xff) + 1];
+			}
+			for (int d = 0; d < 256; ++d) { count[d+1] += count[d]; }
+			for (std::ptrdiff_t k = 0; k < n; ++k) {
+				std::ptrdiff_t pos = count[((unsigned long long)(sc[k] - base)) >> shift & 0xff]++;
+				dc[pos] = sc[k];
+				dv[pos] = sv[k];
+			}
+		}
+
+		/**
+		 * Sort the n entries of one row by column.  Sorted rows are left
+		 * alone, short rows use an insertion sort, and long rows use a 
+		 * radix sort on the column with ctmp and vtmp as the buffers.
+		 */
+		template <class ColIter, class ValIter>
+		void crm_sort_row(ColIter c, ValIter v, std::ptrdiff_t n,
+			std::vector<typename std::iterator_traits<ColIter>::value_type>& ctmp,
+			std::vector<typename std::iterator_traits<ValIter>::value_type>& vtmp)
+		{
+			typedef typename std::iterator_traits<ColIter>::value_type ctype;
+			typedef typename std::iterator_traits<ValIter>::value_type vtype;
+
+			std::ptrdiff_t k = 1;
+			while (k < n && !(c[k] < c[k-1])) { ++k; }
+			if (k >= n) { return; }
+
+			if (n <= crm_insertion_sort_max)
+			{
+				for (std::ptrdiff_t i = 1; i < n; ++i)
+				{
+					ctype cv = c[i];
+					vtype vv = v[i];
+					std::ptrdiff_t j = i;
+					for (; j > 0 && cv < c[j-1]; --j) {
+						c[j] = c[j-1];
+						v[j] = v[j-1];
+					}
+					c[j] = cv;
+					v[j] = vv;
+				}
+			}
+			else if (n <= crm_radix_sort_min)
+			{
+				std::sort(
+					crm_make_col_val_iter(c, v),
+					crm_make_col_val_iter(c + n, v + n),
+					crm_col_val_iter_tuple_compare<ColIter,ValIter>());
+			}
+			else
+			{
+				// only sort the bytes where the columns differ
+				ctype cmin = *std::min_element(c, c + n);
+				ctype cmax = *std::max_element(c, c + n);
+				unsigned long long range = (unsigned long long)(cmax - cmin);
+
+				ctmp.resize(n);
+				vtmp.resize(n);
+
+				bool in_tmp = false;
+				for (int shift = 0; shift == 0 || (range >> shift) > 0; shift += 8)
+				{
+					if (in_tmp) {
+						crm_radix_pass(ctmp.begin(), vtmp.begin(), n, c, v, cmin, shift);
+					} else {
+						crm_radix_pass(c, v, n, ctmp.begin(), vtmp.begin(), cmin, shift);
+					}
+					in_tmp = !in_tmp;
+				}
+				if (in_tmp)
+				{
+					std::copy(ctmp.begin(), ctmp.begin() + n, c);
+					std::copy(vtmp.begin(), vtmp.begin() + n, v);
+				}
+			}
+		}
+	}
+
 	/**
 	 * Sort the storage of a matrix.  This function sorts the entries
-	 * in each row by column.
+	 * in each row by column.  The rows are split into ranges with about
+	 * the same number of nonzeros for each thread.
 	 */
 	template <class RowIter, class ColIter, class ValIter>
 	void sort_storage(compressed_row_matrix<RowIter, ColIter, ValIter>& m)
@@ -532,25 +728,61 @@ namespace yasmic
 		typedef smatrix_traits<Matrix> traits;
 
 		typedef typename traits::index_type itype;
-		typedef typename traits::value_type vtype;
-
-		RowIter ri, riend;
-		ri = m._rstart;
-		riend = m._rend-1;
 
+		RowIter rows = m._rstart;
 		ColIter ci = m._cstart;
 		ValIter vi = m._vstart;
+		itype nr = (itype)(m._rend - m._rstart) - 1;
+		if (nr < 1) { return; }
 
-		for(; ri != riend; ++ri)
+		int nparts = util::max_threads();
+
+		#pragma omp parallel for num_threads(nparts) schedule(static,1)
+		for (int p = 0; p < nparts; ++p)
 		{
-			typename traits::nz_index_type pos_start = *ri;
-			typename traits::nz_index_type pos_end = *(ri+1);
+			std::vector<typename std::iterator_traits<ColIter>::value_type> ctmp;
+			std::vector<typename std::iterator_traits<ValIter>::value_type> vtmp;
+
+			itype rend = impl::crm_balanced_row(rows, nr, nparts, p+1);
+			for (itype r = impl::crm_balanced_row(rows, nr, nparts, p); r < rend; ++r)
+			{
+				impl::crm_sort_row(ci + rows[r], vi + rows[r], 
+					(std::ptrdiff_t)(rows[r+1] - rows[r]), ctmp, vtmp);
+			}
+		}
+	}
 
-			std::sort(
-				impl::crm_make_col_val_iter(ci + pos_start, vi + pos_start),
-				impl::crm_make_col_val_iter(ci + pos_end, vi + pos_end),
-				impl::crm_col_val_iter_tuple_compare<ColIter,ValIter>());
+	/**
+	 * @return true if the columns of every row are strictly increasing,
+	 * i.e. the matrix is already packed and sorted.
+	 */
+	template <class RowIter, class ColIter, class ValIter>
+	bool is_sorted_storage(const compressed_row_matrix<RowIter, ColIter, ValIter>& m)
+	{
+		typedef compressed_row_matrix<RowIter, ColIter, ValIter> Matrix;
+		typedef typename smatrix_traits<Matrix>::index_type itype;
+
+		RowIter rows = m._rstart;
+		ColIter ci = m._cstart;
+		itype nr = (itype)(m._rend - m._rstart) - 1;
+
+		int nparts = util::max_threads();
+		int sorted = 1;
+
+		#pragma omp parallel for num_threads(nparts) schedule(static,1) reduction(&&:sorted)
+		for (int p = 0; p < nparts; ++p)
+		{
+			itype rend = impl::crm_balanced_row(rows, nr, nparts, p+1);
+			for (itype r = impl::crm_balanced_row(rows, nr, nparts, p); r < rend && sorted; ++r)
+			{
+				for (typename std::iterator_traits<RowIter>::value_type k = rows[r]+1; 
+					 k < rows[r+1]; ++k)
+				{
+					if (!(ci[k-1] < ci[k])) { sorted = 0; break; }
+				}
+			}
 		}
+		return (sorted != 0);
 	}
 
     /* ========================================================
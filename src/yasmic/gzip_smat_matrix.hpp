@@ -0,0 +1,194 @@
+#ifndef YASMIC_GZIP_SMAT_MATRIX
+#define YASMIC_GZIP_SMAT_MATRIX
+
+/**
+ * @file gzip_smat_matrix.hpp
+ * Read a gzip compressed smat file as a stream of nonzeros.
+ *
+ * The file is inflated by a yasmic::gzip_block_reader on a separate
+ * thread and the numbers are scanned directly from the inflated blocks
+ * with the scanners in yasmic/util/text_scanner.hpp.
+ *
+ * Unlike ifstream_matrix, the nonzeros of a gzip_smat_matrix can only
+ * be traversed ONCE, the file is never inflated a second time.  Use it
+ * with load_matrix_to_crm_single_pass or with a degrees file.
+ */
+
+#include <boost/tuple/tuple.hpp>
+#include <iterator>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <yasmic/smatrix_traits.hpp>
+#include <yasmic/generic_matrix_operations.hpp>
+#include <yasmic/util/text_scanner.hpp>
+#include <yasmic/util/gzip_block_reader.hpp>
+
+namespace yasmic
+{
+	namespace impl
+	{
+		template <class Matrix, class i_index_type, class i_value_type>
+		class gzip_smat_matrix_const_iterator
+		: public boost::iterator_facade<
+            gzip_smat_matrix_const_iterator<Matrix, i_index_type, i_value_type>,
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type> const,
+            boost::single_pass_traversal_tag,
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type> const >
+        {
+        public:
+            gzip_smat_matrix_const_iterator()
+				: _m(0), _r(0), _c(0), _v(0)
+			{}
+
+            gzip_smat_matrix_const_iterator(Matrix* m)
+				: _m(m), _r(0), _c(0), _v(0)
+            { increment(); }
+
+        private:
+            friend class boost::iterator_core_access;
+
+            void increment()
+            {
+				if (_m != 0 && !_m->read_nonzero(_r, _c, _v))
+				{
+                    _m = 0;
+				}
+            }
+
+            bool equal(gzip_smat_matrix_const_iterator const& other) const
+            {
+				return (_m == other._m);
+            }
+
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type>
+            dereference() const
+            {
+            	return boost::make_tuple(_r, _c, _v);
+            }
+
+            Matrix* _m;
+
+			i_index_type _r, _c;
+			i_value_type _v;
+        };
+	}
+
+	template <class index_type = int, class value_type = double, class size_type = int>
+	class gzip_smat_matrix
+	{
+	public:
+		/**
+		 * Open a gzip compressed smat file and read the header.
+		 */
+		gzip_smat_matrix(const std::string& filename)
+			: _p(0), _end(0), _nrows(0), _ncols(0), _nnz(0), _valid(false)
+		{
+			_valid = _reader.open(filename)
+                     && read_token(_nrows) && read_token(_ncols)
+                     && read_token(_nnz);
+		}
+
+        /**
+         * @return false if the file or the header could not be read
+         */
+        bool valid() const { return (_valid); }
+
+        /**
+         * Read the next triple from the stream.
+         *
+         * @return false at the end of the file or on a parse error
+         */
+        bool read_nonzero(index_type& r, index_type& c, value_type& v)
+        {
+            return (read_token(r) && read_token(c) && read_token(v));
+        }
+
+        const gzip_block_reader& reader() const { return (_reader); }
+
+	private:
+        /**
+         * Skip whitespace and fetch the next block if this one is used
+         * up.  The blocks end at newlines, so a token never spans two
+         * blocks.
+         */
+        template <class T>
+        bool read_token(T& t)
+        {
+            for (;;)
+            {
+                _p = impl::scan_skip_space(_p, _end);
+                if (_p != _end) { break; }
+                if (!_reader.next(_p, _end)) { return (false); }
+            }
+            return (impl::scan_value(_p, _end, t));
+        }
+
+        gzip_block_reader _reader;
+
+        const char* _p;
+        const char* _end;
+
+    public:
+		size_type _nrows;
+		size_type _ncols;
+		size_type _nnz;
+
+        bool _valid;
+	};
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+    struct smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >
+    {
+    	typedef i_size_type size_type;
+    	typedef i_index_type index_type;
+		typedef i_value_type value_type;
+
+		typedef boost::tuple<index_type, index_type, value_type> nonzero_descriptor;
+
+		typedef impl::gzip_smat_matrix_const_iterator<
+            gzip_smat_matrix<i_index_type, i_value_type, i_size_type>,
+            i_index_type, i_value_type> nonzero_iterator;
+
+		typedef i_size_type nz_index_type;
+
+		typedef void row_iterator;
+
+		typedef void row_nonzero_descriptor;
+		typedef void row_nonzero_iterator;
+
+		typedef void column_iterator;
+
+        typedef void properties;
+    };
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+    inline std::pair<typename smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type,
+                     typename smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type >
+    dimensions(gzip_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+    {
+        return (std::make_pair(m._nrows, m._ncols));
+    }
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+	inline typename smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type
+	nnz(gzip_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+	{
+        return (m._nnz);
+	}
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+	inline std::pair<typename smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >::nonzero_iterator,
+                     typename smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> >::nonzero_iterator>
+    nonzeros(gzip_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+    {
+    	typedef smatrix_traits<gzip_smat_matrix<i_index_type, i_value_type, i_size_type> > traits;
+        typedef typename traits::nonzero_iterator nz_iter;
+
+        return (std::make_pair(nz_iter(&m), nz_iter()));
+    }
+}
+
+#endif //YASMIC_GZIP_SMAT_MATRIX
@@ -0,0 +1,177 @@
+#ifndef YASMIC_MAPPED_SMAT_MATRIX
+#define YASMIC_MAPPED_SMAT_MATRIX
+
+/**
+ * @file mapped_smat_matrix.hpp
+ * Interpret a block of memory holding a text smat file as a matrix.
+ *
+ * This type is the memory mapped counterpart to ifstream_matrix.  It
+ * reads the same format
+ *
+ *   nrows ncols nnz
+ *   i j v
+ *   ...
+ *
+ * but scans the numbers directly from the bytes with the scanners in
+ * yasmic/util/text_scanner.hpp instead of using istream_iterator, so
+ * the nonzeros can be traversed as often as needed without any
+ * seeking or locale overhead.
+ *
+ * The matrix does not own the memory; usually it comes from a
+ * util::mapped_file that must outlive the matrix.
+ */
+
+#include <boost/tuple/tuple.hpp>
+#include <iterator>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <yasmic/smatrix_traits.hpp>
+#include <yasmic/generic_matrix_operations.hpp>
+#include <yasmic/util/text_scanner.hpp>
+
+namespace yasmic
+{
+	namespace impl
+	{
+		template <class i_index_type, class i_value_type>
+		class mapped_smat_matrix_const_iterator
+		: public boost::iterator_facade<
+            mapped_smat_matrix_const_iterator<i_index_type, i_value_type>,
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type> const,
+            boost::forward_traversal_tag,
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type> const >
+        {
+        public:
+            mapped_smat_matrix_const_iterator()
+				: _p(0), _end(0), _r(0), _c(0), _v(0)
+			{}
+
+            mapped_smat_matrix_const_iterator(const char* p, const char* end)
+				: _p(p), _end(end), _r(0), _c(0), _v(0)
+            { increment(); }
+
+        private:
+            friend class boost::iterator_core_access;
+
+            void increment()
+            {
+				if (_p != 0)
+				{
+                    // like istream_iterator, we stop at the first
+                    // entry we cannot parse
+                    if (!scan_int(_p, _end, _r) ||
+                        !scan_int(_p, _end, _c) ||
+                        !scan_value(_p, _end, _v))
+                    {
+                        _p = 0;
+                    }
+				}
+            }
+
+            bool equal(mapped_smat_matrix_const_iterator const& other) const
+            {
+				return (_p == other._p);
+            }
+
+            boost::tuple<
+                i_index_type, i_index_type, i_value_type>
+            dereference() const
+            {
+            	return boost::make_tuple(_r, _c, _v);
+            }
+
+            const char* _p;
+            const char* _end;
+
+			i_index_type _r, _c;
+			i_value_type _v;
+        };
+	}
+
+	template <class index_type = int, class value_type = double, class size_type = int>
+	struct mapped_smat_matrix
+	{
+		/**
+		 * @param begin the first byte of the smat file
+		 * @param end one past the last byte of the smat file
+		 */
+		mapped_smat_matrix(const char* begin, const char* end)
+			: _begin(begin), _end(end), _nz_begin(begin),
+              _nrows(0), _ncols(0), _nnz(0), _valid(false)
+		{
+			const char* p = _begin;
+            _valid = impl::scan_int(p, _end, _nrows)
+                     && impl::scan_int(p, _end, _ncols)
+                     && impl::scan_int(p, _end, _nnz);
+            _nz_begin = p;
+		}
+
+        /**
+         * @return false if the header line could not be read
+         */
+        bool valid() const { return (_valid); }
+
+		const char* _begin;
+		const char* _end;
+        const char* _nz_begin;
+
+		size_type _nrows;
+		size_type _ncols;
+		size_type _nnz;
+
+        bool _valid;
+	};
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+    struct smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >
+    {
+    	typedef i_size_type size_type;
+    	typedef i_index_type index_type;
+		typedef i_value_type value_type;
+
+		typedef boost::tuple<index_type, index_type, value_type> nonzero_descriptor;
+
+		typedef impl::mapped_smat_matrix_const_iterator<i_index_type, i_value_type> nonzero_iterator;
+
+		typedef i_size_type nz_index_type;
+
+		typedef void row_iterator;
+
+		typedef void row_nonzero_descriptor;
+		typedef void row_nonzero_iterator;
+
+		typedef void column_iterator;
+
+        typedef void properties;
+    };
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+    inline std::pair<typename smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type,
+                     typename smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type >
+    dimensions(mapped_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+    {
+        return (std::make_pair(m._nrows, m._ncols));
+    }
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+	inline typename smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >::size_type
+	nnz(mapped_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+	{
+        return (m._nnz);
+	}
+
+	template <class i_index_type, class i_value_type, class i_size_type>
+	inline std::pair<typename smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >::nonzero_iterator,
+                     typename smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> >::nonzero_iterator>
+    nonzeros(mapped_smat_matrix<i_index_type, i_value_type, i_size_type>& m)
+    {
+    	typedef smatrix_traits<mapped_smat_matrix<i_index_type, i_value_type, i_size_type> > traits;
+        typedef typename traits::nonzero_iterator nz_iter;
+
+        return (std::make_pair(nz_iter(m._nz_begin, m._end), nz_iter()));
+    }
+}
+
+#endif //YASMIC_MAPPED_SMAT_MATRIX
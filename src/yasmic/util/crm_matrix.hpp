@@ -13,14 +13,14 @@
 #include <vector>
 
 #include <yasmic/transpose_matrix.hpp>
-#include <yasmic/nonzero_union.hpp>
 #include <yasmic/util/load_crm_matrix.hpp>
+#include <yasmic/util/symmetrize_crm.hpp>
 #include <yasmic/matrix_row_col_graph.hpp>
 
 /**
  * Symmetrize a CRM matrix by adding a (j,i,v) for each (i,j,v) pair.  This
  * operation doubles the number of nonzeros in the matrix and returns
- * a matrix with nr = nc.
+ * a matrix with nr = nc.  See symmetrize_crm.hpp.
  *
  * All parameters are input/output.
  *
@@ -35,40 +35,8 @@ template <class index_type, class value_type>
 void symmetrize_crm(std::vector<index_type>& rows, std::vector<index_type>& cols, std::vector<value_type>& vals, 
                index_type& nr, index_type& nc, index_type& nzcount)
 {
-    using namespace yasmic;
-
-    nzcount = (index_type)(2*cols.size());
-
-    std::vector<index_type> rows_temp(rows);
-	std::vector<index_type> cols_temp(cols);
-	std::vector<value_type> vals_temp(vals);
-
-	std::fill(rows.begin(), rows.end(), 0);
-	cols.resize(nzcount);
-	vals.resize(nzcount);
-
-    typedef compressed_row_matrix<
-		typename std::vector<index_type>::iterator, 
-		typename std::vector<index_type>::iterator,
-		typename std::vector<value_type>::iterator  >
-        crs_matrix;  
-
-	typedef transpose_matrix<crs_matrix> t_matrix;
-	typedef nonzero_union<crs_matrix, t_matrix> nzu_matrix;
-
-
-
-	crs_matrix m(rows_temp.begin(), rows_temp.end(), cols_temp.begin(), cols_temp.end(), 
-				vals_temp.begin(), vals_temp.end(), nr, nc, nzcount/2);
-
-	t_matrix mt(m);
-	nzu_matrix nzu(m, mt);
-
-	nr = nrows(nzu);
-	nc = ncols(nzu);
-
-	// load the matrix
-	load_matrix_to_crm(nzu, rows.begin(), cols.begin(), vals.begin());
+    symmetrize_crm_storage(rows, cols, vals, nr, nc);
+    nzcount = rows.back();
 }
 
 template<class Type>
@@ -0,0 +1,134 @@
+#ifndef YASMIC_UTIL_CRM_STATS
+#define YASMIC_UTIL_CRM_STATS
+
+/**
+ * @file crm_stats.hpp
+ * Compute the value range, the degree range, and the row and column
+ * norms of a crm matrix in one pass with many threads.
+ *
+ * The rows are split into ranges with about the same number of
+ * nonzeros.  Each thread reduces the values of a row with simd
+ * min, max, and sum of squares, and scatters the squares into its own
+ * column sums, so no two threads write the same column.  The column
+ * sums are added up over the columns at the end.
+ */
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#include <yasmic/compressed_row_matrix.hpp>
+
+#include <util/parallel.hpp>
+
+/** The ranges of the values and degrees of a matrix. */
+template <class Index, class Value>
+struct crm_stats
+{
+    Value min_val;
+    Value max_val;
+    Index min_degree;
+    Index max_degree;
+};
+
+/**
+ * Compute the stats and the inverse 2-norms of the rows and columns
+ * of a crm matrix.
+ *
+ * @param nr the number of rows
+ * @param nc the number of columns
+ * @param ai the row pointers, nr+1 entries
+ * @param aj the column indices
+ * @param vals the values, anything that can be indexed by a nonzero,
+ *   e.g. util::constant_array for a pattern matrix
+ * @param s the stats (output)
+ * @param rnorm the inverse row norms, nr entries (output)
+ * @param cnorm the inverse column norms, nc entries (output)
+ */
+template <class Index, class RowPtr, class ValMap, class Value>
+void compute_crm_stats(Index nr, Index nc, const RowPtr* ai, const Index* aj,
+    ValMap vals, crm_stats<Index,Value>& s, Value* rnorm, Value* cnorm)
+{
+    using namespace std;
+
+    int nparts = yasmic::impl::crm_pack_threads(nc, ai[nr] - ai[0]);
+
+    vector<Index> bounds(nparts+1);
+    for (int p = 0; p <= nparts; ++p) {
+        bounds[p] = yasmic::impl::crm_balanced_row(ai, nr, nparts, p);
+    }
+
+    // the first range sums straight into cnorm
+    vector< vector<Value> > csum(nparts);
+    vector< crm_stats<Index,Value> > part(nparts);
+
+    #pragma omp parallel for num_threads(nparts) schedule(static,1)
+    for (int p = 0; p < nparts; ++p)
+    {
+        Value* c;
+        if (p == 0) {
+            std::fill(cnorm, cnorm + nc, (Value)0);
+            c = cnorm;
+        } else {
+            csum[p].assign(nc, 0);
+            c = &csum[p][0];
+        }
+
+        Value vmin = numeric_limits<Value>::max();
+        Value vmax = -numeric_limits<Value>::max();
+        Index dmin = numeric_limits<Index>::max();
+        Index dmax = 0;
+
+        for (Index r = bounds[p]; r < bounds[p+1]; ++r)
+        {
+            RowPtr kbegin = ai[r], kend = ai[r+1];
+            Index deg = (Index)(kend - kbegin);
+            dmin = deg < dmin ? deg : dmin;
+            dmax = deg > dmax ? deg : dmax;
+
+            Value rs = 0, rmin = vmin, rmax = vmax;
+            #pragma omp simd reduction(+:rs) reduction(min:rmin) reduction(max:rmax)
+            for (RowPtr k = kbegin; k < kend; ++k)
+            {
+                Value v = (Value)vals[k];
+                rs += v*v;
+                rmin = v < rmin ? v : rmin;
+                rmax = v > rmax ? v : rmax;
+            }
+            vmin = rmin;
+            vmax = rmax;
+            rnorm[r] = 1.0/sqrt(rs);
+
+            for (RowPtr k = kbegin; k < kend; ++k)
+            {
+                Value v = (Value)vals[k];
+                c[aj[k]] += v*v;
+            }
+        }
+
+        part[p].min_val = vmin;
+        part[p].max_val = vmax;
+        part[p].min_degree = dmin;
+        part[p].max_degree = dmax;
+    }
+
+    s = part[0];
+    for (int p = 1; p < nparts; ++p)
+    {
+        s.min_val = std::min(s.min_val, part[p].min_val);
+        s.max_val = std::max(s.max_val, part[p].max_val);
+        s.min_degree = std::min(s.min_degree, part[p].min_degree);
+        s.max_degree = std::max(s.max_degree, part[p].max_degree);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (Index j = 0; j < nc; ++j)
+    {
+        Value cs = cnorm[j];
+        for (int p = 1; p < nparts; ++p) { cs += csum[p][j]; }
+        cnorm[j] = 1.0/sqrt(cs);
+    }
+}
+
+#endif // YASMIC_UTIL_CRM_STATS
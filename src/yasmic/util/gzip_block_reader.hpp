@@ -0,0 +1,355 @@
+#ifndef YASMIC_UTIL_GZIP_BLOCK_READER
+#define YASMIC_UTIL_GZIP_BLOCK_READER
+
+/**
+ * @file gzip_block_reader.hpp
+ * Inflate a gzip file on a separate thread and hand the output to the
+ * caller in large blocks of complete lines.
+ *
+ * The boost gzip_decompressor inflates through a small buffer on the
+ * calling thread, and every seek back to the start of the stream
+ * inflates the file again.  The gzip_block_reader reads the file
+ * exactly once: a helper thread runs zlib's inflate into a small ring
+ * of large buffers while the caller parses the previous buffer.
+ *
+ * Each block ends just after a newline (except possibly the last one),
+ * so a whitespace separated token never straddles two blocks.  The
+ * partial line at the end of a buffer is copied to the start of the
+ * next buffer before the thread inflates more data into it.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <zlib.h>
+
+#include <util/thread.hpp>
+#include <util/parallel.hpp>
+
+namespace yasmic
+{
+    class gzip_block_reader
+    {
+    public:
+        /**
+         * @param nbuffers the number of buffers in the ring (at least 2)
+         * @param buffer_size the size of each buffer in bytes
+         */
+        gzip_block_reader(int nbuffers = 3, std::size_t buffer_size = 16<<20)
+            : _buffers(nbuffers < 2 ? 2 : nbuffers), _lengths(_buffers.size(), 0),
+              _filled(_buffers.size(), false), _buffer_size(buffer_size),
+              _file(0), _tail(0), _current(-1),
+              _done(false), _stop(false), _error(false),
+              _bytes_out(0), _inflate_time(0.0)
+        {}
+
+        ~gzip_block_reader() { close(); }
+
+        /**
+         * Open a gzip file and start inflating it on a separate thread.
+         *
+         * @return false if the file or the thread could not be opened
+         */
+        bool open(const std::string& filename)
+        {
+            close();
+
+            _file = std::fopen(filename.c_str(), "rb");
+            if (!_file)
+            {
+                return (false);
+            }
+
+            for (std::size_t i = 0; i < _buffers.size(); ++i)
+            {
+                _buffers[i].resize(_buffer_size);
+                _lengths[i] = 0;
+                _filled[i] = false;
+            }
+            _tail = 0;
+            _current = -1;
+            _done = false;
+            _stop = false;
+            _error = false;
+            _bytes_out = 0;
+            _inflate_time = 0.0;
+
+            if (!_thread.start(&gzip_block_reader::run, this))
+            {
+                std::fclose(_file);
+                _file = 0;
+                return (false);
+            }
+
+            return (true);
+        }
+
+        /**
+         * Stop the inflate thread and close the file.
+         */
+        void close()
+        {
+            {
+                util::scoped_lock l(_lock);
+                _stop = true;
+                _cond.notify_all();
+            }
+            _thread.join();
+
+            if (_file)
+            {
+                std::fclose(_file);
+                _file = 0;
+            }
+        }
+
+        /**
+         * Release the previous block and get the next one.  This call
+         * blocks until the inflate thread has produced the block.
+         *
+         * @param begin set to the first byte of the block
+         * @param end set to one past the last byte of the block
+         * @return false at the end of the file or after an error
+         */
+        bool next(const char*& begin, const char*& end)
+        {
+            util::scoped_lock l(_lock);
+
+            if (_current >= 0)
+            {
+                _filled[_current] = false;
+                _cond.notify_all();
+                _current = -1;
+            }
+
+            while (!_filled[_tail] && !_done)
+            {
+                _cond.wait(_lock);
+            }
+
+            if (!_filled[_tail])
+            {
+                return (false);
+            }
+
+            _current = (int)_tail;
+            _tail = (_tail + 1) % _buffers.size();
+
+            begin = &_buffers[_current][0];
+            end = begin + _lengths[_current];
+            return (true);
+        }
+
+        /**
+         * @return true if the file could not be inflated
+         */
+        bool error() const { return (_error); }
+
+        /**
+         * @return the number of bytes inflated so far
+         */
+        double bytes_out() const { return (_bytes_out); }
+
+        /**
+         * @return the time the thread spent reading and inflating
+         */
+        double inflate_time() const { return (_inflate_time); }
+
+    private:
+        gzip_block_reader(const gzip_block_reader&);
+        gzip_block_reader& operator= (const gzip_block_reader&);
+
+        static void run(void *arg)
+        {
+            ((gzip_block_reader*)arg)->inflate_file();
+        }
+
+        /**
+         * Wait until buffer i is free.
+         * @return false if the reader was closed
+         */
+        bool wait_for_buffer(std::size_t i)
+        {
+            util::scoped_lock l(_lock);
+            while (_filled[i] && !_stop)
+            {
+                _cond.wait(_lock);
+            }
+            return (!_stop);
+        }
+
+        void publish(std::size_t i, std::size_t len)
+        {
+            util::scoped_lock l(_lock);
+            _lengths[i] = len;
+            _filled[i] = true;
+            _cond.notify_all();
+        }
+
+        void finish(bool error)
+        {
+            util::scoped_lock l(_lock);
+            _error = error;
+            _done = true;
+            _cond.notify_all();
+        }
+
+        /**
+         * The thread function.  Inflate the file into the ring of buffers.
+         */
+        void inflate_file()
+        {
+            std::vector<unsigned char> in(1<<20);
+
+            z_stream zs;
+            std::memset(&zs, 0, sizeof(zs));
+            // 15+32 lets zlib detect both the gzip and zlib headers
+            if (inflateInit2(&zs, 15+32) != Z_OK)
+            {
+                std::cerr << "error: cannot initialize zlib" << std::endl;
+                finish(true);
+                return;
+            }
+
+            double t0 = util::wall_time();
+            double waiting = 0.0;
+
+            std::size_t cur = 0;
+            std::size_t fill = 0;     // bytes in the current buffer
+            bool eof = false;
+            bool stream_end = false;
+            bool error = false;
+
+            if (!wait_for_buffer(cur))
+            {
+                inflateEnd(&zs);
+                finish(false);
+                return;
+            }
+
+            while (!error)
+            {
+                std::vector<char>& buf = _buffers[cur];
+
+                // inflate until the buffer is full or the input ends
+                while (fill < buf.size() && !(eof && zs.avail_in == 0))
+                {
+                    if (zs.avail_in == 0)
+                    {
+                        std::size_t n = std::fread(&in[0], 1, in.size(), _file);
+                        if (n == 0) { eof = true; continue; }
+                        zs.next_in = &in[0];
+                        zs.avail_in = (uInt)n;
+                    }
+
+                    if (stream_end)
+                    {
+                        // concatenated gzip members continue the file
+                        inflateReset(&zs);
+                        stream_end = false;
+                    }
+
+                    zs.next_out = (Bytef*)&buf[fill];
+                    zs.avail_out = (uInt)(buf.size() - fill);
+
+                    int rval = inflate(&zs, Z_NO_FLUSH);
+                    fill = buf.size() - zs.avail_out;
+
+                    if (rval == Z_STREAM_END)
+                    {
+                        stream_end = true;
+                    }
+                    else if (rval != Z_OK && rval != Z_BUF_ERROR)
+                    {
+                        std::cerr << "error: invalid gzip data ("
+                                  << (zs.msg ? zs.msg : "inflate failed")
+                                  << ")" << std::endl;
+                        error = true;
+                        break;
+                    }
+                }
+
+                if (error) { break; }
+
+                bool last = eof && zs.avail_in == 0;
+                if (last && !stream_end && fill > 0)
+                {
+                    std::cerr << "error: unexpected end of gzip file" << std::endl;
+                    error = true;
+                    break;
+                }
+
+                // find the end of the last complete line
+                std::size_t len = fill;
+                if (!last)
+                {
+                    while (len > 0 && buf[len-1] != '\n') { --len; }
+                    if (len == 0)
+                    {
+                        // a single line is longer than the buffer
+                        buf.resize(2*buf.size());
+                        continue;
+                    }
+                }
+
+                _bytes_out += (double)len;
+                std::size_t next = (cur + 1) % _buffers.size();
+
+                if (len > 0)
+                {
+                    publish(cur, len);
+
+                    double tw = util::wall_time();
+                    if (!wait_for_buffer(next)) { break; }
+                    waiting += util::wall_time() - tw;
+
+                    // move the partial line to the next buffer
+                    std::vector<char>& nbuf = _buffers[next];
+                    std::size_t carry = fill - len;
+                    if (nbuf.size() < carry + _buffer_size/2)
+                    {
+                        nbuf.resize(carry + _buffer_size);
+                    }
+                    if (carry > 0)
+                    {
+                        std::memcpy(&nbuf[0], &buf[len], carry);
+                    }
+                    fill = carry;
+                    cur = next;
+                }
+
+                if (last) { break; }
+            }
+
+            inflateEnd(&zs);
+            _inflate_time = util::wall_time() - t0 - waiting;
+            finish(error);
+        }
+
+        std::vector< std::vector<char> > _buffers;
+        std::vector<std::size_t> _lengths;
+        std::vector<bool> _filled;
+        std::size_t _buffer_size;
+
+        std::FILE *_file;
+
+        std::size_t _tail;  // the next buffer the caller reads
+        int _current;       // the buffer the caller is reading
+
+        bool _done;
+        bool _stop;
+        bool _error;
+
+        double _bytes_out;
+        double _inflate_time;
+
+        util::mutex _lock;
+        util::condition _cond;
+        util::thread _thread;
+    };
+}
+
+#endif // YASMIC_UTIL_GZIP_BLOCK_READER
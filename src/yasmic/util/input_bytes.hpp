@@ -0,0 +1,151 @@
+#ifndef YASMIC_UTIL_INPUT_BYTES
+#define YASMIC_UTIL_INPUT_BYTES
+
+/**
+ * @file input_bytes.hpp
+ * All the bytes of an input file in memory, either memory mapped or,
+ * for a gzip file, inflated once on a separate thread.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <yasmic/verbose_util.hpp>
+#ifdef YASMIC_UTIL_LOAD_GZIP
+#include <yasmic/util/gzip_block_reader.hpp>
+#endif // YASMIC_UTIL_LOAD_GZIP
+
+#include <util/mapped_file.hpp>
+
+namespace yasmic
+{
+    class input_bytes
+    {
+    public:
+        input_bytes() : _begin(0), _end(0), _gzip(false) {}
+
+        /**
+         * Map a file, or inflate it if it starts with the gzip magic
+         * number.  The errors are written to cerr.
+         *
+         * @return false if the file cannot be read
+         */
+        bool open(const std::string& filename)
+        {
+            using namespace std;
+
+            close();
+
+            if (!_mf.open(filename))
+            {
+                cerr << "error: cannot open " << filename << endl;
+                return (false);
+            }
+
+            _begin = _mf.begin();
+            _end = _mf.end();
+
+            if (_mf.size() < 2 || (unsigned char)_begin[0] != 0x1f
+                || (unsigned char)_begin[1] != 0x8b)
+            {
+                return (true);
+            }
+
+#ifdef YASMIC_UTIL_LOAD_GZIP
+            // inflate into one buffer of the size in the gzip trailer
+            _data.reserve(inflated_size_hint(_begin, _end));
+#endif // YASMIC_UTIL_LOAD_GZIP
+
+            _mf.close();
+            _begin = _end = 0;
+            _gzip = true;
+
+#ifdef YASMIC_UTIL_LOAD_GZIP
+            YASMIC_VERBOSE( cerr << "detected gzip" << endl; )
+
+            yasmic::gzip_block_reader reader;
+            if (!reader.open(filename))
+            {
+                cerr << "error: cannot open " << filename << endl;
+                return (false);
+            }
+            const char *b, *e;
+            while (reader.next(b, e)) { _data.insert(_data.end(), b, e); }
+            if (reader.error())
+            {
+                cerr << "error: cannot inflate " << filename << endl;
+                std::vector<char>().swap(_data);
+                return (false);
+            }
+
+            _begin = _data.empty() ? 0 : &_data[0];
+            _end = _begin + _data.size();
+            return (true);
+#else
+            cerr << "error: gzip files are not supported" << endl;
+            return (false);
+#endif // YASMIC_UTIL_LOAD_GZIP
+        }
+
+        /**
+         * Use bytes that are already in memory instead of a file.
+         * @param data the bytes, swapped out of data
+         */
+        void assign(std::vector<char>& data)
+        {
+            close();
+            _data.swap(data);
+            _begin = _data.empty() ? 0 : &_data[0];
+            _end = _begin + _data.size();
+        }
+
+        void close()
+        {
+            _mf.close();
+            std::vector<char>().swap(_data);
+            _begin = _end = 0;
+            _gzip = false;
+        }
+
+        const char* begin() const { return (_begin); }
+        const char* end() const { return (_end); }
+        std::size_t size() const { return ((std::size_t)(_end - _begin)); }
+
+        /** @return true if the bytes were inflated from a gzip file */
+        bool gzipped() const { return (_gzip); }
+
+    private:
+        /**
+         * The inflated size of a gzip file from its last 4 bytes,
+         * which hold the size mod 2^32, raised by multiples of 2^32 to
+         * at least the compressed size.
+         */
+        static std::size_t inflated_size_hint(const char* begin, const char* end)
+        {
+            std::size_t csize = (std::size_t)(end - begin);
+            if (csize < 18) { return (0); }
+
+            const unsigned char *t = (const unsigned char*)end - 4;
+            std::size_t size = (std::size_t)t[0] | ((std::size_t)t[1] << 8)
+                | ((std::size_t)t[2] << 16) | ((std::size_t)t[3] << 24);
+            if (sizeof(std::size_t) > 4)
+            {
+                const std::size_t wrap = (std::size_t)1 << (4*sizeof(std::size_t));
+                while (size < csize) { size += wrap; }
+            }
+            return (size);
+        }
+
+        input_bytes(const input_bytes&);
+        input_bytes& operator= (const input_bytes&);
+
+        util::mapped_file _mf;
+        std::vector<char> _data;
+        const char* _begin;
+        const char* _end;
+        bool _gzip;
+    };
+} // namespace yasmic
+
+#endif // YASMIC_UTIL_INPUT_BYTES
@@ -0,0 +1,264 @@
+#ifndef YASMIC_UTIL_LOAD_CRM_EDGES
+#define YASMIC_UTIL_LOAD_CRM_EDGES
+
+/**
+ * @file load_crm_edges.hpp
+ * Load an edge list with arbitrary 64-bit node ids, e.g. a SNAP graph,
+ * into a crm data structure with many threads.
+ *
+ * An edge list has one edge "src dst [weight]" on each line and no
+ * header.  Lines that start with # or % are comments.  The node ids
+ * do not have to be contiguous, so the size of the matrix is only
+ * known after every edge has been read.  The file is read once:
+ * 1.  the file is split into chunks at newlines, and each thread
+ *     parses a chunk into its own list of edges;
+ * 2.  each thread sorts the distinct ids of its chunk, and the sorted
+ *     lists are merged in pairs, in parallel, into the sorted list of
+ *     all the ids;
+ * 3.  each thread replaces the ids of its edges with their position
+ *     in that list, so node k of the matrix is the kth smallest id;
+ * 4.  the relabeled edges are scattered into crm arrays with
+ *     load_crm_chunked.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include <boost/cstdint.hpp>
+
+#include <yasmic/verbose_util.hpp>
+#include <yasmic/util/text_scanner.hpp>
+#include <yasmic/util/input_bytes.hpp>
+#include <yasmic/util/load_crm_parallel.hpp>
+
+#include <util/parallel.hpp>
+
+namespace yasmic
+{
+namespace impl
+{
+    /**
+     * Parse the edges in [p,end) into ids, two for each edge, and
+     * their weights into w.  A missing weight is 1.
+     *
+     * @return false if a line is not an edge, with p on that line
+     */
+    template <class Value>
+    bool parse_edges(const char*& p, const char* end,
+        std::vector<boost::int64_t>& ids, std::vector<Value>& w)
+    {
+        while ((p = scan_skip_space(p, end)) != end)
+        {
+            const char* le = scan_next_line(p, end);
+            if (*p == '#' || *p == '%') { p = le; continue; }
+
+            boost::int64_t u, v;
+            Value x = 1;
+            const char* q = p;
+            if (!scan_int(q, le, u) || !scan_int(q, le, v)) { return (false); }
+            q = scan_skip_space(q, le);
+            if (q != le && !scan_value(q, le, x)) { return (false); }
+            if (scan_skip_space(q, le) != le) { return (false); }
+
+            ids.push_back(u);
+            ids.push_back(v);
+            w.push_back(x);
+            p = le;
+        }
+        return (true);
+    }
+
+    /**
+     * A ChunkSource for edges that are already in memory, with one
+     * chunk for each list of edges.
+     */
+    template <class Index, class Value>
+    class edge_chunk_source
+    {
+    public:
+        edge_chunk_source(const std::vector< std::vector<Index> >& ij,
+            const std::vector< std::vector<Value> >& w)
+        : _ij(ij), _w(w) {}
+
+        int nchunks() const { return ((int)_ij.size()); }
+
+        std::size_t chunk_bytes(int i) const
+        { return (_ij[i].size()*sizeof(Index) + _w[i].size()*sizeof(Value)); }
+
+        template <class Sink>
+        bool parse_chunk(int i, Sink& s)
+        {
+            const std::vector<Index>& ij = _ij[i];
+            const std::vector<Value>& w = _w[i];
+            for (std::size_t k = 0; k < w.size(); ++k) {
+                s(ij[2*k], ij[2*k+1], w[k]);
+            }
+            return (true);
+        }
+
+    private:
+        const std::vector< std::vector<Index> >& _ij;
+        const std::vector< std::vector<Value> >& _w;
+    };
+} // namespace impl
+
+    /**
+     * @return true if filename is an edge list, i.e. ends in .edges or
+     * .txt, optionally followed by .gz
+     */
+    inline bool is_edge_list_file(const std::string& filename)
+    {
+        std::string f = filename;
+        std::transform(f.begin(), f.end(), f.begin(), (int(*)(int))tolower);
+        std::string::size_type n = f.size();
+        if (n > 3 && f.compare(n-3, 3, ".gz") == 0) { n -= 3; }
+        return ((n > 6 && f.compare(n-6, 6, ".edges") == 0)
+                || (n > 4 && f.compare(n-4, 4, ".txt") == 0));
+    }
+} // namespace yasmic
+
+/**
+ * Load an edge list, possibly gzipped.  The matrix is square with one
+ * row and column for each distinct node id, in increasing order of the
+ * ids.
+ *
+ * @param ids if not 0, set to the node id of each row and column
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_edges(const std::string& filename,
+        std::vector<NzIndex>& rows, std::vector<Index>& cols,
+        std::vector<Value>& vals,
+        Index &nr, Index &nc, NzIndex &nzcount,
+        std::vector<boost::int64_t>* ids = 0)
+{
+    using namespace yasmic::impl;
+    using namespace std;
+
+    yasmic::input_bytes in;
+    if (!in.open(filename))
+    {
+        return (false);
+    }
+
+    const char* begin = in.begin();
+    const char* end = in.end();
+
+    int nchunks = (int)std::min<std::size_t>(util::max_threads(),
+                    in.size()/(1<<20) + 1);
+
+    vector<const char*> bounds(nchunks+1);
+    bounds[0] = begin;
+    bounds[nchunks] = end;
+    for (int i = 1; i < nchunks; ++i)
+    {
+        const char* p = begin + (std::size_t)(((double)in.size()*i)/nchunks);
+        p = std::max(p, bounds[i-1]);
+        bounds[i] = scan_next_line(p, end);
+    }
+
+    YASMIC_VERBOSE( cerr << "parsing with " << nchunks << " threads..." << endl; )
+
+    //
+    // 1.  parse the edges of each chunk
+    //
+    vector< vector<boost::int64_t> > edges(nchunks);
+    vector< vector<Value> > w(nchunks);
+    vector<const char*> error_pos(nchunks, (const char*)0);
+
+    #pragma omp parallel for num_threads(nchunks) schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        const char* p = bounds[i];
+        if (!parse_edges(p, bounds[i+1], edges[i], w[i])) { error_pos[i] = p; }
+    }
+
+    for (int i = 0; i < nchunks; ++i)
+    {
+        if (error_pos[i])
+        {
+            cerr << "error: " << filename << " is not an edge list, parse error "
+                 << "at byte " << (error_pos[i] - begin) << endl;
+            return (false);
+        }
+    }
+    in.close();
+
+    //
+    // 2.  sort the ids of each chunk and merge them
+    //
+    vector< vector<boost::int64_t> > sorted(nchunks);
+
+    #pragma omp parallel for num_threads(nchunks) schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        sorted[i] = edges[i];
+        std::sort(sorted[i].begin(), sorted[i].end());
+        sorted[i].erase(std::unique(sorted[i].begin(), sorted[i].end()),
+            sorted[i].end());
+    }
+
+    for (int step = 1; step < nchunks; step *= 2)
+    {
+        #pragma omp parallel for schedule(dynamic,1)
+        for (int i = 0; i < nchunks - step; i += 2*step)
+        {
+            vector<boost::int64_t> u;
+            u.reserve(sorted[i].size() + sorted[i+step].size());
+            std::set_union(sorted[i].begin(), sorted[i].end(),
+                sorted[i+step].begin(), sorted[i+step].end(),
+                std::back_inserter(u));
+            sorted[i].swap(u);
+            vector<boost::int64_t>().swap(sorted[i+step]);
+        }
+    }
+
+    const vector<boost::int64_t>& nodes = sorted[0];
+    if (nodes.size() > (std::size_t)std::numeric_limits<Index>::max())
+    {
+        cerr << "error: " << filename << " has too many nodes" << endl;
+        return (false);
+    }
+
+    nr = (Index)nodes.size();
+    nc = nr;
+
+    YASMIC_VERBOSE( cerr << "found " << nr << " nodes" << endl; )
+
+    //
+    // 3.  relabel the edges
+    //
+    vector< vector<Index> > ij(nchunks);
+    NzIndex nz = 0;
+
+    #pragma omp parallel for num_threads(nchunks) schedule(static,1) reduction(+:nz)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        ij[i].resize(edges[i].size());
+        for (std::size_t k = 0; k < edges[i].size(); ++k)
+        {
+            ij[i][k] = (Index)(std::lower_bound(nodes.begin(), nodes.end(),
+                        edges[i][k]) - nodes.begin());
+        }
+        vector<boost::int64_t>().swap(edges[i]);
+        nz += (NzIndex)w[i].size();
+    }
+
+    //
+    // 4.  build the crm arrays
+    //
+    nzcount = nz;
+    edge_chunk_source<Index, Value> src(ij, w);
+    if (!load_crm_chunked(src, nr, nc, nzcount, rows, cols, vals))
+    {
+        return (false);
+    }
+
+    if (ids) { ids->assign(nodes.begin(), nodes.end()); }
+    return (true);
+}
+
+#endif // YASMIC_UTIL_LOAD_CRM_EDGES
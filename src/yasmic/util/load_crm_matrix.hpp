@@ -32,6 +32,7 @@
 #include <vector>
 
 #include <yasmic/verbose_util.hpp>
+#include <yasmic/util/load_monitor.hpp>
 
 #include <boost/iterator/reverse_iterator.hpp>
 
@@ -40,16 +41,24 @@
 #include <yasmic/binary_ifstream_graph.hpp>
 #include <yasmic/cluto_ifstream_matrix.hpp>
 #include <yasmic/graph_ifstream_matrix.hpp>
+#include <yasmic/mapped_smat_matrix.hpp>
+#include <yasmic/bvgraph_matrix.hpp>
+#include <yasmic/util/load_crm_parallel.hpp>
+#include <yasmic/util/load_crm_edges.hpp>
+#include <yasmic/util/input_bytes.hpp>
+
+#include <util/mapped_file.hpp>
 
 #define BOOST_IOSTREAMS_NO_LIB
 #include <boost/iostreams/filtering_stream.hpp>
 
 #ifdef YASMIC_UTIL_LOAD_GZIP
 
-// include the boost code to do the gzip files.
+// include the boost code to do the gzip files, the BOOST zlib code 
+// itself is compiled once in boost_zlib.cc
 #include <yasmic/boost_mod/gzip.hpp>
-// just directly include the BOOST zlib code
-#include <yasmic/boost_mod/zlib.cpp>
+
+#include <yasmic/gzip_smat_matrix.hpp>
 
 #endif // YASMIC_UTIL_LOAD_GZIP
 
@@ -57,6 +66,9 @@
  * This function actually loads the data from a matrix file.
  *
  * This function allocates and frees sizeof(Index)*nrows memory.
+ *
+ * The nonzeros are reported to crm_load_monitor, if it is set (see
+ * load_monitor.hpp).
  */
 template <class InputMatrix, class RAIRows, class RAICols, class RAIVals>
 bool load_matrix_to_crm(InputMatrix& m, 
@@ -68,14 +80,18 @@ bool load_matrix_to_crm(InputMatrix& m,
 
 	typedef typename iterator_traits<RAIRows>::value_type index_type;
 
-	typename smatrix_traits<InputMatrix>::index_type nr = nrows(m);
-    typename smatrix_traits<InputMatrix>::index_type nc = ncols(m);
+	typedef typename smatrix_traits<InputMatrix>::index_type mindex_type;
+
+	mindex_type nr = nrows(m);
+    mindex_type nc = ncols(m);
 	typename smatrix_traits<InputMatrix>::nz_index_type nzcount = 0;
 
 	typename smatrix_traits<InputMatrix>::nonzero_iterator nzi, nzend;
 
 	int warning = 0;
 
+	load_monitor<mindex_type>* monitor = crm_load_monitor<mindex_type>();
+
     typename smatrix_traits<InputMatrix>::index_type last_good_r = 0;
     typename smatrix_traits<InputMatrix>::index_type last_good_c = 0;
 	typename smatrix_traits<InputMatrix>::nz_index_type last_good_nz = 0;
@@ -87,11 +103,15 @@ bool load_matrix_to_crm(InputMatrix& m,
 		return (false);
 	}
 
+	if (monitor) { monitor->begin(nr, nc, nnz(m), rows_populated ? 1 : 2); }
+
 	if (rows_populated == false)
 	{
+		load_monitor_buffer<mindex_type> mb(monitor, true);
 		boost::tie(nzi, nzend) = nonzeros(m);
 		for (; nzi != nzend; ++nzi)
 		{
+			mb(row(*nzi, m), column(*nzi, m));
 			warning = warning | (row(*nzi, m) >= nr) | (column(*nzi, m) >= nc);
             last_good_r = (!warning)*row(*nzi,m);
             last_good_c = (!warning)*column(*nzi,m);
@@ -124,11 +144,13 @@ bool load_matrix_to_crm(InputMatrix& m,
 	index_type cc;
 
 	nzcount = 0;
+	load_monitor_buffer<mindex_type> mb(monitor, rows_populated);
 	tie(nzi, nzend) = nonzeros(m);
     for (; nzi != nzend; ++nzi)
     {
 		cr = row(*nzi, m);
 		cc = column(*nzi, m);
+		mb(cr, cc);
 		cols[rows[cr]] = cc;
 		vals[rows[cr]] = value(*nzi,m);
 		++rows[cr];
@@ -160,19 +182,139 @@ bool load_matrix_to_crm(InputMatrix& m,
 	return (true);
 }
 
+/**
+ * This function loads the data from a matrix file in a single pass over
+ * the nonzeros.
+ *
+ * load_matrix_to_crm iterates over nonzeros(m) twice, once to count the
+ * row degrees and once to scatter the nonzeros.  For the streaming
+ * formats, each pass parses the entire file again.  This function
+ * parses the nonzeros once into a coordinate (COO) buffer and then
+ * builds the crm arrays from the buffer with a counting sort.
+ *
+ * The rows array must be zero on input, just like load_matrix_to_crm.
+ *
+ * This function allocates and frees (2*sizeof(Index)+sizeof(Value))*nnz 
+ * memory for the coordinate buffer.
+ */
+template <class InputMatrix, class RAIRows, class RAICols, class RAIVals>
+bool load_matrix_to_crm_single_pass(InputMatrix& m, 
+						RAIRows rows, RAICols cols, RAIVals vals)
+{
+	using namespace yasmic;
+	using namespace std;
+
+	typedef typename smatrix_traits<InputMatrix>::index_type mindex_type;
+	typedef typename smatrix_traits<InputMatrix>::value_type mvalue_type;
+	typedef typename smatrix_traits<InputMatrix>::nz_index_type mnz_index_type;
+
+	mindex_type nr = nrows(m);
+	mindex_type nc = ncols(m);
+	mnz_index_type nzmax = nnz(m);
+
+	if (nr < 1)
+	{
+		cerr << "error: invalid number of rows" << endl;
+		return (false);
+	}
+
+	//
+	// 1.  parse the nonzeros into the coordinate buffer
+	//
+	vector<mindex_type> coo_rows;
+	vector<mindex_type> coo_cols;
+	vector<mvalue_type> coo_vals;
+	coo_rows.reserve(nzmax);
+	coo_cols.reserve(nzmax);
+	coo_vals.reserve(nzmax);
+
+	mnz_index_type nzcount = 0;
+
+	load_monitor<mindex_type>* monitor = crm_load_monitor<mindex_type>();
+	if (monitor) { monitor->begin(nr, nc, nzmax, 1); }
+	load_monitor_buffer<mindex_type> mb(monitor, true);
+
+	typename smatrix_traits<InputMatrix>::nonzero_iterator nzi, nzend;
+	for (boost::tie(nzi, nzend) = nonzeros(m); nzi != nzend; ++nzi)
+	{
+		mindex_type r = row(*nzi, m);
+		mindex_type c = column(*nzi, m);
+		mb(r, c);
+
+		if (r < 0 || r >= nr || c < 0 || c >= nc)
+		{
+			cerr << "error: invalid matrix data, nrows or ncols exceeded (" 
+                << r << "," << c << "," << nzcount << ")"
+                << endl;
+			return (false);
+		}
+
+		if (nzcount == nzmax)
+		{
+			// don't let the buffer grow past nnz(m)
+			++nzcount;
+			break;
+		}
+
+		coo_rows.push_back(r);
+		coo_cols.push_back(c);
+		coo_vals.push_back(value(*nzi, m));
+		++nzcount;
+	}
+	mb.flush();
+
+	if (nzcount != nzmax)
+	{
+		cerr << "error: number of nonzeros do not match nnz" << endl;
+		return (false);
+	}
+
+	//
+	// 2.  counting sort by row
+	//
+	for (mnz_index_type k = 0; k < nzcount; ++k)
+	{
+		++rows[coo_rows[k]+1];
+	}
+
+	partial_sum(rows, rows+(nr+1), rows);
+
+	for (mnz_index_type k = 0; k < nzcount; ++k)
+	{
+		mindex_type r = coo_rows[k];
+		cols[rows[r]] = coo_cols[k];
+		vals[rows[r]] = coo_vals[k];
+		++rows[r];
+	}
+
+	std::copy(boost::make_reverse_iterator(rows+nr-1),
+		boost::make_reverse_iterator(rows), 
+		boost::make_reverse_iterator(rows+nr));
+
+	rows[0] = 0;
+
+	return (true);
+}
+
 /**
  * This function does most of the work loading the matrix.
  * 
  * 1.  Allocate storage in the passed std::vectors.
  * 2.  Check for degrees metadata and read.
  * 3.  Load the data for the graph.
+ *
+ * If single_pass is true and there is no degrees metadata, the
+ * nonzeros are read once with load_matrix_to_crm_single_pass instead
+ * of twice with load_matrix_to_crm.  This costs extra memory but
+ * avoids parsing the file a second time.
  */
-template <class InputMatrix, class Index, class Value>
+template <class InputMatrix, class Index, class NzIndex, class Value>
 bool load_crm_graph_type(InputMatrix& m, std::string filename,
-						 std::vector<Index>& rows,
+						 std::vector<NzIndex>& rows,
 						 std::vector<Index>& cols,
 						 std::vector<Value>& vals,
-						 Index& nr, Index& nc, Index& nzcount)
+						 Index& nr, Index& nc, NzIndex& nzcount,
+						 bool single_pass = false)
 {
 	using namespace yasmic;
 	using namespace std;
@@ -243,8 +385,8 @@ bool load_crm_graph_type(InputMatrix& m, std::string filename,
 				// the degrees file is binary
 				std::ifstream degfile(filename_degrees.c_str(), ios::binary);
 
-				typename std::vector<Index>::iterator i = rows.begin();
-				typename std::vector<Index>::iterator iend = rows.end();
+				typename std::vector<NzIndex>::iterator i = rows.begin();
+				typename std::vector<NzIndex>::iterator iend = rows.end();
 
 				// we read degrees into the second one
 				++i;
@@ -277,10 +419,164 @@ bool load_crm_graph_type(InputMatrix& m, std::string filename,
 	// 
 	// 3.  Load the matrix
 	//
+	if (single_pass && !degrees_data)
+	{
+		YASMIC_VERBOSE( std::cerr << "loading in a single pass..." << std::endl; )
+
+		return (load_matrix_to_crm_single_pass(m, rows.begin(), cols.begin(), 
+			vals.begin()));
+	}
+
 	return (load_matrix_to_crm(m, rows.begin(), cols.begin(), vals.begin(),
 		degrees_data));
 }
 
+/**
+ * Load an uncompressed smat file by memory mapping it and scanning the
+ * numbers directly from the mapped bytes.  With more than one thread,
+ * the file is parsed by load_crm_matrix_parallel_text, which does not
+ * use a .degs file.
+ *
+ * @param mapped set to false if the file could not be memory mapped,
+ * in which case nothing was loaded and the caller should fall back to
+ * the istream based loader.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_mapped_smat(const std::string& filename,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
+					std::vector<Value>& vals,
+					Index &nr, Index &nc, NzIndex &nzcount, bool& mapped,
+					bool single_pass = false)
+{
+    if (util::max_threads() > 1)
+    {
+        return (load_crm_matrix_parallel_text(filename, 
+                    yasmic::impl::smat_text_format, false,
+                    rows, cols, vals, nr, nc, nzcount, mapped));
+    }
+
+    util::mapped_file mf;
+    mapped = mf.open(filename);
+    if (!mapped)
+    {
+        return (false);
+    }
+
+    YASMIC_VERBOSE( std::cerr << "scanning memory mapped smat..." << std::endl; )
+
+    mf.advise_sequential();
+    yasmic::mapped_smat_matrix<Index, Value, NzIndex> m(mf.begin(), mf.end());
+    return (load_crm_graph_type(m, filename, rows, cols, vals,
+                nr, nc, nzcount, single_pass));
+}
+
+/**
+ * Load a cluto file.  Sparse cluto files are parsed in parallel
+ * when there is more than one thread.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_cluto(const std::string& filename,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
+					std::vector<Value>& vals,
+					Index &nr, Index &nc, NzIndex &nzcount,
+					bool single_pass = false)
+{
+    std::ifstream ifs(filename.c_str());
+    yasmic::cluto_ifstream_matrix<Index, Value, NzIndex> m(ifs);
+
+    if (!m._dense && util::max_threads() > 1)
+    {
+        bool mapped;
+        bool rval = load_crm_matrix_parallel_text(filename,
+                        yasmic::impl::cluto_text_format, m._graph,
+                        rows, cols, vals, nr, nc, nzcount, mapped);
+        if (mapped)
+        {
+            return (rval);
+        }
+    }
+
+    return (load_crm_graph_type(m, filename, rows, cols, vals,
+                nr, nc, nzcount, single_pass));
+}
+
+/**
+ * Load a graph (metis) file.  The file is parsed in parallel
+ * when there is more than one thread.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_graph(const std::string& filename,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
+					std::vector<Value>& vals,
+					Index &nr, Index &nc, NzIndex &nzcount,
+					bool single_pass = false)
+{
+    if (util::max_threads() > 1)
+    {
+        bool mapped;
+        bool rval = load_crm_matrix_parallel_text(filename,
+                        yasmic::impl::graph_text_format, true,
+                        rows, cols, vals, nr, nc, nzcount, mapped);
+        if (mapped)
+        {
+            return (rval);
+        }
+    }
+
+    std::ifstream ifs(filename.c_str());
+    yasmic::graph_ifstream_matrix<Index, Value, NzIndex> m(ifs);
+    return (load_crm_graph_type(m, filename, rows, cols, vals,
+                nr, nc, nzcount, single_pass));
+}
+
+/**
+ * Load a Matrix Market file.  An uncompressed file is memory mapped
+ * and a gzip compressed file, found by its magic number, is inflated
+ * into memory once on a separate thread (see input_bytes.hpp); both
+ * are parsed with load_crm_matrix_mtx_text.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_mtx(const std::string& filename,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
+					std::vector<Value>& vals,
+					Index &nr, Index &nc, NzIndex &nzcount)
+{
+    yasmic::input_bytes in;
+    if (!in.open(filename)) { return (false); }
+    return (load_crm_matrix_mtx_text(in.begin(), in.end(),
+                rows, cols, vals, nr, nc, nzcount));
+}
+
+/**
+ * Load a Boldi-Vigna (WebGraph) graph stored in basename.properties
+ * and basename.graph.  If basename.offsets exists, ranges of nodes are
+ * decoded on separate threads.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_bvgraph(const std::string& basename,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
+					std::vector<Value>& vals,
+					Index &nr, Index &nc, NzIndex &nzcount)
+{
+    yasmic::bvgraph_matrix g(basename.c_str());
+    if (!g.valid())
+    {
+        return (false);
+    }
+
+    nr = g.num_nodes();
+    nc = nr;
+    nzcount = (NzIndex)g.num_arcs();
+
+    int nchunks = yasmic::impl::crm_parallel_chunks(nr, nzcount,
+                    (std::size_t)util::filesize(g.graph_filename()));
+    yasmic::impl::bvgraph_chunk_source src(g, nchunks);
+
+    YASMIC_VERBOSE( std::cerr << "decoding with " << src.nchunks() << " threads..." << std::endl; )
+
+    return (load_crm_chunked(src, nr, nc, nzcount, rows, cols, vals));
+}
+
 /** 
  * Test if a file with a .graph extension is a smat or not.
  */
@@ -322,12 +618,16 @@ bool load_crm_matrix_graph_test(InputStream& ifs)
  * All three operations need an input matrix type, but we need
  * to do the same thing for all, so this function dumps all
  * the work on load_crm_graph_type.
+ *
+ * The single_pass option is forwarded to load_crm_graph_type.
  */
-template <class Index, class Value>
+template <class Index, class NzIndex, class Value>
 bool load_crm_matrix(std::string filename, 
-					std::vector<Index>& rows, std::vector<Index>& cols,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
 					std::vector<Value>& vals,
-					Index &nr, Index &nc, Index &nzcount)
+					Index &nr, Index &nc, NzIndex &nzcount,
+					bool single_pass = false,
+					std::vector<boost::int64_t>* ids = 0)
 {
 	using namespace std;
 	
@@ -374,6 +674,17 @@ bool load_crm_matrix(std::string filename,
 
 #endif // YASMIC_UTIL_LOAD_GZIP
 
+        // a bvgraph is basename.graph with basename.properties
+        string basename = filename.substr(0, dot);
+        if (!ios_filter && (ext.compare("properties") == 0
+            || (ext.compare("graph") == 0 
+                && util::file_exists(basename + ".properties"))))
+        {
+            YASMIC_VERBOSE( std::cerr << "using bvgraph loader..." << std::endl; )
+            return (load_crm_matrix_bvgraph(basename, rows, cols, vals,
+                        nr, nc, nzcount));
+        }
+
         bool smat_graph = false;
 
         if (ext.compare("graph") == 0)
@@ -399,26 +710,61 @@ bool load_crm_matrix(std::string filename,
 
             if (ios_filter)
             {
-                ifstream ifs(filename.c_str(), ios_base::in | ios_base::binary);
-                ios_fifs.push(ifs);
-			    yasmic::ifstream_matrix<> m(ios_fifs);
-			    return (load_crm_graph_type(m, filename, rows, cols, vals,
-				    		nr, nc, nzcount));
+#ifdef YASMIC_UTIL_LOAD_GZIP
+                // inflate the file once on a separate thread, the
+                // nonzeros can only be read once, so force single_pass
+                YASMIC_VERBOSE( std::cerr << "inflating on a separate thread..." << std::endl; )
+
+                yasmic::gzip_smat_matrix<Index, Value, NzIndex> m(filename);
+                if (!m.valid())
+                {
+                    cerr << "error: cannot read the header of " << filename << endl;
+                    return (false);
+                }
+
+                bool rval = load_crm_graph_type(m, filename, rows, cols, vals,
+                                nr, nc, nzcount, true);
+
+                YASMIC_VERBOSE( 
+                    std::cerr << "inflated " << m.reader().bytes_out()/(1024.0*1024.0) 
+                              << " MB in " << m.reader().inflate_time() << "s" << std::endl; )
+
+                return (rval && !m.reader().error());
+#endif // YASMIC_UTIL_LOAD_GZIP
             }
             else
             {
+                bool mapped;
+                bool rval = load_crm_matrix_mapped_smat(filename, rows, cols, vals,
+                                nr, nc, nzcount, mapped, single_pass);
+                if (mapped)
+                {
+                    return (rval);
+                }
+
                 ifstream ifs(filename.c_str());
-                yasmic::ifstream_matrix<> m(ifs);
+                yasmic::ifstream_matrix<Index, Value, NzIndex> m(ifs);
 
-			    //yasmic::ifstream_matrix<> m(ifs);
 			    return (load_crm_graph_type(m, filename, rows, cols, vals,
-				    		nr, nc, nzcount));
+				    		nr, nc, nzcount, single_pass));
             }
 		}
         else if (ext.compare("bssmat") == 0)
         {
             YASMIC_VERBOSE( std::cerr << "using bssmat loader..." << std::endl; )
 
+            if (!ios_filter)
+            {
+                bool mapped;
+                bool rval = load_crm_matrix_mapped_binary(filename, 
+                                yasmic::impl::bssmat_binary_format,
+                                rows, cols, vals, nr, nc, nzcount, mapped);
+                if (mapped)
+                {
+                    return (rval);
+                }
+            }
+
             ifstream ifs(filename.c_str(), ios_base::in | ios::binary);
             
             if (ios_filter)
@@ -426,19 +772,31 @@ bool load_crm_matrix(std::string filename,
                 ios_fifs.push(ifs);
                 yasmic::binary_ifstream_graph<> m(ios_fifs);
                 return (load_crm_graph_type(m, filename, rows, cols, vals,
-                            nr, nc, nzcount));
+                            nr, nc, nzcount, single_pass));
             }
             else
             {
                 yasmic::binary_ifstream_graph<> m(ifs);
                 return (load_crm_graph_type(m, filename, rows, cols, vals,
-                            nr, nc, nzcount));
+                            nr, nc, nzcount, single_pass));
             }
         }
 		else if (ext.compare("bsmat") == 0)
 		{
 			YASMIC_VERBOSE( std::cerr << "using bsmat loader..." << std::endl; )
 
+            if (!ios_filter)
+            {
+                bool mapped;
+                bool rval = load_crm_matrix_mapped_binary(filename, 
+                                yasmic::impl::bsmat_binary_format,
+                                rows, cols, vals, nr, nc, nzcount, mapped);
+                if (mapped)
+                {
+                    return (rval);
+                }
+            }
+
             ifstream ifs(filename.c_str(), ios_base::in | ios::binary);
             
             if (ios_filter)
@@ -446,32 +804,41 @@ bool load_crm_matrix(std::string filename,
             	ios_fifs.push(ifs);
                 yasmic::binary_ifstream_matrix<> m(ios_fifs);
 			    return (load_crm_graph_type(m, filename, rows, cols, vals,
-				    		nr, nc, nzcount));
+				    		nr, nc, nzcount, single_pass));
             }
             else
             {
                 yasmic::binary_ifstream_matrix<> m(ifs);
 			    return (load_crm_graph_type(m, filename, rows, cols, vals,
-				    		nr, nc, nzcount));
+				    		nr, nc, nzcount, single_pass));
             }
 		}
+        else if (ext.compare("mtx") == 0)
+        {
+            YASMIC_VERBOSE( std::cerr << "using matrix market loader..." << std::endl; )
+
+            return (load_crm_matrix_mtx(filename, rows, cols, vals,
+                        nr, nc, nzcount));
+        }
         else if (ext.compare("mat") == 0 || ext.compare("cmat") == 0 
                  || ext.compare("cgraph") == 0)
 		{
 			YASMIC_VERBOSE( std::cerr << "using cluto loader..." << std::endl; )
 
-			ifstream ifs(filename.c_str());
-			yasmic::cluto_ifstream_matrix<> m(ifs);
-			return (load_crm_graph_type(m, filename, rows, cols, vals,
-						nr, nc, nzcount));
+			return (load_crm_matrix_cluto(filename, rows, cols, vals,
+						nr, nc, nzcount, single_pass));
 		}
         else if (ext.compare("graph") == 0)
         {
             YASMIC_VERBOSE( std::cerr << "using graph loader..." << std::endl; )
-            ifstream ifs(filename.c_str());
-			yasmic::graph_ifstream_matrix<> m(ifs);
-			return (load_crm_graph_type(m, filename, rows, cols, vals,
-						nr, nc, nzcount));
+			return (load_crm_matrix_graph(filename, rows, cols, vals,
+						nr, nc, nzcount, single_pass));
+        }
+        else if (ext.compare("edges") == 0 || ext.compare("txt") == 0)
+        {
+            YASMIC_VERBOSE( std::cerr << "using edge list loader..." << std::endl; )
+            return (load_crm_matrix_edges(filename, rows, cols, vals,
+                        nr, nc, nzcount, ids));
         }
 		else
 		{
@@ -493,18 +860,20 @@ namespace impl
 {
 	// this is a workaround for the world's most ridiculous portability
 	// bug between gcc and msvc.
-	int lower_case ( int c )
+	inline int lower_case ( int c )
 	{
 	    return tolower ( c );
 	}
 }
 } 
 
-template <class Index, class Value>
+template <class Index, class NzIndex, class Value>
 bool load_crm_matrix(std::string filetype_hint, std::string filename, 
-					std::vector<Index>& rows, std::vector<Index>& cols,
+					std::vector<NzIndex>& rows, std::vector<Index>& cols,
 					std::vector<Value>& vals,
-					Index &nr, Index &nc, Index &nzcount)
+					Index &nr, Index &nc, NzIndex &nzcount,
+					bool single_pass = false,
+					std::vector<boost::int64_t>* ids = 0)
 {
     using namespace std;
 
@@ -516,32 +885,58 @@ bool load_crm_matrix(std::string filetype_hint, std::string filename,
     {
         YASMIC_VERBOSE( cerr << "using cluto loader..." << endl; )
 
-        ifstream ifs(filename.c_str());
-		yasmic::cluto_ifstream_matrix<> m(ifs);
-		return (load_crm_graph_type(m, filename, rows, cols, vals,
-					nr, nc, nzcount));
+		return (load_crm_matrix_cluto(filename, rows, cols, vals,
+					nr, nc, nzcount, single_pass));
     }
     else if (filetype_hint.compare("graph") == 0)
     {
         YASMIC_VERBOSE( std::cerr << "using graph loader..." << std::endl; )
-        ifstream ifs(filename.c_str());
-		yasmic::graph_ifstream_matrix<> m(ifs);
-		return (load_crm_graph_type(m, filename, rows, cols, vals,
+		return (load_crm_matrix_graph(filename, rows, cols, vals,
+					nr, nc, nzcount, single_pass));
+    }
+    else if (filetype_hint.compare("bvgraph") == 0)
+    {
+        YASMIC_VERBOSE( std::cerr << "using bvgraph loader..." << std::endl; )
+        string basename = filename;
+        string::size_type dot = filename.find_last_of(".");
+        if (dot != string::npos) { basename = filename.substr(0, dot); }
+		return (load_crm_matrix_bvgraph(basename, rows, cols, vals,
+					nr, nc, nzcount));
+    }
+    else if (filetype_hint.compare("mtx") == 0)
+    {
+        YASMIC_VERBOSE( std::cerr << "using matrix market loader..." << std::endl; )
+		return (load_crm_matrix_mtx(filename, rows, cols, vals,
 					nr, nc, nzcount));
     }
     else if (filetype_hint.compare("smat") == 0)
     {
         YASMIC_VERBOSE( std::cerr << "using smat loader..." << std::endl; )
 
+        bool mapped;
+        bool rval = load_crm_matrix_mapped_smat(filename, rows, cols, vals,
+                        nr, nc, nzcount, mapped, single_pass);
+        if (mapped)
+        {
+            return (rval);
+        }
+
 		ifstream ifs(filename.c_str());
-		yasmic::ifstream_matrix<> m(ifs);
+		yasmic::ifstream_matrix<Index, Value, NzIndex> m(ifs);
 		return (load_crm_graph_type(m, filename, rows, cols, vals,
-					nr, nc, nzcount));
+					nr, nc, nzcount, single_pass));
+    }
+    else if (filetype_hint.compare("edges") == 0)
+    {
+        YASMIC_VERBOSE( std::cerr << "using edge list loader..." << std::endl; )
+        return (load_crm_matrix_edges(filename, rows, cols, vals,
+                    nr, nc, nzcount, ids));
     }
     else
     {
         YASMIC_VERBOSE( std::cerr << "filetype hint didn't help, trying the extension loader..." << endl; )
-        return (load_crm_matrix(filename, rows, cols, vals, nr, nc, nzcount));
+        return (load_crm_matrix(filename, rows, cols, vals, nr, nc, nzcount, 
+                    single_pass, ids));
     }
 }
 
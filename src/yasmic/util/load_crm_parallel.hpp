@@ -0,0 +1,902 @@
+#ifndef YASMIC_UTIL_LOAD_CRM_PARALLEL
+#define YASMIC_UTIL_LOAD_CRM_PARALLEL
+
+/**
+ * @file load_crm_parallel.hpp
+ * Load a matrix into a crm data structure with many threads.
+ *
+ * The loader works on a ChunkSource, an object that splits the input
+ * into independent pieces.  A ChunkSource provides
+ *
+ *   int nchunks() const;
+ *   std::size_t chunk_bytes(int i) const;
+ *   template <class Sink> bool parse_chunk(int i, Sink& s);
+ *
+ * where parse_chunk calls s(r, c, v) for every nonzero in chunk i, in
+ * the order they appear in the input, and returns false if the chunk
+ * cannot be parsed.  parse_chunk is called twice for every chunk, and
+ * for different chunks at the same time.
+ *
+ * The crm arrays are built in three steps:
+ * 1.  each thread counts the row degrees of its chunk into its own
+ *     histogram;
+ * 2.  the histograms are merged into the row pointers and per-thread
+ *     row offsets with a parallel prefix sum;
+ * 3.  each thread parses its chunk again and scatters the nonzeros
+ *     directly into their final position.
+ *
+ * The result is identical to load_matrix_to_crm: the nonzeros of each
+ * row keep the order they have in the input.
+ *
+ * A ChunkSource may report an entry of the input more than once, e.g.
+ * the Matrix Market source reports both (i,j) and (j,i) for an entry
+ * of a symmetric matrix.  The expansion happens inside the scatter, so
+ * a symmetric matrix never needs a temporary copy.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <algorithm>
+
+#include <yasmic/verbose_util.hpp>
+#include <yasmic/util/text_scanner.hpp>
+#include <yasmic/util/load_monitor.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <util/parallel.hpp>
+#include <util/mapped_file.hpp>
+
+namespace yasmic
+{
+namespace impl
+{
+    /**
+     * The first pass sink; count the row degrees and check the indices.
+     */
+    template <class Index, class NzIndex>
+    struct crm_count_sink
+    {
+        crm_count_sink(Index* d, Index m, Index n, load_monitor<Index>* mon = 0)
+        : deg(d), nr(m), nc(n), nz(0), bad(false), bad_r(0), bad_c(0),
+          monitor(mon, true)
+        {}
+
+        template <class V>
+        void operator() (Index r, Index c, V)
+        {
+            monitor(r, c);
+            if (r < 0 || r >= nr || c < 0 || c >= nc) {
+                if (!bad) { bad = true; bad_r = r; bad_c = c; }
+            } else {
+                ++deg[r];
+            }
+            ++nz;
+        }
+
+        Index* deg;
+        Index nr, nc;
+        NzIndex nz;
+        bool bad;
+        Index bad_r, bad_c;
+        load_monitor_buffer<Index> monitor;
+    };
+
+    /**
+     * The second pass sink; put each nonzero in its final place.  The
+     * position of the next nonzero of row r is rows[r] + offset[r].
+     * The offsets are relative to the start of the row, so they fit
+     * in an Index even when the row pointers need a wider NzIndex.
+     */
+    template <class Index, class NzIndex, class RAICols, class RAIVals>
+    struct crm_scatter_sink
+    {
+        crm_scatter_sink(const NzIndex* r, Index* o, RAICols c, RAIVals v,
+            load_monitor<Index>* mon = 0)
+        : rows(r), offset(o), cols(c), vals(v), monitor(mon, false)
+        {}
+
+        template <class V>
+        void operator() (Index r, Index c, V v)
+        {
+            monitor(r, c);
+            NzIndex k = rows[r] + offset[r]++;
+            cols[k] = c;
+            vals[k] = v;
+        }
+
+        const NzIndex* rows;
+        Index* offset;
+        RAICols cols;
+        RAIVals vals;
+        load_monitor_buffer<Index> monitor;
+    };
+
+    /**
+     * Pick the number of chunks for a parallel load.  Each chunk needs a
+     * histogram with nr entries, so we never use more chunks than it
+     * takes for the histograms to be as large as the column array.
+     */
+    template <class Index, class Size>
+    int crm_parallel_chunks(Index nr, Size nnz, std::size_t bytes,
+        std::size_t min_chunk_bytes = (1<<20))
+    {
+        int nthreads = util::max_threads();
+        if (nr > 0) {
+            double hist_limit = (double)nnz/(double)nr;
+            if (hist_limit < (double)nthreads) { nthreads = (int)hist_limit; }
+        }
+        std::size_t size_limit = bytes/min_chunk_bytes + 1;
+        if (size_limit < (std::size_t)nthreads) { nthreads = (int)size_limit; }
+        return (std::max(nthreads, 1));
+    }
+
+    /**
+     * The text formats handled by text_chunk_source.
+     */
+    enum text_format
+    {
+        smat_text_format,   // "i j v" on each line, 0 indexed
+        cluto_text_format,  // "j v j v ..." on line i, 1 indexed
+        graph_text_format,  // "j j j ..." on line i, 1 indexed
+        mtx_text_format,    // "i j v" on each line, 1 indexed
+        mtx_pattern_text_format // "i j" on each line, 1 indexed
+    };
+
+    /**
+     * The symmetry of a Matrix Market file.  Symmetric and skew-symmetric
+     * files only store the lower triangle, the entries above the diagonal
+     * are added by the loader.
+     */
+    enum mtx_symmetry
+    {
+        mtx_general,
+        mtx_symmetric,
+        mtx_skew_symmetric
+    };
+
+    /**
+     * A ChunkSource for text files in memory.  The data is split into
+     * chunks at newline boundaries.  For the line oriented formats, the
+     * first row of each chunk is found by counting the newlines in the
+     * preceding chunks.
+     *
+     * For the Matrix Market formats, entries() is the number of entries
+     * in the file, which is less than the number of nonzeros reported to
+     * the sinks for a symmetric matrix.
+     */
+    template <class Index, class Value>
+    class text_chunk_source
+    {
+    public:
+        text_chunk_source(text_format fmt, const char* begin, const char* end,
+            int nchunks, mtx_symmetry sym = mtx_general)
+        : _fmt(fmt), _sym(sym), _bounds(nchunks+1), _first_row(nchunks+1, 0),
+          _entries(nchunks, 0), _error_chunk(-1), _error_pos(0)
+        {
+            _bounds[0] = begin;
+            _bounds[nchunks] = end;
+            for (int i = 1; i < nchunks; ++i) {
+                const char* p = begin + (std::size_t)(((double)(end - begin)*i)/nchunks);
+                p = std::max(p, _bounds[i-1]);
+                _bounds[i] = scan_next_line(p, end);
+            }
+
+            if (_fmt == cluto_text_format || _fmt == graph_text_format) {
+                // count the lines in each chunk
+                #pragma omp parallel for num_threads(nchunks) schedule(static,1)
+                for (int i = 0; i < nchunks; ++i) {
+                    Index lines = 0;
+                    const char* p = _bounds[i];
+                    const char* e = _bounds[i+1];
+                    while ((p = (const char*)std::memchr(p, '\n', e - p)) != 0) {
+                        ++lines; ++p;
+                    }
+                    _first_row[i+1] = lines;
+                }
+                for (int i = 0; i < nchunks; ++i) {
+                    _first_row[i+1] += _first_row[i];
+                }
+            }
+        }
+
+        int nchunks() const { return ((int)_bounds.size() - 1); }
+
+        std::size_t chunk_bytes(int i) const
+        { return (_bounds[i+1] - _bounds[i]); }
+
+        template <class Sink>
+        bool parse_chunk(int i, Sink& s)
+        {
+            const char* p = _bounds[i];
+            const char* end = _bounds[i+1];
+            bool rval;
+            switch (_fmt) {
+                case smat_text_format: rval = parse_smat(p, end, s); break;
+                case cluto_text_format: rval = parse_lines<true>(p, end, _first_row[i], s); break;
+                case graph_text_format: rval = parse_lines<false>(p, end, _first_row[i], s); break;
+                case mtx_text_format: rval = parse_mtx<true>(p, end, _entries[i], s); break;
+                case mtx_pattern_text_format: rval = parse_mtx<false>(p, end, _entries[i], s); break;
+                default: rval = false;
+            }
+            if (!rval) {
+                #pragma omp critical (text_chunk_source_error)
+                {
+                    if (_error_chunk < 0 || i < _error_chunk) {
+                        _error_chunk = i;
+                        _error_pos = p;
+                    }
+                }
+            }
+            return (rval);
+        }
+
+        /**
+         * @return the position of the first parse error
+         */
+        const char* error_position() const { return (_error_pos); }
+
+        /**
+         * @return the number of Matrix Market entries in the parsed chunks
+         */
+        std::size_t entries() const
+        {
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < _entries.size(); ++i) { n += _entries[i]; }
+            return (n);
+        }
+
+    private:
+        template <class Sink>
+        bool parse_smat(const char*& p, const char* end, Sink& s)
+        {
+            Index r, c;
+            Value v;
+            while ((p = scan_skip_space(p, end)) != end) {
+                if (!scan_int(p, end, r) || !scan_int(p, end, c) ||
+                    !scan_value(p, end, v)) {
+                    return (false);
+                }
+                s(r, c, v);
+            }
+            return (true);
+        }
+
+        template <bool values, class Sink>
+        bool parse_lines(const char*& p, const char* end, Index r, Sink& s)
+        {
+            Index c;
+            Value v = 1;
+            while (p != end) {
+                const char* le = (const char*)std::memchr(p, '\n', end - p);
+                if (le == 0) { le = end; }
+                // both formats use 1 indexed columns
+                while (scan_int(p, le, c)) {
+                    if (values && !scan_value(p, le, v)) { return (false); }
+                    s(r, c-1, v);
+                }
+                if (scan_skip_space(p, le) != le) { return (false); }
+                p = (le == end) ? end : le + 1;
+                ++r;
+            }
+            return (true);
+        }
+
+        /**
+         * Parse "i j [v]" entries with 1 indexed rows and columns and
+         * report the mirrored entry above the diagonal for symmetric
+         * and skew-symmetric matrices.
+         */
+        template <bool values, class Sink>
+        bool parse_mtx(const char*& p, const char* end, std::size_t& entries,
+            Sink& s)
+        {
+            Index r, c;
+            Value v = 1;
+            entries = 0;
+            while ((p = scan_skip_space(p, end)) != end) {
+                if (!scan_int(p, end, r) || !scan_int(p, end, c) ||
+                    (values && !scan_value(p, end, v))) {
+                    return (false);
+                }
+                --r; --c;
+                s(r, c, v);
+                if (r != c) {
+                    if (_sym == mtx_symmetric) { s(c, r, v); }
+                    else if (_sym == mtx_skew_symmetric) { s(c, r, -v); }
+                }
+                ++entries;
+            }
+            return (true);
+        }
+
+        text_format _fmt;
+        mtx_symmetry _sym;
+        std::vector<const char*> _bounds;
+        std::vector<Index> _first_row;
+        std::vector<std::size_t> _entries;
+
+        int _error_chunk;
+        const char* _error_pos;
+    };
+
+    /**
+     * The binary formats handled by binary_chunk_source.  Both start
+     * with the int32 header "nrows ncols nnz".
+     */
+    enum binary_format
+    {
+        bsmat_binary_format,    // int32 i, int32 j, double v for each nonzero
+        bssmat_binary_format    // int32 i, int32 j for each nonzero
+    };
+
+    /**
+     * The byte order of a binary file.  The files have no marker for
+     * it, so auto_byte_order picks the order for which the header
+     * matches the size of the file.
+     */
+    enum binary_byte_order
+    {
+        auto_byte_order,
+        little_endian_byte_order,
+        big_endian_byte_order
+    };
+
+    inline bool host_is_big_endian()
+    {
+        const boost::uint16_t one = 1;
+        return (*(const unsigned char*)&one == 0);
+    }
+
+    /**
+     * Read a T from the unaligned bytes at p, reversing them if swap is
+     * true.
+     */
+    template <class T, bool swap>
+    inline T load_binary(const char* p)
+    {
+        T t;
+        if (swap) {
+            char b[sizeof(T)];
+            for (std::size_t k = 0; k < sizeof(T); ++k) { b[k] = p[sizeof(T)-1-k]; }
+            std::memcpy(&t, b, sizeof(T));
+        } else {
+            std::memcpy(&t, p, sizeof(T));
+        }
+        return (t);
+    }
+
+    /**
+     * A ChunkSource for the nonzero records of a binary file in memory.
+     * The records have a fixed size, so the chunks are just equal
+     * ranges of records.
+     */
+    template <class Index, class Value>
+    class binary_chunk_source
+    {
+    public:
+        binary_chunk_source(binary_format fmt, bool swap, 
+            const char* begin, std::size_t nrecords, int nchunks)
+        : _fmt(fmt), _swap(swap), _bounds(nchunks+1)
+        {
+            std::size_t rs = record_size(fmt);
+            for (int i = 0; i < nchunks; ++i) {
+                _bounds[i] = begin + rs*(std::size_t)(((double)nrecords*i)/nchunks);
+            }
+            _bounds[nchunks] = begin + rs*nrecords;
+        }
+
+        static std::size_t record_size(binary_format fmt)
+        {
+            return (fmt == bsmat_binary_format ? 
+                2*sizeof(boost::int32_t) + sizeof(double) : 2*sizeof(boost::int32_t));
+        }
+
+        int nchunks() const { return ((int)_bounds.size() - 1); }
+
+        std::size_t chunk_bytes(int i) const
+        { return (_bounds[i+1] - _bounds[i]); }
+
+        template <class Sink>
+        bool parse_chunk(int i, Sink& s)
+        {
+            const char* p = _bounds[i];
+            const char* end = _bounds[i+1];
+            bool values = (_fmt == bsmat_binary_format);
+            if (values && _swap) { parse_records<true,true>(p, end, s); }
+            else if (values) { parse_records<true,false>(p, end, s); }
+            else if (_swap) { parse_records<false,true>(p, end, s); }
+            else { parse_records<false,false>(p, end, s); }
+            return (true);
+        }
+
+    private:
+        template <bool values, bool swap, class Sink>
+        void parse_records(const char* p, const char* end, Sink& s)
+        {
+            const std::size_t rs = record_size(values ? 
+                bsmat_binary_format : bssmat_binary_format);
+            for (; p != end; p += rs) {
+                Index r = (Index)load_binary<boost::int32_t, swap>(p);
+                Index c = (Index)load_binary<boost::int32_t, swap>(p + sizeof(boost::int32_t));
+                Value v = values ? 
+                    (Value)load_binary<double, swap>(p + 2*sizeof(boost::int32_t)) : (Value)1;
+                s(r, c, v);
+            }
+        }
+
+        binary_format _fmt;
+        bool _swap;
+        std::vector<const char*> _bounds;
+    };
+
+} // namespace impl
+} // namespace yasmic
+
+/**
+ * Load a matrix from a ChunkSource into crm arrays with one thread
+ * per chunk.  Both passes report to crm_load_monitor, if it is set.
+ *
+ * @param src the chunk source
+ * @param nr the number of rows
+ * @param nc the number of columns
+ * @param nzcount the number of nonzeros the input should contain, or
+ *   if count_nnz is true, set to the number of nonzeros in the input
+ * @param rows the row pointers, resized to nr+1
+ * @param cols the column indices, resized to nzcount
+ * @param vals the values, resized to nzcount
+ * @param count_nnz true if the number of nonzeros is not known ahead
+ *   of time, e.g. for a source that expands a symmetric matrix
+ * @return false if the input is invalid
+ */
+template <class ChunkSource, class Index, class NzIndex, class Value>
+bool load_crm_chunked(ChunkSource& src, Index nr, Index nc, NzIndex& nzcount,
+        std::vector<NzIndex>& rows, std::vector<Index>& cols,
+        std::vector<Value>& vals, bool count_nnz = false)
+{
+    using namespace std;
+
+    if (nr < 1)
+    {
+        cerr << "error: invalid number of rows" << endl;
+        return (false);
+    }
+
+    int nchunks = src.nchunks();
+
+    rows.assign(nr+1, 0);
+
+    vector< vector<Index> > hist(nchunks);
+    vector<NzIndex> chunk_nz(nchunks, 0);
+    vector<char> chunk_ok(nchunks, 1);
+    vector<char> chunk_bad(nchunks, 0);
+    vector<Index> bad_r(nchunks), bad_c(nchunks);
+    vector<double> count_time(nchunks), scatter_time(nchunks);
+
+    yasmic::load_monitor<Index>* monitor = yasmic::crm_load_monitor<Index>();
+    if (monitor) { monitor->begin(nr, nc, nzcount, 2); }
+
+    //
+    // 1.  count the degrees of each chunk
+    //
+    #pragma omp parallel for num_threads(nchunks) schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        double t0 = util::wall_time();
+
+        // allocate the histogram on the thread that uses it
+        hist[i].assign(nr, 0);
+
+        yasmic::impl::crm_count_sink<Index, NzIndex> s(&hist[i][0], nr, nc, monitor);
+        chunk_ok[i] = src.parse_chunk(i, s);
+        chunk_nz[i] = s.nz;
+        chunk_bad[i] = s.bad;
+        bad_r[i] = s.bad_r;
+        bad_c[i] = s.bad_c;
+
+        count_time[i] = util::wall_time() - t0;
+    }
+
+    NzIndex nz = 0;
+    for (int i = 0; i < nchunks; ++i)
+    {
+        if (!chunk_ok[i])
+        {
+            cerr << "error: invalid matrix data, cannot parse chunk " << i << endl;
+            return (false);
+        }
+        if (chunk_bad[i])
+        {
+            cerr << "error: invalid matrix data, nrows or ncols exceeded ("
+                << bad_r[i] << "," << bad_c[i] << ")" << endl;
+            return (false);
+        }
+        nz += chunk_nz[i];
+    }
+
+    if (count_nnz)
+    {
+        nzcount = nz;
+    }
+    else if (nz != nzcount)
+    {
+        cerr << "error: number of nonzeros do not match nnz" << endl;
+        return (false);
+    }
+
+    cols.resize(nzcount);
+    vals.resize(nzcount);
+
+    //
+    // 2.  merge the histograms, afterwards hist[i][r] is the offset
+    //     of chunk i's nonzeros in row r, and rows[r+1] is the degree
+    //
+    #pragma omp parallel for schedule(static)
+    for (Index r = 0; r < nr; ++r)
+    {
+        Index s = 0;
+        for (int i = 0; i < nchunks; ++i)
+        {
+            Index d = hist[i][r];
+            hist[i][r] = s;
+            s += d;
+        }
+        rows[r+1] = s;
+    }
+
+    util::parallel_partial_sum(rows.begin()+1, nr);
+
+    //
+    // 3.  scatter the nonzeros
+    //
+    typedef typename vector<Index>::iterator col_iter;
+    typedef typename vector<Value>::iterator val_iter;
+
+    #pragma omp parallel for num_threads(nchunks) schedule(static,1)
+    for (int i = 0; i < nchunks; ++i)
+    {
+        double t0 = util::wall_time();
+
+        yasmic::impl::crm_scatter_sink<Index, NzIndex, col_iter, val_iter> s(&rows[0],
+            &hist[i][0], cols.begin(), vals.begin(), monitor);
+        src.parse_chunk(i, s);
+
+        // release the histogram as soon as we are done
+        vector<Index>().swap(hist[i]);
+
+        scatter_time[i] = util::wall_time() - t0;
+    }
+
+    YASMIC_VERBOSE(
+        for (int i = 0; i < nchunks; ++i)
+        {
+            double mb = (double)src.chunk_bytes(i)/(1024.0*1024.0);
+            cerr << "  thread " << i << ": " << mb << " MB, "
+                 << "count " << count_time[i] << "s ("
+                 << mb/std::max(count_time[i],1e-9) << " MB/s), "
+                 << "scatter " << scatter_time[i] << "s ("
+                 << mb/std::max(scatter_time[i],1e-9) << " MB/s)" << endl;
+        }
+    )
+
+    return (true);
+}
+
+/**
+ * Load a text file with many threads by memory mapping it and splitting
+ * it into chunks at line boundaries.
+ *
+ * @param fmt the format of the file
+ * @param graph for cluto_text_format, true if the header is "n nnz"
+ *   instead of "nrows ncols nnz"
+ * @param mapped set to false if the file could not be memory mapped,
+ *   in which case nothing was loaded and the caller should fall back
+ *   to a different loader.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_parallel_text(const std::string& filename,
+        yasmic::impl::text_format fmt, bool graph,
+        std::vector<NzIndex>& rows, std::vector<Index>& cols,
+        std::vector<Value>& vals,
+        Index &nr, Index &nc, NzIndex &nzcount, bool& mapped)
+{
+    using namespace yasmic::impl;
+
+    util::mapped_file mf;
+    mapped = mf.open(filename);
+    if (!mapped)
+    {
+        return (false);
+    }
+
+    const char* p = mf.begin();
+    const char* end = mf.end();
+
+    bool header;
+    switch (fmt)
+    {
+        case smat_text_format:
+            header = scan_int(p, end, nr) && scan_int(p, end, nc)
+                     && scan_int(p, end, nzcount);
+            break;
+
+        case cluto_text_format:
+            if (graph) {
+                header = scan_int(p, end, nr) && scan_int(p, end, nzcount);
+                nc = nr;
+            } else {
+                header = scan_int(p, end, nr) && scan_int(p, end, nc)
+                         && scan_int(p, end, nzcount);
+            }
+            break;
+
+        case graph_text_format:
+            // the graph header stores the number of undirected edges
+            header = scan_int(p, end, nr) && scan_int(p, end, nzcount);
+            nc = nr;
+            nzcount = 2*nzcount;
+            break;
+
+        default:
+            header = false;
+    }
+
+    if (!header)
+    {
+        std::cerr << "error: cannot read the header of " << filename << std::endl;
+        return (false);
+    }
+
+    if (fmt != smat_text_format)
+    {
+        // the rows start on the line after the header
+        p = scan_next_line(p, end);
+    }
+
+    int nchunks = crm_parallel_chunks(nr, nzcount, (std::size_t)(end - p));
+
+    YASMIC_VERBOSE( std::cerr << "parsing with " << nchunks << " threads..." << std::endl; )
+
+    text_chunk_source<Index, Value> src(fmt, p, end, nchunks);
+    bool rval = load_crm_chunked(src, nr, nc, nzcount, rows, cols, vals);
+    if (!rval && src.error_position())
+    {
+        std::cerr << "error: parse error at byte "
+                  << (src.error_position() - mf.begin()) << std::endl;
+    }
+
+    return (rval);
+}
+
+/**
+ * Load a bsmat or bssmat file by memory mapping it and splitting its
+ * nonzero records into one chunk per thread.  The records are read in
+ * place, so both passes over the nonzeros run at memory speed.
+ *
+ * @param order the byte order of the file; with auto_byte_order, the
+ *   order is the one for which the size of the file matches the header
+ * @param mapped set to false if the file could not be memory mapped,
+ *   in which case nothing was loaded and the caller should fall back
+ *   to a different loader.
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_mapped_binary(const std::string& filename,
+        yasmic::impl::binary_format fmt,
+        std::vector<NzIndex>& rows, std::vector<Index>& cols,
+        std::vector<Value>& vals,
+        Index &nr, Index &nc, NzIndex &nzcount, bool& mapped,
+        yasmic::impl::binary_byte_order order = yasmic::impl::auto_byte_order)
+{
+    using namespace yasmic::impl;
+    using namespace std;
+
+    util::mapped_file mf;
+    mapped = mf.open(filename);
+    if (!mapped)
+    {
+        return (false);
+    }
+
+    const std::size_t header_size = 3*sizeof(boost::int32_t);
+    const std::size_t rs = binary_chunk_source<Index, Value>::record_size(fmt);
+    if (mf.size() < header_size)
+    {
+        cerr << "error: cannot read the header of " << filename << endl;
+        return (false);
+    }
+
+    // the number of nonzeros in the header fixes the size of the file
+    const char* nnz_pos = mf.begin() + 2*sizeof(boost::int32_t);
+    boost::int64_t native_nnz = load_binary<boost::int32_t, false>(nnz_pos);
+    boost::int64_t swapped_nnz = load_binary<boost::int32_t, true>(nnz_pos);
+    bool native_fits = native_nnz >= 0 
+        && mf.size() == header_size + rs*(std::size_t)native_nnz;
+    bool swapped_fits = swapped_nnz >= 0 
+        && mf.size() == header_size + rs*(std::size_t)swapped_nnz;
+
+    bool swap;
+    if (order == auto_byte_order)
+    {
+        if (!native_fits && !swapped_fits)
+        {
+            cerr << "error: the size of " << filename 
+                 << " does not match the number of nonzeros" << endl;
+            return (false);
+        }
+        swap = !native_fits;
+    }
+    else
+    {
+        swap = (order == big_endian_byte_order) != host_is_big_endian();
+        if (!(swap ? swapped_fits : native_fits))
+        {
+            cerr << "error: the size of " << filename 
+                 << " does not match the number of nonzeros" << endl;
+            return (false);
+        }
+    }
+
+    YASMIC_VERBOSE( if (swap) { cerr << "swapping the byte order..." << endl; } )
+
+    const char* p = mf.begin();
+    if (swap)
+    {
+        nr = (Index)load_binary<boost::int32_t, true>(p);
+        nc = (Index)load_binary<boost::int32_t, true>(p + sizeof(boost::int32_t));
+        nzcount = (NzIndex)swapped_nnz;
+    }
+    else
+    {
+        nr = (Index)load_binary<boost::int32_t, false>(p);
+        nc = (Index)load_binary<boost::int32_t, false>(p + sizeof(boost::int32_t));
+        nzcount = (NzIndex)native_nnz;
+    }
+
+    int nchunks = crm_parallel_chunks(nr, nzcount, mf.size() - header_size);
+
+    YASMIC_VERBOSE( std::cerr << "reading with " << nchunks << " threads..." << std::endl; )
+
+    mf.advise_sequential();
+    binary_chunk_source<Index, Value> src(fmt, swap, p + header_size, 
+        (std::size_t)nzcount, nchunks);
+    return (load_crm_chunked(src, nr, nc, nzcount, rows, cols, vals));
+}
+
+/**
+ * Read the banner, comments, and size line of a Matrix Market file in
+ * memory.  The file must be a "matrix coordinate" file with a real,
+ * integer, or pattern field and general, symmetric, or skew-symmetric
+ * symmetry.
+ *
+ * @param p the first byte of the file, set to the first entry
+ * @param entries set to the number of entries on the size line
+ * @return false if the header is invalid or unsupported
+ */
+template <class Index, class NzIndex>
+bool read_mtx_header(const char*& p, const char* end,
+        yasmic::impl::text_format& fmt, yasmic::impl::mtx_symmetry& sym,
+        Index &nr, Index &nc, NzIndex &entries)
+{
+    using namespace yasmic::impl;
+    using namespace std;
+
+    const char* le = scan_next_line(p, end);
+
+    // parse the banner
+    //   %%MatrixMarket matrix coordinate real general
+    string banner(p, le);
+    transform(banner.begin(), banner.end(), banner.begin(), (int(*)(int))tolower);
+    istringstream iss(banner);
+    string tag, object, format, field, symmetry;
+    iss >> tag >> object >> format >> field >> symmetry;
+
+    if (tag != "%%matrixmarket" || object != "matrix")
+    {
+        cerr << "error: missing %%MatrixMarket matrix banner" << endl;
+        return (false);
+    }
+    if (format != "coordinate")
+    {
+        cerr << "error: only coordinate Matrix Market files are supported" << endl;
+        return (false);
+    }
+
+    if (field == "real" || field == "integer") { fmt = mtx_text_format; }
+    else if (field == "pattern") { fmt = mtx_pattern_text_format; }
+    else
+    {
+        cerr << "error: unsupported Matrix Market field " << field << endl;
+        return (false);
+    }
+
+    if (symmetry == "general") { sym = mtx_general; }
+    else if (symmetry == "symmetric") { sym = mtx_symmetric; }
+    else if (symmetry == "skew-symmetric") { sym = mtx_skew_symmetric; }
+    else
+    {
+        cerr << "error: unsupported Matrix Market symmetry " << symmetry << endl;
+        return (false);
+    }
+
+    // skip the comments, then read the size line
+    p = le;
+    for (;;)
+    {
+        const char* q = scan_skip_space(p, end);
+        if (q == end || *q != '%') { break; }
+        p = scan_next_line(q, end);
+    }
+
+    if (!scan_int(p, end, nr) || !scan_int(p, end, nc) || !scan_int(p, end, entries))
+    {
+        cerr << "error: cannot read the Matrix Market size line" << endl;
+        return (false);
+    }
+
+    if (sym != mtx_general && nr != nc)
+    {
+        cerr << "error: a symmetric Matrix Market file must be square" << endl;
+        return (false);
+    }
+
+    return (true);
+}
+
+/**
+ * Load a Matrix Market coordinate file from memory with one thread per
+ * chunk.  See read_mtx_header for the supported files.  The 1 indexed
+ * entries are translated to 0 indexed rows and columns, and the upper
+ * triangle of a symmetric matrix is added while scattering the 
+ * nonzeros, so nzcount is the number of nonzeros after the expansion.
+ *
+ * @param begin the first byte of the file
+ * @param end one past the last byte of the file
+ */
+template <class Index, class NzIndex, class Value>
+bool load_crm_matrix_mtx_text(const char* begin, const char* end,
+        std::vector<NzIndex>& rows, std::vector<Index>& cols,
+        std::vector<Value>& vals,
+        Index &nr, Index &nc, NzIndex &nzcount)
+{
+    using namespace yasmic::impl;
+    using namespace std;
+
+    const char* p = begin;
+    text_format fmt;
+    mtx_symmetry sym;
+    NzIndex entries;
+    if (!read_mtx_header(p, end, fmt, sym, nr, nc, entries))
+    {
+        return (false);
+    }
+
+    // a general file has one nonzero per entry, otherwise the number
+    // of nonzeros is counted while loading
+    nzcount = (sym == mtx_general) ? entries : 2*entries;
+    int nchunks = crm_parallel_chunks(nr, nzcount, (std::size_t)(end - p));
+
+    YASMIC_VERBOSE( std::cerr << "parsing with " << nchunks << " threads..." << std::endl; )
+
+    text_chunk_source<Index, Value> src(fmt, p, end, nchunks, sym);
+    bool rval = load_crm_chunked(src, nr, nc, nzcount, rows, cols, vals,
+                    sym != mtx_general);
+    if (!rval && src.error_position())
+    {
+        cerr << "error: parse error at byte "
+             << (src.error_position() - begin) << endl;
+    }
+
+    if (rval && src.entries() != (std::size_t)entries)
+    {
+        cerr << "error: number of entries do not match the size line" << endl;
+        return (false);
+    }
+
+    return (rval);
+}
+
+#endif // YASMIC_UTIL_LOAD_CRM_PARALLEL
@@ -0,0 +1,107 @@
+#ifndef YASMIC_UTIL_LOAD_MONITOR
+#define YASMIC_UTIL_LOAD_MONITOR
+
+/**
+ * @file load_monitor.hpp
+ * Watch the nonzeros of a matrix as the crm loaders parse it.
+ *
+ * A program that wants to show a matrix while it is still loading
+ * sets crm_load_monitor<Index>() before calling load_crm_matrix.  The
+ * loaders call begin once they know the size of the matrix, then
+ * nonzeros with each batch of nonzeros from their first pass over the
+ * input and advance for the nonzeros of any later pass.  The indices
+ * are reported before they are checked, so a monitor must ignore the
+ * ones outside the matrix.
+ *
+ * The parallel loaders call nonzeros and advance from many threads at
+ * once.
+ */
+
+#include <vector>
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+namespace yasmic
+{
+    template <class Index>
+    class load_monitor
+    {
+    public:
+        virtual ~load_monitor() {}
+
+        /**
+         * The input is a matrix with nr rows and nc columns and about
+         * nnz nonzeros, and the loader reads the nonzeros passes times.
+         */
+        virtual void begin(Index nr, Index nc, boost::uint64_t nnz,
+            int passes) = 0;
+
+        /** The nonzeros (r[k],c[k]) for k < n from the first pass. */
+        virtual void nonzeros(const Index* r, const Index* c, std::size_t n) = 0;
+
+        /** Another n nonzeros of a later pass. */
+        virtual void advance(std::size_t n) = 0;
+    };
+
+    /**
+     * The monitor for the loaders with an Index type, or 0.
+     */
+    template <class Index>
+    load_monitor<Index>*& crm_load_monitor()
+    {
+        static load_monitor<Index>* m = 0;
+        return (m);
+    }
+
+    /**
+     * Collect the nonzeros of one pass (on one thread) for a monitor
+     * and hand them over in batches.  Without a monitor, this does
+     * nothing.
+     */
+    template <class Index>
+    class load_monitor_buffer
+    {
+    public:
+        const static std::size_t batch_size = 65536;
+
+        load_monitor_buffer(load_monitor<Index>* m, bool first_pass)
+        : _m(m), _first_pass(first_pass), _n(0)
+        {
+            if (_m && _first_pass) {
+                _r.resize(batch_size);
+                _c.resize(batch_size);
+            }
+        }
+
+        ~load_monitor_buffer() { flush(); }
+
+        void operator() (Index r, Index c)
+        {
+            if (!_m) { return; }
+            if (_first_pass) { _r[_n] = r; _c[_n] = c; }
+            if (++_n == batch_size) { flush(); }
+        }
+
+        void flush()
+        {
+            if (_n == 0) { return; }
+            if (_first_pass) { _m->nonzeros(&_r[0], &_c[0], _n); }
+            else { _m->advance(_n); }
+            _n = 0;
+        }
+
+    private:
+        load_monitor_buffer(const load_monitor_buffer&);
+        load_monitor_buffer& operator= (const load_monitor_buffer&);
+
+        load_monitor<Index>* _m;
+        bool _first_pass;
+        std::size_t _n;
+        std::vector<Index> _r;
+        std::vector<Index> _c;
+    };
+
+} // namespace yasmic
+
+#endif // YASMIC_UTIL_LOAD_MONITOR
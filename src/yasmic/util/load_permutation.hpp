@@ -0,0 +1,258 @@
+#ifndef YASMIC_UTIL_LOAD_PERMUTATION
+#define YASMIC_UTIL_LOAD_PERMUTATION
+
+/**
+ * @file load_permutation.hpp
+ * Load and check a permutation file with many threads.
+ *
+ * A permutation file holds the n entries of a permutation of 0..n-1,
+ * either as whitespace separated text, or as native binary int32 or
+ * int64 values.  Any of these may be gzipped.  The file is read with
+ * input_bytes, and then
+ * 1.  a binary file is converted with one block of entries per thread,
+ *     and a text file is split into chunks at whitespace, the tokens
+ *     of each chunk are counted, and each chunk is parsed straight
+ *     into its place;
+ * 2.  each thread marks the values of a block of entries in a shared
+ *     bitmap, and the bitmap is checked for a missing value, so a
+ *     file that is not a permutation is rejected.
+ *
+ * A file is binary if its size is 4n or 8n bytes and it has a zero
+ * byte near the start, which a text file never has.
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+
+#include <yasmic/verbose_util.hpp>
+#include <yasmic/util/text_scanner.hpp>
+#include <yasmic/util/input_bytes.hpp>
+
+#include <util/parallel.hpp>
+
+namespace yasmic
+{
+namespace impl
+{
+    /**
+     * Convert n binary values of type T into p.
+     * @return false if a value is not in [0,n)
+     */
+    template <class T, class Index>
+    bool permutation_from_binary(const char* data, Index n, Index* p)
+    {
+        bool ok = true;
+
+        #pragma omp parallel for schedule(static) reduction(&&:ok)
+        for (Index i = 0; i < n; ++i)
+        {
+            T v;
+            std::memcpy(&v, data + (std::size_t)i*sizeof(T), sizeof(T));
+            ok = ok && v >= 0 && v < (T)n;
+            p[i] = (Index)v;
+        }
+
+        return (ok);
+    }
+
+    /**
+     * Parse whitespace separated integers into p with one chunk of the
+     * text for each thread.
+     * @return false if there are not exactly n integers or a value is
+     *   not in [0,n)
+     */
+    template <class Index>
+    bool permutation_from_text(const char* begin, const char* end,
+        Index n, Index* p, const std::string& filename)
+    {
+        using namespace std;
+
+        std::size_t bytes = (std::size_t)(end - begin);
+        int nchunks = (int)std::min<std::size_t>(util::max_threads(),
+                        bytes/(1<<16) + 1);
+
+        // the chunks start at whitespace, so no token is split
+        vector<const char*> bounds(nchunks+1);
+        bounds[0] = begin;
+        bounds[nchunks] = end;
+        for (int i = 1; i < nchunks; ++i)
+        {
+            const char* b = begin + (std::size_t)(((double)bytes*i)/nchunks);
+            b = std::max(b, bounds[i-1]);
+            while (b != end && !scan_is_space(*b)) { ++b; }
+            bounds[i] = b;
+        }
+
+        vector<boost::int64_t> count(nchunks+1, 0);
+
+        #pragma omp parallel for schedule(static,1)
+        for (int i = 0; i < nchunks; ++i)
+        {
+            boost::int64_t c = 0;
+            bool space = true;
+            for (const char* q = bounds[i]; q != bounds[i+1]; ++q)
+            {
+                bool s = scan_is_space(*q);
+                if (space && !s) { ++c; }
+                space = s;
+            }
+            count[i+1] = c;
+        }
+
+        for (int i = 0; i < nchunks; ++i) { count[i+1] += count[i]; }
+        if (count[nchunks] != (boost::int64_t)n)
+        {
+            cerr << "error: " << filename << " contains " << count[nchunks]
+                 << " entries, not " << n << endl;
+            return (false);
+        }
+
+        bool ok = true;
+
+        #pragma omp parallel for schedule(static,1) reduction(&&:ok)
+        for (int i = 0; i < nchunks; ++i)
+        {
+            const char *q = bounds[i], *qend = bounds[i+1];
+            Index* out = p + count[i];
+            boost::int64_t v = 0;
+            while (ok && scan_skip_space(q, qend) != qend)
+            {
+                // each counted token has to be exactly one integer, or
+                // the values would not line up with the counts
+                ok = scan_int(q, qend, v) && (q == qend || scan_is_space(*q))
+                     && v >= 0 && v < (boost::int64_t)n;
+                if (!ok) { break; }
+                *out++ = (Index)v;
+            }
+        }
+
+        if (!ok)
+        {
+            cerr << "error: " << filename << " has an entry that is not an "
+                 << "integer in [0," << n << ")" << endl;
+        }
+        return (ok);
+    }
+} // namespace impl
+
+    /**
+     * Check that the n entries of p, which are all in [0,n), are a
+     * permutation.  Each thread marks the values of a block of p in a
+     * bitmap, and then the bitmap has to be full.
+     *
+     * @param missing set to the smallest value that is not in p
+     * @return true if p is a permutation
+     */
+    template <class Index>
+    bool is_permutation(const Index* p, Index n, Index& missing)
+    {
+        typedef unsigned int word;
+        const int bits = std::numeric_limits<word>::digits;
+
+        Index nwords = n/bits + 1;
+        std::vector<word> seen(nwords);
+
+        #pragma omp parallel for schedule(static)
+        for (Index i = 0; i < nwords; ++i) { seen[i] = 0; }
+
+        #pragma omp parallel for schedule(static)
+        for (Index i = 0; i < n; ++i)
+        {
+            word b = (word)1 << (p[i] % bits);
+            #pragma omp atomic
+            seen[p[i] / bits] |= b;
+        }
+
+        Index first = n;
+
+        #pragma omp parallel for schedule(static) reduction(min:first)
+        for (Index j = 0; j < n; ++j)
+        {
+            if (!(seen[j / bits] & ((word)1 << (j % bits)))) {
+                first = std::min(first, j);
+            }
+        }
+
+        missing = first;
+        return (first == n);
+    }
+
+    /**
+     * Set ip to the inverse of the permutation p, in parallel.
+     */
+    template <class Index>
+    void invert_permutation(const Index* p, Index n, Index* ip)
+    {
+        #pragma omp parallel for schedule(static)
+        for (Index i = 0; i < n; ++i) { ip[p[i]] = i; }
+    }
+
+    /**
+     * Load a permutation of 0..n-1 from a text, binary, or gzipped
+     * file.  The errors are written to cerr.
+     *
+     * @param p the permutation, only changed if the file is valid
+     * @return false if the file cannot be read or is not a permutation
+     */
+    template <class Index>
+    bool load_permutation(const std::string& filename, Index n,
+        std::vector<Index>& p)
+    {
+        using namespace std;
+
+        input_bytes in;
+        if (!in.open(filename))
+        {
+            return (false);
+        }
+
+        const char* begin = in.begin();
+        const char* end = in.end();
+
+        std::size_t bytes = (std::size_t)(end - begin);
+        bool binary = n > 0
+            && (bytes == (std::size_t)n*4 || bytes == (std::size_t)n*8)
+            && std::memchr(begin, 0, std::min<std::size_t>(bytes, 4096));
+
+        vector<Index> q(n);
+        Index* qp = q.empty() ? 0 : &q[0];
+        if (binary)
+        {
+            YASMIC_VERBOSE( cerr << "reading binary int"
+                                 << (bytes/n)*8 << " entries" << endl; )
+
+            bool ok = bytes == (std::size_t)n*4
+                ? impl::permutation_from_binary<boost::int32_t>(begin, n, qp)
+                : impl::permutation_from_binary<boost::int64_t>(begin, n, qp);
+            if (!ok)
+            {
+                cerr << "error: " << filename << " has an entry that is not "
+                     << "in [0," << n << ")" << endl;
+                return (false);
+            }
+        }
+        else if (!impl::permutation_from_text(begin, end, n, qp, filename))
+        {
+            return (false);
+        }
+
+        Index missing;
+        if (!is_permutation(qp, n, missing))
+        {
+            cerr << "error: " << filename << " is not a permutation, "
+                 << missing << " is missing" << endl;
+            return (false);
+        }
+
+        p.swap(q);
+        return (true);
+    }
+} // namespace yasmic
+
+#endif // YASMIC_UTIL_LOAD_PERMUTATION
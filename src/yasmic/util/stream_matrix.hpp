@@ -0,0 +1,294 @@
+#ifndef YASMIC_UTIL_STREAM_MATRIX
+#define YASMIC_UTIL_STREAM_MATRIX
+
+/**
+ * @file stream_matrix.hpp
+ * Read the nonzeros of a matrix file from the disk without loading the
+ * matrix into memory.
+ *
+ * stream_matrix_file picks a ChunkSource (see load_crm_parallel.hpp)
+ * for the format of the file and hands it to a visitor, which can
+ * parse its chunks as many times as it needs to.  Every format that
+ * load_crm_matrix reads can be streamed, except edge lists, which
+ * number their nodes in memory, and compressed Matrix Market files,
+ * which are inflated into memory.
+ */
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <yasmic/util/load_crm_matrix.hpp>
+
+namespace yasmic
+{
+namespace impl
+{
+    /**
+     * A ChunkSource with one chunk for the nonzeros of a yasmic matrix
+     * whose nonzeros can be read more than once.
+     */
+    template <class InputMatrix>
+    class matrix_chunk_source
+    {
+    public:
+        explicit matrix_chunk_source(InputMatrix& m) : _m(m) {}
+
+        int nchunks() const { return (1); }
+
+        template <class Sink>
+        bool parse_chunk(int, Sink& s)
+        {
+            typename smatrix_traits<InputMatrix>::nonzero_iterator nzi, nzend;
+            for (boost::tie(nzi, nzend) = nonzeros(_m); nzi != nzend; ++nzi) {
+                s(row(*nzi, _m), column(*nzi, _m), value(*nzi, _m));
+            }
+            return (true);
+        }
+
+    private:
+        InputMatrix& _m;
+    };
+
+#ifdef YASMIC_UTIL_LOAD_GZIP
+
+    /**
+     * A ChunkSource with one chunk for a gzip compressed smat file.  The
+     * file can only be read once, so it is opened again for every pass.
+     */
+    template <class Index, class Value, class NzIndex>
+    class gzip_smat_chunk_source
+    {
+    public:
+        typedef gzip_smat_matrix<Index, Value, NzIndex> matrix_type;
+
+        explicit gzip_smat_chunk_source(const std::string& filename)
+        : _filename(filename) {}
+
+        int nchunks() const { return (1); }
+
+        template <class Sink>
+        bool parse_chunk(int, Sink& s)
+        {
+            matrix_type m(_filename);
+            matrix_chunk_source<matrix_type> ms(m);
+            return (m.valid() && ms.parse_chunk(0, s) && !m.reader().error());
+        }
+
+    private:
+        std::string _filename;
+    };
+
+#endif // YASMIC_UTIL_LOAD_GZIP
+
+} // namespace impl
+} // namespace yasmic
+
+/**
+ * Read a matrix file with a ChunkSource for its format.  The format is
+ * picked from the extension as in load_crm_matrix.  The visitor is
+ * called once as
+ *
+ *   visit(src, nr, nc, nnz, nnz_exact)
+ *
+ * with a ChunkSource src whose chunks give the nonzeros in the order
+ * of the file each time they are parsed, the size of the matrix, and
+ * the number of nonzeros in the header.  nnz_exact is false if nnz is
+ * only an estimate, as for a symmetric Matrix Market file, whose
+ * nonzeros on the diagonal are not mirrored.  The visitor has to check
+ * the indices of the nonzeros.
+ *
+ * @param streamed set to false if the format cannot be streamed, in
+ *   which case nothing was read and the file has to be loaded with
+ *   load_crm_matrix
+ * @return the result of visit, or false if the file is invalid
+ */
+template <class Index, class NzIndex, class Value, class Visitor>
+bool stream_matrix_file(const std::string& filename, Visitor& visit,
+        bool& streamed)
+{
+    using namespace std;
+    using namespace yasmic::impl;
+
+    streamed = true;
+
+    string::size_type dot = filename.find_last_of(".");
+    if (dot == string::npos)
+    {
+        cerr << "Error: matrix type indeterminate." << endl;
+        return (false);
+    }
+    string ext = filename.substr(dot+1);
+    string basename = filename.substr(0, dot);
+    transform(ext.begin(), ext.end(), ext.begin(), lower_case);
+
+    bool gz = (ext.compare("gz") == 0);
+    if (gz)
+    {
+        string::size_type dot2 = basename.find_last_of(".");
+        ext = (dot2 == string::npos) ? string() : basename.substr(dot2+1);
+        transform(ext.begin(), ext.end(), ext.begin(), lower_case);
+    }
+
+    typedef boost::iostreams::filtering_stream<boost::iostreams::input_seekable>
+        filtered_ifstream;
+
+    // a bvgraph is basename.graph with basename.properties
+    if (!gz && (ext.compare("properties") == 0
+        || (ext.compare("graph") == 0 && util::file_exists(basename + ".properties"))))
+    {
+        yasmic::bvgraph_matrix g(basename.c_str());
+        if (!g.valid()) { return (false); }
+        bvgraph_chunk_source s(g, 1);
+        return (visit(s, (Index)g.num_nodes(), (Index)g.num_nodes(),
+                    (NzIndex)g.num_arcs(), true));
+    }
+
+    // if the first line of a .graph file has 3 entries, it is a smat
+    bool smat_graph = false;
+    if (ext.compare("graph") == 0)
+    {
+        ifstream ifs(filename.c_str(), ios_base::in | ios_base::binary);
+#ifdef YASMIC_UTIL_LOAD_GZIP
+        if (gz)
+        {
+            filtered_ifstream fs;
+            fs.push(boost::iostreams::gzip_decompressor());
+            fs.push(ifs);
+            smat_graph = load_crm_matrix_graph_test<Index>(fs);
+        }
+        else
+#endif // YASMIC_UTIL_LOAD_GZIP
+        {
+            smat_graph = load_crm_matrix_graph_test<Index>(ifs);
+        }
+    }
+
+    if (ext.compare("smat") == 0 || smat_graph)
+    {
+#ifdef YASMIC_UTIL_LOAD_GZIP
+        if (gz)
+        {
+            typedef gzip_smat_chunk_source<Index, Value, NzIndex> gzip_source;
+            Index nr, nc;
+            NzIndex nnz;
+            {
+                typename gzip_source::matrix_type header(filename);
+                if (!header.valid())
+                {
+                    cerr << "error: cannot read the header of " << filename << endl;
+                    return (false);
+                }
+                nr = header._nrows; nc = header._ncols; nnz = header._nnz;
+            }
+            gzip_source s(filename);
+            return (visit(s, nr, nc, nnz, true));
+        }
+#endif // YASMIC_UTIL_LOAD_GZIP
+
+        util::mapped_file mf;
+        if (mf.open(filename))
+        {
+            mf.advise_sequential();
+            yasmic::mapped_smat_matrix<Index, Value, NzIndex> m(mf.begin(), mf.end());
+            matrix_chunk_source< yasmic::mapped_smat_matrix<Index, Value, NzIndex> > s(m);
+            return (visit(s, nrows(m), ncols(m), nnz(m), true));
+        }
+
+        ifstream ifs(filename.c_str());
+        yasmic::ifstream_matrix<Index, Value, NzIndex> m(ifs);
+        matrix_chunk_source< yasmic::ifstream_matrix<Index, Value, NzIndex> > s(m);
+        return (visit(s, nrows(m), ncols(m), nnz(m), true));
+    }
+    else if (ext.compare("bsmat") == 0 || ext.compare("bssmat") == 0)
+    {
+        // the gzip filter seeks by inflating from the start again, so
+        // both kinds of stream can be read more than once
+        ifstream ifs(filename.c_str(), ios_base::in | ios::binary);
+        filtered_ifstream fs;
+#ifdef YASMIC_UTIL_LOAD_GZIP
+        if (gz)
+        {
+            fs.push(boost::iostreams::gzip_decompressor());
+            fs.push(ifs);
+        }
+#endif // YASMIC_UTIL_LOAD_GZIP
+        istream& is = gz ? (istream&)fs : (istream&)ifs;
+        if (ext.compare("bsmat") == 0)
+        {
+            yasmic::binary_ifstream_matrix<> m(is);
+            matrix_chunk_source< yasmic::binary_ifstream_matrix<> > s(m);
+            return (visit(s, (Index)nrows(m), (Index)ncols(m), (NzIndex)nnz(m), true));
+        }
+        else
+        {
+            yasmic::binary_ifstream_graph<> m(is);
+            matrix_chunk_source< yasmic::binary_ifstream_graph<> > s(m);
+            return (visit(s, (Index)nrows(m), (Index)ncols(m), (NzIndex)nnz(m), true));
+        }
+    }
+    else if (ext.compare("mtx") == 0)
+    {
+        util::mapped_file mf;
+        if (gz || !mf.open(filename))
+        {
+            streamed = false;
+            return (false);
+        }
+        mf.advise_sequential();
+
+        const char* p = mf.begin();
+        text_format fmt;
+        mtx_symmetry sym;
+        Index nr, nc;
+        NzIndex entries;
+        if (!read_mtx_header(p, mf.end(), fmt, sym, nr, nc, entries))
+        {
+            return (false);
+        }
+
+        text_chunk_source<Index, Value> s(fmt, p, mf.end(), 1, sym);
+        if (!visit(s, nr, nc, (sym == mtx_general) ? entries : 2*entries,
+                sym == mtx_general))
+        {
+            if (s.error_position())
+            {
+                cerr << "error: parse error at byte "
+                     << (s.error_position() - mf.begin()) << endl;
+            }
+            return (false);
+        }
+        if (s.entries() != (std::size_t)entries)
+        {
+            cerr << "error: number of entries do not match the size line" << endl;
+            return (false);
+        }
+        return (true);
+    }
+    else if (!gz && (ext.compare("mat") == 0 || ext.compare("cmat") == 0
+                     || ext.compare("cgraph") == 0))
+    {
+        ifstream ifs(filename.c_str());
+        yasmic::cluto_ifstream_matrix<Index, Value, NzIndex> m(ifs);
+        matrix_chunk_source< yasmic::cluto_ifstream_matrix<Index, Value, NzIndex> > s(m);
+        return (visit(s, nrows(m), ncols(m), nnz(m), true));
+    }
+    else if (!gz && ext.compare("graph") == 0)
+    {
+        ifstream ifs(filename.c_str());
+        yasmic::graph_ifstream_matrix<Index, Value, NzIndex> m(ifs);
+        matrix_chunk_source< yasmic::graph_ifstream_matrix<Index, Value, NzIndex> > s(m);
+        return (visit(s, nrows(m), ncols(m), nnz(m), true));
+    }
+    else if (yasmic::is_edge_list_file(filename))
+    {
+        streamed = false;
+        return (false);
+    }
+
+    cerr << "Error: matrix type unknown." << endl;
+    return (false);
+}
+
+#endif // YASMIC_UTIL_STREAM_MATRIX
@@ -0,0 +1,139 @@
+#ifndef YASMIC_UTIL_SYMMETRIZE_CRM
+#define YASMIC_UTIL_SYMMETRIZE_CRM
+
+/**
+ * @file symmetrize_crm.hpp
+ * Build the crm arrays of A+A' from the crm arrays of A with many
+ * threads.
+ *
+ * The nonzeros of A are split into ranges of rows with about the same
+ * number of nonzeros, and
+ * 1.  each thread counts the columns of its range into its own
+ *     histogram, which are the degrees of its part of A';
+ * 2.  the histograms are merged into the row pointers of A+A' and
+ *     per-thread offsets with a parallel prefix sum;
+ * 3.  each thread copies its rows of A and scatters its nonzeros of A'
+ *     into a single output that is sized once.
+ *
+ * Row i of the output is row i of A followed by the nonzeros of A' in
+ * row i, in the order of the rows of A, so the result is the same with
+ * any number of threads.  The duplicates, e.g. (i,j) when A has both
+ * (i,j) and (j,i) or the diagonal, are left in place; pack_storage
+ * merges them in place afterwards.
+ *
+ * The memory is the input, the output, and one histogram for each
+ * thread, instead of the copies of the input that the transpose and
+ * union matrices need.
+ */
+
+#include <vector>
+#include <algorithm>
+
+#include <yasmic/compressed_row_matrix.hpp>
+
+#include <util/parallel.hpp>
+
+/**
+ * Replace the crm arrays of A with those of A+A'.  A non-square A is
+ * extended with empty rows or columns, so the result is
+ * max(nr,nc) by max(nr,nc).
+ *
+ * All parameters are input/output.
+ *
+ * @param rows the crm rows vector
+ * @param cols the crm cols vector
+ * @param vals the crm vals vector
+ * @param nr the number of rows
+ * @param nc the number of columns
+ */
+template <class NzIndex, class Index, class Value>
+void symmetrize_crm_storage(std::vector<NzIndex>& rows, std::vector<Index>& cols,
+    std::vector<Value>& vals, Index& nr, Index& nc)
+{
+    using namespace std;
+
+    Index n = std::max(nr, nc);
+    NzIndex nz = rows[nr] - rows[0];
+
+    int nparts = yasmic::impl::crm_pack_threads(n, nz);
+
+    vector<Index> bounds(nparts+1);
+    for (int p = 0; p <= nparts; ++p) {
+        bounds[p] = yasmic::impl::crm_balanced_row(rows.begin(), nr, nparts, p);
+    }
+
+    //
+    // 1.  count the nonzeros of A' in each row for each range
+    //
+    vector< vector<Index> > hist(nparts);
+
+    #pragma omp parallel for num_threads(nparts) schedule(static,1)
+    for (int p = 0; p < nparts; ++p)
+    {
+        // allocate the histogram on the thread that uses it
+        hist[p].assign(n, 0);
+        Index* h = &hist[p][0];
+        for (NzIndex k = rows[bounds[p]]; k < rows[bounds[p+1]]; ++k) {
+            ++h[cols[k]];
+        }
+    }
+
+    //
+    // 2.  merge the histograms, afterwards hist[p][i] is the offset of
+    //     range p's nonzeros in the A' part of row i
+    //
+    vector<NzIndex> srows(n+1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (Index i = 0; i < n; ++i)
+    {
+        Index s = 0;
+        for (int p = 0; p < nparts; ++p)
+        {
+            Index d = hist[p][i];
+            hist[p][i] = s;
+            s += d;
+        }
+        srows[i+1] = (NzIndex)s + (i < nr ? rows[i+1] - rows[i] : 0);
+    }
+
+    util::parallel_partial_sum(srows.begin()+1, n);
+
+    //
+    // 3.  copy the rows of A and scatter the nonzeros of A'
+    //
+    vector<Index> scols(2*nz);
+    vector<Value> svals(2*nz);
+
+    #pragma omp parallel for num_threads(nparts) schedule(static,1)
+    for (int p = 0; p < nparts; ++p)
+    {
+        Index* h = &hist[p][0];
+        for (Index r = bounds[p]; r < bounds[p+1]; ++r)
+        {
+            NzIndex k = rows[r], kend = rows[r+1];
+            std::copy(cols.begin() + k, cols.begin() + kend, scols.begin() + srows[r]);
+            std::copy(vals.begin() + k, vals.begin() + kend, svals.begin() + srows[r]);
+
+            for (; k < kend; ++k)
+            {
+                Index j = cols[k];
+                NzIndex pos = srows[j] + h[j]++;
+                if (j < nr) { pos += rows[j+1] - rows[j]; }
+                scols[pos] = r;
+                svals[pos] = vals[k];
+            }
+        }
+
+        // release the histogram as soon as we are done
+        vector<Index>().swap(hist[p]);
+    }
+
+    rows.swap(srows);
+    cols.swap(scols);
+    vals.swap(svals);
+    nr = n;
+    nc = n;
+}
+
+#endif // YASMIC_UTIL_SYMMETRIZE_CRM
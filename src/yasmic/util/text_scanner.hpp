@@ -0,0 +1,228 @@
+#ifndef YASMIC_UTIL_TEXT_SCANNER
+#define YASMIC_UTIL_TEXT_SCANNER
+
+/**
+ * @file text_scanner.hpp
+ * Hand written scanners to read whitespace separated numbers
+ * directly from a block of memory, e.g. a memory mapped file.
+ *
+ * These functions replace the istream extraction operators for the
+ * loaders that read large text files.  They do not use the locale
+ * and never make a virtual call, so they are an order of magnitude
+ * faster than operator>>.
+ *
+ * Every scanner takes a pointer p into the range [p,end), skips any
+ * leading whitespace, and advances p past the token on success.  On
+ * failure, p is left unchanged.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace yasmic
+{
+namespace impl
+{
+    inline bool scan_is_space(char c)
+    {
+        return (c == ' ' || c == '\t' || c == '\n' || c == '\r'
+                || c == '\v' || c == '\f');
+    }
+
+    inline bool scan_is_digit(char c)
+    {
+        return ((unsigned)(c - '0') < 10u);
+    }
+
+    /**
+     * Skip whitespace.
+     *
+     * @return a pointer to the first non-whitespace character or end.
+     */
+    inline const char* scan_skip_space(const char* p, const char* end)
+    {
+        while (p != end && scan_is_space(*p)) { ++p; }
+        return (p);
+    }
+
+    /**
+     * Skip whitespace on the current line, but stop at a newline.
+     */
+    inline const char* scan_skip_blank(const char* p, const char* end)
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) { ++p; }
+        return (p);
+    }
+
+    /**
+     * Move to the first character after the next newline.
+     */
+    inline const char* scan_next_line(const char* p, const char* end)
+    {
+        const char* nl = (const char*)std::memchr(p, '\n', end - p);
+        if (nl) { return (nl+1); }
+        return (end);
+    }
+
+    /**
+     * Read a signed decimal integer.
+     */
+    template <class Int>
+    inline bool scan_int(const char*& p, const char* end, Int& v)
+    {
+        const char* q = scan_skip_space(p, end);
+        bool neg = false;
+        if (q != end && (*q == '-' || *q == '+')) { neg = (*q == '-'); ++q; }
+        if (q == end || !scan_is_digit(*q)) { return (false); }
+
+        Int r = 0;
+        while (q != end && scan_is_digit(*q)) {
+            r = r*10 + (Int)(*q - '0');
+            ++q;
+        }
+
+        v = neg ? -r : r;
+        p = q;
+        return (true);
+    }
+
+    /**
+     * Read a floating point value by copying the token and calling strtod.
+     * This function is the fallback for values the fast path can't
+     * convert exactly (long mantissas, huge exponents, inf, nan).
+     */
+    inline bool scan_double_slow(const char*& p, const char* end, double& v)
+    {
+        const char* q = scan_skip_space(p, end);
+        const char* tend = q;
+        while (tend != end && !scan_is_space(*tend)) { ++tend; }
+        if (tend == q) { return (false); }
+
+        char buf[128];
+        std::string longbuf;
+        const char* token = buf;
+        std::size_t len = tend - q;
+        if (len < sizeof(buf)) {
+            std::memcpy(buf, q, len);
+            buf[len] = '\0';
+        } else {
+            longbuf.assign(q, tend);
+            token = longbuf.c_str();
+        }
+
+        char* tokend;
+        double r = std::strtod(token, &tokend);
+        if (tokend == token) { return (false); }
+
+        v = r;
+        p = q + (tokend - token);
+        return (true);
+    }
+
+    /**
+     * Read a floating point value.
+     *
+     * The fast path handles up to 19 significant digits and decimal
+     * exponents where the mantissa and the power of ten are both
+     * exactly representable, which is where the result of a single
+     * multiply or divide is correctly rounded.  All other values are
+     * handed to strtod.
+     */
+    inline bool scan_double(const char*& p, const char* end, double& v)
+    {
+        static const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+            1e21, 1e22 };
+        const unsigned long long max_exact = 1ull << 53;
+
+        const char* q = scan_skip_space(p, end);
+        bool neg = false;
+        if (q != end && (*q == '-' || *q == '+')) { neg = (*q == '-'); ++q; }
+
+        unsigned long long mant = 0;
+        int digits = 0;
+        int exp10 = 0;
+        bool any = false;
+        bool exact = true;
+
+        while (q != end && scan_is_digit(*q)) {
+            any = true;
+            if (digits < 19) {
+                mant = mant*10 + (unsigned)(*q - '0');
+                if (mant) { ++digits; }
+            } else {
+                ++exp10;
+                if (*q != '0') { exact = false; }
+            }
+            ++q;
+        }
+
+        if (q != end && *q == '.') {
+            ++q;
+            while (q != end && scan_is_digit(*q)) {
+                any = true;
+                if (digits < 19) {
+                    mant = mant*10 + (unsigned)(*q - '0');
+                    if (mant) { ++digits; }
+                    --exp10;
+                } else if (*q != '0') {
+                    exact = false;
+                }
+                ++q;
+            }
+        }
+
+        if (!any) { return (scan_double_slow(p, end, v)); }
+
+        if (q != end && (*q == 'e' || *q == 'E')) {
+            const char* e = q+1;
+            bool eneg = false;
+            if (e != end && (*e == '-' || *e == '+')) { eneg = (*e == '-'); ++e; }
+            if (e != end && scan_is_digit(*e)) {
+                int ev = 0;
+                while (e != end && scan_is_digit(*e)) {
+                    if (ev < 100000) { ev = ev*10 + (*e - '0'); }
+                    ++e;
+                }
+                exp10 += eneg ? -ev : ev;
+                q = e;
+            }
+        }
+
+        if (!exact || mant > max_exact || exp10 < -22 || exp10 > 22) {
+            return (scan_double_slow(p, end, v));
+        }
+
+        double r = (double)mant;
+        if (exp10 < 0) { r /= pow10[-exp10]; }
+        else { r *= pow10[exp10]; }
+
+        v = neg ? -r : r;
+        p = q;
+        return (true);
+    }
+
+    /**
+     * Overloads to scan any value type.
+     */
+    inline bool scan_value(const char*& p, const char* end, double& v)
+    { return scan_double(p, end, v); }
+
+    inline bool scan_value(const char*& p, const char* end, float& v)
+    {
+        double d;
+        if (!scan_double(p, end, d)) { return (false); }
+        v = (float)d;
+        return (true);
+    }
+
+    template <class Int>
+    inline bool scan_value(const char*& p, const char* end, Int& v)
+    { return scan_int(p, end, v); }
+
+} // namespace impl
+} // namespace yasmic
+
+#endif // YASMIC_UTIL_TEXT_SCANNER
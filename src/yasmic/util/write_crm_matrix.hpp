@@ -0,0 +1,683 @@
+#ifndef YASMIC_UTIL_WRITE_CRM_MATRIX
+#define YASMIC_UTIL_WRITE_CRM_MATRIX
+
+/**
+ * @file write_crm_matrix.hpp
+ * Write a matrix in crm arrays to a file with many threads.
+ *
+ * The writers in write_matrix.hpp format one nonzero at a time through
+ * an ostream.  These writers take the crm arrays directly and format
+ * the rows in blocks with about the same number of nonzeros: each
+ * thread formats one block into its own buffer, and the buffers are
+ * written in order, so the output is the same with any number of
+ * threads and at most one round of blocks is in memory.
+ * write_coord_matrix does the same for nonzeros streamed from a file
+ * in the coordinate formats, which do not need the rows together.
+ *
+ * The formats are the ones the loaders read, plus two dumps:
+ *   smat    "nrows ncols nnz" then "i j v" for each nonzero, 0 indexed
+ *   mtx     a Matrix Market coordinate file, 1 indexed
+ *   cluto   "nrows ncols nnz" then "j v j v ..." on each row, 1 indexed
+ *   bsmat   int32 "nrows ncols nnz" then int32 i, int32 j, double v
+ *   bssmat  int32 "nrows ncols nnz" then int32 i, int32 j
+ *   petsc   a big endian PETSc binary matrix
+ *   bcsr    int64 "nrows ncols nnz", then the int64 row pointers, the
+ *           int32 column indices, and the double values, as they are
+ *           in memory
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+
+#include <boost/cstdint.hpp>
+
+#include <util/parallel.hpp>
+
+namespace yasmic
+{
+    enum crm_output_format
+    {
+        smat_output_format,
+        mtx_output_format,
+        cluto_output_format,
+        bsmat_output_format,
+        bssmat_output_format,
+        petsc_output_format,
+        bcsr_output_format
+    };
+
+namespace impl
+{
+    /** Write the decimal digits of v at p and return the end. */
+    template <class Int>
+    inline char* format_int(char* p, Int v)
+    {
+        char buf[24];
+        int n = 0;
+        bool neg = v < 0;
+        boost::uint64_t x = neg ? (boost::uint64_t)0 - (boost::uint64_t)v
+                                : (boost::uint64_t)v;
+        do { buf[n++] = (char)('0' + x%10); x /= 10; } while (x != 0);
+        if (neg) { *p++ = '-'; }
+        while (n > 0) { *p++ = buf[--n]; }
+        return (p);
+    }
+
+    /**
+     * Write the shortest of %.15g and %.17g that reads back as v at p
+     * and return the end.
+     */
+    inline char* format_double(char* p, double v)
+    {
+        int n = std::sprintf(p, "%.15g", v);
+        if (std::strtod(p, 0) != v) { n = std::sprintf(p, "%.17g", v); }
+        return (p + n);
+    }
+
+    /** The most bytes format_int and format_double write. */
+    const std::size_t max_int_chars = 21;
+    const std::size_t max_double_chars = 25;
+
+    template <class T>
+    inline char* put_binary(char* p, T v, bool swap)
+    {
+        std::memcpy(p, &v, sizeof(T));
+        if (swap) { std::reverse(p, p + sizeof(T)); }
+        return (p + sizeof(T));
+    }
+
+    inline bool host_is_little_endian()
+    {
+        boost::uint32_t x = 1;
+        return (*(unsigned char*)&x == 1);
+    }
+
+    /**
+     * Format the rows of a crm matrix.  Each format has
+     *   std::size_t max_bytes(Index r1, Index r2);
+     *   char* format(Index r1, Index r2, char* p);
+     * for the rows [r1,r2).
+     */
+    template <class Index, class NzIndex, class Value>
+    struct crm_row_format
+    {
+        crm_row_format(crm_output_format fmt, const NzIndex* rows,
+            const Index* cols, const Value* vals)
+        : fmt(fmt), rows(rows), cols(cols), vals(vals) {}
+
+        std::size_t max_bytes(Index r1, Index r2) const
+        {
+            std::size_t nz = (std::size_t)(rows[r2] - rows[r1]);
+            std::size_t nr = (std::size_t)(r2 - r1);
+            switch (fmt) {
+                case bsmat_output_format: return (nz*(8 + sizeof(double)));
+                case bssmat_output_format: return (nz*8);
+                case cluto_output_format:
+                    return (nz*(max_int_chars + max_double_chars + 2) + nr);
+                default:
+                    return (nz*(2*max_int_chars + max_double_chars + 3));
+            }
+        }
+
+        char* format(Index r1, Index r2, char* p) const
+        {
+            switch (fmt) {
+                case smat_output_format: return (format_coord<0,true>(r1, r2, p));
+                case mtx_output_format:
+                    return (vals ? format_coord<1,true>(r1, r2, p)
+                                 : format_coord<1,false>(r1, r2, p));
+                case cluto_output_format: return (format_cluto(r1, r2, p));
+                case bsmat_output_format: return (format_binary<true>(r1, r2, p));
+                case bssmat_output_format: return (format_binary<false>(r1, r2, p));
+                default: return (p);
+            }
+        }
+
+        double value(NzIndex k) const { return (vals ? (double)vals[k] : 1.0); }
+
+        template <int base, bool values>
+        char* format_coord(Index r1, Index r2, char* p) const
+        {
+            for (Index r = r1; r < r2; ++r) {
+                for (NzIndex k = rows[r]; k < rows[r+1]; ++k) {
+                    p = format_int(p, r + base);
+                    *p++ = ' ';
+                    p = format_int(p, cols[k] + base);
+                    if (values) {
+                        *p++ = ' ';
+                        p = format_double(p, value(k));
+                    }
+                    *p++ = '\n';
+                }
+            }
+            return (p);
+        }
+
+        char* format_cluto(Index r1, Index r2, char* p) const
+        {
+            for (Index r = r1; r < r2; ++r) {
+                for (NzIndex k = rows[r]; k < rows[r+1]; ++k) {
+                    if (k != rows[r]) { *p++ = ' '; }
+                    p = format_int(p, cols[k] + 1);
+                    *p++ = ' ';
+                    p = format_double(p, value(k));
+                }
+                *p++ = '\n';
+            }
+            return (p);
+        }
+
+        template <bool values>
+        char* format_binary(Index r1, Index r2, char* p) const
+        {
+            for (Index r = r1; r < r2; ++r) {
+                for (NzIndex k = rows[r]; k < rows[r+1]; ++k) {
+                    p = put_binary(p, (boost::int32_t)r, false);
+                    p = put_binary(p, (boost::int32_t)cols[k], false);
+                    if (values) { p = put_binary(p, value(k), false); }
+                }
+            }
+            return (p);
+        }
+
+        crm_output_format fmt;
+        const NzIndex* rows;
+        const Index* cols;
+        const Value* vals;
+    };
+
+    /**
+     * Write the rows of a crm matrix with a row format, one round of
+     * blocks at a time.
+     */
+    template <class Format, class Index, class NzIndex>
+    bool write_crm_rows(std::ostream& f, const Format& fmt, Index nr,
+        const NzIndex* rows)
+    {
+        const NzIndex block_nz = 1<<18;
+
+        int nthreads = util::max_threads();
+        std::vector< std::vector<char> > buf(nthreads);
+        std::vector<Index> b(nthreads+1);
+
+        for (Index r = 0; r < nr && f; r = b[nthreads])
+        {
+            // the blocks of this round, at least one row each
+            b[0] = r;
+            for (int t = 0; t < nthreads; ++t)
+            {
+                Index next = (Index)(std::lower_bound(rows + b[t], rows + nr,
+                                rows[b[t]] + block_nz) - rows);
+                next = std::max(next, (Index)(b[t] + 1));
+                next = std::min(next, (Index)(b[t] + block_nz));
+                b[t+1] = std::min(next, nr);
+            }
+
+            #pragma omp parallel for num_threads(nthreads) schedule(static,1)
+            for (int t = 0; t < nthreads; ++t)
+            {
+                buf[t].resize(fmt.max_bytes(b[t], b[t+1]) + 1);
+                char* end = fmt.format(b[t], b[t+1], &buf[t][0]);
+                buf[t].resize(end - &buf[t][0]);
+            }
+
+            for (int t = 0; t < nthreads; ++t)
+            {
+                if (!buf[t].empty()) { f.write(&buf[t][0], (std::streamsize)buf[t].size()); }
+            }
+        }
+
+        return (!f.fail());
+    }
+
+    /**
+     * Write n values of type T, converted from get(i), in blocks, with
+     * the bytes of each value reversed if swap is true.
+     */
+    template <class T, class Get>
+    bool write_binary_array(std::ostream& f, std::size_t n, const Get& get,
+        bool swap)
+    {
+        const std::size_t block = 1<<20;
+        std::vector<char> buf;
+
+        for (std::size_t i = 0; i < n && f; i += block)
+        {
+            std::size_t m = std::min(block, n - i);
+            buf.resize(m*sizeof(T));
+            char* p = &buf[0];
+
+            #pragma omp parallel for schedule(static)
+            for (std::ptrdiff_t j = 0; j < (std::ptrdiff_t)m; ++j) {
+                put_binary(p + j*sizeof(T), (T)get(i + j), swap);
+            }
+
+            f.write(p, (std::streamsize)buf.size());
+        }
+
+        return (!f.fail());
+    }
+
+    template <class NzIndex>
+    struct row_length
+    {
+        row_length(const NzIndex* rows) : rows(rows) {}
+        boost::int32_t operator() (std::size_t i) const
+        { return ((boost::int32_t)(rows[i+1] - rows[i])); }
+        const NzIndex* rows;
+    };
+
+    template <class T>
+    struct array_value
+    {
+        array_value(const T* a) : a(a) {}
+        T operator() (std::size_t i) const { return (a[i]); }
+        const T* a;
+    };
+
+    /** The values of a crm matrix, or 1 for every nonzero without values. */
+    template <class Value>
+    struct crm_value
+    {
+        crm_value(const Value* vals) : vals(vals) {}
+        double operator() (std::size_t i) const
+        { return (vals ? (double)vals[i] : 1.0); }
+        const Value* vals;
+    };
+
+    template <class T>
+    inline bool write_header(std::ostream& f, const T* h, int n, bool swap)
+    {
+        for (int i = 0; i < n; ++i) {
+            char b[sizeof(T)];
+            put_binary(b, h[i], swap);
+            f.write(b, sizeof(T));
+        }
+        return (!f.fail());
+    }
+
+    /** @return true if the sizes fit the 32-bit integers of the format */
+    template <class Index, class NzIndex>
+    inline bool output_format_fits(crm_output_format fmt, Index nr, Index nc,
+        NzIndex nz)
+    {
+        const boost::int64_t imax = std::numeric_limits<boost::int32_t>::max();
+        if (fmt == bcsr_output_format || fmt == smat_output_format
+            || fmt == mtx_output_format || fmt == cluto_output_format)
+        {
+            return (true);
+        }
+        return ((boost::int64_t)nr <= imax && (boost::int64_t)nc <= imax
+            && (boost::int64_t)nz <= imax);
+    }
+
+    /**
+     * Write the header of a format, everything before the nonzeros.
+     * @param values false to write a pattern Matrix Market file
+     */
+    template <class Index, class NzIndex>
+    inline bool write_matrix_header(std::ostream& f, crm_output_format fmt,
+        Index nr, Index nc, NzIndex nz, bool values)
+    {
+        switch (fmt)
+        {
+            case smat_output_format:
+            case cluto_output_format:
+                f << nr << " " << nc << " " << nz << "\n";
+                break;
+
+            case mtx_output_format:
+                f << "%%MatrixMarket matrix coordinate "
+                  << (values ? "real" : "pattern") << " general\n";
+                f << nr << " " << nc << " " << nz << "\n";
+                break;
+
+            case bsmat_output_format:
+            case bssmat_output_format:
+            {
+                boost::int32_t h[3] = { (boost::int32_t)nr, (boost::int32_t)nc,
+                                        (boost::int32_t)nz };
+                return (write_header(f, h, 3, false));
+            }
+
+            case petsc_output_format:
+            {
+                boost::int32_t h[4] = { 1211216, (boost::int32_t)nr,
+                                        (boost::int32_t)nc, (boost::int32_t)nz };
+                return (write_header(f, h, 4, host_is_little_endian()));
+            }
+
+            case bcsr_output_format:
+            {
+                boost::int64_t h[3] = { nr, nc, nz };
+                return (write_header(f, h, 3, false));
+            }
+        }
+        return (!f.fail());
+    }
+
+    /** @return true if a format is one nonzero after another in any order */
+    inline bool is_coordinate_format(crm_output_format fmt)
+    {
+        return (fmt == smat_output_format || fmt == mtx_output_format
+            || fmt == bsmat_output_format || fmt == bssmat_output_format);
+    }
+
+    /**
+     * Format nonzeros that arrive one at a time in a coordinate format.
+     * The nonzeros are buffered, and a full buffer is formatted in
+     * blocks with many threads and written in order as in
+     * write_crm_rows, so the file has the nonzeros in the order they
+     * arrive.  Nonzeros outside the matrix are counted but not written.
+     */
+    template <class Index>
+    class coord_stream_writer
+    {
+    public:
+        coord_stream_writer(std::ostream& f, crm_output_format fmt,
+            Index nr, Index nc)
+        : _f(f), _fmt(fmt), _nr(nr), _nc(nc), _nthreads(util::max_threads()),
+          _buf(_nthreads), _count(0), _outside(0)
+        {
+            _rows.reserve(_nthreads*block_nz);
+            _cols.reserve(_nthreads*block_nz);
+            _vals.reserve(_nthreads*block_nz);
+        }
+
+        template <class I, class V>
+        void operator() (I r, I c, V v)
+        {
+            ++_count;
+            if (r < 0 || (boost::int64_t)r >= (boost::int64_t)_nr
+                || c < 0 || (boost::int64_t)c >= (boost::int64_t)_nc)
+            {
+                ++_outside;
+                return;
+            }
+            _rows.push_back((Index)r);
+            _cols.push_back((Index)c);
+            _vals.push_back((double)v);
+            if (_rows.size() == (std::size_t)_nthreads*block_nz) { flush(); }
+        }
+
+        /** Write the buffered nonzeros. */
+        bool flush()
+        {
+            std::size_t n = _rows.size();
+            std::size_t b = (n + _nthreads - 1)/_nthreads;
+
+            #pragma omp parallel for num_threads(_nthreads) schedule(static,1)
+            for (int t = 0; t < _nthreads; ++t)
+            {
+                std::size_t k1 = std::min(n, t*b), k2 = std::min(n, k1 + b);
+                _buf[t].resize(max_bytes(k2 - k1) + 1);
+                char* end = format(k1, k2, &_buf[t][0]);
+                _buf[t].resize(end - &_buf[t][0]);
+            }
+
+            for (int t = 0; t < _nthreads; ++t)
+            {
+                if (!_buf[t].empty()) { _f.write(&_buf[t][0], (std::streamsize)_buf[t].size()); }
+            }
+
+            _rows.clear();
+            _cols.clear();
+            _vals.clear();
+            return (!_f.fail());
+        }
+
+        /** The nonzeros so far, including the ones outside the matrix. */
+        boost::int64_t count() const { return (_count); }
+        boost::int64_t outside() const { return (_outside); }
+
+    private:
+        static const std::size_t block_nz = 1<<18;
+
+        std::size_t max_bytes(std::size_t nz) const
+        {
+            switch (_fmt) {
+                case bsmat_output_format: return (nz*(8 + sizeof(double)));
+                case bssmat_output_format: return (nz*8);
+                default: return (nz*(2*max_int_chars + max_double_chars + 3));
+            }
+        }
+
+        char* format(std::size_t k1, std::size_t k2, char* p) const
+        {
+            for (std::size_t k = k1; k < k2; ++k)
+            {
+                switch (_fmt) {
+                    case bsmat_output_format:
+                    case bssmat_output_format:
+                        p = put_binary(p, (boost::int32_t)_rows[k], false);
+                        p = put_binary(p, (boost::int32_t)_cols[k], false);
+                        if (_fmt == bsmat_output_format) {
+                            p = put_binary(p, _vals[k], false);
+                        }
+                        break;
+                    default:
+                    {
+                        int base = (_fmt == mtx_output_format) ? 1 : 0;
+                        p = format_int(p, _rows[k] + base);
+                        *p++ = ' ';
+                        p = format_int(p, _cols[k] + base);
+                        *p++ = ' ';
+                        p = format_double(p, _vals[k]);
+                        *p++ = '\n';
+                    }
+                }
+            }
+            return (p);
+        }
+
+        std::ostream& _f;
+        crm_output_format _fmt;
+        Index _nr, _nc;
+        int _nthreads;
+        std::vector<Index> _rows;
+        std::vector<Index> _cols;
+        std::vector<double> _vals;
+        std::vector< std::vector<char> > _buf;
+        boost::int64_t _count;
+        boost::int64_t _outside;
+    };
+
+    /** Count the nonzeros from a ChunkSource. */
+    struct count_sink
+    {
+        count_sink() : n(0) {}
+        template <class I, class V>
+        void operator() (I, I, V) { ++n; }
+        boost::int64_t n;
+    };
+
+    /** Parse every chunk of a ChunkSource in order into a sink. */
+    template <class ChunkSource, class Sink>
+    bool parse_chunks(ChunkSource& src, Sink& s)
+    {
+        for (int i = 0; i < src.nchunks(); ++i)
+        {
+            if (!src.parse_chunk(i, s))
+            {
+                std::cerr << "error: invalid matrix data, cannot parse chunk "
+                          << i << std::endl;
+                return (false);
+            }
+        }
+        return (true);
+    }
+} // namespace impl
+
+    /**
+     * Pick the output format from the extension of a file name.
+     * @return false if the extension is not an output format
+     */
+    inline bool crm_output_format_from_filename(const std::string& filename,
+        crm_output_format& fmt)
+    {
+        std::string::size_type dot = filename.find_last_of(".");
+        if (dot == std::string::npos) { return (false); }
+
+        std::string ext = filename.substr(dot+1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), (int(*)(int))tolower);
+
+        if (ext == "smat") { fmt = smat_output_format; }
+        else if (ext == "mtx") { fmt = mtx_output_format; }
+        else if (ext == "mat" || ext == "cmat") { fmt = cluto_output_format; }
+        else if (ext == "bsmat") { fmt = bsmat_output_format; }
+        else if (ext == "bssmat") { fmt = bssmat_output_format; }
+        else if (ext == "petsc") { fmt = petsc_output_format; }
+        else if (ext == "bcsr") { fmt = bcsr_output_format; }
+        else { return (false); }
+        return (true);
+    }
+} // namespace yasmic
+
+/**
+ * Write a matrix in crm arrays to a file.  The errors are written to
+ * cerr.
+ *
+ * @param vals the values, or 0 to write 1 for each value
+ * @return false if the file cannot be written, or if the matrix is too
+ * large for the 32-bit indices of the format
+ */
+template <class Index, class NzIndex, class Value>
+bool write_crm_matrix(const std::string& filename, yasmic::crm_output_format fmt,
+        Index nr, Index nc, NzIndex nz,
+        const NzIndex* rows, const Index* cols, const Value* vals)
+{
+    using namespace yasmic;
+    using namespace yasmic::impl;
+    using namespace std;
+
+    if (!output_format_fits(fmt, nr, nc, nz))
+    {
+        cerr << "error: the matrix is too large for " << filename << endl;
+        return (false);
+    }
+
+    ofstream f(filename.c_str(), ios::binary);
+    if (!f)
+    {
+        cerr << "error: cannot open " << filename << endl;
+        return (false);
+    }
+
+    bool swap = host_is_little_endian();
+
+    write_matrix_header(f, fmt, nr, nc, nz, vals != 0);
+
+    if (fmt == petsc_output_format)
+    {
+        write_binary_array<boost::int32_t>(f, nr, row_length<NzIndex>(rows), swap);
+        write_binary_array<boost::int32_t>(f, nz, array_value<Index>(cols), swap);
+        write_binary_array<double>(f, nz, crm_value<Value>(vals), swap);
+    }
+    else if (fmt == bcsr_output_format)
+    {
+        write_binary_array<boost::int64_t>(f, (std::size_t)nr + 1,
+            array_value<NzIndex>(rows), false);
+        write_binary_array<boost::int32_t>(f, nz, array_value<Index>(cols), false);
+        write_binary_array<double>(f, nz, crm_value<Value>(vals), false);
+    }
+
+    if (fmt != petsc_output_format && fmt != bcsr_output_format)
+    {
+        write_crm_rows(f, crm_row_format<Index, NzIndex, Value>(fmt, rows, cols, vals),
+            nr, rows);
+    }
+
+    f.close();
+    if (f.fail())
+    {
+        cerr << "error: cannot write " << filename << endl;
+        return (false);
+    }
+    return (true);
+}
+
+/**
+ * Write the nonzeros from a ChunkSource (see load_crm_parallel.hpp) to
+ * a file in a coordinate format: smat, mtx, bsmat, or bssmat.  The
+ * nonzeros are written in the order of the chunks without a copy of
+ * the matrix in memory, so repeated entries stay repeated.  The errors
+ * are written to cerr and the file is removed.
+ *
+ * @param nz the number of nonzeros the chunks give
+ * @param nz_exact false if nz is only an estimate, in which case the
+ *   chunks are parsed once to count the nonzeros before the header
+ * @return false if the chunks cannot be parsed, do not give nz
+ *   nonzeros inside the matrix, or the file cannot be written
+ */
+template <class Index, class NzIndex, class ChunkSource>
+bool write_coord_matrix(const std::string& filename,
+        yasmic::crm_output_format fmt, ChunkSource& src,
+        Index nr, Index nc, NzIndex nz, bool nz_exact)
+{
+    using namespace yasmic;
+    using namespace yasmic::impl;
+    using namespace std;
+
+    if (!is_coordinate_format(fmt))
+    {
+        cerr << "error: " << filename << " is not a coordinate format" << endl;
+        return (false);
+    }
+
+    if (!nz_exact)
+    {
+        count_sink c;
+        if (!parse_chunks(src, c)) { return (false); }
+        nz = (NzIndex)c.n;
+    }
+
+    if (!output_format_fits(fmt, nr, nc, nz))
+    {
+        cerr << "error: the matrix is too large for " << filename << endl;
+        return (false);
+    }
+
+    ofstream f(filename.c_str(), ios::binary);
+    if (!f)
+    {
+        cerr << "error: cannot open " << filename << endl;
+        return (false);
+    }
+
+    write_matrix_header(f, fmt, nr, nc, nz, true);
+
+    coord_stream_writer<Index> w(f, fmt, nr, nc);
+    bool rval = parse_chunks(src, w);
+    w.flush();
+    f.close();
+
+    if (rval && w.outside() > 0)
+    {
+        cerr << "error: " << w.outside() << " nonzeros are outside the "
+             << nr << " x " << nc << " matrix" << endl;
+        rval = false;
+    }
+    else if (rval && w.count() != (boost::int64_t)nz)
+    {
+        cerr << "error: read " << w.count() << " nonzeros, but the header "
+             << "has " << nz << endl;
+        rval = false;
+    }
+    else if (f.fail())
+    {
+        cerr << "error: cannot write " << filename << endl;
+        rval = false;
+    }
+
+    if (!rval) { std::remove(filename.c_str()); }
+    return (rval);
+}
+
+#endif // YASMIC_UTIL_WRITE_CRM_MATRIX
@@ -14,6 +14,10 @@
 // this file is somewhat strange.  There are two sections; the first section 
 // simple makes a few define statements
 //
+// the first section has its own guard so that the variable is only
+// defined once even if a source file includes this file many times
+#ifndef YASMIC_VERBOSE_UTIL_VARIABLE
+#define YASMIC_VERBOSE_UTIL_VARIABLE
 #ifdef YASMIC_VERBOSE_UTIL_DEFINE
 namespace yasmic
 {
@@ -25,6 +29,7 @@ namespace yasmic
     extern int yasmic_verbose;
 }
 #endif // YASMIC_VERBOSE_UTIL_DEFINE
+#endif // YASMIC_VERBOSE_UTIL_VARIABLE
 
 #ifndef YASMIC_VERBOSE_UTIL
 #define YASMIC_VERBOSE_UTIL